@@ -62,6 +62,9 @@ static constexpr auto server_connection_callback =
 
 
             // moqtServer->cleanup_connection(connection);
+
+            // subscriptions parked on the connection (e.g. open ended ones) would never run again
+            moqtServer->shutdown_connection(connection);
             break;
         }
         case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
@@ -78,6 +81,53 @@ static constexpr auto server_connection_callback =
     return QUIC_STATUS_SUCCESS;
 };
 
+/*
+    Hands the buffers of a QUIC_STREAM_EVENT_RECEIVE to the deserializer of the stream
+    and returns what the stream callback has to return (see ReceiveMode)
+*/
+static inline QUIC_STATUS
+receive_buffers(HQUIC stream, StreamContext& streamContext, const QUIC_STREAM_EVENT* event)
+{
+    MOQT& moqtObject = streamContext.moqtObject_;
+    auto& deserializer = streamContext.deserializer_;
+
+    // nothing to complete later without bytes (e.g. only the FIN)
+    if (moqtObject.receiveMode_ == ReceiveMode::ZERO_COPY && event->RECEIVE.TotalBufferLength != 0)
+    {
+        for (std::uint64_t bufferIndex = 0; bufferIndex < event->RECEIVE.BufferCount; bufferIndex++)
+        {
+            // the descriptors are only valid in the callback, the data till it is completed
+            QUIC_BUFFER* descriptor = (QUIC_BUFFER*)malloc(sizeof(QUIC_BUFFER));
+            *descriptor = event->RECEIVE.Buffers[bufferIndex];
+
+            deserializer->append_buffer(
+            UniqueQuicBuffer(descriptor,
+                             rvn::QUIC_BUFFERDeleter(stream, moqtObject.get_tbl()->StreamReceiveComplete)));
+        }
+
+        // buffers the deserializer already consumed have been completed inline, the rest follow
+        return QUIC_STATUS_PENDING;
+    }
+
+    for (std::uint64_t bufferIndex = 0; bufferIndex < event->RECEIVE.BufferCount; bufferIndex++)
+    {
+        const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[bufferIndex];
+
+        // make a copy of the buffer, we do not need a copy, but there seems to be a bug in MsQuic with
+        // lifetime management of the buffers in MultiReceive Mode
+        QUIC_BUFFER* newBuffer = (QUIC_BUFFER*)malloc(sizeof(QUIC_BUFFER) + buffer->Length);
+        newBuffer->Length = buffer->Length;
+        newBuffer->Buffer = (uint8_t*)newBuffer + sizeof(QUIC_BUFFER);
+        std::memcpy(newBuffer->Buffer, buffer->Buffer, buffer->Length);
+
+        deserializer->append_buffer(UniqueQuicBuffer(newBuffer, rvn::QUIC_BUFFERDeleter()));
+    }
+
+    // https://github.com/microsoft/msquic/blob/f96015560399d60cbdd8608b6fa2120560118500/docs/Streams.md#synchronous-vs-asynchronous
+    // we are consuming the buffer in the callback because we are making a copy
+    return QUIC_STATUS_SUCCESS;
+}
+
 // Control Stream Open Flags = QUIC_STREAM_OPEN_FLAG_NONE |
 // QUIC_STREAM_OPEN_FLAG_0_RTT Control Stream Start flags =
 // QUIC_STREAM_START_FLAG_PRIORITY_WORK
@@ -85,8 +135,6 @@ static constexpr auto server_control_stream_callback =
 []([[maybe_unused]] HQUIC controlStream, void* context, QUIC_STREAM_EVENT* event)
 {
     StreamContext* streamContext = static_cast<StreamContext*>(context);
-    MOQT& moqtObject = streamContext->moqtObject_;
-    auto& deserializer = streamContext->deserializer_;
 
     utils::wait_for(streamContext->streamHasBeenConstructed);
     // moqtObject.get_tbl()->StreamReceiveSetEnabled(controlStream, true);
@@ -102,29 +150,7 @@ static constexpr auto server_control_stream_callback =
         }
         case QUIC_STREAM_EVENT_RECEIVE:
         {
-            for (std::uint64_t bufferIndex = 0;
-                 bufferIndex < event->RECEIVE.BufferCount; bufferIndex++)
-            {
-                const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[bufferIndex];
-
-                // make a copy of the buffer, we do not need a copy, but there seems to be a bug in MsQuic with
-                // lifetime management of the buffers in MultiReceive Mode
-                QUIC_BUFFER* newBuffer =
-                (QUIC_BUFFER*)malloc(sizeof(QUIC_BUFFER) + buffer->Length);
-                newBuffer->Length = buffer->Length;
-                newBuffer->Buffer = (uint8_t*)newBuffer + sizeof(QUIC_BUFFER);
-                std::memcpy(newBuffer->Buffer, buffer->Buffer, buffer->Length);
-
-                deserializer->append_buffer(
-                UniqueQuicBuffer(newBuffer,
-                                 rvn::QUIC_BUFFERDeleter(controlStream,
-                                                         moqtObject.get_tbl()->StreamReceiveComplete)));
-            }
-
-            // https://github.com/microsoft/msquic/blob/f96015560399d60cbdd8608b6fa2120560118500/docs/Streams.md#synchronous-vs-asynchronous
-            // we are consuming the buffer in the callback because we are making a copy
-            return QUIC_STATUS_SUCCESS;
-            break;
+            return receive_buffers(controlStream, *streamContext, event);
         }
         case QUIC_STREAM_EVENT_SEND_COMPLETE:
         {
@@ -136,7 +162,7 @@ static constexpr auto server_control_stream_callback =
             static_cast<StreamSendContext*>(event->SEND_COMPLETE.ClientContext);
 
             streamSendContext->send_complete_cb();
-            delete streamSendContext;
+            StreamSendContextPool::destroy(streamSendContext);
             break;
         }
         case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
@@ -173,9 +199,32 @@ static constexpr auto server_data_stream_callback =
                                            "on data stream");
             break;
         }
+        case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        {
+            // delivered for every send (also cancelled ones when the stream is aborted)
+            // destroying the context releases its reference on the object buffer
+            StreamSendContext* streamSendContext =
+            static_cast<StreamSendContext*>(event->SEND_COMPLETE.ClientContext);
+
+            // might resume subscriptions held back by the connection's send budget
+            if (auto connectionState = streamContext->connectionStateWeakPtr_.lock())
+                connectionState->send_completed(*streamContext, streamSendContext->totalLength);
+
+            streamSendContext->send_complete_cb();
+            StreamSendContextPool::destroy(streamSendContext);
+            break;
+        }
+        case QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE:
+        {
+            if (auto connectionState = streamContext->connectionStateWeakPtr_.lock())
+                connectionState->ideal_send_buffer_changed(*streamContext,
+                                                           event->IDEAL_SEND_BUFFER_SIZE.ByteCount);
+            break;
+        }
         case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
         {
-            delete streamContext;
+            // created by ConnectionState::send_object from the connection's pool
+            StreamContextPool::destroy(streamContext);
             break;
         }
 
@@ -192,7 +241,6 @@ static constexpr auto client_data_stream_callback =
 {
     StreamContext* streamContext = static_cast<StreamContext*>(context);
     ConnectionState& connectionState = streamContext->connectionState_;
-    MOQT& moqtObject = streamContext->moqtObject_;
 
     // TODO: wait for stream setup
     switch (event->Type)
@@ -204,30 +252,7 @@ static constexpr auto client_data_stream_callback =
         }
         case QUIC_STREAM_EVENT_RECEIVE:
         {
-            // accumulate all data messages received and read them when closing stream
-            for (std::uint64_t bufferIndex = 0;
-                 bufferIndex < event->RECEIVE.BufferCount; bufferIndex++)
-            {
-                const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[bufferIndex];
-
-                // make a copy of the buffer, we do not need a copy, but there seems to be a bug in MsQuic with
-                // lifetime management of the buffers in MultiReceive Mode
-                QUIC_BUFFER* newBuffer =
-                (QUIC_BUFFER*)malloc(sizeof(QUIC_BUFFER) + buffer->Length);
-                newBuffer->Length = buffer->Length;
-                newBuffer->Buffer = (uint8_t*)newBuffer + sizeof(QUIC_BUFFER);
-                std::memcpy(newBuffer->Buffer, buffer->Buffer, buffer->Length);
-
-                streamContext->deserializer_->append_buffer(
-                UniqueQuicBuffer(newBuffer,
-                                 rvn::QUIC_BUFFERDeleter(dataStream,
-                                                         moqtObject.get_tbl()->StreamReceiveComplete)));
-            }
-
-            // https://github.com/microsoft/msquic/blob/f96015560399d60cbdd8608b6fa2120560118500/docs/Streams.md#synchronous-vs-asynchronous
-            // we are consuming the buffer in the callback because we are making a copy
-            return QUIC_STATUS_SUCCESS;
-            break;
+            return receive_buffers(dataStream, *streamContext, event);
         }
         case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
         {
@@ -246,7 +271,6 @@ static constexpr auto client_control_stream_callback =
 []([[maybe_unused]] HQUIC controlStream, void* context, QUIC_STREAM_EVENT* event)
 {
     StreamContext* streamContext = static_cast<StreamContext*>(context);
-    MOQT& moqtObject = streamContext->moqtObject_;
 
     utils::wait_for(streamContext->streamHasBeenConstructed);
     // moqtObject.get_tbl()->StreamReceiveSetEnabled(controlStream, true);
@@ -260,29 +284,7 @@ static constexpr auto client_control_stream_callback =
         }
         case QUIC_STREAM_EVENT_RECEIVE:
         {
-            for (std::uint64_t bufferIndex = 0;
-                 bufferIndex < event->RECEIVE.BufferCount; bufferIndex++)
-            {
-                const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[bufferIndex];
-
-                // make a copy of the buffer, we do not need a copy, but there seems to be a bug in MsQuic with
-                // lifetime management of the buffers in MultiReceive Mode
-                QUIC_BUFFER* newBuffer =
-                (QUIC_BUFFER*)malloc(sizeof(QUIC_BUFFER) + buffer->Length);
-                newBuffer->Length = buffer->Length;
-                newBuffer->Buffer = (uint8_t*)newBuffer + sizeof(QUIC_BUFFER);
-                std::memcpy(newBuffer->Buffer, buffer->Buffer, buffer->Length);
-
-                streamContext->deserializer_->append_buffer(
-                UniqueQuicBuffer(newBuffer,
-                                 rvn::QUIC_BUFFERDeleter(controlStream,
-                                                         moqtObject.get_tbl()->StreamReceiveComplete)));
-            }
-
-            // https://github.com/microsoft/msquic/blob/f96015560399d60cbdd8608b6fa2120560118500/docs/Streams.md#synchronous-vs-asynchronous
-            // we are consuming the buffer in the callback because we are making a copy
-            return QUIC_STATUS_SUCCESS;
-            break;
+            return receive_buffers(controlStream, *streamContext, event);
         }
         case QUIC_STREAM_EVENT_SEND_COMPLETE:
         {
@@ -294,7 +296,7 @@ static constexpr auto client_control_stream_callback =
             static_cast<StreamSendContext*>(event->SEND_COMPLETE.ClientContext);
 
             streamSendContext->send_complete_cb();
-            delete streamSendContext;
+            StreamSendContextPool::destroy(streamSendContext);
             break;
         }
         default: break;
@@ -4,14 +4,22 @@
 #include <serialization/messages.hpp>
 #include <strong_types.hpp>
 //////////////////////////////
-#include <functional>
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 //////////////////////////////
 #include <definitions.hpp>
 #include <deserializer.hpp>
 #include <message_handler.hpp>
+#include <object_buffer.hpp>
 #include <serialization/serialization.hpp>
+#include <slab_pool.hpp>
 #include <utilities.hpp>
 #include <variant>
 #include <wrappers.hpp>
@@ -21,6 +29,8 @@
 
 namespace rvn
 {
+class SubscriptionWaiter;
+
 enum class StreamType
 {
     CONTROL,
@@ -45,6 +55,18 @@ struct StreamContext
         StreamState which requires rvn::unique_stream which requires StreamContext
     */
     std::optional<serialization::Deserializer<MessageHandler>> deserializer_;
+
+    // send accounting of data streams (see SendBackpressurePolicy), lives till SHUTDOWN_COMPLETE
+    // so that every SEND_COMPLETE of the stream finds it, even after the DataStreamState is erased
+    std::atomic<std::uint64_t> inFlightBytes_{};
+    // last QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE of the stream
+    std::atomic<std::uint64_t> idealSendBufferBytes_{};
+    // a subscription waits for the stream to drain
+    std::atomic_bool sendBlocked_{};
+    // set for the data streams opened by the server, their SEND_COMPLETE can come in after the
+    // connection state is gone (the streams are only aborted), connectionState_ dangles then
+    std::weak_ptr<ConnectionState> connectionStateWeakPtr_;
+
     StreamContext(MOQT& moqtObject, ConnectionState& connectionState)
     : streamCreationTimePoint_(Clock::now()), moqtObject_(moqtObject),
       connectionState_(connectionState) {};
@@ -53,52 +75,168 @@ struct StreamContext
     void construct_deserializer(StreamState& streamState, bool isControlStream);
 };
 
+/*
+    One StreamSend: up to maxBuffers QUIC_BUFFERs sent as a gather list,
+    e.g. the stream header followed by consecutive objects of the stream
+    Object buffers are referenced (never copied) till the send completes
+*/
 class StreamSendContext
 {
 public:
-    // owns the QUIC_BUFFERS
-    QUIC_BUFFER* buffer;
+    static constexpr std::uint32_t maxBuffers = 16;
+
+    // handed to StreamSend, the first bufferCount are used
+    std::array<QUIC_BUFFER, maxBuffers> buffers;
     std::uint32_t bufferCount;
+    std::uint64_t totalLength;
+
+    // buffers[i] points into objectBuffers[i] if it is set,
+    // otherwise buffers[i] is owned (created by serialization::serialize)
+    std::array<ObjectBufferRef, maxBuffers> objectBuffers;
 
     // non owning reference
     const StreamContext* streamContext;
 
-    std::function<void(StreamSendContext*)> sendCompleteCallback =
-    utils::NoOpVoid<StreamSendContext*>;
+    // plain function pointer and context: setting a callback never allocates (std::function might)
+    using SendCompleteCallback = void (*)(StreamSendContext*, void*);
+    SendCompleteCallback sendCompleteCallback = nullptr;
+    void* sendCompleteContext = nullptr;
+
+    // empty, buffers are appended
+    explicit StreamSendContext(const StreamContext* streamContext_)
+    : bufferCount(0), totalLength(0), streamContext(streamContext_)
+    {
+    }
 
+    // takes ownership of buffer created by serialization::serialize
     StreamSendContext(QUIC_BUFFER* buffer_,
-                      const std::uint32_t bufferCount_,
                       const StreamContext* streamContext_,
-                      std::function<void(StreamSendContext*)> sendCompleteCallback_ =
-                      utils::NoOpVoid<StreamSendContext*>)
-    : buffer(buffer_), bufferCount(bufferCount_), streamContext(streamContext_),
-      sendCompleteCallback(sendCompleteCallback_)
+                      SendCompleteCallback sendCompleteCallback_ = nullptr,
+                      void* sendCompleteContext_ = nullptr)
+    : bufferCount(0), totalLength(0), streamContext(streamContext_),
+      sendCompleteCallback(sendCompleteCallback_), sendCompleteContext(sendCompleteContext_)
     {
-        utils::ASSERT_LOG_THROW(bufferCount == 1, "bufferCount should be 1", bufferCount);
+        append(buffer_);
     }
 
+    // zero copy send of a shared object buffer
+    StreamSendContext(ObjectBufferRef objectBuffer_, const StreamContext* streamContext_)
+    : bufferCount(0), totalLength(0), streamContext(streamContext_)
+    {
+        append(std::move(objectBuffer_));
+    }
+
+    StreamSendContext(const StreamSendContext&) = delete;
+    StreamSendContext& operator=(const StreamSendContext&) = delete;
+
     ~StreamSendContext()
     {
         destroy_buffers();
     }
 
+    bool full() const noexcept
+    {
+        return bufferCount == maxBuffers;
+    }
+
+    // takes ownership of buffer created by serialization::serialize
+    void append(QUIC_BUFFER* buffer_)
+    {
+        utils::ASSERT_LOG_THROW(!full(), "StreamSendContext is full", bufferCount);
+        buffers[bufferCount++] = *buffer_;
+        totalLength += buffer_->Length;
+        // the descriptor is copied, only the data is kept
+        free(buffer_);
+    }
+
+    void append(ObjectBufferRef objectBuffer_)
+    {
+        utils::ASSERT_LOG_THROW(!full(), "StreamSendContext is full", bufferCount);
+        buffers[bufferCount] = *objectBuffer_->quic_buffer();
+        totalLength += objectBuffer_->length();
+        objectBuffers[bufferCount++] = std::move(objectBuffer_);
+    }
+
     std::tuple<QUIC_BUFFER*, std::uint32_t> get_buffers()
     {
-        return { buffer, bufferCount };
+        return { buffers.data(), bufferCount };
     }
     void destroy_buffers()
     {
-        // We do nothing in destroy buffers as some part of the codebase uses 0 copy send
-        // TODO: fix this
+        for (std::uint32_t i = 0; i < bufferCount; ++i)
+        {
+            if (objectBuffers[i])
+                // other subscribers and the cache might still be using the buffer
+                objectBuffers[i].reset();
+            else
+                free(buffers[i].Buffer);
+        }
+        bufferCount = 0;
+        totalLength = 0;
     }
 
     // callback called when the send is succsfull
     void send_complete_cb()
     {
-        sendCompleteCallback(this);
+        if (sendCompleteCallback != nullptr)
+            sendCompleteCallback(this, sendCompleteContext);
     }
 };
 
+/*
+    Send and stream contexts are created on every send / new stream and destroyed on MsQuic
+    workers (SEND_COMPLETE, SHUTDOWN_COMPLETE), they come from pools of their connection
+    (see ConnectionState) so that the send path does not go to the heap once the pools are warm
+    Destroying returns the context to the pool it came from, lock free
+*/
+using StreamSendContextPool = SlabPool<StreamSendContext, 32>;
+using StreamContextPool = SlabPool<StreamContext, 32>;
+
+struct StreamSendContextDeleter
+{
+    void operator()(StreamSendContext* streamSendContext) const noexcept
+    {
+        StreamSendContextPool::destroy(streamSendContext);
+    }
+};
+
+using StreamSendContextPtr = std::unique_ptr<StreamSendContext, StreamSendContextDeleter>;
+
+/*
+    Objects sent on a data stream are gathered into one StreamSend (see StreamSendContext)
+    The gathered send of a stream is handed to MsQuic
+        right away once it has maxBuffers buffers or maxPendingBytes bytes
+        otherwise on ConnectionState::flush_sends, every send of the flush but the last one
+        is DELAY_SEND so that MsQuic coalesces them and schedules the connection once
+
+    objectsPerPass: objects a subscription which is behind (catching up) sends on one stream
+    before the subscription thread moves on (and flushes)
+*/
+struct SendFlushPolicy
+{
+    std::uint32_t maxBuffers = StreamSendContext::maxBuffers;
+    std::uint64_t maxPendingBytes = 64 * 1024;
+    std::uint32_t objectsPerPass = 8;
+};
+
+/*
+    Bytes handed to StreamSend which have not been completed by MsQuic (QUIC_STREAM_EVENT_SEND_COMPLETE)
+    are accounted per connection and per stream, subscriptions stop sending on a connection
+        with connectionHighWater bytes in flight till it drained to connectionLowWater
+        on a stream with max(streamHighWater, ideal send buffer size of the stream) bytes in flight
+    The ideal send buffer size (QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE) is what MsQuic wants
+    in flight to keep the path busy, a fast path is not held back by streamHighWater
+
+    Objects gathered but not yet handed to StreamSend are not accounted (bounded by SendFlushPolicy)
+    0 disables the respective limit
+*/
+struct SendBackpressurePolicy
+{
+    std::uint64_t connectionHighWater = 16 * 1024 * 1024;
+    std::uint64_t connectionLowWater = 8 * 1024 * 1024;
+    std::uint64_t streamHighWater = 1024 * 1024;
+};
+
 struct StreamState
 {
     rvn::unique_stream stream;
@@ -128,14 +266,87 @@ public:
     std::shared_ptr<MPMCQueue<StreamHeaderSubgroupObject>> objectQueue_;
     std::shared_ptr<StreamHeaderSubgroupMessage> streamHeaderSubgroupMessage_;
 
+    // gathered send which has not been handed to MsQuic yet
+    // mutable: appended to with the reader lock of ConnectionState::dataStreams held
+    mutable std::mutex pendingSendMtx_;
+    mutable StreamSendContextPtr pendingSend_;
+
     DataStreamState(rvn::unique_stream&& stream, struct ConnectionState& connectionState);
     bool can_send_object(const ObjectIdentifier& objectIdentifier) const noexcept;
     void set_header(StreamHeaderSubgroupMessage streamHeaderSubgroupMessage);
     std::weak_ptr<void> get_life_time_flag() const noexcept;
 };
 
+/*
+    Data streams of a connection, the streams opened by the server to send objects are indexed
+    by (track alias, group, subgroup) of their header, so that finding the stream of an object
+    and aborting it is O(1) instead of a scan over all streams
+    Only accessed through ConnectionState::dataStreams (reader / writer lock)
+*/
+struct DataStreams
+{
+    struct Key
+    {
+        std::uint64_t trackAlias_;
+        std::uint64_t groupId_;
+        std::uint64_t subgroupId_;
+
+        bool operator==(const Key&) const = default;
+
+        struct Hash
+        {
+            std::uint64_t operator()(const Key& key) const noexcept
+            {
+                std::uint64_t hash = key.trackAlias_ * 0x9E3779B97F4A7C15ULL;
+                hash ^= key.groupId_ * 0xC2B2AE3D27D4EB4FULL;
+                hash ^= key.subgroupId_ * 0x165667B19E3779F9ULL;
+                return hash ^ (hash >> 32);
+            }
+        };
+    };
+
+    using Iterator = StableContainer<DataStreamState>::iterator;
+
+    StableContainer<DataStreamState> streams_;
+    std::unordered_map<Key, Iterator, Key::Hash> index_;
+
+    static Key key_of(const StreamHeaderSubgroupMessage& streamHeader) noexcept
+    {
+        return { streamHeader.trackAlias_.get(), streamHeader.groupId_.get(),
+                 streamHeader.subgroupId_.get() };
+    }
+
+    DataStreamState* find(const Key& key) const noexcept
+    {
+        auto iter = index_.find(key);
+        return iter == index_.end() ? nullptr : std::addressof(*iter->second);
+    }
+
+    // the stream has to have its header set
+    void index(Iterator iter)
+    {
+        index_.insert_or_assign(key_of(*iter->streamHeaderSubgroupMessage_), iter);
+    }
+
+    void erase(Iterator iter)
+    {
+        if (iter->streamHeaderSubgroupMessage_)
+        {
+            auto indexIter = index_.find(key_of(*iter->streamHeaderSubgroupMessage_));
+            if (indexIter != index_.end() && indexIter->second == iter)
+                index_.erase(indexIter);
+        }
+        streams_.erase(iter);
+    }
+};
+
 struct ConnectionState : std::enable_shared_from_this<ConnectionState>
 {
+    // contexts are destroyed by SEND_COMPLETE / SHUTDOWN_COMPLETE, which can be delivered after the
+    // connection state is gone (streams are only aborted), the pools live till the last one returns
+    StreamSendContextPool::Handle sendContextPool_;
+    StreamContextPool::Handle streamContextPool_;
+
     // StreamManager //////////////////////////////////////////////////////////////
     std::shared_mutex trackAliasMtx_;
     std::unordered_map<TrackIdentifier, TrackAlias, TrackIdentifier::Hash, TrackIdentifier::Equal> trackAliasMap_;
@@ -152,20 +363,77 @@ struct ConnectionState : std::enable_shared_from_this<ConnectionState>
     std::optional<TrackIdentifier> alias_to_identifier(TrackAlias trackAlias);
     std::optional<TrackAlias> identifier_to_alias(const TrackIdentifier& trackIdentifier);
 
-    RWProtected<StableContainer<DataStreamState>> dataStreams;
+    RWProtected<DataStreams> dataStreams;
+
+    // index key of the stream the object is sent on, nullopt if the track has no alias
+    std::optional<DataStreams::Key> stream_key(const ObjectIdentifier& objectIdentifier);
 
     std::optional<StreamState> controlStream;
 
     void delete_data_stream(HQUIC streamHandle);
     void enqueue_data_buffer(QUIC_BUFFER* buffer);
 
+    SendFlushPolicy sendFlushPolicy_;
+    SendBackpressurePolicy sendBackpressurePolicy_;
+
+    /*
+        held while one of the connection's subscriptions is fulfilled (gathering and flush_sends)
+        subscriptions of a connection normally run on one thread, but stolen ones run on the thief,
+        without it a send taken out of pendingSend_ by one thread could be handed to StreamSend
+        after a later send of the same stream flushed by the other
+    */
+    std::mutex fulfillMtx_;
+
+    // bytes of all data streams handed to StreamSend and not completed yet
+    std::atomic<std::uint64_t> inFlightBytes_;
+    // a subscription waits for the connection to drain to connectionLowWater
+    std::atomic<bool> sendBlocked_;
+
+    // subscriptions waiting for the connection (or one of its streams) to drain
+    std::mutex sendWaitersMtx_;
+    std::vector<std::weak_ptr<SubscriptionWaiter>> sendWaiters_;
+    std::atomic<bool> hasSendWaiters_;
+
+    // streams with a pending send, the life time flag tells if the stream is still there
+    std::mutex pendingSendsMtx_;
+    std::vector<std::pair<std::weak_ptr<void>, const DataStreamState*>> pendingSends_;
+
+    // called with the reader (or writer) lock of dataStreams held
+    QUIC_STATUS enqueue_send(const DataStreamState& dataStream, ObjectBufferRef objectBuffer);
+    QUIC_STATUS stream_send(const DataStreamState& dataStream,
+                            StreamSendContextPtr streamSendContext,
+                            QUIC_SEND_FLAGS flags);
+
     QUIC_STATUS send_object(std::weak_ptr<DataStreamState> dataStream,
                             const ObjectIdentifier& objectIdentifier,
                             QUIC_BUFFER* buffer);
+    // middle of the range, used when the subscriber did not ask for anything
+    static constexpr std::uint8_t defaultSubscriberPriority = 128;
+
+    // holds a reference to objectBuffer till the send completes
+    // subscriberPriority (with the group's publisher priority) sets the priority of a new stream
+    // the object might only be gathered (see SendFlushPolicy), the caller has to flush_sends
     QUIC_STATUS
     send_object(const ObjectIdentifier& objectIdentifier,
-                QUIC_BUFFER* buffer,
-                std::optional<std::chrono::milliseconds> timeoutDuration);
+                ObjectBufferRef objectBuffer,
+                std::optional<std::chrono::milliseconds> timeoutDuration,
+                std::uint8_t subscriberPriority = defaultSubscriberPriority);
+    // hands the gathered sends of all streams to MsQuic
+    QUIC_STATUS flush_sends();
+
+    // true if the connection, or the stream the object would be sent on, has too many bytes in flight
+    // streamExists: the subscription already sent on the stream, otherwise only the connection is checked
+    bool send_budget_exceeded(const ObjectIdentifier& objectIdentifier, bool streamExists);
+    // the waiter is woken up once the connection or a blocked stream drained, a waiter is listed once
+    // check send_budget_exceeded again after adding: the bytes might have drained in between
+    void add_send_waiter(const std::shared_ptr<SubscriptionWaiter>& waiter);
+    // QUIC_STREAM_EVENT_SEND_COMPLETE / QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE of a data stream
+    void send_completed(StreamContext& streamContext, std::uint64_t numBytes);
+    void ideal_send_buffer_changed(StreamContext& streamContext, std::uint64_t numBytes);
+    std::uint64_t stream_send_limit(const StreamContext& streamContext) const noexcept;
+    void wake_send_waiters();
+    // re-prioritizes the open streams of the track, the subscriber priority changed (SUBSCRIBE_UPDATE)
+    void set_subscriber_priority(TrackAlias trackAlias, std::uint8_t subscriberPriority);
     void send_control_buffer(QUIC_BUFFER* buffer, QUIC_SEND_FLAGS flags = QUIC_SEND_FLAG_NONE);
     /////////////////////////////////////////////////////////////////////////////
 
@@ -175,8 +443,13 @@ struct ConnectionState : std::enable_shared_from_this<ConnectionState>
     std::string path;
     // TODO: role
 
-    ConnectionState(unique_connection&& connection, class MOQT& moqtObject)
-    : connection_(std::move(connection)), moqtObject_(moqtObject)
+    ConnectionState(unique_connection&& connection,
+                    class MOQT& moqtObject,
+                    SendFlushPolicy sendFlushPolicy = {},
+                    SendBackpressurePolicy sendBackpressurePolicy = {})
+    : sendFlushPolicy_(sendFlushPolicy), sendBackpressurePolicy_(sendBackpressurePolicy),
+      inFlightBytes_(0), sendBlocked_(false), hasSendWaiters_(false), connection_(std::move(connection)),
+      moqtObject_(moqtObject)
     {
     }
 
@@ -191,6 +464,8 @@ struct ConnectionState : std::enable_shared_from_this<ConnectionState>
     StreamState& establish_control_stream();
 
     void abort_if_sending(const ObjectIdentifier& oid);
+    // aborts the streams of the groups of the track (the subscription is gone), O(1) per group
+    void abort_group_streams(TrackAlias trackAlias, std::span<const std::uint64_t> groupIds);
 };
 
 } // namespace rvn
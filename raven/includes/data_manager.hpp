@@ -3,20 +3,31 @@
 #include <boost/functional/hash.hpp>
 #include <chrono>
 #include <cstdint>
+#include <dense_slot_array.hpp>
 #include <filesystem>
 #include <functional>
 #include <iostream>
+#include <limits>
+#include <manifest.hpp>
 #include <map>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <object_buffer.hpp>
+#include <object_cache.hpp>
+#include <publish_buffer.hpp>
+#include <segment_log.hpp>
+#include <storage_io.hpp>
 #include <shared_mutex>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <strong_types.hpp>
+#include <subgroup_intervals.hpp>
 #include <unordered_map>
 #include <utilities.hpp>
 #include <variant>
 #include <vector>
+#include <write_behind.hpp>
 
 
 /*
@@ -86,43 +97,114 @@ enum class ObjectWaitStatus
     Ready
 };
 using ObjectWaitSignal = std::shared_ptr<std::atomic<ObjectWaitStatus>>;
-using ObjectType = std::tuple<QUIC_BUFFER*, std::optional<std::chrono::milliseconds>>;
+
+/*
+    Readiness notification for objects which are not published yet
+    Passed to get_object, registered on the group if the object is in Wait
+    and notified exactly once when the object becomes Ready, so that readers can
+    park instead of polling the wait signal
+
+    The published object is handed over with the notification (fan out): every reader waiting
+    at the live edge gets the same buffer, resolved once by the publisher, without a lookup
+
+    notify_object_ready is called on the publishing thread (with no DataManager locks held),
+    it should only hand the reader over to whoever runs it
+*/
+class ObjectWaiter
+{
+public:
+    virtual ~ObjectWaiter() = default;
+    virtual void notify_object_ready(const class GroupHandle& groupHandle,
+                                     ObjectId objectId,
+                                     const ObjectBufferRef& objectBuffer) = 0;
+};
+
+/*
+    Live tail notification of a track: object ids registered after a reader enumerated the track
+    (add_subgroup, add_open_ended_subgroup, cap_and_next), a new group is announced
+    with its first subgroup, objects of a registered range are waited on with ObjectWaiter
+
+    The observers are taken with the writer lock of the group's object ids held, notify_subgroup_added
+    is called on the publishing thread once the lock has been released, in order per group:
+    a reader which registered on the track before it looked at the object ids of a group sees every
+    subgroup either there or in a notification (possibly both, never neither), a notification can
+    come in after the reader went past the subgroup, it should only hand the range over to whoever
+    reads the track (who drops what it already took)
+*/
+class TrackObserver
+{
+public:
+    virtual ~TrackObserver() = default;
+    virtual void notify_subgroup_added(const std::shared_ptr<class GroupHandle>& groupHandle,
+                                       ObjectId beginObjectId,
+                                       ObjectId endObjectId) = 0;
+};
+
+using ObjectType = std::tuple<ObjectBufferRef, std::optional<std::chrono::milliseconds>>;
 using ObjectOrStatus = std::variant<ObjectType, ObjectWaitSignal, DoesNotExist>;
 
+/*
+    TrackIdentifiers are interned: every TrackIdentifier with the same namespace and name
+    points to the same registry entry which holds a small integer track id and the precomputed hash
+
+    Hashing and comparing a TrackIdentifier (done for every object sent) is O(1)
+    instead of going over all the strings, only construction looks up the registry
+
+    The entry is dropped from the registry once the last TrackIdentifier referring to it is gone,
+    a track id is stable as long as some TrackIdentifier (e.g. the TrackHandle's) is alive
+*/
 class TrackIdentifier
 {
-    std::shared_ptr<std::pair<std::vector<std::string>, std::string>> trackIdentifierInternal_;
+    struct Interned
+    {
+        std::vector<std::string> tnamespace_;
+        std::string tname_;
+        std::uint64_t trackId_;
+        std::uint64_t hash_;
+    };
+
+    std::shared_ptr<const Interned> trackIdentifierInternal_;
+
+    static std::shared_ptr<const Interned> intern(std::vector<std::string> tracknamespace,
+                                                  std::string trackname);
 
 public:
     struct Hash
     {
-        std::uint64_t operator()(const TrackIdentifier& id) const
+        std::uint64_t operator()(const TrackIdentifier& id) const noexcept
         {
-            std::uint64_t hash = 0;
-            for (const auto& ns : id.tnamespace())
-                boost::hash_combine(hash, ns);
-
-            boost::hash_combine(hash, id.tname());
-            return hash;
+            return id.hash();
         }
     };
     using Equal = std::equal_to<TrackIdentifier>;
 
     const std::vector<std::string>& tnamespace() const noexcept
     {
-        return trackIdentifierInternal_->first;
+        return trackIdentifierInternal_->tnamespace_;
     }
     const std::string& tname() const noexcept
     {
-        return trackIdentifierInternal_->second;
+        return trackIdentifierInternal_->tname_;
+    }
+
+    // unique among all live TrackIdentifiers
+    std::uint64_t track_id() const noexcept
+    {
+        return trackIdentifierInternal_->trackId_;
+    }
+
+    std::uint64_t hash() const noexcept
+    {
+        return trackIdentifierInternal_->hash_;
     }
 
     TrackIdentifier(std::vector<std::string> tracknamespace, std::string trackname);
 
 
-    bool operator==(const TrackIdentifier& other) const
+    bool operator==(const TrackIdentifier& other) const noexcept
     {
-        return tnamespace() == other.tnamespace() && tname() == other.tname();
+        // interned, same track => same entry
+        return trackIdentifierInternal_ == other.trackIdentifierInternal_;
     }
 
     friend inline std::ostream& operator<<(std::ostream& os, const TrackIdentifier& id)
@@ -207,6 +289,21 @@ class SubgroupHandle
 public:
     bool add_object(std::string object);
 
+    /*
+        zero copy publish: the wire header is written into the headroom of the buffer
+        and the buffer itself is cached, sent and persisted (payload is never copied)
+    */
+    bool add_object(PublishBuffer object);
+
+    /*
+        publishes objects with consecutive object ids in one go (bursty publishers)
+            - one serialization arena for the whole batch
+            - every cache shard is locked once
+            - one submission to the persister
+        either all objects are stored or none, objects are moved from
+    */
+    bool add_objects(std::span<std::string> objects);
+
     // caps the subgroup with how many ever objects it currently has
     void cap();
 
@@ -222,6 +319,7 @@ public:
     friend class DataManager;
     friend class TrackHandle;
     friend class SubgroupHandle;
+    friend class WriteBehindPersister;
     GroupIdentifier groupIdentifier_;
     PublisherPriority publisherPriority_;
     std::optional<std::chrono::milliseconds> deliveryTimeout_;
@@ -231,70 +329,96 @@ public:
     GroupHandle& operator=(GroupHandle&&) = delete;
 
 private:
-    struct Comparator
-    {
-        bool operator()(std::uint64_t l, std::uint64_t r) const
-        {
-            std::uint64_t lMasked = l & (~(1ULL << 63)); //  mask the MSB
-            std::uint64_t rMasked = r & (~(1ULL << 63)); //  mask the MSB
-
-
-            // we want {0_begin, 1_end, 1_begin, 2_end, ...}
-            if (lMasked == rMasked)
-                return l > r;
-            else
-                return lMasked < rMasked;
-        }
-    };
-
     // stores number of concrete objects that is, objects which have been stored
     std::atomic<std::uint64_t> numStoredObjects_;
 
     std::shared_mutex objectIdsMtx_;
-    std::set<std::uint64_t, Comparator> objectIds_;
-
-    struct ObjectIdHash
-    {
-        std::uint64_t operator()(const ObjectId& oid) const noexcept
-        {
-            return oid.get();
-        }
-    };
-
-    using ObjectIdEqual = std::equal_to<ObjectId>;
-
-    RWProtected<std::unordered_map<ObjectId, QUIC_BUFFER*, ObjectIdHash, ObjectIdEqual>> groupCache_;
-    RWProtected<std::unordered_map<ObjectId, ObjectWaitSignal, ObjectIdHash, ObjectIdEqual>> objectWaitSignals_;
+    SubgroupIntervals objectIds_;
+    // taken before objectIdsMtx_ when adding a subgroup, held till the track observers were notified
+    std::mutex notifyMtx_;
+
+    // identifies the group's objects in DataManager::objectCache_
+    std::uint64_t cacheKey_;
+
+    /*
+        ready/wait state of every object indexed by ObjectId, readable without locks
+        wait signals handed to subscribers point directly into these slots
+        (aliasing shared_ptr which keeps the group alive)
+    */
+    DenseSlotArray<std::atomic<ObjectWaitStatus>> objectStates_;
+
+    // all objects of the group are appended to a single segment file
+    SegmentLog segmentLog_;
+
+    // identifies the group's track in the manifest
+    std::uint64_t trackKey_;
+    // track observers are told about new subgroups
+    std::weak_ptr<class TrackHandle> trackHandle_;
+
+    /*
+        readers parked on objects of this group which are not Ready yet, (objectId, waiter)
+        numWaiters_ lets publishers skip waitersMtx_ when nobody is waiting:
+            publisher: store Ready (seq_cst), load numWaiters_ (seq_cst)
+            reader:    increment numWaiters_ (seq_cst), load state (seq_cst)
+        at least one of them sees the other, so a notification can not be missed
+        weak: a reader which is gone (unsubscribed) is dropped instead of being kept alive
+        till its object is published, which might never happen
+    */
+    std::mutex waitersMtx_;
+    std::vector<std::pair<std::uint64_t, std::weak_ptr<ObjectWaiter>>> waiters_;
+    std::atomic<std::uint64_t> numWaiters_{};
+
+    // returns false (and registers nothing) if the object turned Ready meanwhile
+    bool add_waiter(std::uint64_t objectId,
+                    const std::atomic<ObjectWaitStatus>& objectState,
+                    const std::shared_ptr<ObjectWaiter>& waiter);
+
+    // called once objects firstObjectId, firstObjectId + 1, ... have been marked Ready
+    void notify_waiters(std::uint64_t firstObjectId, std::span<const ObjectBufferRef> objectBuffers);
+
+    // records the subgroup range in the manifest, called with objectIdsMtx_ held
+    void log_subgroup(std::uint64_t beginObjectId, std::uint64_t endObjectId);
+    // the track's observers, taken with the writer lock of objectIdsMtx_ held
+    std::vector<std::shared_ptr<TrackObserver>> track_observers();
+    // tells them about a new subgroup, called with notifyMtx_ held (and objectIdsMtx_ released)
+    void notify_subgroup_added(std::span<const std::shared_ptr<TrackObserver>> observers,
+                               std::uint64_t beginObjectId,
+                               std::uint64_t endObjectId);
+
+    // warm restart: rebuilds the object index from the segment log, returns number of objects
+    std::uint64_t recover();
 
 public:
     GroupHandle(GroupIdentifier groupIdentifier,
                 PublisherPriority publisherPriority_,
                 std::optional<std::chrono::milliseconds> deliveryTimeout,
-                DataManager& dataManagerHandle);
+                DataManager& dataManagerHandle,
+                std::uint64_t trackKey,
+                std::weak_ptr<TrackHandle> trackHandle);
+    ~GroupHandle();
 
     SubgroupHandle add_subgroup(std::uint64_t numElements);
     SubgroupHandle add_open_ended_subgroup();
 
+    // adds a subgroup of exactly objects.size() objects and publishes all of them as a batch
+    bool add_objects(std::span<std::string> objects);
+
     SubGroupId get_subgroup_id(ObjectId objectId) const
     {
-        std::uint64_t objectIdInt = objectId.get();
-
-        /*
-            begin is small
-            end is capital
-
-                 x                                        -> upper bound gives 1, subgroup id is 0
-                         x                                -> x == e0, upper bound gives 2, subgroup id is 1
-            [b0     e0) [e0     e1) [e1     e2) [e2     e3)
-        */
-        auto iter = objectIds_.upper_bound(objectIdInt);
-        if (iter == objectIds_.begin())
-            throw std::invalid_argument("ObjectId not found in GroupHandle");
-        return SubGroupId(std::distance(objectIds_.begin(), iter) / 2);
+        return SubGroupId(objectIds_.subgroup_index(objectId.get()));
     }
 
     bool has_object_id(ObjectId objectId);
 
+    // the group's objects are cached under { cache_key(), objectId } in the object cache
+    std::uint64_t cache_key() const noexcept
+    {
+        return cacheKey_;
+    }
+
+    // the object after objectId in this group, nullopt at the end of the group
+    std::optional<ObjectId> next_object_id(ObjectId objectId);
+
     std::uint64_t
     num_objects_in_range(ObjectId left = ObjectId(0),
                          ObjectId right = ObjectId(std::numeric_limits<std::uint64_t>::max()));
@@ -308,50 +432,107 @@ class TrackHandle : public std::enable_shared_from_this<TrackHandle>
 
     TrackIdentifier trackIdentifier_;
 
+    // identifies the track in the manifest
+    std::uint64_t trackKey_;
+
+    // live tail readers of the track, expired ones are dropped when they are taken
+    std::mutex observersMtx_;
+    std::vector<std::weak_ptr<TrackObserver>> observers_;
+
+    std::vector<std::shared_ptr<TrackObserver>> observers();
+
 public:
     std::shared_mutex groupHandlesMtx_;
 
     std::map<GroupId, std::shared_ptr<GroupHandle>> groupHandles_;
 
     // should be private because but want to use std::make_shared
-    TrackHandle(DataManager& dataManagerHandle, TrackIdentifier trackIdentifier);
+    TrackHandle(DataManager& dataManagerHandle, TrackIdentifier trackIdentifier, std::uint64_t trackKey);
 
     std::weak_ptr<GroupHandle>
     add_group(GroupId groupId,
               PublisherPriority publisherPriority,
-              std::optional<std::chrono::milliseconds> deliveryTimeout)
-    {
-        // writer lock
-        std::unique_lock<std::shared_mutex> l(groupHandlesMtx_);
-
-        auto [iter, success] =
-        groupHandles_.try_emplace(groupId,
-                                  std::make_shared<GroupHandle>(GroupIdentifier(trackIdentifier_, groupId),
-                                                                publisherPriority, deliveryTimeout,
-                                                                dataManager_));
+              std::optional<std::chrono::milliseconds> deliveryTimeout);
 
-        return iter->second->weak_from_this();
-    }
+    // register before looking at the groups (see TrackObserver), e.g. with groupHandlesMtx_ held
+    void add_observer(std::weak_ptr<TrackObserver> observer);
 
     TrackHandle& operator=(const TrackHandle&) = delete;
     TrackHandle& operator=(TrackHandle&&) = delete;
 };
 
 
-// TODO: Read and make use of https://www.sqlite.org/fasterthanfs.html
+struct DataManagerOptions
+{
+    std::uint64_t cacheBudgetBytes_ = ObjectCache::defaultBudgetBytes;
+    std::uint64_t maxPendingPersistenceBytes_ = WriteBehindPersister::defaultMaxPendingBytes;
+    // segment files kept open at once (LRU), the others are reopened when used
+    std::size_t maxOpenSegmentFiles_ = SegmentFiles::defaultMaxOpenFiles;
+    // falls back to Posix if io_uring is unavailable
+    StorageBackendType storageBackend_ = StorageBackendType::Posix;
+    // warm restart: rebuild the hierarchy from DATA_DIRECTORY instead of wiping it
+    bool recoverFromStorage_ = false;
+};
 
+struct RecoveryStats
+{
+    std::uint64_t numTracks_;
+    std::uint64_t numGroups_;
+    std::uint64_t numObjects_;
+    // replaying the manifest (hierarchy) and scanning the segment logs (object index)
+    std::chrono::microseconds manifestReplayTime_;
+    std::chrono::microseconds indexRebuildTime_;
+    // from the start of the DataManager constructor till it can serve objects
+    std::chrono::microseconds timeToServing_;
+};
+
+/*
+    Storage layout:
+        DATA_DIRECTORY/<namespace...>/<trackname>/<groupId>.log
+
+        DATA_DIRECTORY/.raven_manifest
+
+    Each group has one append-only segment file (see segment_log.hpp)
+    instead of one file per object, the manifest (see manifest.hpp) records the hierarchy
+
+    Warm restart (DataManagerOptions::recoverFromStorage_):
+        the manifest is replayed to rebuild tracks, groups and subgroup ranges,
+        then the segment logs are scanned in parallel (one task per track) to rebuild the object index
+        subgroups are capped at their first object which was not recovered (open ended ones after
+        their last recovered object), their publishers are gone
+*/
 class DataManager
 {
     friend class SubgroupHandle;
     friend class GroupHandle;
     friend class TrackHandle;
 
+    // segment logs of all groups do their I/O through it
+    std::unique_ptr<StorageIo> storageIo_;
+    // open fds of the segment logs, must outlive the object hierarchy
+    SegmentFiles segmentFiles_;
+
+    // must outlive the object hierarchy, groups drop their entries on destruction
+    ObjectCache objectCache_;
+    std::atomic<std::uint64_t> nextGroupCacheKey_{};
+
+    Manifest manifest_;
+    std::atomic<std::uint64_t> nextTrackKey_{};
+    std::optional<RecoveryStats> recoveryStats_;
+
     std::shared_mutex objectHierarchyMtx_;
-    std::unordered_map<TrackIdentifier, std::shared_ptr<TrackHandle>, TrackIdentifier::Hash, TrackIdentifier::Equal> objectHierarchy_;
+    // keyed by TrackIdentifier::track_id()
+    std::unordered_map<std::uint64_t, std::shared_ptr<TrackHandle>> objectHierarchy_;
+
+    // destroyed first: drains pending writes while groups and the cache are still alive
+    WriteBehindPersister persister_;
 
     std::string get_path_string(const TrackIdentifier& trackIdentifier);
-    std::string get_path_string(const GroupIdentifier& groupIdentifier);
-    std::string get_path_string(const ObjectIdentifier& objectIdentifier);
+    // path of the segment file which stores all objects of the group
+    std::string get_segment_path_string(const GroupIdentifier& groupIdentifier);
+    std::string get_manifest_path_string();
+
+    void recover_from_storage(TimePoint constructionTimePoint);
 
     bool store_object(const GroupIdentifier& groupIdentifier,
                       ObjectId objectId,
@@ -361,21 +542,41 @@ class DataManager
                       ObjectId objectId,
                       std::string&& object);
 
+    bool store_object(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                      ObjectId objectId,
+                      PublishBuffer&& publishBuffer);
+
+    // caches, marks ready and enqueues for persistence an already serialized object
+    void publish_object(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                        ObjectId objectId,
+                        std::atomic<ObjectWaitStatus>* objectState,
+                        ObjectBufferRef objectBuffer,
+                        std::uint64_t payloadLength);
+
+    // stores objects firstObjectId, firstObjectId + 1, ...
+    bool store_objects(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                       ObjectId firstObjectId,
+                       std::span<std::string> objects);
+
 public:
-    std::weak_ptr<TrackHandle>
-    add_track_identifier(std::vector<std::string> tracknamespace, std::string trackname)
-    {
-        TrackIdentifier trackIdentifier(std::move(tracknamespace), std::move(trackname));
+    // objects are cached and sent as one QUIC_BUFFER (32 bit length) with their header (objectId
+    // and payload length var ints), larger payloads are not stored (add_object returns false)
+    static constexpr std::uint64_t maxPayloadSize =
+    std::numeric_limits<std::uint32_t>::max() - 2 * sizeof(std::uint64_t);
 
-        auto [iter, success] =
-        objectHierarchy_.try_emplace(trackIdentifier,
-                                     std::make_shared<TrackHandle>(*this, trackIdentifier));
+    std::weak_ptr<TrackHandle>
+    add_track_identifier(std::vector<std::string> tracknamespace, std::string trackname);
 
-        return iter->second->weak_from_this();
-    }
 
+    // if the object is not published yet and waiter is given, waiter is notified once it is
+    // (registered weakly, the caller keeps the waiter alive while it waits)
+    ObjectOrStatus get_object(const ObjectIdentifier& objectIdentifier,
+                              const std::shared_ptr<ObjectWaiter>& waiter = nullptr);
 
-    ObjectOrStatus get_object(const ObjectIdentifier& objectIdentifier);
+    // for readers which hold on to the group (subscription cursors), skips the track and group lookup
+    ObjectOrStatus get_object(GroupHandle& groupHandle,
+                              ObjectId objectId,
+                              const std::shared_ptr<ObjectWaiter>& waiter = nullptr);
     std::weak_ptr<TrackHandle> get_track_handle(const TrackIdentifier& trackIdentifier);
     std::weak_ptr<GroupHandle> get_group_handle(const GroupIdentifier& groupIdentifier);
 
@@ -392,10 +593,34 @@ public:
     // returns true if it could succesfully advance
     bool next(ObjectIdentifier& objectIdentifier, std::uint64_t advanceBy = 1);
 
-    DataManager()
+    ObjectCache::Stats get_cache_stats() const noexcept
     {
-        // Remove data directory
-        std::filesystem::remove_all(DATA_DIRECTORY);
+        return objectCache_.get_stats();
     }
+
+    PersistenceStats get_persistence_stats()
+    {
+        return persister_.get_stats();
+    }
+
+    // blocks till every object stored so far (and the hierarchy) has been written to storage
+    void flush_storage()
+    {
+        persister_.flush();
+        manifest_.flush();
+    }
+
+    StorageBackendType get_storage_backend() const noexcept
+    {
+        return storageIo_->type();
+    }
+
+    // nullopt unless the DataManager was constructed with recoverFromStorage_
+    const std::optional<RecoveryStats>& get_recovery_stats() const noexcept
+    {
+        return recoveryStats_;
+    }
+
+    DataManager(DataManagerOptions options = {});
 };
 } // namespace rvn
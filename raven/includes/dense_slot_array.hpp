@@ -0,0 +1,126 @@
+#pragma once
+////////////////////////////////////////////
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Array of T indexed by a dense uint64 id (ObjectId within a group)
+
+    Slots live in fixed size blocks which never move, so a T& handed out stays valid
+    for the lifetime of the array and readers never take a lock:
+        directory (atomic pointer) -> block (atomic pointer) -> slot
+
+    Only growth (new block or bigger directory) takes growMtx_
+    old directories are kept alive till destruction because readers might still be using them
+
+    T must be default constructible, slots are created in their default state
+*/
+template <typename T, std::size_t BlockSizeLog2 = 12> class DenseSlotArray
+{
+    static constexpr std::uint64_t blockSize = 1ULL << BlockSizeLog2;
+    static constexpr std::uint64_t blockMask = blockSize - 1;
+
+    using Block = std::array<T, blockSize>;
+
+    struct Directory
+    {
+        std::uint64_t numBlocks_;
+        std::unique_ptr<std::atomic<Block*>[]> blocks_;
+
+        Directory(std::uint64_t numBlocks)
+        : numBlocks_(numBlocks), blocks_(new std::atomic<Block*>[numBlocks])
+        {
+            for (std::uint64_t i = 0; i < numBlocks_; ++i)
+                blocks_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<Directory*> directory_;
+
+    std::mutex growMtx_;
+    std::vector<std::unique_ptr<Directory>> directories_;
+
+    // index of the last slot which can be created
+    std::uint64_t maxIndex_;
+
+public:
+    DenseSlotArray(std::uint64_t maxIndex = (1ULL << 32) - 1) : maxIndex_(maxIndex)
+    {
+        directories_.push_back(std::make_unique<Directory>(1));
+        directory_.store(directories_.back().get(), std::memory_order_release);
+    }
+
+    ~DenseSlotArray()
+    {
+        // every block is present in the latest directory
+        Directory* directory = directory_.load(std::memory_order_relaxed);
+        for (std::uint64_t i = 0; i < directory->numBlocks_; ++i)
+            delete directory->blocks_[i].load(std::memory_order_relaxed);
+    }
+
+    DenseSlotArray(const DenseSlotArray&) = delete;
+    DenseSlotArray& operator=(const DenseSlotArray&) = delete;
+
+    // lock free, returns nullptr if the slot has not been created
+    T* find(std::uint64_t index) const noexcept
+    {
+        Directory* directory = directory_.load(std::memory_order_acquire);
+
+        std::uint64_t blockIdx = index >> BlockSizeLog2;
+        if (blockIdx >= directory->numBlocks_)
+            return nullptr;
+
+        Block* block = directory->blocks_[blockIdx].load(std::memory_order_acquire);
+        if (block == nullptr)
+            return nullptr;
+
+        return &(*block)[index & blockMask];
+    }
+
+    // returns nullptr if index is larger than maxIndex
+    T* get_or_create(std::uint64_t index)
+    {
+        if (T* slot = find(index); slot != nullptr)
+            return slot;
+
+        if (index > maxIndex_)
+            return nullptr;
+
+        std::lock_guard l(growMtx_);
+
+        std::uint64_t blockIdx = index >> BlockSizeLog2;
+        Directory* directory = directory_.load(std::memory_order_relaxed);
+        if (blockIdx >= directory->numBlocks_)
+        {
+            std::uint64_t numBlocks = directory->numBlocks_;
+            while (numBlocks <= blockIdx)
+                numBlocks *= 2;
+
+            auto newDirectory = std::make_unique<Directory>(numBlocks);
+            for (std::uint64_t i = 0; i < directory->numBlocks_; ++i)
+                newDirectory->blocks_[i].store(directory->blocks_[i].load(std::memory_order_relaxed),
+                                               std::memory_order_relaxed);
+
+            directory = newDirectory.get();
+            directories_.push_back(std::move(newDirectory));
+            directory_.store(directory, std::memory_order_release);
+        }
+
+        Block* block = directory->blocks_[blockIdx].load(std::memory_order_relaxed);
+        if (block == nullptr)
+        {
+            block = new Block();
+            directory->blocks_[blockIdx].store(block, std::memory_order_release);
+        }
+
+        return &(*block)[index & blockMask];
+    }
+};
+} // namespace rvn
@@ -1,8 +1,12 @@
 #pragma once
 ///////////////////////////////////////////////////////////////////////////////
 #include "strong_types.hpp"
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <new>
 #include <optional>
+#include <span>
 #include <utility>
 ///////////////////////////////////////////////////////////////////////////////
 #include <non_contiguous_span.hpp>
@@ -26,11 +30,30 @@ namespace rvn::serialization
 */
 template <typename DeserializedMessageHandler> class Deserializer
 {
+    /*
+        Received buffers, the ones before headIdx_ have been consumed and released
+        (in order: releasing completes a zero copy receive), the consumed prefix is erased
+        once it makes up half the vector, so every buffer is moved O(1) times amortized
+    */
     std::vector<UniqueQuicBuffer> quicBuffers_;
+    std::size_t headIdx_ = 0;
     std::mutex quicBuffersMutex_;
 
-    // begin index in first buffer
+    // begin index in the head buffer
     std::uint64_t beginIndex_ = 0;
+    // bytes from beginIndex_ in the head buffer to the end of the last buffer
+    std::uint64_t size_ = 0;
+
+    /*
+        Zero copy buffers are part of the stream's receive window till they are released, a
+        message larger than the window would never be complete (MsQuic does not indicate more)
+        Past maxReferencedBytes the referenced buffers are copied out and completed, they are
+        always a suffix of the held buffers, so every byte is copied at most once
+        Has to stay below StreamRecvWindowDefault (64 KiB unless configured)
+    */
+    static constexpr std::uint64_t maxReferencedBytes = 32 * 1024;
+    // bytes of the held buffers which reference MsQuic's data
+    std::uint64_t referencedBytes_ = 0;
 
     enum class DeserializerType : bool
     {
@@ -63,16 +86,69 @@ template <typename DeserializedMessageHandler> class Deserializer
     {
         utils::ASSERT_LOG_THROW(numBytes <= size(), "Deserialized more bytes than available",
                                 numBytes, ">", size());
+        size_ -= numBytes;
         // advance begin index
         beginIndex_ += numBytes;
-        auto iter = quicBuffers_.begin();
-        while (iter != quicBuffers_.end() && beginIndex_ >= (*iter)->Length)
+        while (headIdx_ != quicBuffers_.size() && beginIndex_ >= quicBuffers_[headIdx_]->Length)
+        {
+            beginIndex_ -= quicBuffers_[headIdx_]->Length;
+            if (quicBuffers_[headIdx_].get_deleter().references_receive())
+                referencedBytes_ -= quicBuffers_[headIdx_]->Length;
+            quicBuffers_[headIdx_++].reset();
+        }
+
+        if (headIdx_ == quicBuffers_.size())
+        {
+            quicBuffers_.clear();
+            headIdx_ = 0;
+        }
+        else if (headIdx_ * 2 >= quicBuffers_.size())
+        {
+            quicBuffers_.erase(quicBuffers_.begin(), quicBuffers_.begin() + headIdx_);
+            headIdx_ = 0;
+        }
+    }
+
+    // whole buffers are copied, so beginIndex_ stays valid for the head buffer
+    void copy_out_referenced_buffers()
+    {
+        std::size_t firstReferencedIdx = quicBuffers_.size();
+        while (firstReferencedIdx != headIdx_ &&
+               quicBuffers_[firstReferencedIdx - 1].get_deleter().references_receive())
+            --firstReferencedIdx;
+
+        for (std::size_t bufferIdx = firstReferencedIdx; bufferIdx < quicBuffers_.size(); ++bufferIdx)
         {
-            beginIndex_ -= (*iter)->Length;
-            ++iter;
+            const QUIC_BUFFER& buffer = *quicBuffers_[bufferIdx];
+            QUIC_BUFFER* ownedBuffer =
+            static_cast<QUIC_BUFFER*>(malloc(sizeof(QUIC_BUFFER) + buffer.Length));
+            if (ownedBuffer == nullptr)
+                throw std::bad_alloc();
+            ownedBuffer->Length = buffer.Length;
+            ownedBuffer->Buffer = reinterpret_cast<std::uint8_t*>(ownedBuffer) + sizeof(QUIC_BUFFER);
+            std::memcpy(ownedBuffer->Buffer, buffer.Buffer, buffer.Length);
+
+            // releases (completes) the referenced buffer, in order
+            quicBuffers_[bufferIdx] = UniqueQuicBuffer(ownedBuffer, QUIC_BUFFERDeleter());
         }
-        quicBuffers_.erase(quicBuffers_.begin(), iter);
-        cachedSize_ = std::numeric_limits<std::uint64_t>::max();
+        referencedBytes_ = 0;
+    }
+
+    std::span<UniqueQuicBuffer> buffers() noexcept
+    {
+        return std::span<UniqueQuicBuffer>(quicBuffers_).subspan(headIdx_);
+    }
+
+    // the buffers holding the next numBytes (at least one), spans over them do not depend
+    // on how much more has been received
+    std::span<UniqueQuicBuffer> leading_buffers(std::uint64_t numBytes) noexcept
+    {
+        std::size_t endIdx = headIdx_;
+        std::uint64_t bufferedBytes = quicBuffers_[endIdx++]->Length - beginIndex_;
+        while (bufferedBytes < numBytes)
+            bufferedBytes += quicBuffers_[endIdx++]->Length;
+
+        return std::span<UniqueQuicBuffer>(quicBuffers_).subspan(headIdx_, endIdx - headIdx_);
     }
 
     // returns optinal value, std::numeric_limits<std::uint64_t>::max() is the nullopt
@@ -88,7 +164,7 @@ template <typename DeserializedMessageHandler> class Deserializer
             return std::numeric_limits<std::uint64_t>::max();
 
         // get the span
-        NonContiguousSpan span(quicBuffers_, beginIndex_);
+        NonContiguousSpan span(leading_buffers(quicVarIntLength), beginIndex_);
         std::uint64_t quicVarInt;
 
         auto numBytesDeserialized =
@@ -137,7 +213,7 @@ template <typename DeserializedMessageHandler> class Deserializer
             return;
 
         // get the span
-        NonContiguousSpan span(quicBuffers_, beginIndex_);
+        NonContiguousSpan span(leading_buffers(messageLength_), beginIndex_);
 
         std::uint64_t numBytesDeserialized = 0;
 
@@ -159,6 +235,18 @@ template <typename DeserializedMessageHandler> class Deserializer
             numBytesDeserialized = detail::deserialize(msg, span);
             messageHandler_(std::move(msg));
         }
+        else if (messageType_ == MoQtMessageType::SUBSCRIBE_UPDATE)
+        {
+            SubscribeUpdateMessage msg;
+            numBytesDeserialized = detail::deserialize(msg, span);
+            messageHandler_(std::move(msg));
+        }
+        else if (messageType_ == MoQtMessageType::UNSUBSCRIBE)
+        {
+            UnsubscribeMessage msg;
+            numBytesDeserialized = detail::deserialize(msg, span);
+            messageHandler_(std::move(msg));
+        }
         else
         {
             utils::ASSERT_LOG_THROW(false, "Unsuppored message type",
@@ -276,16 +364,9 @@ template <typename DeserializedMessageHandler> class Deserializer
         if (size() < subGroupObjectPayloadLength_)
             return;
 
-        std::string payload;
-        payload.reserve(subGroupObjectPayloadLength_.value());
-        for (std::uint64_t i = 0; i < subGroupObjectPayloadLength_;)
-        {
-            auto bytes = chunked_at(i);
-            i += bytes.size();
-            for (const auto& byte : bytes)
-                payload.push_back(byte);
-        }
-        bytes_deserialized_hook(subGroupObjectPayloadLength_.value());
+        std::string payload(subGroupObjectPayloadLength_.value(), '\0');
+        copy_to(payload.data(), payload.size());
+        bytes_deserialized_hook(payload.size());
 
         auto msg =
         StreamHeaderSubgroupObject{ subGroupObjectId_.value(), std::move(payload) };
@@ -341,7 +422,7 @@ template <typename DeserializedMessageHandler> class Deserializer
 
     void process_state_machine_input()
     {
-        utils::ASSERT_LOG_THROW(quicBuffers_.size(),
+        utils::ASSERT_LOG_THROW(headIdx_ != quicBuffers_.size(),
                                 "Expected at least one buffer");
 
         switch (type_)
@@ -374,58 +455,41 @@ template <typename DeserializedMessageHandler> class Deserializer
         }
     }
 
-    std::uint8_t& at(std::size_t index) const noexcept
+    // O(1) for the bytes of the head buffer (varint prefixes, single bytes)
+    std::uint8_t at(std::size_t index) const noexcept
     {
         index += beginIndex_;
-        std::size_t bufferMaxIdx = quicBuffers_.front()->Length;
-        auto bufferIter = quicBuffers_.begin();
-        while (index >= bufferMaxIdx)
-        {
-            ++bufferIter;
-            bufferMaxIdx += (*bufferIter)->Length;
-        }
+        std::size_t bufferIdx = headIdx_;
+        while (index >= quicBuffers_[bufferIdx]->Length)
+            index -= quicBuffers_[bufferIdx++]->Length;
 
-        return (*bufferIter)->Buffer[index - bufferMaxIdx + (*bufferIter)->Length];
+        return quicBuffers_[bufferIdx]->Buffer[index];
     }
 
-    std::span<const std::uint8_t> chunked_at(std::size_t index) const noexcept
+    // copies the next numBytes (has to be <= size()), one memcpy per buffer
+    void copy_to(char* dest, std::uint64_t numBytes) const noexcept
     {
-        index += beginIndex_;
-        std::size_t bufferMaxIdx = quicBuffers_.front()->Length;
-        auto bufferIter = quicBuffers_.begin();
-        while (index >= bufferMaxIdx)
+        std::uint64_t offset = beginIndex_;
+        for (std::size_t bufferIdx = headIdx_; numBytes != 0; ++bufferIdx)
         {
-            ++bufferIter;
-            bufferMaxIdx += (*bufferIter)->Length;
+            const QUIC_BUFFER& buffer = *quicBuffers_[bufferIdx];
+            std::uint64_t numBytesCopied = std::min<std::uint64_t>(buffer.Length - offset, numBytes);
+            std::memcpy(dest, buffer.Buffer + offset, numBytesCopied);
+            dest += numBytesCopied;
+            numBytes -= numBytesCopied;
+            offset = 0;
         }
-
-        return { std::addressof(
-                 (*bufferIter)->Buffer[index - bufferMaxIdx + (*bufferIter)->Length]),
-                 std::addressof((*bufferIter)->Buffer[(*bufferIter)->Length]) };
     }
 
-    // computing size is a relatively expensive operation, so we cache the size
-    mutable std::uint64_t cachedSize_;
     std::uint64_t size() const noexcept
     {
-        if (cachedSize_ != std::numeric_limits<std::uint64_t>::max())
-            return cachedSize_;
-
-        std::uint64_t totalLen = 0;
-        for (const auto& buffer : quicBuffers_)
-            totalLen += buffer->Length;
-
-        totalLen -= beginIndex_;
-
-        cachedSize_ = totalLen;
-        return totalLen;
+        return size_;
     }
 
 public:
     std::uint64_t numBytesReceived;
     Deserializer(bool isControlStream, DeserializedMessageHandler messageHandler = {})
-    : messageHandler_(messageHandler), dataStreamHeader_(std::nullopt),
-      cachedSize_(std::numeric_limits<std::uint64_t>::max()), numBytesReceived(0)
+    : messageHandler_(messageHandler), dataStreamHeader_(std::nullopt), numBytesReceived(0)
     {
         if (isControlStream)
         {
@@ -441,13 +505,21 @@ public:
 
     void append_buffer(UniqueQuicBuffer buffer)
     {
+        // nothing to read, dropping it right away completes it (in order) in zero copy mode
+        if (buffer->Length == 0)
+            return;
+
         std::unique_lock<std::mutex> lock(quicBuffersMutex_);
-        if (cachedSize_ != std::numeric_limits<std::uint64_t>::max())
-            cachedSize_ += buffer->Length;
+        size_ += buffer->Length;
         numBytesReceived += buffer->Length;
+        if (buffer.get_deleter().references_receive())
+            referencedBytes_ += buffer->Length;
         quicBuffers_.emplace_back(std::move(buffer));
 
         process_state_machine_input();
+
+        if (referencedBytes_ > maxReferencedBytes)
+            copy_out_referenced_buffers();
     }
 };
 } // namespace rvn::serialization
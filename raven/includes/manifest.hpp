@@ -0,0 +1,119 @@
+#pragma once
+////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Append-only manifest of the object hierarchy, used for warm restarts
+
+    The segment logs only know about objects, the manifest records everything else
+    (tracks, groups and subgroup ranges) so that the hierarchy can be rebuilt
+    without walking DATA_DIRECTORY
+
+    Every record is
+        [type (1 byte)][payloadLength (4 bytes)][payload]
+
+        Track    => trackKey, numNamespaces, (length, namespace)..., (length, trackname)
+        Group    => trackKey, groupId, publisherPriority, deliveryTimeout in ms (~0 if none)
+        Subgroup => trackKey, groupId, begin, end
+                    (written on every change of the range, the last one for a begin wins)
+
+    trackKey is a small integer assigned by the DataManager so that groups and
+    subgroups do not repeat the full track name
+
+    Records are produced on hierarchy changes only (not per object), often with a group lock held,
+    so logging only appends to an in memory buffer, flush writes the buffer with one write
+    and syncs it (the write-behind persister flushes before every batch of objects, see write_behind.hpp)
+    a torn record at the tail (crash while writing) is ignored on replay
+*/
+class Manifest
+{
+public:
+    enum class RecordType : std::uint8_t
+    {
+        Track = 1,
+        Group = 2,
+        Subgroup = 3
+    };
+
+    static constexpr std::uint64_t noDeliveryTimeout = ~0ULL;
+
+    struct TrackRecord
+    {
+        std::uint64_t trackKey_;
+        std::vector<std::string> tracknamespace_;
+        std::string trackname_;
+    };
+
+    struct GroupRecord
+    {
+        std::uint64_t trackKey_;
+        std::uint64_t groupId_;
+        std::uint8_t publisherPriority_;
+        std::optional<std::chrono::milliseconds> deliveryTimeout_;
+    };
+
+    struct SubgroupRecord
+    {
+        std::uint64_t trackKey_;
+        std::uint64_t groupId_;
+        std::uint64_t begin_;
+        std::uint64_t end_;
+    };
+
+    // everything in the manifest, in the order it was written
+    struct Contents
+    {
+        std::vector<TrackRecord> tracks_;
+        std::vector<GroupRecord> groups_;
+        std::vector<SubgroupRecord> subgroups_;
+        // bytes up to the end of the last complete record, a torn tail starts here
+        std::uint64_t validLength_ = 0;
+    };
+
+private:
+    // guards pending_
+    std::mutex mtx_;
+    // records logged since the last flush
+    std::string pending_;
+
+    // serializes flushes, guards the members below
+    std::mutex flushMtx_;
+    int fd_ = -1;
+    std::string path_;
+    // log only the first failure, not every record
+    bool writeFailed_ = false;
+
+    void append(RecordType type, std::string_view payload);
+
+public:
+    Manifest() = default;
+    // flushes what is still pending
+    ~Manifest();
+
+    Manifest(const Manifest&) = delete;
+    Manifest& operator=(const Manifest&) = delete;
+
+    // opens (creates if required) the manifest for appending, throws std::runtime_error on failure
+    // records logged before are kept and written by the next flush
+    void open(std::string path);
+
+    // writes (and fdatasyncs) every record logged so far, does nothing till the manifest is open
+    void flush();
+
+    // parses the manifest at path, returns empty contents if there is no manifest
+    static Contents read(const std::string& path);
+
+    void log_track(const TrackRecord& record);
+    void log_group(const GroupRecord& record);
+    void log_subgroup(const SubgroupRecord& record);
+};
+} // namespace rvn
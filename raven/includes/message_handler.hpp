@@ -16,6 +16,8 @@ public:
     void operator()(ClientSetupMessage clientSetupMessage);
     void operator()(ServerSetupMessage serverSetupMessage);
     void operator()(SubscribeMessage subscribeMessage);
+    void operator()(SubscribeUpdateMessage subscribeUpdateMessage);
+    void operator()(UnsubscribeMessage unsubscribeMessage);
     void operator()(StreamHeaderSubgroupObject streamHeaderSubgroupObject);
     void operator()(StreamHeaderSubgroupMessage streamHeaderSubgroupMessage);
 };
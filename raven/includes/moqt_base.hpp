@@ -21,6 +21,23 @@ enum class HostType
     SERVER
 };
 
+/*
+    How the stream callbacks hand received bytes to the deserializer
+    COPY: the bytes are copied out of MsQuic's buffers and the receive completes in the callback
+    ZERO_COPY: the deserializer references MsQuic's buffers, the callback returns QUIC_STATUS_PENDING
+        and every buffer is completed (StreamReceiveComplete) once the deserializer consumed it
+        requires StreamMultiReceiveEnabled: receives keep coming while earlier buffers are held
+        and completions add up in order, without it MsQuic would indicate the held bytes again
+        a message which is not complete yet holds at most 32 KiB of the receive window, beyond that
+        its buffers are copied out and completed (see Deserializer), so StreamRecvWindowDefault
+        must stay above that (the default is 64 KiB)
+*/
+enum class ReceiveMode
+{
+    COPY,
+    ZERO_COPY
+};
+
 class MOQT
 {
 
@@ -78,6 +95,8 @@ public:
     QUIC_SETTINGS* Settings;
     uint32_t SettingsSize; // set along with Settings
     QUIC_CREDENTIAL_CONFIG* CredConfig;
+    // read on every receive, set before any stream is opened
+    ReceiveMode receiveMode_ = ReceiveMode::COPY;
 
     std::uint64_t secondaryCounter;
 
@@ -151,6 +170,9 @@ public:
 
     MOQT& set_controlStreamCb(stream_cb_lamda_t controlStreamCb_);
     MOQT& set_dataStreamCb(stream_cb_lamda_t dataStreamCb_);
+
+    // optional, COPY by default
+    MOQT& set_receiveMode(ReceiveMode receiveMode);
     //////////////////////////////////////////////////////////////////////////
 
     const QUIC_API_TABLE* get_tbl();
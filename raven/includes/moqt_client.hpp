@@ -48,6 +48,18 @@ public:
         connectionState->send_control_buffer(quicBuffer);
     }
 
+    void subscribe_update(SubscribeUpdateMessage&& subscribeUpdateMessage)
+    {
+        QUIC_BUFFER* quicBuffer = serialization::serialize(subscribeUpdateMessage);
+        connectionState->send_control_buffer(quicBuffer);
+    }
+
+    void unsubscribe(UnsubscribeMessage&& unsubscribeMessage)
+    {
+        QUIC_BUFFER* quicBuffer = serialization::serialize(unsubscribeMessage);
+        connectionState->send_control_buffer(quicBuffer);
+    }
+
 
     MOQTClient(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> execConfigTuple = { nullptr, 0 });
 
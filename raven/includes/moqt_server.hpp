@@ -25,9 +25,17 @@ public:
     std::shared_mutex connectionStateMapMtx;
     std::unordered_map<HQUIC, std::shared_ptr<ConnectionState>> connectionStateMap;
 
+    // given to every accepted connection
+    SendFlushPolicy sendFlushPolicy_;
+    SendBackpressurePolicy sendBackpressurePolicy_;
 
+
+    // numSubscriptionThreads: threads the subscriptions are sharded over (by connection)
     MOQTServer(std::shared_ptr<DataManager> dataManager,
-               std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> execConfigTuple = { nullptr, 0 });
+               std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> execConfigTuple = { nullptr, 0 },
+               std::size_t numSubscriptionThreads = 1,
+               SendFlushPolicy sendFlushPolicy = {},
+               SendBackpressurePolicy sendBackpressurePolicy = {});
 
     void start_listener(QUIC_ADDR* LocalAddress);
 
@@ -62,7 +70,8 @@ public:
         std::unique_lock l(connectionStateMapMtx);
         connectionStateMap.emplace(connectionHandle,
                                    std::make_shared<ConnectionState>(std::move(connection),
-                                                                     *this));
+                                                                     *this, sendFlushPolicy_,
+                                                                     sendBackpressurePolicy_));
 
         return QUIC_STATUS_SUCCESS;
     }
@@ -87,5 +96,28 @@ public:
         std::unique_lock l(connectionStateMapMtx);
         connectionStateMap.erase(connection);
     }
+
+    // QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE: the subscriptions of the connection end
+    void shutdown_connection(HQUIC connection)
+    {
+        std::shared_lock l(connectionStateMapMtx);
+        auto iter = connectionStateMap.find(connection);
+        if (iter != connectionStateMap.end())
+            subscriptionManager_->remove_connection(iter->second);
+    }
+
+    /*
+        closing a connection calls back QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE (see shutdown_connection)
+        the connection states are destroyed out of connectionStateMap, which is empty by then
+    */
+    ~MOQTServer()
+    {
+        std::unordered_map<HQUIC, std::shared_ptr<ConnectionState>> connectionStates;
+        {
+            std::unique_lock l(connectionStateMapMtx);
+            connectionStates.swap(connectionStateMap);
+        }
+        connectionStates.clear();
+    }
 };
 } // namespace rvn
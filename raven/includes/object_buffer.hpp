@@ -0,0 +1,252 @@
+#pragma once
+////////////////////////////////////////////
+#include <msquic.h>
+////////////////////////////////////////////
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Serialized object shared between the object cache and every in-flight StreamSend
+
+    Intrusively reference counted so that we can keep zero copy fan-out
+    (every subscriber sends the same QUIC_BUFFER) and still free the buffer once
+    the cache has dropped it and every send of it has completed
+
+    Holders:
+        ObjectCache entry       -> released on eviction / group deletion
+        StreamSendContext       -> released on QUIC_STREAM_EVENT_SEND_COMPLETE
+
+    Objects published in a batch share one ObjectBufferArena,
+    their Buffer points into the arena instead of being allocated separately
+
+    Objects published with a PublishBuffer keep its allocation, Buffer starts
+    at the header which was written into the headroom
+*/
+
+/*
+    Single allocation holding the serialized bytes of a batch of objects
+    Every ObjectBuffer of the batch holds a reference, the memory is freed
+    once all of them have been released (evicting one object of a batch does not free anything)
+
+    The cache copies objects which outlive their batch out of the arena (see ObjectCache),
+    otherwise a single hot object would keep the bytes of the whole batch around
+*/
+class ObjectBufferArena
+{
+    std::uint8_t* data_;
+    std::atomic<std::uint32_t> refCount_;
+    std::uint32_t numObjects_;
+
+    ObjectBufferArena(std::uint8_t* data, std::uint32_t numObjects)
+    : data_(data), refCount_(1), numObjects_(numObjects)
+    {
+    }
+
+    ~ObjectBufferArena()
+    {
+        free(data_);
+    }
+
+public:
+    ObjectBufferArena(const ObjectBufferArena&) = delete;
+    ObjectBufferArena& operator=(const ObjectBufferArena&) = delete;
+
+    // takes ownership of malloc'd data, the returned arena has a reference count of 1
+    static ObjectBufferArena* create(std::uint8_t* data, std::uint32_t numObjects)
+    {
+        return new ObjectBufferArena(data, numObjects);
+    }
+
+    std::uint8_t* data() const noexcept
+    {
+        return data_;
+    }
+
+    void add_ref() noexcept
+    {
+        refCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept
+    {
+        if (refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    // some object of the batch has been released, its bytes are still held by the others
+    bool partly_released() const noexcept
+    {
+        return refCount_.load(std::memory_order_relaxed) < numObjects_;
+    }
+};
+
+class ObjectBuffer
+{
+    // what is handed to StreamSend
+    QUIC_BUFFER quicBuffer_;
+    std::atomic<std::uint32_t> refCount_;
+    // Buffer lives in allocation_ (owned by us, might start before Buffer) or in arena_
+    std::uint8_t* allocation_;
+    ObjectBufferArena* arena_;
+
+    ObjectBuffer(std::uint32_t length,
+                 std::uint8_t* buffer,
+                 std::uint8_t* allocation,
+                 ObjectBufferArena* arena = nullptr)
+    : refCount_(1), allocation_(allocation), arena_(arena)
+    {
+        quicBuffer_.Length = length;
+        quicBuffer_.Buffer = buffer;
+    }
+
+    ~ObjectBuffer()
+    {
+        if (arena_ != nullptr)
+            arena_->release();
+        else
+            free(allocation_);
+    }
+
+public:
+    ObjectBuffer(const ObjectBuffer&) = delete;
+    ObjectBuffer& operator=(const ObjectBuffer&) = delete;
+
+    /*
+        takes ownership of a buffer returned by serialization::serialize
+        the returned ObjectBuffer has a reference count of 1
+    */
+    static ObjectBuffer* create(QUIC_BUFFER* serializedBuffer)
+    {
+        ObjectBuffer* objectBuffer = new ObjectBuffer(serializedBuffer->Length, serializedBuffer->Buffer,
+                                                      serializedBuffer->Buffer);
+        free(serializedBuffer);
+        return objectBuffer;
+    }
+
+    // [offset, offset + length) of the arena, takes a reference on the arena
+    static ObjectBuffer*
+    create(ObjectBufferArena* arena, std::uint64_t offset, std::uint32_t length)
+    {
+        arena->add_ref();
+        return new ObjectBuffer(length, arena->data() + offset, nullptr, arena);
+    }
+
+    // takes ownership of a malloc'd allocation, buffer points somewhere inside it (zero copy publish)
+    static ObjectBuffer* create(std::uint8_t* allocation, std::uint8_t* buffer, std::uint32_t length)
+    {
+        return new ObjectBuffer(length, buffer, allocation);
+    }
+
+    // copy with its own allocation, the copy does not hold an arena
+    static ObjectBuffer* copy(const ObjectBuffer& objectBuffer)
+    {
+        std::uint32_t length = objectBuffer.length();
+        std::uint8_t* allocation = static_cast<std::uint8_t*>(malloc(length));
+        if (allocation == nullptr)
+            throw std::bad_alloc();
+        std::memcpy(allocation, objectBuffer.quicBuffer_.Buffer, length);
+        return new ObjectBuffer(length, allocation, allocation);
+    }
+
+    // the buffer keeps bytes of released objects of its batch alive
+    bool pins_released_arena() const noexcept
+    {
+        return arena_ != nullptr && arena_->partly_released();
+    }
+
+    QUIC_BUFFER* quic_buffer() noexcept
+    {
+        return &quicBuffer_;
+    }
+
+    std::uint32_t length() const noexcept
+    {
+        return quicBuffer_.Length;
+    }
+
+    void add_ref() noexcept
+    {
+        refCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept
+    {
+        // acq_rel: all uses of the buffer happen before it is freed
+        if (refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    std::uint32_t use_count() const noexcept
+    {
+        return refCount_.load(std::memory_order_relaxed);
+    }
+};
+
+// owning reference to an ObjectBuffer (intrusive shared pointer)
+class ObjectBufferRef
+{
+    ObjectBuffer* objectBuffer_;
+
+public:
+    ObjectBufferRef() noexcept : objectBuffer_(nullptr)
+    {
+    }
+
+    // adopts the reference held by objectBuffer (does not increment)
+    explicit ObjectBufferRef(ObjectBuffer* objectBuffer) noexcept
+    : objectBuffer_(objectBuffer)
+    {
+    }
+
+    ObjectBufferRef(const ObjectBufferRef& other) noexcept
+    : objectBuffer_(other.objectBuffer_)
+    {
+        if (objectBuffer_ != nullptr)
+            objectBuffer_->add_ref();
+    }
+
+    ObjectBufferRef(ObjectBufferRef&& other) noexcept
+    : objectBuffer_(std::exchange(other.objectBuffer_, nullptr))
+    {
+    }
+
+    ObjectBufferRef& operator=(ObjectBufferRef other) noexcept
+    {
+        std::swap(objectBuffer_, other.objectBuffer_);
+        return *this;
+    }
+
+    ~ObjectBufferRef()
+    {
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        if (objectBuffer_ != nullptr)
+            std::exchange(objectBuffer_, nullptr)->release();
+    }
+
+    ObjectBuffer* get() const noexcept
+    {
+        return objectBuffer_;
+    }
+
+    ObjectBuffer* operator->() const noexcept
+    {
+        return objectBuffer_;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return objectBuffer_ != nullptr;
+    }
+};
+} // namespace rvn
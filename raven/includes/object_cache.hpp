@@ -0,0 +1,172 @@
+#pragma once
+////////////////////////////////////////////
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+////////////////////////////////////////////
+#include <object_buffer.hpp>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Global cache of serialized objects with a byte budget
+
+    Evicted objects are not lost, they are still in the group's segment log
+    and DataManager::get_object reads them back on a miss
+
+    Eviction policy is CLOCK (second chance):
+        - every hit sets the referenced bit of the entry
+        - newly inserted entries start referenced so the newest objects survive one sweep
+        - the clock hand clears referenced bits until it finds an unreferenced entry to evict
+
+    The cache is split into shards (by key hash) each with its own lock, ring and budget
+    the entries of a group are linked within each shard, dropping a group only visits its own entries
+
+    Entries hold a reference to the ObjectBuffer, eviction only drops that reference,
+    sends which are still in flight keep the buffer alive
+
+    Dirty entries (not yet persisted by the write-behind stage) are pinned,
+    the clock hand skips them till they are marked clean
+
+    Entries are charged only for their own object, an entry of a batch whose other objects
+    have been released would keep their bytes alive (the arena is freed as a whole):
+    the clock hand copies such an entry out of the arena when it gives it a second chance
+*/
+class ObjectCache
+{
+public:
+    struct Key
+    {
+        // unique id of the group (GroupHandle::cacheKey_), not the MOQT GroupId
+        std::uint64_t groupKey_;
+        std::uint64_t objectId_;
+
+        bool operator==(const Key& other) const noexcept
+        {
+            return groupKey_ == other.groupKey_ && objectId_ == other.objectId_;
+        }
+    };
+
+    struct Stats
+    {
+        std::uint64_t hits_;
+        std::uint64_t misses_;
+        std::uint64_t evictions_;
+        std::uint64_t residentBytes_;
+        std::uint64_t budgetBytes_;
+
+        double hit_rate() const noexcept
+        {
+            std::uint64_t lookups = hits_ + misses_;
+            return lookups == 0 ? 0.0 : static_cast<double>(hits_) / lookups;
+        }
+    };
+
+    static constexpr std::uint64_t defaultBudgetBytes = 256ULL << 20; // 256 MiB
+
+private:
+    struct KeyHash
+    {
+        std::uint64_t operator()(const Key& key) const noexcept
+        {
+            // objectIds are dense, mix them so that consecutive objects spread over shards
+            std::uint64_t h = key.groupKey_ * 0x9E3779B97F4A7C15ULL ^ key.objectId_;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            return h;
+        }
+    };
+
+    static constexpr std::size_t noSlot = std::numeric_limits<std::size_t>::max();
+
+    struct Entry
+    {
+        Key key_;
+        ObjectBufferRef buffer_;
+        std::uint64_t numBytes_;
+        bool referenced_;
+        bool occupied_;
+        bool dirty_;
+        // entries of the same group in this shard (doubly linked through ring slots)
+        std::size_t prevInGroup_ = noSlot;
+        std::size_t nextInGroup_ = noSlot;
+    };
+
+    struct Shard
+    {
+        std::mutex mtx_;
+        std::vector<Entry> ring_;
+        std::vector<std::size_t> freeSlots_;
+        std::unordered_map<Key, std::size_t, KeyHash> index_;
+        // groupKey -> first entry of the group in this shard
+        std::unordered_map<std::uint64_t, std::size_t> groupHeads_;
+        std::size_t hand_ = 0;
+        std::uint64_t residentBytes_ = 0;
+    };
+
+    static constexpr std::size_t numShards = 16;
+
+    std::array<Shard, numShards> shards_;
+    std::uint64_t shardBudgetBytes_;
+
+    std::atomic<std::uint64_t> hits_{};
+    std::atomic<std::uint64_t> misses_{};
+    std::atomic<std::uint64_t> evictions_{};
+    std::atomic<std::uint64_t> residentBytes_{};
+
+    Shard& get_shard(const Key& key) noexcept
+    {
+        return shards_[KeyHash{}(key) % numShards];
+    }
+
+    static std::uint64_t buffer_size(const ObjectBufferRef& buffer) noexcept
+    {
+        return sizeof(ObjectBuffer) + buffer->length();
+    }
+
+    // evicts entries from shard till numBytes can fit into it, expects shard lock to be held
+    void make_space(Shard& shard, std::uint64_t numBytes);
+    void remove_entry(Shard& shard, std::size_t slot);
+    void link_group_entry(Shard& shard, std::size_t slot);
+    void unlink_group_entry(Shard& shard, std::size_t slot);
+    // expects shard lock to be held
+    ObjectBufferRef insert(Shard& shard, Key key, ObjectBufferRef buffer, bool dirty);
+
+public:
+    ObjectCache(std::uint64_t budgetBytes = defaultBudgetBytes);
+
+    ObjectCache(const ObjectCache&) = delete;
+    ObjectCache& operator=(const ObjectCache&) = delete;
+
+    // returns empty reference on miss
+    ObjectBufferRef get(Key key);
+
+    // if key was already present, the already cached buffer is returned
+    ObjectBufferRef put(Key key, ObjectBufferRef buffer, bool dirty = false);
+
+    /*
+        puts objects firstObjectId, firstObjectId + 1, ... of a group,
+        every shard is locked once for the whole batch
+        buffers which were already cached are replaced by the cached ones
+    */
+    void put_batch(std::uint64_t groupKey,
+                   std::uint64_t firstObjectId,
+                   std::span<ObjectBufferRef> buffers,
+                   bool dirty = false);
+
+    // object has been persisted, entry can be evicted from now on
+    void mark_clean(Key key);
+
+    // drops all entries of a group
+    void erase_group(std::uint64_t groupKey);
+
+    Stats get_stats() const noexcept;
+};
+} // namespace rvn
@@ -0,0 +1,101 @@
+#pragma once
+////////////////////////////////////////////
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <utility>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Payload buffer for the zero copy publish path (SubgroupHandle::add_object(PublishBuffer))
+
+    Memory is allocated with headroom in front of the payload:
+        [headroom][payload ................ capacity]
+                  ^ data()
+
+    The publisher fills the payload in place, Raven then writes the wire header
+    (objectId, payload length) into the headroom right before the payload
+    and hands [header][payload] to StreamSend as is, the payload is never copied
+*/
+class PublishBuffer
+{
+    std::uint8_t* allocation_;
+    std::uint64_t capacity_;
+    std::uint64_t size_;
+
+public:
+    // StreamHeaderSubgroupObject header: objectId and payload length, 8 byte var ints at most
+    static constexpr std::uint64_t headroom = 16;
+
+    PublishBuffer() noexcept : allocation_(nullptr), capacity_(0), size_(0)
+    {
+    }
+
+    // payload capacity, size starts at capacity (call resize if less is written)
+    explicit PublishBuffer(std::uint64_t capacity)
+    : allocation_(static_cast<std::uint8_t*>(malloc(headroom + capacity))),
+      capacity_(capacity), size_(capacity)
+    {
+        if (allocation_ == nullptr)
+            throw std::bad_alloc();
+    }
+
+    PublishBuffer(const PublishBuffer&) = delete;
+    PublishBuffer& operator=(const PublishBuffer&) = delete;
+
+    PublishBuffer(PublishBuffer&& other) noexcept
+    : allocation_(std::exchange(other.allocation_, nullptr)),
+      capacity_(std::exchange(other.capacity_, 0)), size_(std::exchange(other.size_, 0))
+    {
+    }
+
+    PublishBuffer& operator=(PublishBuffer&& other) noexcept
+    {
+        std::swap(allocation_, other.allocation_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    ~PublishBuffer()
+    {
+        free(allocation_);
+    }
+
+    std::uint8_t* data() const noexcept
+    {
+        return allocation_ + headroom;
+    }
+
+    std::uint64_t size() const noexcept
+    {
+        return size_;
+    }
+
+    std::uint64_t capacity() const noexcept
+    {
+        return capacity_;
+    }
+
+    // newSize must not be larger than capacity
+    void resize(std::uint64_t newSize) noexcept
+    {
+        size_ = newSize;
+    }
+
+    std::span<std::uint8_t> payload() const noexcept
+    {
+        return { data(), size_ };
+    }
+
+    // gives up ownership of the allocation (free with free())
+    std::uint8_t* release() noexcept
+    {
+        capacity_ = size_ = 0;
+        return std::exchange(allocation_, nullptr);
+    }
+};
+} // namespace rvn
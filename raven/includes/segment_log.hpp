@@ -0,0 +1,246 @@
+#pragma once
+////////////////////////////////////////////
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+////////////////////////////////////////////
+#include <storage_io.hpp>
+#include <strong_types.hpp>
+////////////////////////////////////////////
+#include <sys/uio.h>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Open file descriptors of the segment logs, shared by all of them
+
+    A server publishes into ever new groups, one fd per group for its whole lifetime would run
+    into RLIMIT_NOFILE, so at most maxOpenFiles segment files are kept open (LRU)
+    a file is opened on its first write or read and closed once it has not been used for a while,
+    the group which is being written stays at the front
+
+    A Lease pins the fd while a write or read of it is in flight, pinned files are never closed
+    (if all of them are pinned we go over maxOpenFiles for a moment)
+*/
+class SegmentFiles
+{
+    struct Entry
+    {
+        const void* owner_;
+        int fd_;
+        std::uint32_t numLeases_;
+        // the owner is gone, close once the last lease is dropped
+        bool closePending_;
+    };
+
+    std::mutex mtx_;
+    // most recently used at the front
+    std::list<Entry> lru_;
+    std::unordered_map<const void*, std::list<Entry>::iterator> entries_;
+    std::size_t maxOpenFiles_;
+
+    // closes least recently used files which are not pinned till at most maxOpenFiles are open
+    void shrink(std::size_t maxOpenFiles);
+    void release(std::list<Entry>::iterator iter);
+
+public:
+    static constexpr std::size_t defaultMaxOpenFiles = 256;
+
+    class Lease
+    {
+        friend class SegmentFiles;
+
+        SegmentFiles* segmentFiles_ = nullptr;
+        std::list<Entry>::iterator iter_;
+
+        Lease(SegmentFiles* segmentFiles, std::list<Entry>::iterator iter)
+        : segmentFiles_(segmentFiles), iter_(iter)
+        {
+        }
+
+    public:
+        Lease() = default;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        // -1 if the file could not be opened
+        int fd() const noexcept
+        {
+            return segmentFiles_ == nullptr ? -1 : iter_->fd_;
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return segmentFiles_ != nullptr;
+        }
+    };
+
+    SegmentFiles(std::size_t maxOpenFiles = defaultMaxOpenFiles);
+    ~SegmentFiles();
+
+    SegmentFiles(const SegmentFiles&) = delete;
+    SegmentFiles& operator=(const SegmentFiles&) = delete;
+
+    // opens (creates if required) the file of owner at path unless it is open already
+    // returns an empty lease if it could not be opened
+    Lease acquire(const void* owner, const std::string& path);
+
+    // the owner is gone, its file is closed (once no lease of it is left)
+    void close(const void* owner);
+
+    std::size_t num_open_files();
+};
+
+/*
+    Append-only log of objects of a single group
+
+    Every object is stored as one record appended at the end of the segment file
+        [magic (4 bytes)][crc (4 bytes)][objectId (8 bytes)][payloadLength (8 bytes)][payload]
+
+    crc is the CRC-32C of objectId and payloadLength, a hole in the file (e.g. space reserved
+    by a batch which was never written) reads as zeros and fails the magic, garbage fails the crc
+
+    The header lets the index be rebuilt by a sequential scan of the file,
+    the in memory index maps objectId -> (payload offset, payload length)
+
+    store  => one vectored write at the tail of the file (for a single object or a whole batch)
+    lookup => one read at the offset from the index
+
+    The actual I/O goes through StorageIo (posix or io_uring), batches of several
+    segment logs can be prepared and submitted to the backend together
+
+    The segment file is only opened while it is used (see SegmentFiles)
+
+    Object ids within a group are dense (subgroups are contiguous ranges starting at 0)
+    so the index is a vector indexed by objectId
+*/
+class SegmentLog
+{
+public:
+    struct RecordHeader
+    {
+        static constexpr std::uint32_t recordMagic = 0x5256534c; // "RVSL"
+
+        std::uint32_t magic_;
+        std::uint32_t crc_;
+        std::uint64_t objectId_;
+        std::uint64_t payloadLength_;
+
+        static RecordHeader make(std::uint64_t objectId, std::uint64_t payloadLength) noexcept;
+        bool is_valid() const noexcept;
+    };
+
+    struct Record
+    {
+        ObjectId objectId_;
+        std::string_view payload_;
+    };
+
+    // space reserved at the tail and the iovecs to fill it, see prepare_batch
+    class PreparedBatch
+    {
+        friend class SegmentLog;
+
+        std::span<const Record> records_;
+        std::vector<RecordHeader> headers_;
+        std::vector<iovec> iov_;
+        std::uint64_t batchOffset_ = 0;
+        std::uint64_t batchSize_ = 0;
+        // keeps the segment file open till the batch is committed or aborted
+        SegmentFiles::Lease lease_;
+
+    public:
+        PreparedBatch() = default;
+        // iov_ points into headers_
+        PreparedBatch(const PreparedBatch&) = delete;
+        PreparedBatch& operator=(const PreparedBatch&) = delete;
+        PreparedBatch(PreparedBatch&&) = default;
+        PreparedBatch& operator=(PreparedBatch&&) = default;
+    };
+
+private:
+    struct IndexEntry
+    {
+        // offset of the payload (not the record header) in the segment file
+        std::uint64_t offset_;
+        std::uint64_t length_;
+
+        static constexpr std::uint64_t invalidOffset = ~0ULL;
+        bool is_valid() const noexcept
+        {
+            return offset_ != invalidOffset;
+        }
+    };
+
+    StorageIo& storageIo_;
+    SegmentFiles& segmentFiles_;
+    std::string path_;
+
+    // guards index_ and tailOffset_
+    mutable std::shared_mutex indexMtx_;
+    std::vector<IndexEntry> index_;
+    std::uint64_t tailOffset_;
+
+public:
+    // the segment file at path is created by the first append
+    SegmentLog(std::string path, StorageIo& storageIo, SegmentFiles& segmentFiles);
+    ~SegmentLog();
+
+    SegmentLog(const SegmentLog&) = delete;
+    SegmentLog& operator=(const SegmentLog&) = delete;
+
+    // returns false if the record could not be written
+    bool append(ObjectId objectId, std::string_view payload);
+
+    // appends all records with a single sequential write
+    bool append_batch(std::span<const Record> records);
+
+    /*
+        Split append_batch, lets the caller submit writes of many segment logs in one go
+            prepared = prepare_batch(records)        -> reserves space at the tail
+            storageIo.write_batch(... write_request(prepared) ...)
+            commit_batch(prepared) on success        -> records become readable
+            abort_batch(prepared) on failure         -> the reserved space is given back
+        records (and their payloads) must stay alive till commit_batch
+        if the segment file can not be opened the write request fails (fd -1)
+    */
+    PreparedBatch prepare_batch(std::span<const Record> records);
+    StorageWriteRequest write_request(PreparedBatch& batch) const noexcept;
+    void commit_batch(const PreparedBatch& batch);
+    // false if a later batch has been reserved meanwhile, the space stays a hole (recovery stops there)
+    bool abort_batch(const PreparedBatch& batch);
+
+    // returns nullopt if the object has not been appended
+    std::optional<std::string> read(ObjectId objectId) const;
+
+    bool contains(ObjectId objectId) const;
+
+    std::uint64_t size_bytes() const;
+
+    /*
+        Rebuilds the index by scanning the segment file (warm restart)
+        stops at the first torn or invalid record (see RecordHeader),
+        anything after it is overwritten by later appends
+        returns the number of records recovered
+    */
+    std::uint64_t recover();
+
+    // one past the largest object id in the index
+    std::uint64_t end_object_id() const;
+    const std::string& path() const noexcept
+    {
+        return path_;
+    }
+};
+} // namespace rvn
@@ -290,6 +290,39 @@ deserialize(rvn::SubscribeMessage& subscribeMessage, ConstSpan& span, NetworkEnd
     return deserializedBytes;
 }
 
+template <typename ConstSpan>
+static inline deserialize_return_t
+deserialize(rvn::SubscribeUpdateMessage& subscribeUpdateMessage, ConstSpan& span, NetworkEndian = network_endian)
+{
+    std::uint64_t deserializedBytes = 0;
+
+    deserializedBytes +=
+    deserialize<ds::quic_var_int>(subscribeUpdateMessage.subscribeId_, span);
+    deserializedBytes +=
+    deserialize<ds::quic_var_int>(subscribeUpdateMessage.start_.group_.get(), span);
+    deserializedBytes +=
+    deserialize<ds::quic_var_int>(subscribeUpdateMessage.start_.object_.get(), span);
+
+    // EndGroup is end group + 1, 0 is an open ended subscription
+    // EndObject 0 is the whole end group
+    std::uint64_t endGroup, endObject;
+    deserializedBytes += deserialize<ds::quic_var_int>(endGroup, span);
+    deserializedBytes += deserialize<ds::quic_var_int>(endObject, span);
+    if (endGroup != 0)
+        subscribeUpdateMessage.end_.emplace(GroupId(endGroup - 1),
+                                            endObject != 0 ? ObjectId(endObject) :
+                                                             SubscribeUpdateMessage::endOfGroup);
+    else
+        subscribeUpdateMessage.end_.reset();
+
+    deserializedBytes +=
+    deserialize_trivial<std::uint8_t>(subscribeUpdateMessage.subscriberPriority_, span);
+
+    deserializedBytes += deserialize_params(subscribeUpdateMessage.parameters_, span);
+
+    return deserializedBytes;
+}
+
 template <typename ConstSpan>
 static inline deserialize_return_t
 deserialize(rvn::SubscribeErrorMessage& subscribeErrorMessage, ConstSpan& span, NetworkEndian = network_endian)
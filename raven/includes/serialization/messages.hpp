@@ -7,6 +7,7 @@
 #include <strong_types.hpp>
 #include <utilities.hpp>
 ////////////////////////////////////////////
+#include <limits>
 #include <optional>
 #include <ostream>
 #include <string>
@@ -248,12 +249,15 @@ struct SubscribeMessage : public ControlMessageBase<SubscribeMessage>
     std::vector<std::string> trackNamespace_;
     std::string trackName_;
     std::uint8_t subscriberPriority_;
+    // 0x0: publisher's order (ascending), 0x1: ascending, 0x2: descending
     std::uint8_t groupOrder_;
     FilterType filterType_;
     std::optional<GroupObjectPair> start_;
     std::optional<GroupObjectPair> end_;
     std::vector<Parameter> parameters_;
 
+    static constexpr std::uint8_t groupOrderDescending = 0x2;
+
     SubscribeMessage() : ControlMessageBase(MoQtMessageType::SUBSCRIBE)
     {
     }
@@ -322,14 +326,50 @@ struct GoAwayMessage
       Subscribe Parameters (..) ...
     }
 */
-struct SubscribeUpdateMessage
+struct SubscribeUpdateMessage : public ControlMessageBase<SubscribeUpdateMessage>
 {
-    iType subscribeId;
-    iType trackAlias;
-    iType group;
-    iType object;
-    // iType numberOfParameters;
-    std::vector<Parameter> params;
+    using GroupObjectPair = SubscribeMessage::GroupObjectPair;
+
+    std::uint64_t subscribeId_;
+    GroupObjectPair start_;
+    // nullopt: open ended, on the wire EndGroup is the end group + 1 and 0 means open ended
+    // the end object itself is not sent (EndObject is the last object + 1)
+    // end_->object_ == endOfGroup: the whole end group, EndObject 0 on the wire
+    std::optional<GroupObjectPair> end_;
+    std::uint8_t subscriberPriority_;
+    std::vector<Parameter> parameters_;
+
+    static constexpr ObjectId endOfGroup{ std::numeric_limits<std::uint64_t>::max() };
+
+    SubscribeUpdateMessage() : ControlMessageBase(MoQtMessageType::SUBSCRIBE_UPDATE)
+    {
+    }
+
+    bool operator==(const SubscribeUpdateMessage& rhs) const
+    {
+        bool isEqual = true;
+
+        isEqual &= subscribeId_ == rhs.subscribeId_;
+        isEqual &= start_ == rhs.start_;
+        isEqual &= utils::optional_equality(end_, rhs.end_);
+        isEqual &= subscriberPriority_ == rhs.subscriberPriority_;
+        isEqual &= parameters_ == rhs.parameters_;
+
+        return isEqual;
+    }
+
+    friend inline std::ostream& operator<<(std::ostream& os, const SubscribeUpdateMessage& msg)
+    {
+        os << "SubscribeId: " << msg.subscribeId_ << " Start: " << msg.start_.group_.get()
+           << " " << msg.start_.object_.get() << " End: "
+           << (msg.end_.has_value() ? std::to_string(msg.end_->group_.get()) + " " +
+                                      std::to_string(msg.end_->object_.get()) :
+                                      "None")
+           << " SubscriberPriority: " << int(msg.subscriberPriority_) << " Parameters: ";
+        for (const auto& parameter : msg.parameters_)
+            os << parameter;
+        return os;
+    }
 };
 
 /*
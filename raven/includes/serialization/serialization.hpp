@@ -3,6 +3,7 @@
 #include <msquic.h>
 
 ///////////////////////////////////c
+#include <bit>
 #include <cassert>
 #include <cstdint>
 #include <serialization/chunk.hpp>
@@ -89,6 +90,45 @@ constexpr guess_size_t guess_size(const std::string& s)
 }
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/*
+    Writes the StreamHeaderSubgroupObject header (objectId, payload length) so that it ends at headerEnd,
+    used to serialize an object in place in front of its payload (see PublishBuffer)
+    returns the header length (at most 16 bytes)
+*/
+inline std::uint64_t
+serialize_subgroup_object_header(std::uint8_t* headerEnd, std::uint64_t objectId, std::uint64_t payloadLength)
+{
+    // quic var int, big endian with the length in the top two bits
+    auto write_var_int = [](std::uint8_t* dest, ds::quic_var_int i)
+    {
+        std::uint8_t size = i.size();
+        std::uint64_t value = i.get();
+        for (std::uint8_t byte = size; byte > 0; --byte, value >>= 8)
+            dest[byte - 1] = value & 0xff;
+
+        // 0b00, 0b01, 0b10, 0b11 for 1, 2, 4, 8 bytes
+        dest[0] |= std::uint8_t(std::countr_zero(size)) << 6;
+    };
+
+    ds::quic_var_int objectIdVarInt(objectId), payloadLengthVarInt(payloadLength);
+    std::uint64_t headerLength = objectIdVarInt.size() + payloadLengthVarInt.size();
+
+    std::uint8_t* headerBegin = headerEnd - headerLength;
+    write_var_int(headerBegin, objectIdVarInt);
+    write_var_int(headerBegin + objectIdVarInt.size(), payloadLengthVarInt);
+
+    return headerLength;
+}
+
+// appends to an existing chunk (used to serialize many messages into one allocation)
+// returns number of bytes appended
+template <typename... Args> std::uint64_t serialize_into(ds::chunk& c, Args&&... args)
+{
+    std::uint64_t beginSize = c.size();
+    (detail::serialize(c, args), ...);
+    return c.size() - beginSize;
+}
+
 template <typename... Args> QUIC_BUFFER* serialize(Args&&... args)
 {
     ds::chunk c;
@@ -138,6 +138,7 @@ template <UnsignedInteger T>
  serialize_return_t serialize(ds::chunk& c, const rvn::ClientSetupMessage& clientSetupMessage);
  serialize_return_t serialize(ds::chunk& c, const rvn::ServerSetupMessage& serverSetupMessage);
  serialize_return_t serialize(ds::chunk& c, const rvn::SubscribeMessage& subscribeMessage);
+ serialize_return_t serialize(ds::chunk& c, const rvn::SubscribeUpdateMessage& subscribeUpdateMessage);
  serialize_return_t serialize(ds::chunk& c, const StreamHeaderSubgroupMessage& msg);
  serialize_return_t serialize(ds::chunk& c, const StreamHeaderSubgroupObject& msg);
  serialize_return_t serialize(ds::chunk& c, const rvn::SubscribeErrorMessage& subscribeErrorMessage);
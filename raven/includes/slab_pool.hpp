@@ -0,0 +1,160 @@
+#pragma once
+////////////////////////////////////////////
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Pool of T with stable addresses, slots are carved out of slabs of SlabSize slots
+
+    Slabs are never freed before the pool, freed slots go on a free list and are reused,
+    so creating and destroying objects does not go to the heap once the pool is warm
+    and objects created one after the other sit next to each other
+
+    Every slot remembers its pool, an object can be destroyed through any pool
+    (e.g. by another thread which took it over)
+    Returning a slot is lock free: it is pushed on the returned_ stack (objects are often destroyed
+    on other threads than the ones creating them, e.g. MsQuic workers completing sends)
+    Taking a slot holds freeMtx_ (never while constructing / destroying), once the free list runs
+    dry the whole returned_ stack is taken over at once, the stack is only ever pushed to and
+    emptied as a whole so there is no ABA
+
+    All objects have to be destroyed before the pool is, unless the pool is owned through a Handle:
+    then the pool is deleted once the handle and every object created from it are gone
+*/
+template <typename T, std::size_t SlabSize = 256> class SlabPool
+{
+    struct Slot
+    {
+        SlabPool* pool_;
+        union
+        {
+            Slot* nextFree_;
+            alignas(T) unsigned char storage_[sizeof(T)];
+        };
+    };
+
+    std::mutex freeMtx_;
+    Slot* freeList_;
+    std::atomic<Slot*> returned_;
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    // objects alive plus one for the owner
+    std::atomic<std::size_t> refs_;
+
+    static Slot* to_slot(T* object) noexcept
+    {
+        return reinterpret_cast<Slot*>(reinterpret_cast<unsigned char*>(object) - offsetof(Slot, storage_));
+    }
+
+    Slot* take_slot()
+    {
+        std::lock_guard l(freeMtx_);
+        if (freeList_ == nullptr)
+            freeList_ = returned_.exchange(nullptr, std::memory_order_acquire);
+
+        if (freeList_ == nullptr)
+        {
+            slabs_.push_back(std::make_unique<Slot[]>(SlabSize));
+            Slot* slab = slabs_.back().get();
+            // handed out in address order
+            for (std::size_t i = SlabSize; i-- > 0;)
+            {
+                slab[i].pool_ = this;
+                slab[i].nextFree_ = freeList_;
+                freeList_ = slab + i;
+            }
+        }
+
+        Slot* slot = freeList_;
+        freeList_ = slot->nextFree_;
+        return slot;
+    }
+
+    void return_slot(Slot* slot) noexcept
+    {
+        Slot* head = returned_.load(std::memory_order_relaxed);
+        do
+            slot->nextFree_ = head;
+        while (!returned_.compare_exchange_weak(head, slot, std::memory_order_release,
+                                                std::memory_order_relaxed));
+    }
+
+public:
+    SlabPool() : freeList_(nullptr), returned_(nullptr), refs_(1)
+    {
+    }
+
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+
+    template <typename... Args> T* create(Args&&... args)
+    {
+        Slot* slot = take_slot();
+        T* object;
+        try
+        {
+            object = ::new (static_cast<void*>(slot->storage_)) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            return_slot(slot);
+            throw;
+        }
+        refs_.fetch_add(1, std::memory_order_relaxed);
+        return object;
+    }
+
+    // returns the slot to the pool it was created from
+    static void destroy(T* object) noexcept
+    {
+        Slot* slot = to_slot(object);
+        SlabPool* pool = slot->pool_;
+        object->~T();
+        pool->return_slot(slot);
+        pool->release();
+    }
+
+    /*
+        Owning handle of a heap allocated pool, for objects which may be destroyed after
+        their owner is gone (e.g. contexts destroyed by MsQuic events delivered after the connection)
+    */
+    class Handle
+    {
+        SlabPool* pool_;
+
+    public:
+        Handle() : pool_(new SlabPool())
+        {
+        }
+
+        ~Handle()
+        {
+            pool_->release();
+        }
+
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+
+        SlabPool* operator->() const noexcept
+        {
+            return pool_;
+        }
+    };
+
+private:
+    // the last reference of a pool owned by a Handle deletes it
+    void release() noexcept
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+};
+} // namespace rvn
@@ -0,0 +1,87 @@
+#pragma once
+////////////////////////////////////////////
+#include <cstdint>
+#include <memory>
+#include <span>
+////////////////////////////////////////////
+#include <sys/uio.h>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Storage I/O backend used by SegmentLog
+
+    Posix   -> pwritev / fdatasync / pread, one syscall per request
+    IoUring -> (liburing, Linux only, needs RAVEN_WITH_IO_URING at build time)
+               all writes (or syncs) of a batch are submitted together and reaped together,
+               reads use a ring of their own (concurrent cold reads are submitted together)
+
+    Backend is selected at runtime (DataManagerOptions::storageBackend_),
+    if io_uring is not compiled in or the ring can not be set up we fall back to Posix
+*/
+enum class StorageBackendType
+{
+    Posix,
+    IoUring
+};
+
+// vectored write of a complete byte range
+struct StorageWriteRequest
+{
+    int fd_;
+    // consumed (advanced) while writing
+    iovec* iov_;
+    int iovCnt_;
+    std::uint64_t offset_;
+    // set by write_batch
+    bool success_ = false;
+};
+
+// makes the written data of a file durable (fdatasync)
+struct StorageSyncRequest
+{
+    int fd_;
+    // set by sync_batch
+    bool success_ = false;
+};
+
+class StorageIo
+{
+public:
+    virtual ~StorageIo() = default;
+
+    virtual StorageBackendType type() const noexcept = 0;
+
+    // writes every request fully (retrying short writes), returns true if all of them succeeded
+    virtual bool write_batch(std::span<StorageWriteRequest> requests) = 0;
+
+    // syncs every file, returns true if all of them succeeded
+    virtual bool sync_batch(std::span<StorageSyncRequest> requests) = 0;
+
+    // reads exactly length bytes, returns false on error or end of file
+    virtual bool read(int fd, void* buffer, std::uint64_t length, std::uint64_t offset) = 0;
+};
+
+namespace detail
+{
+    // skips the first numBytes of the iovec array (after a short write)
+    inline void advance_iovecs(iovec*& iov, int& iovCnt, std::uint64_t numBytes) noexcept
+    {
+        while (iovCnt > 0 && numBytes >= iov->iov_len)
+        {
+            numBytes -= iov->iov_len;
+            ++iov;
+            --iovCnt;
+        }
+        if (iovCnt > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + numBytes;
+            iov->iov_len -= numBytes;
+        }
+    }
+} // namespace detail
+
+// never returns nullptr, falls back to Posix
+std::unique_ptr<StorageIo> make_storage_io(StorageBackendType type);
+} // namespace rvn
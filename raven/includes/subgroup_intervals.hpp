@@ -0,0 +1,154 @@
+#pragma once
+////////////////////////////////////////////
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    ObjectId ranges of the subgroups of a group
+
+    Subgroups are only ever appended after the last one, so the ranges are sorted by begin
+    and we can keep them in a flat vector and binary search them
+
+        subgroup 0     subgroup 1     subgroup 2
+        [b0     e0)    [b1     e1)    [b2     e2)       b(i+1) == e(i) unless subgroup i was capped early
+
+    prefixNumObjects_[i] is the number of object ids in subgroups [0, i)
+    which gives us the number of objects in any range in O(log n)
+
+    An open ended subgroup has end = std::numeric_limits<std::uint64_t>::max()
+
+    Not thread safe, GroupHandle::objectIdsMtx_ protects it
+*/
+class SubgroupIntervals
+{
+    struct Interval
+    {
+        std::uint64_t begin_;
+        std::uint64_t end_;
+    };
+
+    std::vector<Interval> intervals_;
+    std::vector<std::uint64_t> prefixNumObjects_;
+
+    // index of the last subgroup with begin <= objectId, size() if there is none
+    std::size_t lower_subgroup(std::uint64_t objectId) const noexcept
+    {
+        auto iter = std::upper_bound(intervals_.begin(), intervals_.end(), objectId,
+                                     [](std::uint64_t objectId, const Interval& interval)
+                                     { return objectId < interval.begin_; });
+
+        if (iter == intervals_.begin())
+            return intervals_.size();
+        return std::distance(intervals_.begin(), iter) - 1;
+    }
+
+    // number of object ids which belong to a subgroup and are < objectId
+    std::uint64_t num_objects_below(std::uint64_t objectId) const noexcept
+    {
+        std::size_t idx = lower_subgroup(objectId);
+        if (idx == intervals_.size())
+            return 0;
+
+        const Interval& interval = intervals_[idx];
+        return prefixNumObjects_[idx] + (std::min(objectId, interval.end_) - interval.begin_);
+    }
+
+public:
+    bool empty() const noexcept
+    {
+        return intervals_.empty();
+    }
+
+    std::size_t num_subgroups() const noexcept
+    {
+        return intervals_.size();
+    }
+
+    std::uint64_t first_object_id() const noexcept
+    {
+        return intervals_.front().begin_;
+    }
+
+    std::uint64_t subgroup_begin(std::size_t subgroupIdx) const noexcept
+    {
+        return intervals_[subgroupIdx].begin_;
+    }
+
+    std::uint64_t subgroup_end(std::size_t subgroupIdx) const noexcept
+    {
+        return intervals_[subgroupIdx].end_;
+    }
+
+    // end of the last subgroup (begin of the next subgroup to be added)
+    std::uint64_t end_object_id() const noexcept
+    {
+        return intervals_.empty() ? 0 : intervals_.back().end_;
+    }
+
+    // appends subgroup [begin, end), begin must not be smaller than end_object_id()
+    std::size_t append(std::uint64_t begin, std::uint64_t end)
+    {
+        std::uint64_t prefix = 0;
+        if (!intervals_.empty())
+            prefix = prefixNumObjects_.back() + (intervals_.back().end_ - intervals_.back().begin_);
+
+        intervals_.push_back({ begin, end });
+        prefixNumObjects_.push_back(prefix);
+        return intervals_.size() - 1;
+    }
+
+    // changes end of the subgroup beginning at begin, returns false if there is no such subgroup
+    bool set_end(std::uint64_t begin, std::uint64_t end)
+    {
+        std::size_t idx = lower_subgroup(begin);
+        if (idx == intervals_.size() || intervals_[idx].begin_ != begin)
+            return false;
+
+        intervals_[idx].end_ = end;
+
+        // generally it is the last subgroup being capped, so this loop does not run
+        for (std::size_t i = idx + 1; i < intervals_.size(); ++i)
+            prefixNumObjects_[i] =
+            prefixNumObjects_[i - 1] + (intervals_[i - 1].end_ - intervals_[i - 1].begin_);
+
+        return true;
+    }
+
+    // subgroup which contains objectId
+    std::optional<std::size_t> find(std::uint64_t objectId) const noexcept
+    {
+        std::size_t idx = lower_subgroup(objectId);
+        if (idx == intervals_.size() || objectId >= intervals_[idx].end_)
+            return std::nullopt;
+        return idx;
+    }
+
+    std::size_t subgroup_index(std::uint64_t objectId) const
+    {
+        std::optional<std::size_t> idx = find(objectId);
+        if (!idx.has_value())
+            throw std::invalid_argument("ObjectId not found in GroupHandle");
+        return *idx;
+    }
+
+    bool contains(std::uint64_t objectId) const noexcept
+    {
+        return find(objectId).has_value();
+    }
+
+    // number of object ids in [left, right) that belong to some subgroup
+    std::uint64_t num_objects_in_range(std::uint64_t left, std::uint64_t right) const noexcept
+    {
+        if (right <= left)
+            return 0;
+        return num_objects_below(right) - num_objects_below(left);
+    }
+};
+} // namespace rvn
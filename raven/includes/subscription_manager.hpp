@@ -1,13 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <data_manager.hpp>
 #include <definitions.hpp>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <serialization/messages.hpp>
 #include <serialization/serialization.hpp>
+#include <slab_pool.hpp>
 #include <strong_types.hpp>
+#include <unordered_map>
 #include <utilities.hpp>
+#include <variant>
 
 namespace rvn
 {
@@ -27,33 +34,183 @@ struct SubscriptionStateErr
 using FulfillSomeReturn =
 std::variant<bool, SubscriptionStateErr::ConnectionExpired, SubscriptionStateErr::ObjectDoesNotExist>;
 
-// Each stream corresponds to one minor subscription state
+class SubscriptionState;
+class SubscriptionWaiter;
+
+// the connection has been shut down (QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE), all its subscriptions end
+struct ConnectionShutdown
+{
+    // only used as a key, the queue keeps it from being reused before the message is handled
+    const ConnectionState* connectionState_;
+};
+
+// SUBSCRIBE creates a subscription, the others are routed to existing ones
+using SubscriptionQueueMessage =
+std::variant<SubscribeMessage, SubscribeUpdateMessage, UnsubscribeMessage, ConnectionShutdown>;
+
+// a subscription is identified by its connection and the subscriber's subscribe id
+struct SubscriptionKey
+{
+    const ConnectionState* connectionState_;
+    std::uint64_t subscribeId_;
+
+    bool operator==(const SubscriptionKey&) const = default;
+
+    struct Hash
+    {
+        std::uint64_t operator()(const SubscriptionKey& key) const noexcept
+        {
+            std::uint64_t hash =
+            reinterpret_cast<std::uintptr_t>(key.connectionState_) * 0x9E3779B97F4A7C15ULL;
+            hash ^= key.subscribeId_ * 0xC2B2AE3D27D4EB4FULL;
+            return hash ^ (hash >> 32);
+        }
+    };
+};
+
+/*
+    Ready list of one subscription thread
+
+    Publishers push the subscriptions whose awaited object became Ready,
+    a thread with nothing to do parks on wakeupSeq_ (atomic wait, a futex on linux)
+    and is woken up by a push, a new subscription or shutdown
+*/
+class ReadyList
+{
+    std::mutex mtx_;
+    std::vector<std::shared_ptr<SubscriptionWaiter>> ready_;
+    std::atomic<std::uint32_t> wakeupSeq_{};
+
+public:
+    void push(std::shared_ptr<SubscriptionWaiter> waiter);
+
+    // wakes up the thread without handing it a subscription
+    void wake();
+
+    // read before looking for work, passed to park
+    std::uint32_t wakeup_seq() const noexcept
+    {
+        return wakeupSeq_.load(std::memory_order_acquire);
+    }
+
+    // moves everything pushed so far into ready
+    void take(std::vector<std::shared_ptr<SubscriptionWaiter>>& ready);
+
+    // returns once there has been a wake up after seenSeq was read
+    // spins for up to spinDuration before parking
+    void park(std::uint32_t seenSeq, std::chrono::microseconds spinDuration);
+};
+
+/*
+    Registered with the DataManager (get_object) for every object a minor subscription waits on,
+    one per SubscriptionState, queued on the owning thread's ready list at most once at a time
+    Owned by the SubscriptionState, groups only hold it weakly: it is gone with the subscription
+
+    The publisher hands the published objects over with the notification, the owning thread
+    gives them to the waiting minor subscriptions, which send them without going to the DataManager
+*/
+class SubscriptionWaiter : public ObjectWaiter, public std::enable_shared_from_this<SubscriptionWaiter>
+{
+    friend struct ThreadLocalState;
+    friend class SubscriptionState;
+
+    struct HandedObject
+    {
+        const GroupHandle* groupHandle_;
+        ObjectId objectId_;
+        ObjectBufferRef objectBuffer_;
+    };
+
+    // weak: the waiter might outlive the thread (still queued or listed on a connection)
+    std::weak_ptr<ReadyList> readyList_;
+    // only accessed by the owning thread, nullptr once the subscription is gone
+    SubscriptionState* subscriptionState_;
+    std::atomic<bool> queued_;
+    // listed on a connection, waiting for its send budget (see ConnectionState::add_send_waiter)
+    std::atomic<bool> sendBudgetListed_;
+
+    std::mutex handedObjectsMtx_;
+    std::vector<HandedObject> handedObjects_;
+
+public:
+    SubscriptionWaiter(std::weak_ptr<ReadyList> readyList, SubscriptionState& subscriptionState)
+    : readyList_(std::move(readyList)), subscriptionState_(std::addressof(subscriptionState)),
+      queued_(false), sendBudgetListed_(false)
+    {
+    }
+
+    void notify_object_ready(const GroupHandle& groupHandle,
+                             ObjectId objectId,
+                             const ObjectBufferRef& objectBuffer) override;
+
+    // moves everything handed over so far into handedObjects
+    void take_handed_objects(std::vector<HandedObject>& handedObjects);
+
+    // queues the subscription on the owning thread's ready list without handing an object
+    void wake();
+
+    // false if the waiter is already listed
+    bool list_for_send_budget() noexcept
+    {
+        return !sendBudgetListed_.exchange(true, std::memory_order_acq_rel);
+    }
+    void wake_for_send_budget()
+    {
+        sendBudgetListed_.store(false, std::memory_order_release);
+        wake();
+    }
+};
+
+/*
+    Live tail of an open ended subscription (AbsoluteStart, LatestPerGroupInTrack)
+    registered on the track, hands new subgroups over to the subscription (see TrackObserver)
+    owned by the subscription state, which detaches it on destruction
+*/
+class SubscriptionTailObserver : public TrackObserver
+{
+    std::mutex mtx_;
+    SubscriptionState* subscriptionState_;
+
+public:
+    explicit SubscriptionTailObserver(SubscriptionState& subscriptionState)
+    : subscriptionState_(std::addressof(subscriptionState))
+    {
+    }
+
+    void notify_subgroup_added(const std::shared_ptr<GroupHandle>& groupHandle,
+                               ObjectId beginObjectId,
+                               ObjectId endObjectId) override;
+
+    void detach();
+};
+
+/*
+    Each stream corresponds to one minor subscription state (one group of the track)
+    Only the cold fields live here, the ones read on every pass (wait slot, next and last object)
+    are kept by the SubscriptionState as structure of arrays
+*/
 class MinorSubscriptionState
 {
     friend class SubscriptionState;
-    class SubscriptionState* subscriptionState_;
-    std::optional<ObjectIdentifier> previouslySentObject_;
-    ObjectIdentifier objectToSend_;
-    std::optional<ObjectIdentifier> lastObjectToBeSent_;
+    // resolved once: the minor subscription reads the group directly instead of
+    // looking up the track and the group for every object, keeps the wait slots alive
+    std::shared_ptr<GroupHandle> groupHandle_;
+    // track and group of the minor subscription, objectId_ is the object being sent
+    ObjectIdentifier objectIdentifier_;
+    // an object has been sent on the minor subscription's stream
+    bool sentObject_;
 
     bool mustBeSent_;
-    std::optional<ObjectWaitSignal> objectWaitSignal_;
+    // next object to send, handed over by the publisher (see SubscriptionWaiter)
+    ObjectBufferRef handedObject_;
 
     std::optional<std::chrono::milliseconds> subscribeDeliveryTimeout;
 
 public:
-    MinorSubscriptionState(SubscriptionState& subscriptionState,
-                           ObjectIdentifier objectToSend,
-                           std::optional<ObjectIdentifier> lastObjectToBeSent,
+    MinorSubscriptionState(std::shared_ptr<GroupHandle> groupHandle,
                            bool mustBeSent,
                            std::optional<std::chrono::milliseconds> deliveryTimeout);
 
-    // returs true if minor subscription state has been fulfilled
-    FulfillSomeReturn fulfill_some_minor();
-
-    // need this function to be inlined (for better performance) as it is called in tight loop
-    inline bool is_waiting_for_object();
-
     // TODO: cleanup in destructor, notify client that minor subscription has ended
     // WARNING: adding destructor will disable implicitly generated move operations
 };
@@ -61,35 +218,159 @@ public:
 // Each subscription state corresponds to one subscription message
 class SubscriptionState
 {
-    friend MinorSubscriptionState;
     // NOTE: should be protected by checking if it actually exists
     std::weak_ptr<ConnectionState> connectionStateWeakPtr_;
-    // can not be reference because we need Subscription State to be assignable (while removing it from vector)
     DataManager* dataManager_;
     class SubscriptionManager* subscriptionManager_;
     SubscribeMessage subscriptionMessage_;
 
+    /*
+        minor subscriptions in (publisher priority, group order) order
+        hot fields as structure of arrays, index i belongs to minorSubscriptionStates_[i]
+            minorWaitSlots_: state of the awaited object (in its group), nullptr if not waiting
+            minorNextObjectIds_, minorLastObjectIds_: next and last object to send in the group
+    */
     std::vector<MinorSubscriptionState> minorSubscriptionStates_;
+    std::vector<const std::atomic<ObjectWaitStatus>*> minorWaitSlots_;
+    std::vector<ObjectId> minorNextObjectIds_;
+    std::vector<ObjectId> minorLastObjectIds_;
+
+    // handed to the DataManager whenever a minor subscription has to wait for an object
+    // replaced by rebind with updateMtx_ held
+    std::shared_ptr<SubscriptionWaiter> waiter_;
+
+    /*
+        SUBSCRIBE_UPDATE posted by the control stream, applied by the thread running
+        the subscription at the start of its next fulfill_some (never while fulfilling)
+        the last update wins, an update carries the whole range and priority
+    */
+    std::mutex updateMtx_;
+    std::optional<SubscribeUpdateMessage> pendingUpdate_;
+    std::atomic<bool> hasPendingUpdate_;
+    // UNSUBSCRIBE: the streams are aborted by post_unsubscribe, the next fulfill_some finishes the subscription
+    // also set by post_connection_shutdown (the streams are gone with the connection)
+    std::atomic<bool> unsubscribed_;
+    // the last fulfill_some stopped because the connection (or a stream) had too many bytes in flight
+    bool sendBlocked_;
+
+    /*
+        live tail: subgroups registered on the track after the subscription enumerated it,
+        posted by the publisher, applied by the thread running the subscription (like updates)
+        an open ended subscription is not finished when its minor subscriptions are
+    */
+    struct TailEvent
+    {
+        std::shared_ptr<GroupHandle> groupHandle_;
+        ObjectId beginObjectId_;
+        ObjectId endObjectId_;
+    };
+    std::vector<TailEvent> pendingTailEvents_;
+    std::atomic<bool> hasPendingTailEvents_;
+    // per group, the objects below were taken by a minor subscription which is done,
+    // a notification coming in after that is trimmed to what follows
+    std::map<GroupId, ObjectId> takenGroupEnds_;
+    // nullptr unless the subscription is open ended
+    std::shared_ptr<SubscriptionTailObserver> tailObserver_;
 
     void error_handler(SubscriptionStateErr::ConnectionExpired);
     void error_handler(SubscriptionStateErr::ObjectDoesNotExist);
 
     FulfillSomeReturn
-    add_group_subscription(const GroupHandle& groupHandle,
+    add_group_subscription(const std::shared_ptr<GroupHandle>& groupHandle,
                            bool mustBeSent,
                            std::optional<std::chrono::milliseconds> deliveryTimeout = {},
                            std::optional<ObjectId> beginObjectId = {},
                            std::optional<ObjectId> endObjectId = {});
 
+    // not waiting on an object or the awaited object is Ready
+    // need this function to be inlined (for better performance) as it is called in tight loop
+    inline bool minor_runnable(std::size_t minorIdx) const noexcept;
+
+    // returs true if minor subscription state has been fulfilled
+    FulfillSomeReturn fulfill_some_minor(std::size_t minorIdx, ConnectionState& connectionState);
+    // if exceeded the waiter is listed on the connection, see SendBackpressurePolicy
+    bool send_budget_exceeded(const MinorSubscriptionState& minorSubscriptionState,
+                              ConnectionState& connectionState);
+
+    // moves minor subscription srcIdx to dstIdx (all arrays)
+    void move_minor(std::size_t dstIdx, std::size_t srcIdx);
+    void truncate_minors(std::size_t numMinors);
+
+    // narrows / extends the minor subscriptions to the updated range, changes the priority
+    void apply_update(const SubscribeUpdateMessage& subscribeUpdateMessage,
+                      ConnectionState& connectionState);
+
+    // extends the minor subscription of the group or adds one for it, within the subscribed range
+    void apply_tail_events(std::vector<TailEvent>& tailEvents);
+    // registered on the track while its groups are enumerated
+    void follow_track(TrackHandle& trackHandle);
+
+    // open ended and no end set by an update
+    bool live_tail() const noexcept
+    {
+        return tailObserver_ != nullptr && !subscriptionMessage_.end_.has_value();
+    }
+
 public:
     bool cleanup_;
+    // on the owning thread's runnable list (otherwise parked on waiter_)
+    bool runnable_;
+    // position in ThreadLocalState::subscriptionStates_
+    std::size_t index_;
+    // only used as a key (see SubscriptionKey), nullptr if the connection was gone on construction
+    const ConnectionState* connectionState_;
+
     SubscriptionState(std::weak_ptr<ConnectionState>&& connectionState,
                       DataManager& dataManager,
                       SubscriptionManager& subscriptionManager,
-                      SubscribeMessage subscriptionMessage);
+                      SubscribeMessage subscriptionMessage,
+                      const std::shared_ptr<ReadyList>& readyList);
+
+    // the waiter points back to the subscription state
+    SubscriptionState(const SubscriptionState&) = delete;
+    SubscriptionState& operator=(const SubscriptionState&) = delete;
 
     FulfillSomeReturn fulfill_some();
 
+    // false if every minor subscription waits on an object which is not Ready
+    bool has_runnable_minor() const noexcept;
+
+    // parked till the connection drains, not till an object is ready
+    bool send_blocked() const noexcept
+    {
+        return sendBlocked_;
+    }
+
+    std::uint8_t subscriber_priority() const noexcept
+    {
+        return subscriptionMessage_.subscriberPriority_;
+    }
+
+    SubscriptionKey key() const noexcept
+    {
+        return { connectionState_, subscriptionMessage_.subscribeId_ };
+    }
+
+    // hands the update to whichever thread runs the subscription and wakes it up
+    void post_update(SubscribeUpdateMessage subscribeUpdateMessage);
+    // aborts the streams of the minor subscriptions right away, the next SUBSCRIBE can reuse the track alias
+    // called with the connection's fulfillMtx_ held (the minor subscriptions are not changing)
+    void post_unsubscribe(ConnectionState& connectionState);
+    // wakes the subscription (possibly parked for good on an open ended track) to finish it
+    void post_connection_shutdown();
+    void post_tail_event(std::shared_ptr<GroupHandle> groupHandle, ObjectId beginObjectId, ObjectId endObjectId);
+
+    bool unsubscribed() const noexcept
+    {
+        return unsubscribed_.load(std::memory_order_relaxed);
+    }
+
+    // gives the objects handed over to the waiter to the minor subscriptions waiting on them
+    void accept_handed_objects(std::vector<SubscriptionWaiter::HandedObject>& handedObjects);
+
+    // moves the subscription to another thread's ready list (work stealing)
+    void rebind(const std::shared_ptr<ReadyList>& readyList);
+
     std::weak_ptr<ConnectionState>& get_connection_state_weak_ptr() noexcept
     {
         return connectionStateWeakPtr_;
@@ -100,39 +381,148 @@ public:
         return connectionStateWeakPtr_;
     }
 
-    // TODO: removing this destructor causes groups not to advance or abort, need to investigate
-    ~SubscriptionState() = default;
+    // detaches the waiter, it might still be queued (groups only hold it weakly)
+    ~SubscriptionState();
 };
 
 struct ThreadLocalState
 {
+
+    // subscriptions fulfilled per scheduling pass, the rest can be stolen meanwhile
+    static constexpr std::size_t schedulingBatchSize = 64;
+
+    /*
+        runnable subscriptions are run in order of
+            key = runnableSeq_ (when it became runnable) + subscriberPriority * priorityAging
+        higher priority (lower value) goes first, but every subscription which becomes runnable later
+        gets a larger key, so a subscription is overtaken by at most 255 * priorityAging others (no starvation)
+    */
+    static constexpr std::uint64_t priorityAging = 16;
+
+    struct RunnableEntry
+    {
+        std::uint64_t key_;
+        SubscriptionState* subscriptionState_;
+
+        // std heap functions build a max heap
+        bool operator<(const RunnableEntry& other) const noexcept
+        {
+            return key_ > other.key_;
+        }
+    };
+
     SubscriptionManager& subscriptionManager_;
-    // subscription state which this thread is handling
-    // has to be stable container because we have pointers back to subscription state
-    StableContainer<SubscriptionState> subscriptionStates_;
+    std::size_t threadIdx_;
+    std::shared_ptr<ReadyList> readyList_;
+
+    // subscribe, subscribe update and unsubscribe of the connections mapped to this thread
+    // one queue: handled in the order they were received (e.g. UNSUBSCRIBE then SUBSCRIBE with the same id)
+    MPMCQueue<std::tuple<std::weak_ptr<ConnectionState>, SubscriptionQueueMessage>> subscriptionQueue_;
+
+    // subscription states created by this thread, stolen ones stay in the pool they were created from
+    SlabPool<SubscriptionState> subscriptionStatePool_;
+
+    /*
+        subscriptions of the connections mapped to this thread by SubscriptionKey,
+        wherever they run (stolen ones stay here), used to route control messages to them
+        an entry is removed before the subscription state is destroyed
+    */
+    std::mutex subscriptionKeysMtx_;
+    std::unordered_map<SubscriptionKey, SubscriptionState*, SubscriptionKey::Hash> subscriptionsByKey_;
+
+    /*
+        guards subscriptionStates_, runnable_ and the back pointers of the waiters
+        taken by the owning thread between scheduling passes (not while fulfilling) and by thieves
+    */
+    std::mutex mtx_;
+    // subscription states which this thread is handling (SubscriptionState::index_ is the position)
+    std::vector<SubscriptionState*> subscriptionStates_;
+    // subscriptions which have work to do, the rest are parked till their waiter is notified
+    // heap: owner pops the smallest keys, thieves take the tail (dropping the tail keeps it a heap)
+    std::vector<RunnableEntry> runnable_;
+    std::uint64_t runnableSeq_;
+    // runnable_.size(), read without the lock by thieves looking for a victim
+    std::atomic<std::size_t> numRunnable_;
+    // parked with nothing to do, busy threads wake it up to steal
+    std::atomic<bool> parked_;
+
+    ThreadLocalState(SubscriptionManager& subscriptionManager, std::size_t threadIdx);
+
+    // called with mtx_ held
+    // an unsubscribed subscription goes first, it only releases its resources
+    void make_runnable(SubscriptionState& subscriptionState);
+    void push_runnable(SubscriptionState* subscriptionState);
+    void add_subscription_state(SubscriptionState* subscriptionState);
+    // O(1), the last subscription state takes its position
+    void remove_subscription_state(SubscriptionState* subscriptionState);
+
+    // SUBSCRIBE_UPDATE / UNSUBSCRIBE for one of the subscriptions in subscriptionsByKey_
+    void route_control_message(const std::weak_ptr<ConnectionState>& connectionStateWeakPtr,
+                               SubscriptionQueueMessage& queueMessage);
+    // ConnectionShutdown: finishes every subscription of the connection in subscriptionsByKey_
+    void end_connection_subscriptions(const ConnectionState* connectionState);
+
+    // moves half of the runnable subscriptions of some busy thread to this thread
+    bool steal(std::vector<SubscriptionState*>& working);
+
+    // more runnable subscriptions than one pass handles, wakes up a parked thread to steal
+    void wake_thief();
 
     void operator()();
 };
 
+/*
+    Subscriptions are readiness driven: a subscription thread only runs subscriptions
+    which can make progress, a subscription waiting on unpublished objects is parked
+    and is put back on its thread's ready list by the publisher (see ObjectWaiter)
+
+    A thread with no runnable subscription parks, spinBeforePark trades a bounded
+    amount of busy spinning for lower wake up latency (0 parks right away)
+
+    Subscriptions are sharded over the threads by connection, all subscriptions
+    (and so streams) of a connection are served by the same thread
+    A thread which runs out of work steals runnable subscriptions from a busy one
+    before parking, stolen subscriptions stay with the thief
+    (subscriptions of one connection are still fulfilled one at a time, see ConnectionState::fulfillMtx_)
+*/
 class SubscriptionManager
 {
     friend struct ThreadLocalState;
     class DataManager& dataManager_;
     std::atomic<bool> cleanup_;
+    std::chrono::microseconds spinBeforePark_;
 
-    // holds subscriptions messages which need to be processed and start executing
-    MPMCQueue<std::tuple<std::weak_ptr<ConnectionState>, SubscribeMessage>> subscriptionQueue_;
-
-    std::vector<ThreadLocalState> threadLocalStates_;
+    // not relocated, threads refer to their ThreadLocalState and steal from the others
+    std::vector<std::unique_ptr<ThreadLocalState>> threadLocalStates_;
     // thread pool to manage subscriptions
     std::vector<std::jthread> threadPool_;
 
+    // connection affinity: all subscriptions of a connection are created by (and keyed on) the same thread
+    ThreadLocalState& connection_thread(const ConnectionState* connectionState);
+    void enqueue_subscription_message(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                                      SubscriptionQueueMessage queueMessage);
+
+    // false if the connection already has a subscription with the same subscribe id
+    bool register_subscription(SubscriptionState& subscriptionState);
+    void unregister_subscription(SubscriptionState& subscriptionState);
+
 public:
-    SubscriptionManager(DataManager& dataManager, std::size_t numThreads = 1);
+    SubscriptionManager(DataManager& dataManager,
+                        std::size_t numThreads = 1,
+                        std::chrono::microseconds spinBeforePark = {});
     void add_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
                           SubscribeMessage subscribeMessage);
 
 
+    // applied in place to the subscription with the same subscribe id on the connection
+    void update_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                             SubscribeUpdateMessage subscribeUpdateMessage);
+    // the subscription's streams are aborted and its state freed by the thread running it
+    void remove_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                             UnsubscribeMessage unsubscribeMessage);
+    // the connection has been shut down, its subscriptions are finished and their states freed
+    void remove_connection(std::weak_ptr<ConnectionState> connectionStateWeakPtr);
+
     // Error Handling functions
     void mark_subscription_cleanup(SubscriptionState& subscriptionState);
     void notify_subscription_error(SubscriptionState& subscriptionState);
@@ -479,20 +479,37 @@ public:
 };
 
 
+/*
+    Deleter of received buffers, the QUIC_BUFFER descriptor is always malloced
+    Without a receive complete function the data was copied along with the descriptor (ReceiveMode::COPY)
+    With one the data is MsQuic's (ReceiveMode::ZERO_COPY), the receive was left pending and
+    deleting the buffer completes its length on the stream
+    Buffers of a stream have to be deleted in the order they were received
+*/
 class QUIC_BUFFERDeleter
 {
-    // Check chunk_transfer.cpp to understand why this is unused
-    // Ideally we would be calling receive complete, but we are making a copy of
-    // QUIC_BUFFER provided by MsQuic, because of lifetime management issues of the MsQuic buffer when multireceive is enabled
-    [[maybe_unused]] HQUIC streamHandle_;
-    [[maybe_unused]] QUIC_STREAM_RECEIVE_COMPLETE_FN streamReceiveCompletefunction_;
+    HQUIC streamHandle_;
+    QUIC_STREAM_RECEIVE_COMPLETE_FN streamReceiveCompletefunction_;
 
 public:
     void operator()(const QUIC_BUFFER* buffer)
     {
+        if (streamReceiveCompletefunction_ != nullptr)
+            streamReceiveCompletefunction_(streamHandle_, buffer->Length);
         free(const_cast<QUIC_BUFFER*>(buffer));
     }
 
+    // the data is MsQuic's (part of the stream's receive window) till the buffer is deleted
+    bool references_receive() const noexcept
+    {
+        return streamReceiveCompletefunction_ != nullptr;
+    }
+
+    // buffer owns its data
+    QUIC_BUFFERDeleter() : streamHandle_(nullptr), streamReceiveCompletefunction_(nullptr)
+    {
+    }
+
     QUIC_BUFFERDeleter(HQUIC streamHandle, QUIC_STREAM_RECEIVE_COMPLETE_FN streamReceiveCompletefunction)
     : streamHandle_(streamHandle),
       streamReceiveCompletefunction_(streamReceiveCompletefunction)
@@ -0,0 +1,140 @@
+#pragma once
+////////////////////////////////////////////
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+////////////////////////////////////////////
+#include <definitions.hpp>
+#include <object_buffer.hpp>
+#include <strong_types.hpp>
+////////////////////////////////////////////
+
+namespace rvn
+{
+/*
+    Write-behind persistence stage
+
+    Publishers only put the object into the (memory) object cache and mark it ready,
+    durable storage happens on the persister thread:
+        - jobs are drained in batches and grouped per group, every group gets
+          one vectored write per batch and the writes of all groups are submitted
+          to the storage backend together (one submission with io_uring)
+        - queue is bounded by pending bytes, enqueue blocks the publisher when it is full (backpressure)
+        - cache entries stay dirty (pinned, not evictable) till they are persisted
+        - a failed write is retried (ahead of newer jobs, with exponential backoff) and given back
+          its space at the tail of the segment log, after maxPersistAttempts the objects are
+          given up: their cache entries are marked clean, once evicted they are lost
+        - pending manifest records are flushed (and synced) before every batch, the hierarchy of
+          a persisted object is on disk before the object itself
+        - an object only counts as persisted once it is durable: after the writes of a batch
+          every segment file written to is synced (one fdatasync each, submitted together),
+          a failed sync is handled like a failed write (the batch is written again)
+
+    Persistence lag = time between enqueue and the object being durable in the segment log,
+    it includes the syncs (lastSync_ is the part of the last batch spent syncing), expect
+    milliseconds per batch on disks without a write cache backed by power loss protection
+*/
+struct PersistenceStats
+{
+    std::uint64_t pendingObjects_;
+    std::uint64_t pendingBytes_;
+    std::uint64_t persistedObjects_;
+    // failed writes which are retried and objects given up after maxPersistAttempts
+    std::uint64_t retriedObjects_;
+    std::uint64_t failedObjects_;
+    std::uint64_t numBatches_;
+    // lag of the oldest object in the last batch and the worst lag seen so far
+    std::chrono::microseconds lastLag_;
+    std::chrono::microseconds maxLag_;
+    // time the last batch spent in fdatasync of its segment files
+    std::chrono::microseconds lastSync_;
+};
+
+class WriteBehindPersister
+{
+public:
+    struct Job
+    {
+        std::shared_ptr<class GroupHandle> groupHandle_;
+        ObjectId objectId_;
+        // payload_ points into the serialized object, the reference keeps it alive till it is persisted
+        ObjectBufferRef objectBuffer_;
+        std::string_view payload_;
+        TimePoint enqueueTimePoint_;
+        // failed writes of the job so far
+        std::uint32_t numAttempts_ = 0;
+    };
+
+    static constexpr std::uint64_t defaultMaxPendingBytes = 64ULL << 20; // 64 MiB
+    static constexpr std::uint32_t maxPersistAttempts = 4;
+    // doubled after every failed batch, reset by a batch which is written completely
+    static constexpr std::chrono::milliseconds minRetryBackoff{ 10 };
+    static constexpr std::chrono::milliseconds maxRetryBackoff{ 1000 };
+
+private:
+    class ObjectCache& objectCache_;
+    class StorageIo& storageIo_;
+    class Manifest& manifest_;
+    const std::uint64_t maxPendingBytes_;
+
+    std::mutex queueMtx_;
+    // persister waits on it for jobs (_any because it is also woken up by stop requests)
+    std::condition_variable_any jobsAvailableCv_;
+    // publishers (backpressure) and flush wait on it
+    std::condition_variable jobsPersistedCv_;
+    std::deque<Job> jobs_;
+
+    // guarded by queueMtx_
+    std::uint64_t pendingObjects_ = 0;
+    std::uint64_t pendingBytes_ = 0;
+    std::uint64_t numEnqueued_ = 0;
+    std::uint64_t numDone_ = 0;
+    // queued again after a failed write, newer jobs might be done before them
+    std::uint64_t numRetryJobs_ = 0;
+
+    std::atomic<std::uint64_t> persistedObjects_{};
+    std::atomic<std::uint64_t> retriedObjects_{};
+    std::atomic<std::uint64_t> failedObjects_{};
+    std::atomic<std::uint64_t> numBatches_{};
+    std::atomic<std::int64_t> lastLagUs_{};
+    std::atomic<std::int64_t> maxLagUs_{};
+    std::atomic<std::int64_t> lastSyncUs_{};
+
+    // declared last, the thread must stop before the members above are destroyed
+    std::jthread persisterThread_;
+
+    void run(std::stop_token stopToken);
+    // jobs to be retried are moved to retryJobs
+    void persist_batch(std::deque<Job>& batch, std::deque<Job>& retryJobs);
+
+public:
+    WriteBehindPersister(ObjectCache& objectCache,
+                         StorageIo& storageIo,
+                         Manifest& manifest,
+                         std::uint64_t maxPendingBytes = defaultMaxPendingBytes);
+    // persists everything which is still queued
+    ~WriteBehindPersister();
+
+    WriteBehindPersister(const WriteBehindPersister&) = delete;
+    WriteBehindPersister& operator=(const WriteBehindPersister&) = delete;
+
+    // blocks while the queue is full
+    void enqueue(Job job);
+
+    // enqueues all jobs with one lock acquisition and one wake up of the persister
+    void enqueue_batch(std::vector<Job> jobs);
+
+    // blocks till everything enqueued before the call has been persisted (or given up)
+    void flush();
+
+    PersistenceStats get_stats();
+};
+} // namespace rvn
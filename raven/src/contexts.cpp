@@ -14,9 +14,12 @@
 #include <variant>
 #include <wrappers.hpp>
 ////////////////////////////////
+#include <algorithm>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <stdexcept>
+#include <vector>
 ////////////////////////////////
 
 namespace rvn
@@ -62,14 +65,16 @@ std::weak_ptr<void> DataStreamState::get_life_time_flag() const noexcept
 void ConnectionState::delete_data_stream(HQUIC streamHandle)
 {
     dataStreams.write(
-    [&streamHandle](StableContainer<DataStreamState>& dataStreams)
+    [&streamHandle](DataStreams& dataStreams)
     {
         auto iter =
-        std::find_if(dataStreams.begin(), dataStreams.end(),
+        std::find_if(dataStreams.streams_.begin(), dataStreams.streams_.end(),
                      [&streamHandle](const DataStreamState& streamState)
                      { return streamState.stream.get() == streamHandle; });
 
-        dataStreams.erase(iter);
+        // already erased if the stream was aborted by the server (abort_if_sending, abort_group_streams)
+        if (iter != dataStreams.streams_.end())
+            dataStreams.erase(iter);
     });
 }
 
@@ -81,11 +86,11 @@ void ConnectionState::send_control_buffer(QUIC_BUFFER* buffer, QUIC_SEND_FLAGS f
     StreamState* streamState = &controlStream.value();
     HQUIC streamHandle = streamState->stream.get();
 
-    StreamSendContext* streamSendContext =
-    new StreamSendContext(buffer, 1, streamState->streamContext_);
+    StreamSendContext* streamSendContext = sendContextPool_->create(buffer, streamState->streamContext_);
 
+    auto [buffers, bufferCount] = streamSendContext->get_buffers();
     QUIC_STATUS status =
-    moqtObject_.get_tbl()->StreamSend(streamHandle, buffer, 1, flags, streamSendContext);
+    moqtObject_.get_tbl()->StreamSend(streamHandle, buffers, bufferCount, flags, streamSendContext);
     if (QUIC_FAILED(status))
         throw std::runtime_error("Failed to send control message");
 }
@@ -105,13 +110,14 @@ QUIC_STATUS ConnectionState::accept_data_stream(HQUIC streamHandle)
 {
     // register new data stream into connectionState object
     return dataStreams.write(
-    [&](StableContainer<DataStreamState>& dataStreams)
+    [&](DataStreams& dataStreams)
     {
-        dataStreams.emplace_back(rvn::unique_stream(moqtObject_.get_tbl(), streamHandle),
-                                 *this);
+        // not indexed, the client receives on it
+        dataStreams.streams_.emplace_back(rvn::unique_stream(moqtObject_.get_tbl(), streamHandle),
+                                          *this);
 
         // set stream context for stream
-        DataStreamState& streamState = dataStreams.back();
+        DataStreamState& streamState = dataStreams.streams_.back();
         streamState.set_stream_context(new StreamContext(moqtObject_, *this));
         streamState.streamContext_->construct_deserializer(streamState, false);
 
@@ -162,31 +168,39 @@ StreamState& ConnectionState::establish_control_stream()
 }
 
 
+/*
+    MoQT: lower priority value is sent first, subscriber priority decides before publisher priority
+    MsQuic: higher stream priority is sent first (16 bit)
+        => (~subscriberPriority << 8) | ~publisherPriority
+*/
+static std::uint16_t
+to_stream_priority(std::uint8_t subscriberPriority, PublisherPriority publisherPriority)
+{
+    return static_cast<std::uint16_t>((0xFF - subscriberPriority) << 8) |
+           static_cast<std::uint16_t>(0xFF - publisherPriority.get());
+}
+
 QUIC_STATUS ConnectionState::send_object(const ObjectIdentifier& objectIdentifier,
-                                         QUIC_BUFFER* objectPayload,
-                                         std::optional<std::chrono::milliseconds> timeoutDuration)
+                                         ObjectBufferRef objectBuffer,
+                                         std::optional<std::chrono::milliseconds> timeoutDuration,
+                                         std::uint8_t subscriberPriority)
 {
-    auto sendObjectLambda = [&](const StableContainer<DataStreamState>& dataStreams)
+    // TODO: add error handling to this
+    DataStreams::Key streamKey = stream_key(objectIdentifier).value();
+
+    auto sendObjectLambda = [&](const DataStreams& dataStreams)
     {
-        auto iter =
-        std::find_if(dataStreams.begin(), dataStreams.end(),
-                     [&objectIdentifier](const DataStreamState& streamState)
-                     { return streamState.can_send_object(objectIdentifier); });
+        DataStreamState* streamState = dataStreams.find(streamKey);
 
         // We return this to indicate that we have not found a stream to send the object
         // This is not an error, we just need to create a new stream to send the object
         // We never expect StreamSend to return `QUIC_STATUS_ALPN_NEG_FAILURE`, hence
         // if it was returned, the intent is clear
-        if (iter == dataStreams.end())
+        if (streamState == nullptr)
             return QUIC_STATUS_ALPN_NEG_FAILURE;
 
-        StreamSendContext* streamSendContext =
-        new StreamSendContext(objectPayload, 1, iter->streamContext_);
-
-        return moqtObject_.get_tbl()->StreamSend(iter->stream.get(), objectPayload,
-                                                 1, QUIC_SEND_FLAG_PRIORITY_WORK,
-                                                 streamSendContext);
-        return QUIC_STATUS_SUCCESS;
+        // send context holds a reference to the buffer, released on SEND_COMPLETE
+        return enqueue_send(*streamState, std::move(objectBuffer));
     };
 
     QUIC_STATUS trySendStatus = dataStreams.read(sendObjectLambda);
@@ -194,13 +208,11 @@ QUIC_STATUS ConnectionState::send_object(const ObjectIdentifier& objectIdentifie
 
     if (trySendStatus == QUIC_STATUS_ALPN_NEG_FAILURE)
     {
-        // header message
+        // header message, the stream is indexed by it
         StreamHeaderSubgroupMessage objectHeader;
-        // TODO: add error handling to this
-        objectHeader.trackAlias_ = identifier_to_alias(objectIdentifier).value();
-        objectHeader.groupId_ = objectIdentifier.groupId_;
-        // TOOD: get subgroupId
-        objectHeader.subgroupId_ = SubGroupId(0);
+        objectHeader.trackAlias_ = TrackAlias(streamKey.trackAlias_);
+        objectHeader.groupId_ = GroupId(streamKey.groupId_);
+        objectHeader.subgroupId_ = SubGroupId(streamKey.subgroupId_);
 
         // Get publisher priority from group
         MOQTServer& moqtServer = static_cast<MOQTServer&>(moqtObject_);
@@ -210,7 +222,9 @@ QUIC_STATUS ConnectionState::send_object(const ObjectIdentifier& objectIdentifie
         QUIC_BUFFER* objectHeaderQuicBuffer = serialization::serialize(objectHeader);
 
         // Create a new stream and send the object
-        StreamContext* streamContext = new StreamContext(moqtObject_, *this);
+        // returned to the pool on QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE
+        StreamContext* streamContext = streamContextPool_->create(moqtObject_, *this);
+        streamContext->connectionStateWeakPtr_ = weak_from_this();
 
         // TODO: do error handling here
         auto stream =
@@ -220,28 +234,33 @@ QUIC_STATUS ConnectionState::send_object(const ObjectIdentifier& objectIdentifie
                            { QUIC_STREAM_START_FLAG_IMMEDIATE });
 
         QUIC_STATUS status = dataStreams.write(
-        [&, streamIn = std::move(stream), this](StableContainer<DataStreamState>& dataStreams) mutable
+        [&, streamIn = std::move(stream), this](DataStreams& dataStreams) mutable
         {
-            dataStreams.emplace_back(std::move(streamIn), *this);
-            DataStreamState& streamState = dataStreams.back();
+            dataStreams.streams_.emplace_back(std::move(streamIn), *this);
+            DataStreamState& streamState = dataStreams.streams_.back();
             streamState.set_header(objectHeader);
+            dataStreams.index(std::prev(dataStreams.streams_.end()));
             streamState.set_stream_context(streamContext);
 
             // no need deserializer because we don't expect to receive any messages on this stream
 
-            StreamSendContext* streamSendContext =
-            new StreamSendContext(objectHeaderQuicBuffer, 1, streamState.streamContext_);
-
-            // Set priority of stream to indicate the priority of the group
-            // MsQuic uses uint16_t stream priority, unlike moqt which uses 8 bit
-            std::uint16_t streamPriority = objectHeader.publisherPriority_;
+            // under congestion MsQuic sends the higher priority streams first
+            std::uint16_t streamPriority =
+            to_stream_priority(subscriberPriority, objectHeader.publisherPriority_);
             moqtObject_.get_tbl()->SetParam(streamState.stream.get(), QUIC_PARAM_STREAM_PRIORITY,
                                             sizeof(std::uint16_t), &streamPriority);
 
-            return moqtObject_.get_tbl()->StreamSend(streamState.stream.get(),
-                                                     objectHeaderQuicBuffer, 1,
-                                                     QUIC_SEND_FLAG_DELAY_SEND,
-                                                     streamSendContext);
+            // the header goes out in the same StreamSend as the first objects
+            {
+                std::lock_guard l(streamState.pendingSendMtx_);
+                streamState.pendingSend_.reset(
+                sendContextPool_->create(objectHeaderQuicBuffer, streamState.streamContext_));
+            }
+            {
+                std::lock_guard l(pendingSendsMtx_);
+                pendingSends_.emplace_back(streamState.get_life_time_flag(), &streamState);
+            }
+            return QUIC_STATUS_SUCCESS;
         });
 
         /*
@@ -262,26 +281,275 @@ QUIC_STATUS ConnectionState::send_object(const ObjectIdentifier& objectIdentifie
         if (QUIC_FAILED(status))
             return status;
 
-        return send_object(objectIdentifier, objectPayload, timeoutDuration);
+        return send_object(objectIdentifier, std::move(objectBuffer), timeoutDuration,
+                           subscriberPriority);
     }
 
     return trySendStatus;
 }
 
+void ConnectionState::set_subscriber_priority(TrackAlias trackAlias, std::uint8_t subscriberPriority)
+{
+    dataStreams.read(
+    [&](const DataStreams& dataStreams)
+    {
+        // indexed by group, all streams of the track have to be visited anyway
+        for (const auto& streamState : dataStreams.streams_)
+        {
+            const auto& streamHeader = *streamState.streamHeaderSubgroupMessage_;
+            if (streamHeader.trackAlias_ != trackAlias)
+                continue;
+
+            std::uint16_t streamPriority =
+            to_stream_priority(subscriberPriority, streamHeader.publisherPriority_);
+            moqtObject_.get_tbl()->SetParam(streamState.stream.get(), QUIC_PARAM_STREAM_PRIORITY,
+                                            sizeof(std::uint16_t), &streamPriority);
+        }
+    });
+}
+
+QUIC_STATUS ConnectionState::enqueue_send(const DataStreamState& dataStream, ObjectBufferRef objectBuffer)
+{
+    StreamSendContextPtr streamSendContext;
+    bool newlyPending = false;
+    {
+        std::lock_guard l(dataStream.pendingSendMtx_);
+
+        if (!dataStream.pendingSend_)
+        {
+            dataStream.pendingSend_.reset(sendContextPool_->create(dataStream.streamContext_));
+            newlyPending = true;
+        }
+
+        StreamSendContext& pendingSend = *dataStream.pendingSend_;
+        pendingSend.append(std::move(objectBuffer));
+
+        if (pendingSend.bufferCount >= std::min(sendFlushPolicy_.maxBuffers, StreamSendContext::maxBuffers) ||
+            pendingSend.totalLength >= sendFlushPolicy_.maxPendingBytes)
+            streamSendContext = std::move(dataStream.pendingSend_);
+    }
+
+    // enough gathered, not delayed: nothing guarantees a later flush would come soon
+    if (streamSendContext)
+        return stream_send(dataStream, std::move(streamSendContext), QUIC_SEND_FLAG_NONE);
+
+    if (newlyPending)
+    {
+        std::lock_guard l(pendingSendsMtx_);
+        pendingSends_.emplace_back(dataStream.get_life_time_flag(), &dataStream);
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
+QUIC_STATUS ConnectionState::stream_send(const DataStreamState& dataStream,
+                                         StreamSendContextPtr streamSendContext,
+                                         QUIC_SEND_FLAGS flags)
+{
+    auto [buffers, bufferCount] = streamSendContext->get_buffers();
+    std::uint64_t numBytes = streamSendContext->totalLength;
+
+    // accounted before StreamSend, SEND_COMPLETE might be delivered before StreamSend returns
+    dataStream.streamContext_->inFlightBytes_.fetch_add(numBytes);
+    inFlightBytes_.fetch_add(numBytes);
+
+    QUIC_STATUS status =
+    moqtObject_.get_tbl()->StreamSend(dataStream.stream.get(), buffers, bufferCount,
+                                      flags | QUIC_SEND_FLAG_PRIORITY_WORK, streamSendContext.get());
+
+    // SEND_COMPLETE is not delivered for a failed send, otherwise it returns the context to the pool
+    if (QUIC_SUCCEEDED(status))
+        streamSendContext.release();
+    else
+        send_completed(*dataStream.streamContext_, numBytes);
+    return status;
+}
+
+std::uint64_t ConnectionState::stream_send_limit(const StreamContext& streamContext) const noexcept
+{
+    return std::max(sendBackpressurePolicy_.streamHighWater,
+                    streamContext.idealSendBufferBytes_.load(std::memory_order_relaxed));
+}
+
+/*
+    A blocked subscription sets the blocked flag, lists its waiter and checks again,
+    a completion takes the bytes off and then looks at the blocked flag and the waiters
+    (all sequentially consistent): either the completion sees the listed waiter
+    or the subscription sees the drained bytes, no wake up is lost
+*/
+bool ConnectionState::send_budget_exceeded(const ObjectIdentifier& objectIdentifier, bool streamExists)
+{
+    const SendBackpressurePolicy& policy = sendBackpressurePolicy_;
+    if (policy.connectionHighWater != 0 && inFlightBytes_.load() >= policy.connectionHighWater)
+    {
+        sendBlocked_.store(true);
+        return true;
+    }
+
+    if (policy.streamHighWater == 0 || !streamExists)
+        return false;
+
+    std::optional<DataStreams::Key> streamKey = stream_key(objectIdentifier);
+    if (!streamKey)
+        return false;
+
+    return dataStreams.read(
+    [&](const DataStreams& dataStreams)
+    {
+        DataStreamState* streamState = dataStreams.find(*streamKey);
+
+        // aborted (timeout), the next object opens a new stream
+        if (streamState == nullptr)
+            return false;
+
+        StreamContext& streamContext = *streamState->streamContext_;
+        if (streamContext.inFlightBytes_.load() < stream_send_limit(streamContext))
+            return false;
+
+        streamContext.sendBlocked_.store(true);
+        return true;
+    });
+}
+
+void ConnectionState::add_send_waiter(const std::shared_ptr<SubscriptionWaiter>& waiter)
+{
+    // already listed (or being woken up)
+    if (!waiter->list_for_send_budget())
+        return;
+
+    std::lock_guard l(sendWaitersMtx_);
+    sendWaiters_.push_back(waiter);
+    hasSendWaiters_.store(true);
+}
+
+void ConnectionState::send_completed(StreamContext& streamContext, std::uint64_t numBytes)
+{
+    std::uint64_t streamInFlightBytes = streamContext.inFlightBytes_.fetch_sub(numBytes) - numBytes;
+    std::uint64_t inFlightBytes = inFlightBytes_.fetch_sub(numBytes) - numBytes;
+
+    bool drained = false;
+    if (streamInFlightBytes < stream_send_limit(streamContext) && streamContext.sendBlocked_.load())
+        drained |= streamContext.sendBlocked_.exchange(false);
+    if (inFlightBytes <= sendBackpressurePolicy_.connectionLowWater && sendBlocked_.load())
+        drained |= sendBlocked_.exchange(false);
+
+    if (drained && hasSendWaiters_.load())
+        wake_send_waiters();
+}
+
+void ConnectionState::ideal_send_buffer_changed(StreamContext& streamContext, std::uint64_t numBytes)
+{
+    streamContext.idealSendBufferBytes_.store(numBytes, std::memory_order_relaxed);
+
+    // the path got faster, a stream held back by the old size can go on
+    if (streamContext.inFlightBytes_.load() < stream_send_limit(streamContext) &&
+        streamContext.sendBlocked_.load() && streamContext.sendBlocked_.exchange(false) &&
+        hasSendWaiters_.load())
+        wake_send_waiters();
+}
+
+void ConnectionState::wake_send_waiters()
+{
+    std::vector<std::weak_ptr<SubscriptionWaiter>> sendWaiters;
+    {
+        std::lock_guard l(sendWaitersMtx_);
+        sendWaiters.swap(sendWaiters_);
+        hasSendWaiters_.store(false);
+    }
+
+    // every waiter checks its own connection / stream again when it is run
+    for (auto& sendWaiter : sendWaiters)
+        if (auto sendWaiterSharedPtr = sendWaiter.lock())
+            sendWaiterSharedPtr->wake_for_send_budget();
+}
+
+QUIC_STATUS ConnectionState::flush_sends()
+{
+    std::vector<std::pair<std::weak_ptr<void>, const DataStreamState*>> pendingSends;
+    {
+        std::lock_guard l(pendingSendsMtx_);
+        if (pendingSends_.empty())
+            return QUIC_STATUS_SUCCESS;
+        pendingSends.swap(pendingSends_);
+    }
+
+    return dataStreams.read(
+    [&](const DataStreams&)
+    {
+        std::vector<std::pair<const DataStreamState*, StreamSendContextPtr>> streamSends;
+        for (auto& [lifeTimeFlag, dataStream] : pendingSends)
+        {
+            // streams are only erased with the writer lock held
+            if (lifeTimeFlag.expired())
+                continue;
+
+            std::lock_guard l(dataStream->pendingSendMtx_);
+            // already sent (flushed when it got full)
+            if (dataStream->pendingSend_)
+                streamSends.emplace_back(dataStream, std::move(dataStream->pendingSend_));
+        }
+
+        QUIC_STATUS status = QUIC_STATUS_SUCCESS;
+        for (std::size_t i = 0; i < streamSends.size(); ++i)
+        {
+            // the last send is not delayed, MsQuic then sends everything queued on the connection
+            QUIC_SEND_FLAGS flags =
+            (i + 1 == streamSends.size()) ? QUIC_SEND_FLAG_NONE : QUIC_SEND_FLAG_DELAY_SEND;
+
+            QUIC_STATUS sendStatus =
+            stream_send(*streamSends[i].first, std::move(streamSends[i].second), flags);
+            if (QUIC_FAILED(sendStatus))
+                status = sendStatus;
+        }
+        return status;
+    });
+}
+
 void ConnectionState::abort_if_sending(const ObjectIdentifier& oid)
 {
+    std::optional<DataStreams::Key> streamKey = stream_key(oid);
+    if (!streamKey)
+        return;
+
     dataStreams.write(
-    [&](StableContainer<DataStreamState>& dataStreams)
+    [&](DataStreams& dataStreams)
     {
-        auto iter = std::find_if(dataStreams.begin(), dataStreams.end(),
-                                 [&](DataStreamState& streamState)
-                                 { return streamState.can_send_object(oid); });
+        auto indexIter = dataStreams.index_.find(*streamKey);
+        if (indexIter != dataStreams.index_.end())
+            dataStreams.erase(indexIter->second);
+    });
+}
 
-        if (iter != dataStreams.end())
-            dataStreams.erase(iter);
+void ConnectionState::abort_group_streams(TrackAlias trackAlias, std::span<const std::uint64_t> groupIds)
+{
+    if (groupIds.empty())
+        return;
+
+    // pending sends of the erased streams are skipped by flush_sends (life time flag)
+    dataStreams.write(
+    [&](DataStreams& dataStreams)
+    {
+        for (std::uint64_t groupId : groupIds)
+        {
+            // TODO: subgroupId, see stream_key
+            auto indexIter = dataStreams.index_.find({ trackAlias.get(), groupId, 0 });
+            if (indexIter != dataStreams.index_.end())
+                dataStreams.erase(indexIter->second);
+        }
     });
 }
 
+std::optional<DataStreams::Key> ConnectionState::stream_key(const ObjectIdentifier& objectIdentifier)
+{
+    // one alias lookup per object (interned track identifier, precomputed hash), not one per stream
+    std::optional<TrackAlias> trackAlias = identifier_to_alias(objectIdentifier);
+    if (!trackAlias)
+        return std::nullopt;
+
+    // TOOD: get subgroupId
+    return DataStreams::Key{ trackAlias->get(), objectIdentifier.groupId_.get(), 0 };
+}
+
 std::optional<GroupId> ConnectionState::get_current_group(const TrackIdentifier& trackIdentifier)
 {
     // reader lock
@@ -1,14 +1,19 @@
 #include "serialization/messages.hpp"
 #include "serialization/serialization.hpp"
 #include "strong_types.hpp"
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
+#include <iterator>
 #include <data_manager.hpp>
 #include <filesystem>
-#include <fstream>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace depracated
 {
@@ -128,6 +133,46 @@ bool SubgroupHandle::add_object(std::string object)
     return storeReturn;
 }
 
+bool SubgroupHandle::add_object(PublishBuffer object)
+{
+    utils::ASSERT_LOG_THROW(beginObjectId_ < endObjectId_,
+                            "Pushing more objects than allowed");
+
+    auto groupHandleSharedPtr = groupHandle_.lock();
+    // checks if group still exists
+    if (!groupHandleSharedPtr)
+        return false;
+
+    bool storeReturn = dataManager_.store_object(groupHandleSharedPtr,
+                                                 ObjectId(beginObjectId_ + numObjects_++),
+                                                 std::move(object));
+
+    groupHandleSharedPtr->numStoredObjects_.fetch_add(storeReturn, std::memory_order_relaxed);
+
+    return storeReturn;
+}
+
+bool SubgroupHandle::add_objects(std::span<std::string> objects)
+{
+    utils::ASSERT_LOG_THROW(numObjects_ + objects.size() <= endObjectId_ - beginObjectId_,
+                            "Pushing more objects than allowed");
+
+    auto groupHandleSharedPtr = groupHandle_.lock();
+    // checks if group still exists
+    if (!groupHandleSharedPtr)
+        return false;
+
+    bool storeReturn = dataManager_.store_objects(groupHandleSharedPtr,
+                                                  ObjectId(beginObjectId_ + numObjects_), objects);
+    if (!storeReturn)
+        return false;
+
+    numObjects_ += objects.size();
+    groupHandleSharedPtr->numStoredObjects_.fetch_add(objects.size(), std::memory_order_relaxed);
+
+    return true;
+}
+
 void SubgroupHandle::cap()
 {
     auto groupHandleSharedPtr = groupHandle_.lock();
@@ -138,15 +183,10 @@ void SubgroupHandle::cap()
     endObjectId_ = beginObjectId_ + ObjectId(numObjects_);
 
     std::unique_lock l(groupHandleSharedPtr->objectIdsMtx_);
-    auto& objectIds = groupHandleSharedPtr->objectIds_;
-    auto iter = objectIds.find(beginObjectId_);
-    if (iter == objectIds.end())
-        return;
-    ++iter;
 
     // change the range of the subgroup in the group
-    objectIds.erase(iter);
-    objectIds.insert(endObjectId_.get() | (1ULL << 63));
+    if (groupHandleSharedPtr->objectIds_.set_end(beginObjectId_, endObjectId_))
+        groupHandleSharedPtr->log_subgroup(beginObjectId_, endObjectId_);
 }
 
 std::optional<SubgroupHandle> SubgroupHandle::cap_and_next()
@@ -158,33 +198,110 @@ std::optional<SubgroupHandle> SubgroupHandle::cap_and_next()
 
     endObjectId_ = beginObjectId_ + ObjectId(numObjects_);
 
-    std::unique_lock l(groupHandleSharedPtr->objectIdsMtx_);
-    auto& objectIds = groupHandleSharedPtr->objectIds_;
-    auto iter = objectIds.find(beginObjectId_);
-    if (iter == objectIds.end())
-        return {};
-    ++iter;
-
-    // change the range of the subgroup in the group
-    objectIds.erase(iter);
-    objectIds.insert(endObjectId_.get() | (1ULL << 63));
-
-    // Duplicated code from add_open_ended_subgroup
-    std::uint64_t beginObjectId = groupHandleSharedPtr->objectIds_.empty() ?
-                                  0 :
-                                  *groupHandleSharedPtr->objectIds_.rbegin();
-    beginObjectId &= (~(1ULL << 63)); // mask of last bit
-    groupHandleSharedPtr->objectIds_.insert(beginObjectId);
-    groupHandleSharedPtr->objectIds_.insert(std::numeric_limits<std::uint64_t>::max());
+    std::lock_guard notifyLock(groupHandleSharedPtr->notifyMtx_);
+    std::uint64_t beginObjectId;
+    std::vector<std::shared_ptr<TrackObserver>> observers;
+    {
+        std::unique_lock l(groupHandleSharedPtr->objectIdsMtx_);
+        auto& objectIds = groupHandleSharedPtr->objectIds_;
+
+        // change the range of the subgroup in the group
+        if (!objectIds.set_end(beginObjectId_, endObjectId_))
+            return {};
+        groupHandleSharedPtr->log_subgroup(beginObjectId_, endObjectId_);
+
+        // Duplicated code from add_open_ended_subgroup
+        beginObjectId = objectIds.end_object_id();
+        objectIds.append(beginObjectId, std::numeric_limits<std::uint64_t>::max());
+        groupHandleSharedPtr->log_subgroup(beginObjectId, std::numeric_limits<std::uint64_t>::max());
+        observers = groupHandleSharedPtr->track_observers();
+    }
+    groupHandleSharedPtr->notify_subgroup_added(observers, beginObjectId,
+                                                std::numeric_limits<std::uint64_t>::max());
 
     return SubgroupHandle(groupHandleSharedPtr, dataManager_, ObjectId(beginObjectId),
                           ObjectId(std::numeric_limits<std::uint64_t>::max()));
 }
 
+namespace
+{
+class TrackRegistry
+{
+    std::mutex mtx_;
+    // encoded (namespace, name) -> entry, entries erase themselves when the last reference goes away
+    std::unordered_map<std::string, std::weak_ptr<const void>> entries_;
+    std::uint64_t nextTrackId_ = 0;
+
+public:
+    // components are length prefixed so that ({"a", "b"}, "c") and ({"ab"}, "c") differ
+    static std::string encode(const std::vector<std::string>& tracknamespace, const std::string& trackname)
+    {
+        std::string key;
+        auto append = [&key](const std::string& str)
+        {
+            std::uint64_t size = str.size();
+            key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            key.append(str);
+        };
+        for (const auto& ns : tracknamespace)
+            append(ns);
+        append(trackname);
+        return key;
+    }
+
+    template <typename Interned>
+    std::shared_ptr<const Interned>
+    intern(std::vector<std::string>&& tracknamespace, std::string&& trackname)
+    {
+        std::string key = encode(tracknamespace, trackname);
+
+        std::lock_guard l(mtx_);
+
+        auto [iter, inserted] = entries_.try_emplace(key);
+        if (!inserted)
+            if (auto existing = iter->second.lock())
+                return std::static_pointer_cast<const Interned>(existing);
+
+        std::uint64_t hash = 0;
+        for (const auto& ns : tracknamespace)
+            boost::hash_combine(hash, ns);
+        boost::hash_combine(hash, trackname);
+
+        std::shared_ptr<const Interned> interned(
+        new Interned{ std::move(tracknamespace), std::move(trackname), nextTrackId_++, hash },
+        [this, key = std::move(key)](const Interned* interned)
+        {
+            {
+                std::lock_guard l(mtx_);
+                // the key might have been re-interned after this entry expired
+                auto iter = entries_.find(key);
+                if (iter != entries_.end() && iter->second.expired())
+                    entries_.erase(iter);
+            }
+            delete interned;
+        });
+
+        iter->second = interned;
+        return interned;
+    }
+};
+
+// never destroyed, TrackIdentifiers might outlive static destruction
+TrackRegistry& get_track_registry()
+{
+    static TrackRegistry* trackRegistry = new TrackRegistry();
+    return *trackRegistry;
+}
+} // namespace
+
+std::shared_ptr<const TrackIdentifier::Interned>
+TrackIdentifier::intern(std::vector<std::string> tracknamespace, std::string trackname)
+{
+    return get_track_registry().intern<Interned>(std::move(tracknamespace), std::move(trackname));
+}
+
 TrackIdentifier::TrackIdentifier(std::vector<std::string> trackNamespace, std::string tname)
-: trackIdentifierInternal_(
-  std::make_shared<std::pair<std::vector<std::string>, std::string>>(std::move(trackNamespace),
-                                                                     std::move(tname)))
+: trackIdentifierInternal_(intern(std::move(trackNamespace), std::move(tname)))
 {
 }
 
@@ -222,24 +339,39 @@ SubGroupId ObjectIdentifier::get_subgroup_id(DataManager& dataManager) const
 GroupHandle::GroupHandle(GroupIdentifier groupIdentifier,
                          PublisherPriority publisherPriority,
                          std::optional<std::chrono::milliseconds> deliveryTimeout,
-                         DataManager& dataManagerHandle)
+                         DataManager& dataManagerHandle,
+                         std::uint64_t trackKey,
+                         std::weak_ptr<TrackHandle> trackHandle)
 : groupIdentifier_(std::move(groupIdentifier)), publisherPriority_(publisherPriority),
-  deliveryTimeout_(deliveryTimeout), dataManager_(dataManagerHandle)
+  deliveryTimeout_(deliveryTimeout), dataManager_(dataManagerHandle),
+  cacheKey_(dataManager_.nextGroupCacheKey_.fetch_add(1, std::memory_order_relaxed)),
+  // track directory is created by TrackHandle
+  segmentLog_(dataManager_.get_segment_path_string(groupIdentifier_), *dataManager_.storageIo_,
+              dataManager_.segmentFiles_),
+  trackKey_(trackKey), trackHandle_(std::move(trackHandle))
 {
-    // create directory if it does not exist
-    std::string pathString = dataManager_.get_path_string(groupIdentifier_);
-    std::filesystem::create_directories(pathString);
+}
+
+GroupHandle::~GroupHandle()
+{
+    dataManager_.objectCache_.erase_group(cacheKey_);
 }
 
 SubgroupHandle GroupHandle::add_subgroup(std::uint64_t numElements)
 {
-    // writer lock
-    std::unique_lock<std::shared_mutex> l(objectIdsMtx_);
+    std::lock_guard notifyLock(notifyMtx_);
+    std::uint64_t beginObjectId;
+    std::vector<std::shared_ptr<TrackObserver>> observers;
+    {
+        // writer lock
+        std::unique_lock<std::shared_mutex> l(objectIdsMtx_);
 
-    std::uint64_t beginObjectId = objectIds_.empty() ? 0 : *objectIds_.rbegin();
-    beginObjectId &= (~(1ULL << 63)); // mask of last bit
-    objectIds_.insert(beginObjectId);
-    objectIds_.insert((beginObjectId + numElements) | (1ULL << 63));
+        beginObjectId = objectIds_.end_object_id();
+        objectIds_.append(beginObjectId, beginObjectId + numElements);
+        log_subgroup(beginObjectId, beginObjectId + numElements);
+        observers = track_observers();
+    }
+    notify_subgroup_added(observers, beginObjectId, beginObjectId + numElements);
 
     return SubgroupHandle(weak_from_this(), dataManager_, ObjectId(beginObjectId),
                           ObjectId(beginObjectId + numElements));
@@ -247,28 +379,165 @@ SubgroupHandle GroupHandle::add_subgroup(std::uint64_t numElements)
 
 SubgroupHandle GroupHandle::add_open_ended_subgroup()
 {
-    // writer lock
-    std::unique_lock<std::shared_mutex> l(objectIdsMtx_);
+    std::lock_guard notifyLock(notifyMtx_);
+    std::uint64_t beginObjectId;
+    std::vector<std::shared_ptr<TrackObserver>> observers;
+    {
+        // writer lock
+        std::unique_lock<std::shared_mutex> l(objectIdsMtx_);
 
-    std::uint64_t beginObjectId = objectIds_.empty() ? 0 : *objectIds_.rbegin();
-    beginObjectId &= (~(1ULL << 63)); // mask of last bit
-    objectIds_.insert(beginObjectId);
-    objectIds_.insert(std::numeric_limits<std::uint64_t>::max());
+        beginObjectId = objectIds_.end_object_id();
+        objectIds_.append(beginObjectId, std::numeric_limits<std::uint64_t>::max());
+        log_subgroup(beginObjectId, std::numeric_limits<std::uint64_t>::max());
+        observers = track_observers();
+    }
+    notify_subgroup_added(observers, beginObjectId, std::numeric_limits<std::uint64_t>::max());
 
     return SubgroupHandle(weak_from_this(), dataManager_, ObjectId(beginObjectId),
                           ObjectId(std::numeric_limits<std::uint64_t>::max()));
 }
 
+void GroupHandle::log_subgroup(std::uint64_t beginObjectId, std::uint64_t endObjectId)
+{
+    dataManager_.manifest_.log_subgroup(
+    { trackKey_, groupIdentifier_.groupId_.get(), beginObjectId, endObjectId });
+}
+
+std::vector<std::shared_ptr<TrackObserver>> GroupHandle::track_observers()
+{
+    if (auto trackHandleSharedPtr = trackHandle_.lock())
+        return trackHandleSharedPtr->observers();
+    return {};
+}
+
+void GroupHandle::notify_subgroup_added(std::span<const std::shared_ptr<TrackObserver>> observers,
+                                        std::uint64_t beginObjectId,
+                                        std::uint64_t endObjectId)
+{
+    if (observers.empty())
+        return;
+
+    std::shared_ptr<GroupHandle> groupHandleSharedPtr = shared_from_this();
+    for (const auto& observer : observers)
+        observer->notify_subgroup_added(groupHandleSharedPtr, ObjectId(beginObjectId),
+                                        ObjectId(endObjectId));
+}
+
+std::uint64_t GroupHandle::recover()
+{
+    segmentLog_.recover();
+
+    std::unique_lock l(objectIdsMtx_);
+
+    /*
+        the publishers are gone, objects which were not persisted before the restart never show up
+        every subgroup is capped at its first missing object so that nobody waits for it forever
+        (open ended subgroups end up capped after their last recovered object)
+        the caps are logged, the next restart replays them
+    */
+    std::uint64_t numObjects = 0;
+    for (std::size_t subgroupIdx = 0; subgroupIdx < objectIds_.num_subgroups(); ++subgroupIdx)
+    {
+        std::uint64_t beginObjectId = objectIds_.subgroup_begin(subgroupIdx);
+        std::uint64_t endObjectId = objectIds_.subgroup_end(subgroupIdx);
+
+        std::uint64_t objectId = beginObjectId;
+        for (; objectId < endObjectId && segmentLog_.contains(ObjectId(objectId)); ++objectId)
+        {
+            std::atomic<ObjectWaitStatus>* objectState = objectStates_.get_or_create(objectId);
+            if (objectState == nullptr)
+                break;
+            objectState->store(ObjectWaitStatus::Ready, std::memory_order_relaxed);
+            ++numObjects;
+        }
+
+        if (objectId != endObjectId)
+        {
+            objectIds_.set_end(beginObjectId, objectId);
+            log_subgroup(beginObjectId, objectId);
+        }
+    }
+
+    numStoredObjects_.store(numObjects, std::memory_order_release);
+    return numObjects;
+}
+
+bool GroupHandle::add_waiter(std::uint64_t objectId,
+                             const std::atomic<ObjectWaitStatus>& objectState,
+                             const std::shared_ptr<ObjectWaiter>& waiter)
+{
+    std::lock_guard l(waitersMtx_);
+
+    // announce the waiter before looking at the state (see numWaiters_)
+    numWaiters_.fetch_add(1, std::memory_order_seq_cst);
+    if (objectState.load(std::memory_order_seq_cst) == ObjectWaitStatus::Ready)
+    {
+        numWaiters_.fetch_sub(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // readers which are gone are pruned before growing
+    if (waiters_.size() == waiters_.capacity())
+    {
+        std::size_t numExpired = std::erase_if(waiters_, [](const auto& objectIdWaiter)
+                                               { return objectIdWaiter.second.expired(); });
+        numWaiters_.fetch_sub(numExpired, std::memory_order_relaxed);
+    }
+
+    waiters_.emplace_back(objectId, waiter);
+    return true;
+}
+
+void GroupHandle::notify_waiters(std::uint64_t firstObjectId, std::span<const ObjectBufferRef> objectBuffers)
+{
+    if (numWaiters_.load(std::memory_order_seq_cst) == 0)
+        return;
+
+    std::uint64_t endObjectId = firstObjectId + objectBuffers.size();
+
+    // notified outside the lock, waiters may take their own locks
+    std::vector<std::pair<std::uint64_t, std::weak_ptr<ObjectWaiter>>> readyWaiters;
+    {
+        std::lock_guard l(waitersMtx_);
+
+        auto readyBegin =
+        std::partition(waiters_.begin(), waiters_.end(),
+                       [firstObjectId, endObjectId](const auto& objectIdWaiter)
+                       {
+                           return objectIdWaiter.first < firstObjectId ||
+                                  objectIdWaiter.first >= endObjectId;
+                       });
+
+        std::move(readyBegin, waiters_.end(), std::back_inserter(readyWaiters));
+        waiters_.erase(readyBegin, waiters_.end());
+        numWaiters_.fetch_sub(readyWaiters.size(), std::memory_order_relaxed);
+    }
+
+    for (auto& [objectId, waiterWeakPtr] : readyWaiters)
+        if (auto waiter = waiterWeakPtr.lock())
+            waiter->notify_object_ready(*this, ObjectId(objectId), objectBuffers[objectId - firstObjectId]);
+}
+
+bool GroupHandle::add_objects(std::span<std::string> objects)
+{
+    SubgroupHandle subgroupHandle = add_subgroup(objects.size());
+    return subgroupHandle.add_objects(objects);
+}
+
 bool GroupHandle::has_object_id(ObjectId objectId)
 {
     // reader lock
     std::shared_lock<std::shared_mutex> l(objectIdsMtx_);
 
-    auto iter = objectIds_.upper_bound(objectId.get());
-    if (iter == objectIds_.begin())
-        return false;
+    return objectIds_.contains(objectId.get());
+}
 
-    return *std::prev(iter) <= objectId.get();
+std::optional<ObjectId> GroupHandle::next_object_id(ObjectId objectId)
+{
+    ObjectId nextObjectId = objectId + ObjectId(1);
+    if (!has_object_id(nextObjectId))
+        return std::nullopt;
+    return nextObjectId;
 }
 
 std::uint64_t GroupHandle::num_objects_in_range(ObjectId left, ObjectId right)
@@ -276,41 +545,218 @@ std::uint64_t GroupHandle::num_objects_in_range(ObjectId left, ObjectId right)
     // reader lock
     std::shared_lock<std::shared_mutex> l(objectIdsMtx_);
 
-    std::uint64_t numObjects = 0;
+    return objectIds_.num_objects_in_range(left.get(), right.get());
+}
 
-    if (objectIds_.empty())
-        return numObjects;
 
+TrackHandle::TrackHandle(DataManager& dataManagerHandle, TrackIdentifier trackIdentifier, std::uint64_t trackKey)
+: dataManager_(dataManagerHandle), trackIdentifier_(std::move(trackIdentifier)), trackKey_(trackKey)
+{
+    // create directory if it does not exist
+    std::string pathString = dataManager_.get_path_string(trackIdentifier_);
+    std::filesystem::create_directories(pathString);
+}
 
-    // beginning objectId of the subgroup left is in
-    auto subGroupBeginIter = --objectIds_.upper_bound(left.get());
-    while (subGroupBeginIter != objectIds_.end())
-    {
-        auto subGroupEndIter = std::next(subGroupBeginIter);
-        ObjectId endBound = ObjectId(*subGroupEndIter & (~(1ULL << 63)));
+std::weak_ptr<GroupHandle>
+TrackHandle::add_group(GroupId groupId,
+                       PublisherPriority publisherPriority,
+                       std::optional<std::chrono::milliseconds> deliveryTimeout)
+{
+    // writer lock
+    std::unique_lock<std::shared_mutex> l(groupHandlesMtx_);
+
+    auto [iter, success] =
+    groupHandles_.try_emplace(groupId,
+                              std::make_shared<GroupHandle>(GroupIdentifier(trackIdentifier_, groupId),
+                                                            publisherPriority, deliveryTimeout,
+                                                            dataManager_, trackKey_, weak_from_this()));
+
+    if (success)
+        dataManager_.manifest_.log_group(
+        { trackKey_, groupId.get(), publisherPriority.get(), deliveryTimeout });
+
+    return iter->second->weak_from_this();
+}
+
+void TrackHandle::add_observer(std::weak_ptr<TrackObserver> observer)
+{
+    std::lock_guard l(observersMtx_);
 
-        if (endBound >= right)
+    // unsubscribed readers are dropped before the vector grows (amortized O(1))
+    if (observers_.size() == observers_.capacity())
+        std::erase_if(observers_, [](const std::weak_ptr<TrackObserver>& observer) { return observer.expired(); });
+    observers_.push_back(std::move(observer));
+}
+
+std::vector<std::shared_ptr<TrackObserver>> TrackHandle::observers()
+{
+    std::vector<std::shared_ptr<TrackObserver>> observers;
+    std::lock_guard l(observersMtx_);
+    observers.reserve(observers_.size());
+
+    // O(1) removal of expired observers, the order does not matter
+    for (std::size_t i = 0; i < observers_.size();)
+    {
+        if (auto observer = observers_[i].lock())
         {
-            numObjects += right.get() - left.get();
-            break;
+            observers.push_back(std::move(observer));
+            ++i;
         }
         else
         {
-            numObjects += endBound.get() - left.get();
-            subGroupBeginIter = std::next(subGroupEndIter);
+            observers_[i] = std::move(observers_.back());
+            observers_.pop_back();
         }
     }
+    return observers;
+}
 
-    return numObjects;
+DataManager::DataManager(DataManagerOptions options)
+: storageIo_(make_storage_io(options.storageBackend_)),
+  segmentFiles_(options.maxOpenSegmentFiles_), objectCache_(options.cacheBudgetBytes_),
+  persister_(objectCache_, *storageIo_, manifest_, options.maxPendingPersistenceBytes_)
+{
+    TimePoint constructionTimePoint = Clock::now();
+
+    if (!options.recoverFromStorage_)
+        // Remove data directory
+        std::filesystem::remove_all(DATA_DIRECTORY);
+
+    std::filesystem::create_directories(DATA_DIRECTORY);
+    // opened before the replay: caps applied while recovering are appended to the replayed manifest
+    manifest_.open(get_manifest_path_string());
+
+    if (options.recoverFromStorage_)
+        recover_from_storage(constructionTimePoint);
 }
 
+std::weak_ptr<TrackHandle>
+DataManager::add_track_identifier(std::vector<std::string> tracknamespace, std::string trackname)
+{
+    TrackIdentifier trackIdentifier(std::move(tracknamespace), std::move(trackname));
+
+    std::unique_lock l(objectHierarchyMtx_);
+
+    auto [iter, success] = objectHierarchy_.try_emplace(trackIdentifier.track_id(), nullptr);
+    if (success)
+    {
+        std::uint64_t trackKey = nextTrackKey_.fetch_add(1, std::memory_order_relaxed);
+        iter->second = std::make_shared<TrackHandle>(*this, trackIdentifier, trackKey);
+        manifest_.log_track({ trackKey, trackIdentifier.tnamespace(), trackIdentifier.tname() });
+    }
 
-TrackHandle::TrackHandle(DataManager& dataManagerHandle, TrackIdentifier trackIdentifier)
-: dataManager_(dataManagerHandle), trackIdentifier_(std::move(trackIdentifier))
+    return iter->second->weak_from_this();
+}
+
+void DataManager::recover_from_storage(TimePoint constructionTimePoint)
 {
-    // create directory if it does not exist
-    std::string pathString = dataManager_.get_path_string(trackIdentifier_);
-    std::filesystem::create_directories(pathString);
+    std::string manifestPath = get_manifest_path_string();
+    Manifest::Contents contents = Manifest::read(manifestPath);
+
+    // the manifest is appended to, records logged from now on (e.g. caps) must not end up
+    // behind a torn record, where the next replay would stop before them
+    std::error_code ec;
+    if (std::filesystem::file_size(manifestPath, ec) > contents.validLength_ && !ec)
+        std::filesystem::resize_file(manifestPath, contents.validLength_, ec);
+    if (ec)
+        utils::LOG_EVENT(std::cout, "Failed to cut the torn tail off the manifest: ", ec.message());
+
+    // trackKey -> track, trackKeys are unique so there are no duplicate tracks
+    std::unordered_map<std::uint64_t, std::shared_ptr<TrackHandle>> trackHandles;
+    for (auto& trackRecord : contents.tracks_)
+    {
+        TrackIdentifier trackIdentifier(std::move(trackRecord.tracknamespace_),
+                                        std::move(trackRecord.trackname_));
+
+        auto trackHandle =
+        std::make_shared<TrackHandle>(*this, trackIdentifier, trackRecord.trackKey_);
+        objectHierarchy_.try_emplace(trackIdentifier.track_id(), trackHandle);
+        trackHandles.try_emplace(trackRecord.trackKey_, std::move(trackHandle));
+
+        if (trackRecord.trackKey_ >= nextTrackKey_.load(std::memory_order_relaxed))
+            nextTrackKey_.store(trackRecord.trackKey_ + 1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t numGroups = 0;
+    for (const auto& groupRecord : contents.groups_)
+    {
+        auto trackIter = trackHandles.find(groupRecord.trackKey_);
+        if (trackIter == trackHandles.end())
+            continue;
+
+        auto& trackHandle = trackIter->second;
+        GroupId groupId(groupRecord.groupId_);
+        auto [iter, success] = trackHandle->groupHandles_.try_emplace(
+        groupId, std::make_shared<GroupHandle>(GroupIdentifier(trackHandle->trackIdentifier_, groupId),
+                                               PublisherPriority(groupRecord.publisherPriority_),
+                                               groupRecord.deliveryTimeout_, *this,
+                                               groupRecord.trackKey_, trackHandle));
+        numGroups += success;
+    }
+
+    for (const auto& subgroupRecord : contents.subgroups_)
+    {
+        auto trackIter = trackHandles.find(subgroupRecord.trackKey_);
+        if (trackIter == trackHandles.end())
+            continue;
+
+        auto& groupHandles = trackIter->second->groupHandles_;
+        auto groupIter = groupHandles.find(GroupId(subgroupRecord.groupId_));
+        if (groupIter == groupHandles.end())
+            continue;
+
+        // later records for the same subgroup are caps
+        auto& objectIds = groupIter->second->objectIds_;
+        if (!objectIds.set_end(subgroupRecord.begin_, subgroupRecord.end_))
+            objectIds.append(subgroupRecord.begin_, subgroupRecord.end_);
+    }
+
+    TimePoint manifestReplayedTimePoint = Clock::now();
+
+    // rebuild object indices, one track at a time per worker
+    std::vector<std::shared_ptr<TrackHandle>> tracks;
+    tracks.reserve(trackHandles.size());
+    for (auto& [_, trackHandle] : trackHandles)
+        tracks.push_back(trackHandle);
+
+    std::atomic<std::size_t> nextTrack{};
+    std::atomic<std::uint64_t> numObjects{};
+    auto rebuild = [&tracks, &nextTrack, &numObjects]()
+    {
+        std::size_t trackIdx;
+        while ((trackIdx = nextTrack.fetch_add(1, std::memory_order_relaxed)) < tracks.size())
+        {
+            std::uint64_t numTrackObjects = 0;
+            for (auto& [_, groupHandle] : tracks[trackIdx]->groupHandles_)
+                numTrackObjects += groupHandle->recover();
+            numObjects.fetch_add(numTrackObjects, std::memory_order_relaxed);
+        }
+    };
+
+    {
+        std::size_t numWorkers =
+        std::min<std::size_t>(std::max(1U, std::thread::hardware_concurrency()), tracks.size());
+        std::vector<std::jthread> workers;
+        for (std::size_t i = 1; i < numWorkers; ++i)
+            workers.emplace_back(rebuild);
+        rebuild();
+    }
+
+    TimePoint servingTimePoint = Clock::now();
+
+    auto to_us = [](auto duration)
+    { return std::chrono::duration_cast<std::chrono::microseconds>(duration); };
+
+    recoveryStats_ = RecoveryStats{ tracks.size(),
+                                    numGroups,
+                                    numObjects.load(std::memory_order_relaxed),
+                                    to_us(manifestReplayedTimePoint - constructionTimePoint),
+                                    to_us(servingTimePoint - manifestReplayedTimePoint),
+                                    to_us(servingTimePoint - constructionTimePoint) };
+
+    utils::LOG_EVENT(std::cout, "Recovered", recoveryStats_->numTracks_, "tracks,",
+                     recoveryStats_->numGroups_, "groups,", recoveryStats_->numObjects_,
+                     "objects, time to serving:", recoveryStats_->timeToServing_.count(), "us");
 }
 
 std::string DataManager::get_path_string(const TrackIdentifier& trackIdentifier)
@@ -322,50 +768,170 @@ std::string DataManager::get_path_string(const TrackIdentifier& trackIdentifier)
     return pathString;
 }
 
-std::string DataManager::get_path_string(const GroupIdentifier& groupIdentifier)
+std::string DataManager::get_segment_path_string(const GroupIdentifier& groupIdentifier)
 {
     return get_path_string(static_cast<const TrackIdentifier&>(groupIdentifier)) +
-           std::to_string(groupIdentifier.groupId_) + "/";
+           std::to_string(groupIdentifier.groupId_) + ".log";
 }
 
-std::string DataManager::get_path_string(const ObjectIdentifier& objectIdentifier)
+std::string DataManager::get_manifest_path_string()
 {
-    return get_path_string(static_cast<const GroupIdentifier&>(objectIdentifier)) +
-           std::to_string(objectIdentifier.objectId_);
+    return std::string(DATA_DIRECTORY) + ".raven_manifest";
 }
 
-// returns true if object has been stored
+// payload is at the end of the serialized object (after the objectId and length var ints)
+static std::string_view get_payload(const ObjectBufferRef& objectBuffer, std::uint64_t payloadLength)
+{
+    QUIC_BUFFER* quicBuffer = objectBuffer->quic_buffer();
+    return { reinterpret_cast<const char*>(quicBuffer->Buffer) + quicBuffer->Length - payloadLength,
+             payloadLength };
+}
+
+void DataManager::publish_object(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                                 ObjectId objectId,
+                                 std::atomic<ObjectWaitStatus>* objectState,
+                                 ObjectBufferRef objectBuffer,
+                                 std::uint64_t payloadLength)
+{
+    std::string_view payload = get_payload(objectBuffer, payloadLength);
+
+    // dirty: can not be evicted till the persister has written it
+    objectCache_.put({ groupHandleSharedPtr->cacheKey_, objectId.get() }, objectBuffer, true);
+
+    // publishes the object, wakes up everyone holding a wait signal for it
+    // seq_cst: pairs with GroupHandle::add_waiter
+    objectState->store(ObjectWaitStatus::Ready, std::memory_order_seq_cst);
+    groupHandleSharedPtr->notify_waiters(objectId.get(), { &objectBuffer, 1 });
+
+    // blocks if the persister is too far behind
+    persister_.enqueue({ std::move(groupHandleSharedPtr), objectId, std::move(objectBuffer),
+                         payload, Clock::now() });
+}
+
+// returns true if object has been stored (in memory, persistence happens in the background)
 bool DataManager::store_object(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
                                ObjectId objectId,
                                std::string&& object)
 {
+    if (object.size() > maxPayloadSize)
+        return false;
+
+    std::atomic<ObjectWaitStatus>* objectState =
+    groupHandleSharedPtr->objectStates_.get_or_create(objectId.get());
+    if (objectState == nullptr)
+        return false;
+
     StreamHeaderSubgroupObject subgroupObject;
     subgroupObject.objectId_ = objectId;
-    subgroupObject.payload_ = object;
+    subgroupObject.payload_ = std::move(object);
 
-    QUIC_BUFFER* quicBuffer = serialization::serialize(subgroupObject);
+    ObjectBufferRef objectBuffer(ObjectBuffer::create(serialization::serialize(subgroupObject)));
 
-    groupHandleSharedPtr->groupCache_.write(
-    [quicBuffer, objectId](auto& cache)
-    { cache.emplace(ObjectId(objectId), quicBuffer); });
+    publish_object(std::move(groupHandleSharedPtr), objectId, objectState,
+                   std::move(objectBuffer), subgroupObject.payload_.size());
+    return true;
+}
 
-    std::string pathString =
-    get_path_string(groupHandleSharedPtr->groupIdentifier_) + std::to_string(objectId);
-    std::string tempFilePath = pathString + ".temp";
+bool DataManager::store_object(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                               ObjectId objectId,
+                               PublishBuffer&& publishBuffer)
+{
+    if (publishBuffer.size() > maxPayloadSize)
+        return false;
 
-    std::ofstream file(tempFilePath);
-    if (!file.is_open())
+    std::atomic<ObjectWaitStatus>* objectState =
+    groupHandleSharedPtr->objectStates_.get_or_create(objectId.get());
+    if (objectState == nullptr)
         return false;
-    file << subgroupObject.payload_;
 
-    groupHandleSharedPtr->objectWaitSignals_.write(
-    [&objectId](auto& waitSignals)
+    // header goes into the headroom, right in front of the payload
+    std::uint64_t payloadLength = publishBuffer.size();
+    std::uint64_t headerLength =
+    serialization::serialize_subgroup_object_header(publishBuffer.data(), objectId.get(), payloadLength);
+    std::uint8_t* serializedBegin = publishBuffer.data() - headerLength;
+
+    ObjectBufferRef objectBuffer(
+    ObjectBuffer::create(publishBuffer.release(), serializedBegin, headerLength + payloadLength));
+
+    publish_object(std::move(groupHandleSharedPtr), objectId, objectState,
+                   std::move(objectBuffer), payloadLength);
+    return true;
+}
+
+bool DataManager::store_objects(std::shared_ptr<GroupHandle> groupHandleSharedPtr,
+                                ObjectId firstObjectId,
+                                std::span<std::string> objects)
+{
+    if (objects.empty())
+        return true;
+
+    // nothing is published if any object is too large or any object id is out of range
+    for (const auto& object : objects)
+        if (object.size() > maxPayloadSize)
+            return false;
+
+    std::vector<std::atomic<ObjectWaitStatus>*> objectStates(objects.size());
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        objectStates[i] = groupHandleSharedPtr->objectStates_.get_or_create(firstObjectId.get() + i);
+        if (objectStates[i] == nullptr)
+            return false;
+    }
+
+    // serialize every object back to back into one allocation
+    std::uint64_t arenaSize = 0;
+    for (const auto& object : objects)
+        // objectId and payload length are var ints of at most 8 bytes each
+        arenaSize += 2 * sizeof(std::uint64_t) + object.size();
+
+    ds::chunk arenaChunk;
+    arenaChunk.reserve(arenaSize);
+
+    // (offset, length) of every object in the arena
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> objectRanges;
+    objectRanges.reserve(objects.size());
+
+    std::vector<std::uint64_t> payloadLengths;
+    payloadLengths.reserve(objects.size());
+
+    StreamHeaderSubgroupObject subgroupObject;
+    for (std::size_t i = 0; i < objects.size(); ++i)
     {
-        auto iter = waitSignals.find(objectId);
-        if (iter != waitSignals.end())
-            iter->second->store(ObjectWaitStatus::Ready, std::memory_order_release);
-    });
-    std::filesystem::rename(tempFilePath, pathString);
+        subgroupObject.objectId_ = firstObjectId + ObjectId(i);
+        subgroupObject.payload_ = std::move(objects[i]);
+
+        std::uint64_t offset = arenaChunk.size();
+        std::uint64_t length = serialization::serialize_into(arenaChunk, subgroupObject);
+        objectRanges.emplace_back(offset, length);
+        payloadLengths.push_back(subgroupObject.payload_.size());
+    }
+
+    ObjectBufferArena* arena =
+    ObjectBufferArena::create(std::get<0>(arenaChunk.release()), objects.size());
+
+    std::vector<ObjectBufferRef> objectBuffers;
+    objectBuffers.reserve(objects.size());
+    for (const auto& [offset, length] : objectRanges)
+        objectBuffers.emplace_back(ObjectBuffer::create(arena, offset, length));
+
+    // object buffers hold the arena from here on
+    arena->release();
+
+    objectCache_.put_batch(groupHandleSharedPtr->cacheKey_, firstObjectId.get(), objectBuffers, true);
+
+    for (auto* objectState : objectStates)
+        objectState->store(ObjectWaitStatus::Ready, std::memory_order_seq_cst);
+    // every waiter of the batch is notified once
+    groupHandleSharedPtr->notify_waiters(firstObjectId.get(), objectBuffers);
+
+    std::vector<WriteBehindPersister::Job> jobs;
+    jobs.reserve(objects.size());
+    TimePoint enqueueTimePoint = Clock::now();
+    for (std::size_t i = 0; i < objects.size(); ++i)
+        jobs.push_back({ groupHandleSharedPtr, firstObjectId + ObjectId(i), objectBuffers[i],
+                         get_payload(objectBuffers[i], payloadLengths[i]), enqueueTimePoint });
+
+    persister_.enqueue_batch(std::move(jobs));
     return true;
 }
 
@@ -384,7 +950,7 @@ std::optional<ObjectId> DataManager::get_first_object(const GroupIdentifier& gro
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(groupIdentifier);
+    auto iter = objectHierarchy_.find(groupIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return std::nullopt;
 
@@ -402,14 +968,14 @@ std::optional<ObjectId> DataManager::get_first_object(const GroupIdentifier& gro
     if (groupHandleSharedPtr->objectIds_.empty())
         return std::nullopt;
 
-    return ObjectId(*groupHandleSharedPtr->objectIds_.begin());
+    return ObjectId(groupHandleSharedPtr->objectIds_.first_object_id());
 }
 
 std::optional<GroupId> DataManager::get_first_group(const TrackIdentifier& trackIdentifier)
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(trackIdentifier);
+    auto iter = objectHierarchy_.find(trackIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return std::nullopt;
 
@@ -427,7 +993,7 @@ DataManager::get_latest_registered_object(const GroupIdentifier& groupIdentifier
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(groupIdentifier);
+    auto iter = objectHierarchy_.find(groupIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return std::nullopt;
 
@@ -445,7 +1011,7 @@ DataManager::get_latest_registered_object(const GroupIdentifier& groupIdentifier
     if (groupHandleSharedPtr->objectIds_.empty())
         return std::nullopt;
 
-    return ObjectId(*groupHandleSharedPtr->objectIds_.rbegin() & (~(1ULL << 63)));
+    return ObjectId(groupHandleSharedPtr->objectIds_.end_object_id());
 }
 
 std::optional<ObjectId>
@@ -453,7 +1019,7 @@ DataManager::get_latest_concrete_object(const GroupIdentifier& groupIdentifier)
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(groupIdentifier);
+    auto iter = objectHierarchy_.find(groupIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return std::nullopt;
 
@@ -482,7 +1048,7 @@ DataManager::get_publisher_priority(const GroupIdentifier& groupIdentifier)
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(groupIdentifier);
+    auto iter = objectHierarchy_.find(groupIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return std::nullopt;
 
@@ -497,72 +1063,75 @@ DataManager::get_publisher_priority(const GroupIdentifier& groupIdentifier)
     return groupHandleIter->second->publisherPriority_;
 }
 
-ObjectOrStatus DataManager::get_object(const ObjectIdentifier& objectIdentifier)
+ObjectOrStatus DataManager::get_object(const ObjectIdentifier& objectIdentifier,
+                                       const std::shared_ptr<ObjectWaiter>& waiter)
 {
-    // we have reader lock at each step in hierarchy
-    // so can be sure that nothing will be deleted (needs writer lock)
-    std::shared_lock l(objectHierarchyMtx_);
+    std::shared_ptr<GroupHandle> groupHandleSharedPtr;
+    {
+        // we have reader lock at each step in hierarchy
+        // so can be sure that nothing will be deleted (needs writer lock)
+        std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(objectIdentifier);
-    if (iter == objectHierarchy_.end())
-        return DoesNotExist{ "Track does not exist" };
+        auto iter = objectHierarchy_.find(objectIdentifier.track_id());
+        if (iter == objectHierarchy_.end())
+            return DoesNotExist{ "Track does not exist" };
 
-    auto trackHandleSharedPtr = iter->second;
-    l = std::shared_lock(trackHandleSharedPtr->groupHandlesMtx_);
+        auto trackHandleSharedPtr = iter->second;
+        l = std::shared_lock(trackHandleSharedPtr->groupHandlesMtx_);
 
-    auto groupHandleIter =
-    trackHandleSharedPtr->groupHandles_.find(objectIdentifier.groupId_);
+        auto groupHandleIter =
+        trackHandleSharedPtr->groupHandles_.find(objectIdentifier.groupId_);
 
-    if (groupHandleIter == trackHandleSharedPtr->groupHandles_.end())
-        return DoesNotExist{ "Group does not exist" };
+        if (groupHandleIter == trackHandleSharedPtr->groupHandles_.end())
+            return DoesNotExist{ "Group does not exist" };
 
-    std::shared_ptr<GroupHandle> groupHandleSharedPtr = groupHandleIter->second;
-    l = std::shared_lock(groupHandleSharedPtr->objectIdsMtx_);
+        groupHandleSharedPtr = groupHandleIter->second;
+    }
 
-    if (!groupHandleSharedPtr->has_object_id(objectIdentifier.objectId_))
+    return get_object(*groupHandleSharedPtr, objectIdentifier.objectId_, waiter);
+}
+
+ObjectOrStatus DataManager::get_object(GroupHandle& groupHandle,
+                                       ObjectId objectId,
+                                       const std::shared_ptr<ObjectWaiter>& waiter)
+{
+    if (!groupHandle.has_object_id(objectId))
         return DoesNotExist{ "Object does not exist" };
 
-    QUIC_BUFFER* quicBuffer = groupHandleSharedPtr->groupCache_.read(
-    [&objectIdentifier](const auto& groupCache) -> QUIC_BUFFER*
-    {
-        auto iter = groupCache.find(objectIdentifier.objectId_);
-        if (iter != groupCache.end())
-            return iter->second;
-        return nullptr;
-    });
-
-    if (quicBuffer != nullptr)
-        return std::make_tuple(quicBuffer, groupHandleSharedPtr->deliveryTimeout_);
-
-    std::string pathString = get_path_string(objectIdentifier);
-    std::ifstream file(pathString);
-    if (!file.is_open())
+    std::atomic<ObjectWaitStatus>* objectState = groupHandle.objectStates_.get_or_create(objectId.get());
+    if (objectState == nullptr)
+        return DoesNotExist{ "ObjectId out of range" };
+
+    // not published yet, the wait signal is the slot itself so a store can not be missed
+    if (objectState->load(std::memory_order_acquire) == ObjectWaitStatus::Wait)
     {
-        return groupHandleSharedPtr->objectWaitSignals_.write(
-        [&objectIdentifier](auto& waitSignals)
-        {
-            auto [iter, success] =
-            waitSignals.try_emplace(objectIdentifier.objectId_,
-                                    std::make_shared<std::atomic<ObjectWaitStatus>>(
-                                    ObjectWaitStatus::Wait));
+        if (!waiter)
+            return ObjectWaitSignal(groupHandle.shared_from_this(), objectState);
 
-            return iter->second;
-        });
+        // published between the load and the registration => read it right away
+        if (groupHandle.add_waiter(objectId.get(), *objectState, waiter))
+            return ObjectWaitSignal(groupHandle.shared_from_this(), objectState);
     }
 
-    std::string object(std::istreambuf_iterator<char>(file), {});
+    ObjectCache::Key cacheKey{ groupHandle.cacheKey_, objectId.get() };
+    ObjectBufferRef objectBuffer = objectCache_.get(cacheKey);
 
-    StreamHeaderSubgroupObject subgroupObject;
-    subgroupObject.objectId_ = objectIdentifier.objectId_;
-    subgroupObject.payload_ = std::move(object);
+    if (objectBuffer)
+        return std::make_tuple(std::move(objectBuffer), groupHandle.deliveryTimeout_);
+
+    std::optional<std::string> object = groupHandle.segmentLog_.read(objectId);
+    if (!object.has_value())
+        return DoesNotExist{ "Object could not be read from storage" };
 
-    quicBuffer = serialization::serialize(subgroupObject);
+    StreamHeaderSubgroupObject subgroupObject;
+    subgroupObject.objectId_ = objectId;
+    subgroupObject.payload_ = std::move(*object);
 
-    groupHandleSharedPtr->groupCache_.write(
-    [quicBuffer, &objectIdentifier](auto& cache)
-    { cache.emplace(objectIdentifier.objectId_, quicBuffer); });
+    // object was evicted from (or never made it to) the cache, bring it back from storage
+    objectBuffer =
+    objectCache_.put(cacheKey, ObjectBufferRef(ObjectBuffer::create(serialization::serialize(subgroupObject))));
 
-    return std::make_tuple(quicBuffer, groupHandleSharedPtr->deliveryTimeout_);
+    return std::make_tuple(std::move(objectBuffer), groupHandle.deliveryTimeout_);
 }
 
 bool DataManager::next(ObjectIdentifier& objectIdentifier, std::uint64_t advanceBy)
@@ -571,7 +1140,7 @@ bool DataManager::next(ObjectIdentifier& objectIdentifier, std::uint64_t advance
     // so can be sure that nothing will be deleted (needs writer lock)
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(objectIdentifier);
+    auto iter = objectHierarchy_.find(objectIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return false;
 
@@ -620,7 +1189,7 @@ bool DataManager::next(ObjectIdentifier& objectIdentifier, std::uint64_t advance
             // set it to first object in next group
             objectIdentifier.groupId_ = groupHandleIter->first;
             objectIdentifier.objectId_ =
-            ObjectId(*groupHandleIter->second->objectIds_.begin());
+            ObjectId(groupHandleIter->second->objectIds_.first_object_id());
         }
         else
         {
@@ -636,7 +1205,7 @@ std::weak_ptr<TrackHandle> DataManager::get_track_handle(const TrackIdentifier&
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(trackIdentifier);
+    auto iter = objectHierarchy_.find(trackIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return {};
 
@@ -647,7 +1216,7 @@ std::weak_ptr<GroupHandle> DataManager::get_group_handle(const GroupIdentifier&
 {
     std::shared_lock l(objectHierarchyMtx_);
 
-    auto iter = objectHierarchy_.find(groupIdentifier);
+    auto iter = objectHierarchy_.find(groupIdentifier.track_id());
     if (iter == objectHierarchy_.end())
         return {};
 
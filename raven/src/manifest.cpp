@@ -0,0 +1,257 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <manifest.hpp>
+#include <stdexcept>
+#include <unistd.h>
+#include <utilities.hpp>
+
+namespace rvn
+{
+namespace
+{
+    // fields are stored in host byte order, the manifest never leaves the machine
+    template <typename T> void put(std::string& buffer, T value)
+    {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void put_string(std::string& buffer, std::string_view str)
+    {
+        put<std::uint32_t>(buffer, str.size());
+        buffer.append(str);
+    }
+
+    class Reader
+    {
+        std::string_view buffer_;
+
+    public:
+        Reader(std::string_view buffer) : buffer_(buffer)
+        {
+        }
+
+        bool empty() const noexcept
+        {
+            return buffer_.empty();
+        }
+
+        std::uint64_t size() const noexcept
+        {
+            return buffer_.size();
+        }
+
+        template <typename T> bool get(T& value)
+        {
+            if (buffer_.size() < sizeof(T))
+                return false;
+            std::memcpy(&value, buffer_.data(), sizeof(T));
+            buffer_.remove_prefix(sizeof(T));
+            return true;
+        }
+
+        bool get_bytes(std::string_view& bytes, std::uint64_t length)
+        {
+            if (buffer_.size() < length)
+                return false;
+            bytes = buffer_.substr(0, length);
+            buffer_.remove_prefix(length);
+            return true;
+        }
+
+        bool get_string(std::string& str)
+        {
+            std::uint32_t length;
+            std::string_view bytes;
+            if (!get(length) || !get_bytes(bytes, length))
+                return false;
+            str = bytes;
+            return true;
+        }
+    };
+} // namespace
+
+Manifest::~Manifest()
+{
+    flush();
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+void Manifest::open(std::string path)
+{
+    std::lock_guard l(flushMtx_);
+
+    path_ = std::move(path);
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        throw std::runtime_error("ManifestOpenFailure");
+}
+
+void Manifest::append(RecordType type, std::string_view payload)
+{
+    std::lock_guard l(mtx_);
+    put<std::uint8_t>(pending_, utils::to_underlying(type));
+    put<std::uint32_t>(pending_, payload.size());
+    pending_.append(payload);
+}
+
+void Manifest::flush()
+{
+    std::lock_guard flushLock(flushMtx_);
+    if (fd_ < 0)
+        return;
+
+    std::string records;
+    {
+        std::lock_guard l(mtx_);
+        records.swap(pending_);
+    }
+
+    // nothing changed in the hierarchy, no sync either
+    if (records.empty())
+        return;
+
+    // O_APPEND, the records are written with a single write unless it is short
+    std::string_view remaining = records;
+    while (!remaining.empty())
+    {
+        ssize_t ret = ::write(fd_, remaining.data(), remaining.size());
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+        {
+            if (!writeFailed_)
+                utils::LOG_EVENT(std::cout, "Failed to write manifest: ", path_,
+                                 ", warm restart will miss hierarchy changes");
+            writeFailed_ = true;
+            return;
+        }
+        remaining.remove_prefix(ret);
+    }
+
+    // the objects written after this flush must not be on disk without their hierarchy
+    int ret;
+    do
+    {
+        ret = ::fdatasync(fd_);
+    } while (ret < 0 && errno == EINTR);
+    if (ret != 0 && !writeFailed_)
+    {
+        utils::LOG_EVENT(std::cout, "Failed to sync manifest: ", path_,
+                         ", warm restart might miss hierarchy changes");
+        writeFailed_ = true;
+    }
+}
+
+void Manifest::log_track(const TrackRecord& record)
+{
+    std::string payload;
+    put<std::uint64_t>(payload, record.trackKey_);
+    put<std::uint32_t>(payload, record.tracknamespace_.size());
+    for (const auto& ns : record.tracknamespace_)
+        put_string(payload, ns);
+    put_string(payload, record.trackname_);
+
+    append(RecordType::Track, payload);
+}
+
+void Manifest::log_group(const GroupRecord& record)
+{
+    std::string payload;
+    put<std::uint64_t>(payload, record.trackKey_);
+    put<std::uint64_t>(payload, record.groupId_);
+    put<std::uint8_t>(payload, record.publisherPriority_);
+    put<std::uint64_t>(payload, record.deliveryTimeout_.has_value() ?
+                                std::uint64_t(record.deliveryTimeout_->count()) :
+                                noDeliveryTimeout);
+
+    append(RecordType::Group, payload);
+}
+
+void Manifest::log_subgroup(const SubgroupRecord& record)
+{
+    std::string payload;
+    put<std::uint64_t>(payload, record.trackKey_);
+    put<std::uint64_t>(payload, record.groupId_);
+    put<std::uint64_t>(payload, record.begin_);
+    put<std::uint64_t>(payload, record.end_);
+
+    append(RecordType::Subgroup, payload);
+}
+
+Manifest::Contents Manifest::read(const std::string& path)
+{
+    Contents contents;
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return contents;
+
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    Reader reader(buffer);
+    while (!reader.empty())
+    {
+        std::uint8_t type;
+        std::uint32_t payloadLength;
+        std::string_view payload;
+        // torn record at the tail
+        if (!reader.get(type) || !reader.get(payloadLength) || !reader.get_bytes(payload, payloadLength))
+            break;
+        contents.validLength_ = buffer.size() - reader.size();
+
+        Reader payloadReader(payload);
+        bool valid = false;
+        switch (static_cast<RecordType>(type))
+        {
+            case RecordType::Track:
+            {
+                TrackRecord record;
+                std::uint32_t numNamespaces;
+                valid = payloadReader.get(record.trackKey_) && payloadReader.get(numNamespaces);
+                for (std::uint32_t i = 0; valid && i < numNamespaces; ++i)
+                    valid = payloadReader.get_string(record.tracknamespace_.emplace_back());
+                valid = valid && payloadReader.get_string(record.trackname_);
+                if (valid)
+                    contents.tracks_.push_back(std::move(record));
+                break;
+            }
+            case RecordType::Group:
+            {
+                GroupRecord record;
+                std::uint64_t deliveryTimeout;
+                valid = payloadReader.get(record.trackKey_) && payloadReader.get(record.groupId_) &&
+                        payloadReader.get(record.publisherPriority_) &&
+                        payloadReader.get(deliveryTimeout);
+                if (valid)
+                {
+                    if (deliveryTimeout != noDeliveryTimeout)
+                        record.deliveryTimeout_ = std::chrono::milliseconds(deliveryTimeout);
+                    contents.groups_.push_back(record);
+                }
+                break;
+            }
+            case RecordType::Subgroup:
+            {
+                SubgroupRecord record;
+                valid = payloadReader.get(record.trackKey_) && payloadReader.get(record.groupId_) &&
+                        payloadReader.get(record.begin_) && payloadReader.get(record.end_);
+                if (valid)
+                    contents.subgroups_.push_back(record);
+                break;
+            }
+        }
+
+        if (!valid)
+        {
+            utils::LOG_EVENT(std::cout, "Skipping malformed manifest record of type: ", int(type));
+        }
+    }
+
+    return contents;
+}
+} // namespace rvn
@@ -40,6 +40,20 @@ void MessageHandler::operator()(SubscribeMessage subscribeMessage)
                                            std::move(subscribeMessage));
 }
 
+void MessageHandler::operator()(SubscribeUpdateMessage subscribeUpdateMessage)
+{
+    utils::LOG_EVENT(std::cout, "Subscribe Update Message received: \n", subscribeUpdateMessage);
+    subscriptionManager_->update_subscription(streamState_.connectionState_.weak_from_this(),
+                                              std::move(subscribeUpdateMessage));
+}
+
+void MessageHandler::operator()(UnsubscribeMessage unsubscribeMessage)
+{
+    utils::LOG_EVENT(std::cout, "Unsubscribe Message received: \n", unsubscribeMessage);
+    subscriptionManager_->remove_subscription(streamState_.connectionState_.weak_from_this(),
+                                              std::move(unsubscribeMessage));
+}
+
 void MessageHandler::operator()(StreamHeaderSubgroupObject streamHeaderSubgroupObject)
 {
     MOQTClient& moqtClient =
@@ -75,6 +75,12 @@ MOQT& MOQT::set_dataStreamCb(stream_cb_lamda_t dataStreamCb_)
     return *this;
 }
 
+MOQT& MOQT::set_receiveMode(ReceiveMode receiveMode)
+{
+    receiveMode_ = receiveMode;
+    return *this;
+}
+
 MOQT::MOQT(HostType hostType)
 : hostType_(hostType), tbl(rvn::make_unique_quic_table())
 {
@@ -8,9 +8,13 @@ namespace rvn
 {
 
 MOQTServer::MOQTServer(std::shared_ptr<DataManager> dataManager,
-                       std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> execConfigTuple)
+                       std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> execConfigTuple,
+                       std::size_t numSubscriptionThreads,
+                       SendFlushPolicy sendFlushPolicy,
+                       SendBackpressurePolicy sendBackpressurePolicy)
 : MOQT(HostType::SERVER), dataManager_(dataManager),
-  subscriptionManager_(std::make_shared<SubscriptionManager>(*dataManager_))
+  subscriptionManager_(std::make_shared<SubscriptionManager>(*dataManager_, numSubscriptionThreads)),
+  sendFlushPolicy_(sendFlushPolicy), sendBackpressurePolicy_(sendBackpressurePolicy)
 {
     auto [execConfig, execConfigLen] = execConfigTuple;
     QUIC_STATUS status = tbl->SetParam(nullptr, QUIC_PARAM_GLOBAL_EXECUTION_CONFIG,
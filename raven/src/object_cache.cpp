@@ -0,0 +1,204 @@
+#include <object_cache.hpp>
+
+namespace rvn
+{
+ObjectCache::ObjectCache(std::uint64_t budgetBytes)
+: shardBudgetBytes_(budgetBytes / numShards)
+{
+}
+
+void ObjectCache::remove_entry(Shard& shard, std::size_t slot)
+{
+    Entry& entry = shard.ring_[slot];
+
+    unlink_group_entry(shard, slot);
+    shard.index_.erase(entry.key_);
+    shard.residentBytes_ -= entry.numBytes_;
+    residentBytes_.fetch_sub(entry.numBytes_, std::memory_order_relaxed);
+
+    entry.buffer_.reset();
+    entry.occupied_ = false;
+    shard.freeSlots_.push_back(slot);
+}
+
+void ObjectCache::link_group_entry(Shard& shard, std::size_t slot)
+{
+    Entry& entry = shard.ring_[slot];
+    entry.prevInGroup_ = noSlot;
+    entry.nextInGroup_ = noSlot;
+
+    auto [iter, inserted] = shard.groupHeads_.try_emplace(entry.key_.groupKey_, slot);
+    if (inserted)
+        return;
+
+    entry.nextInGroup_ = iter->second;
+    shard.ring_[iter->second].prevInGroup_ = slot;
+    iter->second = slot;
+}
+
+void ObjectCache::unlink_group_entry(Shard& shard, std::size_t slot)
+{
+    Entry& entry = shard.ring_[slot];
+
+    if (entry.nextInGroup_ != noSlot)
+        shard.ring_[entry.nextInGroup_].prevInGroup_ = entry.prevInGroup_;
+
+    if (entry.prevInGroup_ != noSlot)
+        shard.ring_[entry.prevInGroup_].nextInGroup_ = entry.nextInGroup_;
+    else if (entry.nextInGroup_ != noSlot)
+        shard.groupHeads_[entry.key_.groupKey_] = entry.nextInGroup_;
+    else
+        shard.groupHeads_.erase(entry.key_.groupKey_);
+}
+
+void ObjectCache::make_space(Shard& shard, std::uint64_t numBytes)
+{
+    // if everything is dirty (pinned) we give up after two sweeps and go over the budget
+    std::size_t numVisitedSinceEviction = 0;
+
+    // an object larger than the whole shard budget still gets cached (alone)
+    while (!shard.index_.empty() && shard.residentBytes_ + numBytes > shardBudgetBytes_ &&
+           numVisitedSinceEviction < 2 * shard.ring_.size())
+    {
+        if (shard.hand_ >= shard.ring_.size())
+            shard.hand_ = 0;
+
+        Entry& entry = shard.ring_[shard.hand_];
+        ++numVisitedSinceEviction;
+        if (entry.occupied_ && !entry.dirty_)
+        {
+            if (entry.referenced_)
+            {
+                // second chance
+                entry.referenced_ = false;
+                // the entry outlives (part of) its batch, it should not keep the batch's arena alive
+                if (entry.buffer_->pins_released_arena())
+                    entry.buffer_ = ObjectBufferRef(ObjectBuffer::copy(*entry.buffer_.get()));
+            }
+            else
+            {
+                remove_entry(shard, shard.hand_);
+                evictions_.fetch_add(1, std::memory_order_relaxed);
+                numVisitedSinceEviction = 0;
+            }
+        }
+
+        ++shard.hand_;
+    }
+}
+
+ObjectBufferRef ObjectCache::get(Key key)
+{
+    Shard& shard = get_shard(key);
+    std::lock_guard l(shard.mtx_);
+
+    auto iter = shard.index_.find(key);
+    if (iter == shard.index_.end())
+    {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    hits_.fetch_add(1, std::memory_order_relaxed);
+
+    Entry& entry = shard.ring_[iter->second];
+    entry.referenced_ = true;
+    return entry.buffer_;
+}
+
+ObjectBufferRef ObjectCache::put(Key key, ObjectBufferRef buffer, bool dirty)
+{
+    Shard& shard = get_shard(key);
+    std::lock_guard l(shard.mtx_);
+
+    return insert(shard, key, std::move(buffer), dirty);
+}
+
+void ObjectCache::put_batch(std::uint64_t groupKey,
+                            std::uint64_t firstObjectId,
+                            std::span<ObjectBufferRef> buffers,
+                            bool dirty)
+{
+    // consecutive object ids are spread over shards, bucket them first
+    std::array<std::vector<std::uint32_t>, numShards> shardBuffers;
+    for (std::uint32_t i = 0; i < buffers.size(); ++i)
+        shardBuffers[KeyHash{}(Key{ groupKey, firstObjectId + i }) % numShards].push_back(i);
+
+    for (std::size_t shardIdx = 0; shardIdx < numShards; ++shardIdx)
+    {
+        if (shardBuffers[shardIdx].empty())
+            continue;
+
+        Shard& shard = shards_[shardIdx];
+        std::lock_guard l(shard.mtx_);
+        for (std::uint32_t i : shardBuffers[shardIdx])
+            buffers[i] = insert(shard, Key{ groupKey, firstObjectId + i }, std::move(buffers[i]), dirty);
+    }
+}
+
+ObjectBufferRef ObjectCache::insert(Shard& shard, Key key, ObjectBufferRef buffer, bool dirty)
+{
+    // someone else has already cached the object
+    if (auto iter = shard.index_.find(key); iter != shard.index_.end())
+        return shard.ring_[iter->second].buffer_;
+
+    std::uint64_t numBytes = buffer_size(buffer);
+    make_space(shard, numBytes);
+
+    std::size_t slot;
+    if (!shard.freeSlots_.empty())
+    {
+        slot = shard.freeSlots_.back();
+        shard.freeSlots_.pop_back();
+    }
+    else
+    {
+        slot = shard.ring_.size();
+        shard.ring_.emplace_back();
+    }
+
+    shard.ring_[slot] = Entry{ key, buffer, numBytes, true, true, dirty };
+    link_group_entry(shard, slot);
+    shard.index_.emplace(key, slot);
+    shard.residentBytes_ += numBytes;
+    residentBytes_.fetch_add(numBytes, std::memory_order_relaxed);
+
+    return buffer;
+}
+
+void ObjectCache::mark_clean(Key key)
+{
+    Shard& shard = get_shard(key);
+    std::lock_guard l(shard.mtx_);
+
+    if (auto iter = shard.index_.find(key); iter != shard.index_.end())
+        shard.ring_[iter->second].dirty_ = false;
+}
+
+void ObjectCache::erase_group(std::uint64_t groupKey)
+{
+    // O(entries of the group), the rest of the rings is not visited
+    for (auto& shard : shards_)
+    {
+        std::lock_guard l(shard.mtx_);
+        auto iter = shard.groupHeads_.find(groupKey);
+        if (iter == shard.groupHeads_.end())
+            continue;
+
+        std::size_t slot = iter->second;
+        while (slot != noSlot)
+        {
+            std::size_t nextSlot = shard.ring_[slot].nextInGroup_;
+            remove_entry(shard, slot);
+            slot = nextSlot;
+        }
+    }
+}
+
+ObjectCache::Stats ObjectCache::get_stats() const noexcept
+{
+    return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed),
+             evictions_.load(std::memory_order_relaxed),
+             residentBytes_.load(std::memory_order_relaxed), shardBudgetBytes_ * numShards };
+}
+} // namespace rvn
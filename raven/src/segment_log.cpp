@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <mutex>
+#include <segment_log.hpp>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+namespace rvn
+{
+namespace
+{
+    // CRC-32C (Castagnoli), reflected, table driven
+    constexpr auto crc32cTable = []()
+    {
+        std::array<std::uint32_t, 256> table{};
+        for (std::uint32_t i = 0; i < 256; ++i)
+        {
+            std::uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    std::uint32_t crc32c(const void* data, std::size_t length) noexcept
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        std::uint32_t crc = ~0U;
+        for (std::size_t i = 0; i < length; ++i)
+            crc = crc32cTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    std::uint32_t header_crc(std::uint64_t objectId, std::uint64_t payloadLength) noexcept
+    {
+        std::uint64_t fields[2] = { objectId, payloadLength };
+        return crc32c(fields, sizeof(fields));
+    }
+} // namespace
+
+SegmentLog::RecordHeader SegmentLog::RecordHeader::make(std::uint64_t objectId,
+                                                        std::uint64_t payloadLength) noexcept
+{
+    return { recordMagic, header_crc(objectId, payloadLength), objectId, payloadLength };
+}
+
+bool SegmentLog::RecordHeader::is_valid() const noexcept
+{
+    return magic_ == recordMagic && crc_ == header_crc(objectId_, payloadLength_);
+}
+
+SegmentFiles::Lease::Lease(Lease&& other) noexcept
+: segmentFiles_(std::exchange(other.segmentFiles_, nullptr)), iter_(other.iter_)
+{
+}
+
+SegmentFiles::Lease& SegmentFiles::Lease::operator=(Lease&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (segmentFiles_ != nullptr)
+            segmentFiles_->release(iter_);
+        segmentFiles_ = std::exchange(other.segmentFiles_, nullptr);
+        iter_ = other.iter_;
+    }
+    return *this;
+}
+
+SegmentFiles::Lease::~Lease()
+{
+    if (segmentFiles_ != nullptr)
+        segmentFiles_->release(iter_);
+}
+
+SegmentFiles::SegmentFiles(std::size_t maxOpenFiles)
+: maxOpenFiles_(std::max<std::size_t>(maxOpenFiles, 1))
+{
+}
+
+SegmentFiles::~SegmentFiles()
+{
+    for (const auto& entry : lru_)
+        ::close(entry.fd_);
+}
+
+void SegmentFiles::shrink(std::size_t maxOpenFiles)
+{
+    auto iter = lru_.end();
+    while (lru_.size() > maxOpenFiles && iter != lru_.begin())
+    {
+        --iter;
+        if (iter->numLeases_ != 0)
+            continue;
+
+        ::close(iter->fd_);
+        entries_.erase(iter->owner_);
+        iter = lru_.erase(iter);
+    }
+}
+
+void SegmentFiles::release(std::list<Entry>::iterator iter)
+{
+    std::lock_guard l(mtx_);
+    if (--iter->numLeases_ != 0)
+        return;
+
+    if (iter->closePending_)
+    {
+        ::close(iter->fd_);
+        lru_.erase(iter);
+    }
+    else if (lru_.size() > maxOpenFiles_)
+        // went over the limit while everything was pinned
+        shrink(maxOpenFiles_);
+}
+
+SegmentFiles::Lease SegmentFiles::acquire(const void* owner, const std::string& path)
+{
+    std::lock_guard l(mtx_);
+
+    if (auto found = entries_.find(owner); found != entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, found->second);
+        ++found->second->numLeases_;
+        return Lease(this, found->second);
+    }
+
+    // the file is opened with the lock held, an open is cheap compared to the I/O done with it
+    shrink(maxOpenFiles_ - 1);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 && (errno == EMFILE || errno == ENFILE))
+    {
+        // the process is out of fds (not only because of us), give back everything not in use
+        shrink(0);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (fd < 0)
+        return {};
+
+    lru_.push_front(Entry{ owner, fd, 1, false });
+    entries_.emplace(owner, lru_.begin());
+    return Lease(this, lru_.begin());
+}
+
+void SegmentFiles::close(const void* owner)
+{
+    std::lock_guard l(mtx_);
+
+    auto found = entries_.find(owner);
+    if (found == entries_.end())
+        return;
+
+    auto iter = found->second;
+    entries_.erase(found);
+    if (iter->numLeases_ == 0)
+    {
+        ::close(iter->fd_);
+        lru_.erase(iter);
+    }
+    else
+        iter->closePending_ = true;
+}
+
+std::size_t SegmentFiles::num_open_files()
+{
+    std::lock_guard l(mtx_);
+    return lru_.size();
+}
+
+SegmentLog::SegmentLog(std::string path, StorageIo& storageIo, SegmentFiles& segmentFiles)
+: storageIo_(storageIo), segmentFiles_(segmentFiles), path_(std::move(path)), tailOffset_(0)
+{
+    // we only ever append, anything already in the file stays before the tail
+    struct stat st;
+    if (::stat(path_.c_str(), &st) == 0)
+        tailOffset_ = st.st_size;
+}
+
+SegmentLog::~SegmentLog()
+{
+    segmentFiles_.close(this);
+}
+
+bool SegmentLog::append(ObjectId objectId, std::string_view payload)
+{
+    Record record{ objectId, payload };
+    return append_batch(std::span<const Record>(&record, 1));
+}
+
+bool SegmentLog::append_batch(std::span<const Record> records)
+{
+    PreparedBatch batch = prepare_batch(records);
+    StorageWriteRequest request = write_request(batch);
+    if (!storageIo_.write_batch(std::span<StorageWriteRequest>(&request, 1)))
+        return false;
+
+    commit_batch(batch);
+    return true;
+}
+
+SegmentLog::PreparedBatch SegmentLog::prepare_batch(std::span<const Record> records)
+{
+    PreparedBatch batch;
+    batch.records_ = records;
+    batch.headers_.reserve(records.size());
+    batch.iov_.reserve(2 * records.size());
+
+    std::uint64_t batchSize = 0;
+    for (const auto& record : records)
+    {
+        batch.headers_.push_back(RecordHeader::make(record.objectId_.get(), record.payload_.size()));
+        batchSize += sizeof(RecordHeader) + record.payload_.size();
+    }
+
+    // headers_ does not reallocate from here on (moving the vector keeps its buffer)
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        batch.iov_.push_back({ &batch.headers_[i], sizeof(RecordHeader) });
+        batch.iov_.push_back(
+        { const_cast<char*>(records[i].payload_.data()), records[i].payload_.size() });
+    }
+
+    batch.lease_ = segmentFiles_.acquire(this, path_);
+
+    // reserve space at the tail, the write itself happens without the lock
+    std::unique_lock l(indexMtx_);
+    batch.batchOffset_ = tailOffset_;
+    batch.batchSize_ = batchSize;
+    tailOffset_ += batchSize;
+
+    return batch;
+}
+
+StorageWriteRequest SegmentLog::write_request(PreparedBatch& batch) const noexcept
+{
+    return { batch.lease_.fd(), batch.iov_.data(), static_cast<int>(batch.iov_.size()), batch.batchOffset_ };
+}
+
+void SegmentLog::commit_batch(const PreparedBatch& batch)
+{
+    // publish the records only after they have been completely written
+    std::unique_lock l(indexMtx_);
+    std::uint64_t recordOffset = batch.batchOffset_;
+    for (const auto& record : batch.records_)
+    {
+        std::uint64_t objectId = record.objectId_.get();
+        if (index_.size() <= objectId)
+            index_.resize(objectId + 1, IndexEntry{ IndexEntry::invalidOffset, 0 });
+        index_[objectId] = IndexEntry{ recordOffset + sizeof(RecordHeader), record.payload_.size() };
+
+        recordOffset += sizeof(RecordHeader) + record.payload_.size();
+    }
+}
+
+bool SegmentLog::abort_batch(const PreparedBatch& batch)
+{
+    // whatever part of the batch made it to the file is overwritten by the next append
+    std::unique_lock l(indexMtx_);
+    if (tailOffset_ != batch.batchOffset_ + batch.batchSize_)
+        return false;
+
+    tailOffset_ = batch.batchOffset_;
+    return true;
+}
+
+std::optional<std::string> SegmentLog::read(ObjectId objectId) const
+{
+    IndexEntry entry;
+    {
+        std::shared_lock l(indexMtx_);
+        if (index_.size() <= objectId.get() || !index_[objectId.get()].is_valid())
+            return std::nullopt;
+        entry = index_[objectId.get()];
+    }
+
+    SegmentFiles::Lease lease = segmentFiles_.acquire(this, path_);
+    if (!lease)
+        return std::nullopt;
+
+    std::string payload(entry.length_, 0);
+    if (!storageIo_.read(lease.fd(), payload.data(), entry.length_, entry.offset_))
+        return std::nullopt;
+
+    return payload;
+}
+
+bool SegmentLog::contains(ObjectId objectId) const
+{
+    std::shared_lock l(indexMtx_);
+    return index_.size() > objectId.get() && index_[objectId.get()].is_valid();
+}
+
+std::uint64_t SegmentLog::size_bytes() const
+{
+    std::shared_lock l(indexMtx_);
+    return tailOffset_;
+}
+
+std::uint64_t SegmentLog::end_object_id() const
+{
+    std::shared_lock l(indexMtx_);
+    return index_.size();
+}
+
+std::uint64_t SegmentLog::recover()
+{
+    // read the file in large chunks, payloads are skipped (only headers are parsed)
+    constexpr std::uint64_t chunkSize = 1 << 20;
+    // object ids are dense, anything above this is garbage (index would be resized to it)
+    constexpr std::uint64_t maxObjectId = std::numeric_limits<std::uint32_t>::max();
+
+    SegmentFiles::Lease lease = segmentFiles_.acquire(this, path_);
+    if (!lease)
+        return 0;
+
+    std::unique_lock l(indexMtx_);
+
+    std::uint64_t fileSize = tailOffset_;
+    std::uint64_t offset = 0;
+    std::uint64_t numRecords = 0;
+
+    std::vector<char> chunk;
+    // file range currently in chunk
+    std::uint64_t chunkBegin = 0, chunkEnd = 0;
+
+    while (offset + sizeof(RecordHeader) <= fileSize)
+    {
+        if (offset < chunkBegin || offset + sizeof(RecordHeader) > chunkEnd)
+        {
+            chunkBegin = offset;
+            chunkEnd = std::min(fileSize, offset + chunkSize);
+            chunk.resize(chunkEnd - chunkBegin);
+            if (!storageIo_.read(lease.fd(), chunk.data(), chunk.size(), chunkBegin))
+                break;
+        }
+
+        RecordHeader header;
+        std::memcpy(&header, chunk.data() + (offset - chunkBegin), sizeof(RecordHeader));
+
+        // hole, garbage or torn record (crash in the middle of a write)
+        std::uint64_t payloadOffset = offset + sizeof(RecordHeader);
+        if (!header.is_valid() || header.payloadLength_ > fileSize - payloadOffset ||
+            header.objectId_ > maxObjectId)
+            break;
+
+        if (index_.size() <= header.objectId_)
+            index_.resize(header.objectId_ + 1, IndexEntry{ IndexEntry::invalidOffset, 0 });
+        index_[header.objectId_] = IndexEntry{ payloadOffset, header.payloadLength_ };
+
+        offset = payloadOffset + header.payloadLength_;
+        ++numRecords;
+    }
+
+    // new records are appended right after the last complete one
+    tailOffset_ = offset;
+
+    return numRecords;
+}
+} // namespace rvn
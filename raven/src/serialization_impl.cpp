@@ -179,6 +179,64 @@ serialize_return_t serialize(ds::chunk& c, const rvn::SubscribeMessage& subscrib
     return headerLen + msgLen;
 }
 
+serialize_return_t serialize(ds::chunk& c, const rvn::SubscribeUpdateMessage& subscribeUpdateMessage)
+{
+    // EndGroup is sent as end group + 1, 0 is an open ended subscription
+    // EndObject 0 is the whole end group
+    std::uint64_t endGroup = 0, endObject = 0;
+    if (subscribeUpdateMessage.end_.has_value())
+    {
+        const auto& end = *subscribeUpdateMessage.end_;
+        endGroup = end.group_.get() + 1;
+        if (end.object_ == SubscribeUpdateMessage::endOfGroup)
+            endObject = 0;
+        else if (end.object_.get() != 0)
+            endObject = end.object_.get();
+        else
+        {
+            // nothing of the end group: the same range as the whole group before it
+            utils::ASSERT_LOG_THROW(end.group_.get() != 0, "Empty SUBSCRIBE_UPDATE range");
+            endGroup = end.group_.get();
+        }
+    }
+
+    std::uint64_t msgLen = 0;
+    // we need to find out length of the message we would be serializing
+    {
+        msgLen += mock_serialize<ds::quic_var_int>(subscribeUpdateMessage.subscribeId_);
+        msgLen += mock_serialize<ds::quic_var_int>(subscribeUpdateMessage.start_.group_.get());
+        msgLen += mock_serialize<ds::quic_var_int>(subscribeUpdateMessage.start_.object_.get());
+        msgLen += mock_serialize<ds::quic_var_int>(endGroup);
+        msgLen += mock_serialize<ds::quic_var_int>(endObject);
+        msgLen += mock_serialize<std::uint8_t>(subscribeUpdateMessage.subscriberPriority_);
+
+        msgLen +=
+        mock_serialize<ds::quic_var_int>(subscribeUpdateMessage.parameters_.size());
+        for (const auto& parameter : subscribeUpdateMessage.parameters_)
+            msgLen += mock_serialize(parameter);
+    }
+
+    // header
+    std::uint64_t headerLen = 0;
+    headerLen +=
+    serialize<ds::quic_var_int>(c, utils::to_underlying(MoQtMessageType::SUBSCRIBE_UPDATE));
+    headerLen += serialize<ds::quic_var_int>(c, msgLen);
+
+    // body
+    serialize<ds::quic_var_int>(c, subscribeUpdateMessage.subscribeId_);
+    serialize<ds::quic_var_int>(c, subscribeUpdateMessage.start_.group_.get());
+    serialize<ds::quic_var_int>(c, subscribeUpdateMessage.start_.object_.get());
+    serialize<ds::quic_var_int>(c, endGroup);
+    serialize<ds::quic_var_int>(c, endObject);
+    serialize<std::uint8_t>(c, subscribeUpdateMessage.subscriberPriority_);
+
+    serialize<ds::quic_var_int>(c, subscribeUpdateMessage.parameters_.size());
+    for (const auto& parameter : subscribeUpdateMessage.parameters_)
+        serialize(c, parameter);
+
+    return headerLen + msgLen;
+}
+
 serialize_return_t serialize(ds::chunk& c, const StreamHeaderSubgroupMessage& msg)
 {
     std::uint64_t msgLen = 0;
@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <storage_io.hpp>
+#include <unistd.h>
+#include <utilities.hpp>
+#include <vector>
+
+#ifdef RAVEN_WITH_IO_URING
+#include <liburing.h>
+#endif
+
+namespace rvn
+{
+class PosixStorageIo : public StorageIo
+{
+    static bool write_fully(StorageWriteRequest& request)
+    {
+        while (request.iovCnt_ > 0)
+        {
+            ssize_t ret = ::pwritev(request.fd_, request.iov_,
+                                    std::min(request.iovCnt_, IOV_MAX), request.offset_);
+            if (ret < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            // nothing written with bytes remaining, would be retried forever
+            if (ret == 0)
+                return false;
+            request.offset_ += ret;
+            detail::advance_iovecs(request.iov_, request.iovCnt_, ret);
+        }
+
+        return true;
+    }
+
+public:
+    StorageBackendType type() const noexcept override
+    {
+        return StorageBackendType::Posix;
+    }
+
+    bool write_batch(std::span<StorageWriteRequest> requests) override
+    {
+        bool allSucceeded = true;
+        for (auto& request : requests)
+        {
+            request.success_ = write_fully(request);
+            allSucceeded &= request.success_;
+        }
+        return allSucceeded;
+    }
+
+    bool sync_batch(std::span<StorageSyncRequest> requests) override
+    {
+        bool allSucceeded = true;
+        for (auto& request : requests)
+        {
+            int ret;
+            do
+            {
+                ret = ::fdatasync(request.fd_);
+            } while (ret < 0 && errno == EINTR);
+
+            request.success_ = ret == 0;
+            allSucceeded &= request.success_;
+        }
+        return allSucceeded;
+    }
+
+    bool read(int fd, void* buffer, std::uint64_t length, std::uint64_t offset) override
+    {
+        std::uint64_t numRead = 0;
+        while (numRead < length)
+        {
+            ssize_t ret = ::pread(fd, static_cast<char*>(buffer) + numRead,
+                                  length - numRead, offset + numRead);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                return false;
+            numRead += ret;
+        }
+        return true;
+    }
+};
+
+#ifdef RAVEN_WITH_IO_URING
+/*
+    io_uring ring, not thread safe
+    every submission is reaped before the next one, nothing is in flight between calls
+*/
+class IoUringRing
+{
+    static constexpr unsigned queueDepth = 256;
+
+    io_uring ring_;
+    // set if the ring could not be set up again after a failed submission
+    bool broken_ = false;
+
+public:
+    IoUringRing()
+    {
+        int ret = io_uring_queue_init(queueDepth, &ring_, 0);
+        if (ret < 0)
+            throw std::runtime_error("IoUringQueueInitFailure");
+    }
+
+    ~IoUringRing()
+    {
+        if (!broken_)
+            io_uring_queue_exit(&ring_);
+    }
+
+    IoUringRing(const IoUringRing&) = delete;
+    IoUringRing& operator=(const IoUringRing&) = delete;
+
+    bool broken() const noexcept
+    {
+        return broken_;
+    }
+
+    // nullptr if the submission queue is full
+    io_uring_sqe* get_sqe()
+    {
+        return io_uring_get_sqe(&ring_);
+    }
+
+    // submits the queued sqes, returns how many the kernel took or a negative errno
+    int submit()
+    {
+        int ret;
+        do
+        {
+            ret = io_uring_submit(&ring_);
+        } while (ret == -EINTR || ret == -EAGAIN);
+        return ret;
+    }
+
+    /*
+        sqes which the kernel did not take stay in the submission queue and would go out
+        with the next submission, their requests (and buffers) are gone by then
+        nothing is in flight when this is called (every submission is reaped before the next one)
+        so setting up the ring again drops them safely
+    */
+    void reset()
+    {
+        io_uring_queue_exit(&ring_);
+        broken_ = io_uring_queue_init(queueDepth, &ring_, 0) < 0;
+        if (broken_)
+            utils::LOG_EVENT(std::cout, "io_uring setup failed after a failed submission, "
+                                        "falling back to pwritev / pread");
+    }
+
+    /*
+        waits for numInFlight completions, onCompletion(userData, res) is called for each
+        we never return with operations in flight, they point into the caller's requests and buffers
+    */
+    template <typename OnCompletion>
+    void reap(unsigned numInFlight, OnCompletion&& onCompletion)
+    {
+        while (numInFlight > 0)
+        {
+            io_uring_cqe* cqe;
+            int ret = io_uring_wait_cqe(&ring_, &cqe);
+            if (ret == -EINTR || ret == -EAGAIN)
+                continue;
+            if (ret < 0)
+            {
+                // can not wait for the completions any more, the kernel may still write to
+                // (or read from) memory which is about to be freed
+                utils::LOG_EVENT(std::cout, "io_uring_wait_cqe failed: ", -ret,
+                                 " with operations in flight");
+                std::abort();
+            }
+
+            void* userData = io_uring_cqe_get_data(cqe);
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring_, cqe);
+            --numInFlight;
+
+            onCompletion(userData, res);
+        }
+    }
+
+    /*
+        submits every pending operation, prepare(sqe, op) fills in the sqe and
+        onCompletion(op, res) returns true if the op has to be submitted again (EINTR, short I/O)
+        returns with nothing in flight, ops which were not completed are left as they are
+    */
+    template <typename Op, typename Prepare, typename OnCompletion>
+    void run(std::vector<Op*>& pending, Prepare&& prepare, OnCompletion&& onCompletion)
+    {
+        // prepared sqes the kernel has not taken yet
+        unsigned numQueued = 0;
+        while (!broken_ && (!pending.empty() || numQueued > 0))
+        {
+            // queue as many as the ring can take in one go
+            while (!pending.empty())
+            {
+                io_uring_sqe* sqe = get_sqe();
+                if (sqe == nullptr)
+                    break;
+
+                Op* op = pending.back();
+                pending.pop_back();
+
+                prepare(sqe, op);
+                io_uring_sqe_set_data(sqe, op);
+                ++numQueued;
+            }
+
+            // error, or no progress (nothing else is in flight)
+            int numSubmitted = submit();
+            if (numSubmitted <= 0)
+            {
+                utils::LOG_EVENT(std::cout, "io_uring_submit failed: ", -numSubmitted);
+                reset();
+                break;
+            }
+            numQueued -= numSubmitted;
+
+            reap(numSubmitted,
+                 [&pending, &onCompletion](void* userData, int res)
+                 {
+                     Op* op = static_cast<Op*>(userData);
+                     if (onCompletion(op, res))
+                         pending.push_back(op);
+                 });
+        }
+    }
+};
+
+/*
+    writes and syncs come from the persister thread and go through writeRing_,
+    reads come from subscription threads (cache misses only) and go through readRing_,
+    a cold read never waits behind a batch of writes
+
+    reads are batched: a reader queues its read, the first reader finding no submission
+    running submits every queued read together, the others wait for their completion
+    (the reads queued in the meantime go out with the next round)
+
+    a ring which can not be set up again after a failed submission is not used any more,
+    its I/O falls back to the posix backend
+*/
+class IoUringStorageIo : public StorageIo
+{
+    struct ReadOp
+    {
+        int fd_;
+        char* buffer_;
+        std::uint64_t length_;
+        std::uint64_t offset_;
+        std::uint64_t numRead_ = 0;
+        bool done_ = false;
+        bool success_ = false;
+    };
+
+    PosixStorageIo posix_;
+
+    std::mutex writeMtx_;
+    IoUringRing writeRing_;
+
+    // guards queuedReads_, readSubmitting_ and the done_ flags of the queued reads
+    std::mutex readMtx_;
+    std::condition_variable readCv_;
+    std::vector<ReadOp*> queuedReads_;
+    // a reader is submitting, only it uses readRing_
+    bool readSubmitting_ = false;
+    IoUringRing readRing_;
+
+    // submits one round of reads, every read is done on return (pread once the ring is broken)
+    void run_reads(std::vector<ReadOp*>& reads)
+    {
+        std::vector<ReadOp*> pending = reads;
+        readRing_.run(
+        pending,
+        [](io_uring_sqe* sqe, ReadOp* read)
+        {
+            io_uring_prep_read(sqe, read->fd_, read->buffer_ + read->numRead_,
+                               read->length_ - read->numRead_, read->offset_ + read->numRead_);
+        },
+        [](ReadOp* read, int res)
+        {
+            if (res == -EINTR || res == -EAGAIN)
+                return true;
+            // error, or end of file
+            if (res <= 0)
+                return false;
+            read->numRead_ += res;
+            read->success_ = read->numRead_ == read->length_;
+            return !read->success_;
+        });
+
+        // the ring broke half way, the rest is read with pread
+        if (readRing_.broken())
+            for (ReadOp* read : reads)
+                if (!read->success_)
+                    read->success_ =
+                    posix_.read(read->fd_, read->buffer_ + read->numRead_,
+                                read->length_ - read->numRead_, read->offset_ + read->numRead_);
+    }
+
+public:
+    StorageBackendType type() const noexcept override
+    {
+        return StorageBackendType::IoUring;
+    }
+
+    bool write_batch(std::span<StorageWriteRequest> requests) override
+    {
+        std::lock_guard l(writeMtx_);
+        if (writeRing_.broken())
+            return posix_.write_batch(requests);
+
+        // requests which still have bytes to be written
+        // a request only succeeds once the completion of its last bytes has been reaped
+        std::vector<StorageWriteRequest*> pending;
+        pending.reserve(requests.size());
+        for (auto& request : requests)
+        {
+            request.success_ = request.iovCnt_ == 0;
+            if (!request.success_)
+                pending.push_back(&request);
+        }
+
+        writeRing_.run(
+        pending,
+        [](io_uring_sqe* sqe, StorageWriteRequest* request)
+        {
+            io_uring_prep_writev(sqe, request->fd_, request->iov_,
+                                 std::min(request->iovCnt_, IOV_MAX), request->offset_);
+        },
+        [](StorageWriteRequest* request, int res)
+        {
+            if (res == -EINTR || res == -EAGAIN)
+                return true;
+            // error, or nothing written with bytes remaining (would be retried forever)
+            // the request keeps success_ = false
+            if (res <= 0)
+                return false;
+
+            request->offset_ += res;
+            detail::advance_iovecs(request->iov_, request->iovCnt_, res);
+            // short write, write the rest in the next round
+            request->success_ = request->iovCnt_ == 0;
+            return !request->success_;
+        });
+
+        // the ring broke half way, iov_ and offset_ only advanced for completed writes
+        // so the rest is written with pwritev
+        if (writeRing_.broken())
+            for (std::size_t i = 0; i < requests.size(); ++i)
+                if (!requests[i].success_)
+                    posix_.write_batch(requests.subspan(i, 1));
+
+        return std::all_of(requests.begin(), requests.end(),
+                           [](const StorageWriteRequest& request) { return request.success_; });
+    }
+
+    bool sync_batch(std::span<StorageSyncRequest> requests) override
+    {
+        std::lock_guard l(writeMtx_);
+        if (writeRing_.broken())
+            return posix_.sync_batch(requests);
+
+        std::vector<StorageSyncRequest*> pending;
+        pending.reserve(requests.size());
+        for (auto& request : requests)
+        {
+            request.success_ = false;
+            pending.push_back(&request);
+        }
+
+        writeRing_.run(
+        pending,
+        [](io_uring_sqe* sqe, StorageSyncRequest* request)
+        { io_uring_prep_fsync(sqe, request->fd_, IORING_FSYNC_DATASYNC); },
+        [](StorageSyncRequest* request, int res)
+        {
+            if (res == -EINTR || res == -EAGAIN)
+                return true;
+            request->success_ = res == 0;
+            return false;
+        });
+
+        // a sync which has not run is simply run again
+        if (writeRing_.broken())
+            for (std::size_t i = 0; i < requests.size(); ++i)
+                if (!requests[i].success_)
+                    posix_.sync_batch(requests.subspan(i, 1));
+
+        return std::all_of(requests.begin(), requests.end(),
+                           [](const StorageSyncRequest& request) { return request.success_; });
+    }
+
+    bool read(int fd, void* buffer, std::uint64_t length, std::uint64_t offset) override
+    {
+        if (length == 0)
+            return true;
+
+        ReadOp read{ fd, static_cast<char*>(buffer), length, offset };
+
+        std::unique_lock l(readMtx_);
+        queuedReads_.push_back(&read);
+        // a submission is running, our read goes out with the next round
+        readCv_.wait(l, [&] { return read.done_ || !readSubmitting_; });
+
+        // the round we take contains our read, as it was queued before
+        while (!read.done_)
+        {
+            readSubmitting_ = true;
+            std::vector<ReadOp*> reads;
+            reads.swap(queuedReads_);
+            l.unlock();
+
+            run_reads(reads);
+
+            l.lock();
+            for (ReadOp* completed : reads)
+                completed->done_ = true;
+            readSubmitting_ = false;
+            readCv_.notify_all();
+        }
+
+        return read.success_;
+    }
+};
+#endif
+
+std::unique_ptr<StorageIo> make_storage_io(StorageBackendType type)
+{
+    if (type == StorageBackendType::IoUring)
+    {
+#ifdef RAVEN_WITH_IO_URING
+        try
+        {
+            return std::make_unique<IoUringStorageIo>();
+        }
+        catch (const std::exception& e)
+        {
+            utils::LOG_EVENT(std::cout, "io_uring setup failed (", e.what(),
+                             "), falling back to posix storage backend");
+        }
+#else
+        utils::LOG_EVENT(std::cout, "Raven built without RAVEN_WITH_IO_URING, "
+                                    "falling back to posix storage backend");
+#endif
+    }
+
+    return std::make_unique<PosixStorageIo>();
+}
+} // namespace rvn
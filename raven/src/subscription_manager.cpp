@@ -1,6 +1,10 @@
 /////////////////////////////////////////////
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <unistd.h>
@@ -19,27 +23,106 @@
 namespace rvn
 {
 
-MinorSubscriptionState::MinorSubscriptionState(SubscriptionState& subscriptionState,
-                                               ObjectIdentifier objectToSend,
-                                               std::optional<ObjectIdentifier> lastObjectToBeSent,
+void ReadyList::push(std::shared_ptr<SubscriptionWaiter> waiter)
+{
+    {
+        std::lock_guard l(mtx_);
+        ready_.push_back(std::move(waiter));
+    }
+    wake();
+}
+
+void ReadyList::wake()
+{
+    wakeupSeq_.fetch_add(1, std::memory_order_release);
+    wakeupSeq_.notify_one();
+}
+
+void ReadyList::take(std::vector<std::shared_ptr<SubscriptionWaiter>>& ready)
+{
+    std::lock_guard l(mtx_);
+    ready.swap(ready_);
+}
+
+void ReadyList::park(std::uint32_t seenSeq, std::chrono::microseconds spinDuration)
+{
+    if (spinDuration.count() > 0)
+    {
+        auto spinEnd = std::chrono::steady_clock::now() + spinDuration;
+        do
+        {
+            if (wakeupSeq_.load(std::memory_order_acquire) != seenSeq)
+                return;
+        } while (std::chrono::steady_clock::now() < spinEnd);
+    }
+
+    // returns right away if wakeupSeq_ already moved past seenSeq
+    wakeupSeq_.wait(seenSeq, std::memory_order_acquire);
+}
+
+void SubscriptionWaiter::notify_object_ready(const GroupHandle& groupHandle,
+                                             ObjectId objectId,
+                                             const ObjectBufferRef& objectBuffer)
+{
+    {
+        std::lock_guard l(handedObjectsMtx_);
+        handedObjects_.push_back({ std::addressof(groupHandle), objectId, objectBuffer });
+    }
+
+    wake();
+}
+
+void SubscriptionWaiter::wake()
+{
+    // already queued, the thread runs the whole subscription anyway
+    if (queued_.exchange(true, std::memory_order_acq_rel))
+        return;
+
+    if (auto readyList = readyList_.lock())
+        readyList->push(shared_from_this());
+}
+
+void SubscriptionWaiter::take_handed_objects(std::vector<HandedObject>& handedObjects)
+{
+    std::lock_guard l(handedObjectsMtx_);
+    handedObjects.swap(handedObjects_);
+}
+
+void SubscriptionTailObserver::notify_subgroup_added(const std::shared_ptr<GroupHandle>& groupHandle,
+                                                     ObjectId beginObjectId,
+                                                     ObjectId endObjectId)
+{
+    std::lock_guard l(mtx_);
+    if (subscriptionState_ != nullptr)
+        subscriptionState_->post_tail_event(groupHandle, beginObjectId, endObjectId);
+}
+
+void SubscriptionTailObserver::detach()
+{
+    // waits for a notification which is being handed over
+    std::lock_guard l(mtx_);
+    subscriptionState_ = nullptr;
+}
+
+MinorSubscriptionState::MinorSubscriptionState(std::shared_ptr<GroupHandle> groupHandle,
                                                bool mustBeSent,
                                                std::optional<std::chrono::milliseconds> deliveryTimeout)
-: subscriptionState_(std::addressof(subscriptionState)),
-  objectToSend_(std::move(objectToSend)),
-  lastObjectToBeSent_(std::move(lastObjectToBeSent)), mustBeSent_(mustBeSent),
-  subscribeDeliveryTimeout(deliveryTimeout)
+: groupHandle_(std::move(groupHandle)),
+  objectIdentifier_(groupHandle_->groupIdentifier_, ObjectId(0)), sentObject_(false),
+  mustBeSent_(mustBeSent), subscribeDeliveryTimeout(deliveryTimeout)
 {
 }
 
-bool MinorSubscriptionState::is_waiting_for_object()
+bool SubscriptionState::minor_runnable(std::size_t minorIdx) const noexcept
 {
-    if (!objectWaitSignal_.has_value())
+    const std::atomic<ObjectWaitStatus>* waitSlot = minorWaitSlots_[minorIdx];
+    if (waitSlot == nullptr)
         // not waiting on object to be ready
         return true;
 
     // we wait on the flag, only is flag is ready, we do acquire operation
     // might have performance benefits on weaker memory models (ARM, POWERPC...)
-    return (*objectWaitSignal_)->load(std::memory_order_relaxed) == ObjectWaitStatus::Ready;
+    return waitSlot->load(std::memory_order_relaxed) == ObjectWaitStatus::Ready;
 
     // We only return that it is true, we have to reset the flag in the
     // fulfill_some_minor function and also have an acquire load on the flag
@@ -47,35 +130,50 @@ bool MinorSubscriptionState::is_waiting_for_object()
 
 
 // returns true if fulfilling is done
-FulfillSomeReturn MinorSubscriptionState::fulfill_some_minor()
+FulfillSomeReturn SubscriptionState::fulfill_some_minor(std::size_t minorIdx, ConnectionState& connectionState)
 {
-    if (objectWaitSignal_.has_value())
+    MinorSubscriptionState& minorSubscriptionState = minorSubscriptionStates_[minorIdx];
+    ObjectId& nextObjectId = minorNextObjectIds_[minorIdx];
+
+    // nothing is taken from the group till the bytes in flight drained
+    if (send_budget_exceeded(minorSubscriptionState, connectionState))
+        return false;
+
+    if (minorWaitSlots_[minorIdx] != nullptr)
     {
         // we have to reset the flag
-        (*objectWaitSignal_)->load(std::memory_order_acquire);
-        objectWaitSignal_.reset();
+        minorWaitSlots_[minorIdx]->load(std::memory_order_acquire);
+        minorWaitSlots_[minorIdx] = nullptr;
     }
 
-    auto connectionStateSharedPtr = subscriptionState_->connectionStateWeakPtr_.lock();
-    if (!connectionStateSharedPtr)
-        return SubscriptionStateErr::ConnectionExpired{};
-
-    auto objectOrStatus = subscriptionState_->dataManager_->get_object(objectToSend_);
+    // published while we were waiting: the publisher already resolved it for every waiting subscriber
+    // otherwise read it from the group, if the object is not there yet,
+    // the subscription is put back on the ready list once it is
+    ObjectOrStatus objectOrStatus;
+    if (minorSubscriptionState.handedObject_)
+        objectOrStatus = std::make_tuple(std::move(minorSubscriptionState.handedObject_),
+                                         minorSubscriptionState.groupHandle_->deliveryTimeout_);
+    else
+        objectOrStatus =
+        dataManager_->get_object(*minorSubscriptionState.groupHandle_, nextObjectId, waiter_);
 
     if (std::holds_alternative<DoesNotExist>(objectOrStatus))
         return SubscriptionStateErr::ObjectDoesNotExist{};
     else if (std::holds_alternative<ObjectWaitSignal>(objectOrStatus))
     {
-        objectWaitSignal_ = std::move(std::get<ObjectWaitSignal>(objectOrStatus));
+        // the slot lives in the group, which groupHandle_ keeps alive
+        minorWaitSlots_[minorIdx] = std::get<ObjectWaitSignal>(objectOrStatus).get();
         return false;
     }
     else
     {
-        auto [quicBuffer, objectDeliveryTimeout] = std::get<ObjectType>(objectOrStatus);
+        auto [objectBuffer, objectDeliveryTimeout] = std::get<ObjectType>(objectOrStatus);
 
-        if ((!mustBeSent_) && previouslySentObject_.has_value())
-            connectionStateSharedPtr->abort_if_sending(*previouslySentObject_);
+        // the stream is looked up by track and group, the previous object is on the same stream
+        if ((!minorSubscriptionState.mustBeSent_) && minorSubscriptionState.sentObject_)
+            connectionState.abort_if_sending(minorSubscriptionState.objectIdentifier_);
 
+        auto& subscribeDeliveryTimeout = minorSubscriptionState.subscribeDeliveryTimeout;
         if (!objectDeliveryTimeout)
             // now both have value, or neither has value
             objectDeliveryTimeout = subscribeDeliveryTimeout;
@@ -86,73 +184,445 @@ FulfillSomeReturn MinorSubscriptionState::fulfill_some_minor()
             if (*objectDeliveryTimeout > *subscribeDeliveryTimeout)
                 *objectDeliveryTimeout = *subscribeDeliveryTimeout;
 
+        // we do not want to copy because copying track identifier is rather
+        // expensive operation (atomic add of shared_ptr)
+        minorSubscriptionState.objectIdentifier_.objectId_ = nextObjectId;
 
         QUIC_STATUS status =
-        connectionStateSharedPtr->send_object(objectToSend_, quicBuffer, objectDeliveryTimeout);
+        connectionState.send_object(minorSubscriptionState.objectIdentifier_, std::move(objectBuffer),
+                                    objectDeliveryTimeout, subscriber_priority());
         if (QUIC_FAILED(status))
             return SubscriptionStateErr::ConnectionExpired{};
 
-        if (previouslySentObject_.has_value())
-        {
-            // we do not want to copy because copying track identifier is rather
-            // expensive operation (seq cst atomic add of shared_ptr)
-            previouslySentObject_->groupId_ = objectToSend_.groupId_;
-            previouslySentObject_->objectId_ = objectToSend_.objectId_;
-        }
-        else
-            previouslySentObject_ = objectToSend_;
+        minorSubscriptionState.sentObject_ = true;
 
-        bool canAdavance = subscriptionState_->dataManager_->next(objectToSend_);
+        // a minor subscription never leaves its group
+        std::optional<ObjectId> advancedObjectId =
+        minorSubscriptionState.groupHandle_->next_object_id(nextObjectId);
 
-        if (!canAdavance)
+        if (!advancedObjectId)
+        {
+            // the end of what has been taken from the group (see takenGroupEnds_)
+            nextObjectId = nextObjectId + ObjectId(1);
             return true;
-        return (lastObjectToBeSent_.has_value() && objectToSend_ == *lastObjectToBeSent_);
+        }
+        nextObjectId = *advancedObjectId;
+        return nextObjectId == minorLastObjectIds_[minorIdx];
     }
 }
 
+bool SubscriptionState::send_budget_exceeded(const MinorSubscriptionState& minorSubscriptionState,
+                                             ConnectionState& connectionState)
+{
+    const ObjectIdentifier& objectIdentifier = minorSubscriptionState.objectIdentifier_;
+    if (!connectionState.send_budget_exceeded(objectIdentifier, minorSubscriptionState.sentObject_))
+        return false;
+
+    connectionState.add_send_waiter(waiter_);
+    // drained while the waiter was listed, the wake up is spurious then
+    if (!connectionState.send_budget_exceeded(objectIdentifier, minorSubscriptionState.sentObject_))
+        return false;
+
+    sendBlocked_ = true;
+    return true;
+}
+
+void SubscriptionState::move_minor(std::size_t dstIdx, std::size_t srcIdx)
+{
+    minorSubscriptionStates_[dstIdx] = std::move(minorSubscriptionStates_[srcIdx]);
+    minorWaitSlots_[dstIdx] = minorWaitSlots_[srcIdx];
+    minorNextObjectIds_[dstIdx] = minorNextObjectIds_[srcIdx];
+    minorLastObjectIds_[dstIdx] = minorLastObjectIds_[srcIdx];
+}
+
+void SubscriptionState::truncate_minors(std::size_t numMinors)
+{
+    minorSubscriptionStates_.erase(minorSubscriptionStates_.begin() + numMinors,
+                                   minorSubscriptionStates_.end());
+    minorWaitSlots_.resize(numMinors);
+    minorNextObjectIds_.resize(numMinors);
+    minorLastObjectIds_.resize(numMinors);
+}
+
 // returns true if fulfilling is done
 FulfillSomeReturn SubscriptionState::fulfill_some()
 {
+    auto connectionStateSharedPtr = connectionStateWeakPtr_.lock();
+    if (!connectionStateSharedPtr)
+        return SubscriptionStateErr::ConnectionExpired{};
+
+    // uncontended unless another subscription of the connection has been stolen
+    std::lock_guard fulfillLock(connectionStateSharedPtr->fulfillMtx_);
+
+    // the streams have been aborted by post_unsubscribe
+    if (unsubscribed_.load(std::memory_order_acquire)) [[unlikely]]
+        return true;
+
+    if (hasPendingUpdate_.load(std::memory_order_acquire)) [[unlikely]]
+    {
+        std::optional<SubscribeUpdateMessage> subscribeUpdateMessage;
+        {
+            std::lock_guard l(updateMtx_);
+            subscribeUpdateMessage.swap(pendingUpdate_);
+            hasPendingUpdate_.store(false, std::memory_order_relaxed);
+        }
+        if (subscribeUpdateMessage)
+            apply_update(*subscribeUpdateMessage, *connectionStateSharedPtr);
+    }
+
+    if (hasPendingTailEvents_.load(std::memory_order_acquire)) [[unlikely]]
+    {
+        std::vector<TailEvent> tailEvents;
+        {
+            std::lock_guard l(updateMtx_);
+            tailEvents.swap(pendingTailEvents_);
+            hasPendingTailEvents_.store(false, std::memory_order_relaxed);
+        }
+        apply_tail_events(tailEvents);
+    }
+
+    std::uint32_t objectsPerPass =
+    std::max<std::uint32_t>(connectionStateSharedPtr->sendFlushPolicy_.objectsPerPass, 1);
+    sendBlocked_ = false;
+
     bool allFulfilled = true;
-    auto beginIter = minorSubscriptionStates_.begin();
-    auto endIter = minorSubscriptionStates_.end();
+    FulfillSomeReturn errorReturn = false;
+    std::size_t numMinors = minorSubscriptionStates_.size();
+    std::size_t numKept = 0;
 
-    for (auto traversalIter = beginIter; traversalIter != endIter; ++traversalIter)
+    for (std::size_t minorIdx = 0; minorIdx < numMinors; ++minorIdx)
     {
         // by default we assume that minor subscriptions is not fulfilled
         FulfillSomeReturn fulfillReturn = false;
 
         // not waiting on object to be ready or waiting on it and it is ready
         // basically the mathematical logical statement: (waiting -> ready)
-        if (traversalIter->is_waiting_for_object())
-            fulfillReturn = traversalIter->fulfill_some_minor();
+        // a minor subscription which is behind sends several objects, they are gathered into one StreamSend
+        for (std::uint32_t i = 0; i < objectsPerPass && minor_runnable(minorIdx); ++i)
+        {
+            fulfillReturn = fulfill_some_minor(minorIdx, *connectionStateSharedPtr);
+            if (!std::holds_alternative<bool>(fulfillReturn) || std::get<bool>(fulfillReturn) || sendBlocked_)
+                break;
+        }
 
         if (std::holds_alternative<bool>(fulfillReturn))
         {
             if (std::get<bool>(fulfillReturn) == false)
             {
-                if (beginIter != traversalIter)
-                    *beginIter = std::move(*traversalIter);
-                ++beginIter;
+                if (numKept != minorIdx)
+                    move_minor(numKept, minorIdx);
+                ++numKept;
                 allFulfilled = false;
             }
+            else if (tailObserver_ != nullptr)
+                takenGroupEnds_[minorSubscriptionStates_[minorIdx].objectIdentifier_.groupId_] =
+                minorNextObjectIds_[minorIdx];
         }
         else
-            return fulfillReturn;
+        {
+            errorReturn = fulfillReturn;
+            break;
+        }
+    }
+
+    // hand what was gathered in this pass to MsQuic
+    QUIC_STATUS status = connectionStateSharedPtr->flush_sends();
+
+    if (!std::holds_alternative<bool>(errorReturn))
+        return errorReturn;
+    if (QUIC_FAILED(status))
+        return SubscriptionStateErr::ConnectionExpired{};
+
+    truncate_minors(numKept);
+    // an open ended subscription waits for the next subgroup of the track
+    return allFulfilled && !live_tail();
+}
+
+bool SubscriptionState::has_runnable_minor() const noexcept
+{
+    for (std::size_t minorIdx = 0; minorIdx < minorWaitSlots_.size(); ++minorIdx)
+        if (minor_runnable(minorIdx))
+            return true;
+    return false;
+}
+
+void SubscriptionState::rebind(const std::shared_ptr<ReadyList>& readyList)
+{
+    // the old waiter might still be queued, it is ignored from now on (and dropped by the groups)
+    waiter_->subscriptionState_ = nullptr;
+    {
+        // post_update wakes up the subscription through waiter_
+        std::lock_guard l(updateMtx_);
+        waiter_ = std::make_shared<SubscriptionWaiter>(readyList, *this);
+    }
+
+    // wait slots were registered with the old waiter, wait again through the new one
+    std::fill(minorWaitSlots_.begin(), minorWaitSlots_.end(), nullptr);
+}
+
+void SubscriptionState::accept_handed_objects(std::vector<SubscriptionWaiter::HandedObject>& handedObjects)
+{
+    for (auto& handedObject : handedObjects)
+    {
+        // no match: the minor subscription is gone (or already read the object itself)
+        for (std::size_t minorIdx = 0; minorIdx < minorNextObjectIds_.size(); ++minorIdx)
+        {
+            if (minorNextObjectIds_[minorIdx] == handedObject.objectId_ &&
+                minorSubscriptionStates_[minorIdx].groupHandle_.get() == handedObject.groupHandle_)
+            {
+                minorSubscriptionStates_[minorIdx].handedObject_ = std::move(handedObject.objectBuffer_);
+                break;
+            }
+        }
     }
+    handedObjects.clear();
+}
+
+void SubscriptionState::post_update(SubscribeUpdateMessage subscribeUpdateMessage)
+{
+    std::lock_guard l(updateMtx_);
+    pendingUpdate_ = std::move(subscribeUpdateMessage);
+    hasPendingUpdate_.store(true, std::memory_order_release);
 
-    minorSubscriptionStates_.erase(beginIter, endIter);
-    return allFulfilled;
+    // a parked subscription is run (and applies the update) once its thread takes the waiter
+    waiter_->wake();
+}
+
+void SubscriptionState::post_unsubscribe(ConnectionState& connectionState)
+{
+    // streams of minor subscriptions which are done (the whole group has been sent) are left alone
+    std::vector<std::uint64_t> groupIds;
+    groupIds.reserve(minorSubscriptionStates_.size());
+    for (const auto& minorSubscriptionState : minorSubscriptionStates_)
+        groupIds.push_back(minorSubscriptionState.objectIdentifier_.groupId_.get());
+    connectionState.abort_group_streams(subscriptionMessage_.trackAlias_, groupIds);
+
+    std::lock_guard l(updateMtx_);
+    unsubscribed_.store(true, std::memory_order_release);
+    waiter_->wake();
+}
+
+void SubscriptionState::post_connection_shutdown()
+{
+    std::lock_guard l(updateMtx_);
+    unsubscribed_.store(true, std::memory_order_release);
+    waiter_->wake();
+}
+
+void SubscriptionState::post_tail_event(std::shared_ptr<GroupHandle> groupHandle,
+                                        ObjectId beginObjectId,
+                                        ObjectId endObjectId)
+{
+    std::lock_guard l(updateMtx_);
+    pendingTailEvents_.push_back({ std::move(groupHandle), beginObjectId, endObjectId });
+    hasPendingTailEvents_.store(true, std::memory_order_release);
+    waiter_->wake();
+}
+
+void SubscriptionState::follow_track(TrackHandle& trackHandle)
+{
+    tailObserver_ = std::make_shared<SubscriptionTailObserver>(*this);
+    trackHandle.add_observer(tailObserver_);
+}
+
+void SubscriptionState::apply_tail_events(std::vector<TailEvent>& tailEvents)
+{
+    const auto& start = subscriptionMessage_.start_;
+    const auto& end = subscriptionMessage_.end_;
+
+    auto deliveryTimeoutParamOpt = subscriptionMessage_.get_parameter<DeliveryTimeoutParameter>();
+    std::optional<std::chrono::milliseconds> deliveryTimeoutOpt;
+    if (deliveryTimeoutParamOpt.has_value())
+        deliveryTimeoutOpt = deliveryTimeoutParamOpt->timeout_;
+    bool mustBeSent =
+    subscriptionMessage_.filterType_ != SubscribeMessage::FilterType::LatestPerGroupInTrack;
+
+    for (auto& tailEvent : tailEvents)
+    {
+        GroupId groupId = tailEvent.groupHandle_->groupIdentifier_.groupId_;
+        ObjectId beginObjectId = tailEvent.beginObjectId_;
+        ObjectId endObjectId = tailEvent.endObjectId_;
+
+        // outside the (possibly updated) range
+        if ((start.has_value() && groupId < start->group_) || (end.has_value() && end->group_ < groupId))
+            continue;
+        if (start.has_value() && groupId == start->group_ && beginObjectId < start->object_)
+            beginObjectId = start->object_;
+        if (end.has_value() && groupId == end->group_ && end->object_ < endObjectId)
+            endObjectId = end->object_;
+
+        // notified after a minor subscription of the group went past the subgroup and is done
+        auto takenIter = takenGroupEnds_.find(groupId);
+        if (takenIter != takenGroupEnds_.end() && beginObjectId < takenIter->second)
+            beginObjectId = takenIter->second;
+        if (!(beginObjectId < endObjectId))
+            continue;
+
+        auto minorIter =
+        std::find_if(minorSubscriptionStates_.begin(), minorSubscriptionStates_.end(),
+                     [&tailEvent](const MinorSubscriptionState& minorSubscriptionState)
+                     { return minorSubscriptionState.groupHandle_ == tailEvent.groupHandle_; });
+
+        /*
+            the minor subscription of the group is still there: it already covers a subgroup which
+            was there when it was added (or reaches it through next_object_id), it is extended
+            otherwise the group has been sent completely (or never had objects): the new subgroup
+            gets a minor subscription of its own
+        */
+        if (minorIter != minorSubscriptionStates_.end())
+        {
+            ObjectId& lastObjectId =
+            minorLastObjectIds_[std::distance(minorSubscriptionStates_.begin(), minorIter)];
+            if (lastObjectId < endObjectId)
+                lastObjectId = endObjectId;
+        }
+        else
+            add_group_subscription(tailEvent.groupHandle_, mustBeSent, deliveryTimeoutOpt,
+                                   beginObjectId, endObjectId);
+    }
+    tailEvents.clear();
+}
+
+void SubscriptionState::apply_update(const SubscribeUpdateMessage& subscribeUpdateMessage,
+                                     ConnectionState& connectionState)
+{
+    using GroupObjectPair = SubscribeMessage::GroupObjectPair;
+    auto before = [](const GroupObjectPair& lhs, const GroupObjectPair& rhs)
+    { return lhs.group_ < rhs.group_ || (lhs.group_ == rhs.group_ && lhs.object_ < rhs.object_); };
+
+    // the start can only move forward
+    GroupObjectPair start = subscribeUpdateMessage.start_;
+    if (subscriptionMessage_.start_.has_value() && before(start, *subscriptionMessage_.start_))
+        start = *subscriptionMessage_.start_;
+    const std::optional<GroupObjectPair>& end = subscribeUpdateMessage.end_;
+    std::optional<GroupObjectPair> oldEnd = subscriptionMessage_.end_;
+
+    /*
+        narrow: minor subscriptions of groups outside the range are dropped, the first and the
+        last group are clamped, whatever has been sent stays sent
+        kept minor subscriptions continue where they are, on the streams they already have
+    */
+    std::size_t numMinors = minorSubscriptionStates_.size();
+    std::size_t numKept = 0;
+    for (std::size_t minorIdx = 0; minorIdx < numMinors; ++minorIdx)
+    {
+        MinorSubscriptionState& minorSubscriptionState = minorSubscriptionStates_[minorIdx];
+        GroupId groupId = minorSubscriptionState.objectIdentifier_.groupId_;
+        ObjectId& nextObjectId = minorNextObjectIds_[minorIdx];
+        ObjectId& lastObjectId = minorLastObjectIds_[minorIdx];
+
+        if (groupId < start.group_ || (end.has_value() && end->group_ < groupId))
+            continue;
+
+        if (groupId == start.group_ && nextObjectId < start.object_)
+        {
+            // the awaited (or handed over) object is before the new start
+            nextObjectId = start.object_;
+            minorWaitSlots_[minorIdx] = nullptr;
+            minorSubscriptionState.handedObject_.reset();
+        }
+
+        if (end.has_value() && groupId == end->group_ &&
+            end->object_ != SubscribeUpdateMessage::endOfGroup)
+            lastObjectId = end->object_;
+        else if (oldEnd.has_value() && groupId == oldEnd->group_)
+            // no longer the last group (or the whole of it is), the rest of it is sent as well
+            lastObjectId = dataManager_
+                           ->get_latest_registered_object(minorSubscriptionState.groupHandle_->groupIdentifier_)
+                           .value_or(lastObjectId);
+
+        // the last object is not sent (see fulfill_some_minor)
+        if (!(nextObjectId < lastObjectId))
+            continue;
+
+        if (numKept != minorIdx)
+            move_minor(numKept, minorIdx);
+        ++numKept;
+    }
+    truncate_minors(numKept);
+
+    // extend: minor subscriptions for the rest of the old end group and the groups after it
+    bool extended = oldEnd.has_value() && (!end.has_value() || before(*oldEnd, *end));
+    auto trackIdentifier = connectionState.alias_to_identifier(subscriptionMessage_.trackAlias_);
+    if (extended && trackIdentifier.has_value())
+    {
+        if (auto trackHandleSharedPtr = dataManager_->get_track_handle(*trackIdentifier).lock())
+        {
+            auto deliveryTimeoutParamOpt =
+            subscriptionMessage_.get_parameter<DeliveryTimeoutParameter>();
+            std::optional<std::chrono::milliseconds> deliveryTimeoutOpt;
+            if (deliveryTimeoutParamOpt.has_value())
+                deliveryTimeoutOpt = deliveryTimeoutParamOpt->timeout_;
+            bool mustBeSent =
+            subscriptionMessage_.filterType_ != SubscribeMessage::FilterType::LatestPerGroupInTrack;
+
+            std::shared_lock l(trackHandleSharedPtr->groupHandlesMtx_);
+            // open ended from now on: groups added after the ones enumerated here are handed over
+            if (!end.has_value() && tailObserver_ == nullptr)
+                follow_track(*trackHandleSharedPtr);
+
+            auto& groupHandles = trackHandleSharedPtr->groupHandles_;
+            for (auto groupHandleIter = groupHandles.lower_bound(std::max(oldEnd->group_, start.group_));
+                 groupHandleIter != groupHandles.end() &&
+                 !(end.has_value() && end->group_ < groupHandleIter->first);
+                 ++groupHandleIter)
+            {
+                GroupId groupId = groupHandleIter->first;
+                // still being sent, clamped above
+                if (std::any_of(minorSubscriptionStates_.begin(), minorSubscriptionStates_.end(),
+                                [groupId](const MinorSubscriptionState& minorSubscriptionState)
+                                { return minorSubscriptionState.objectIdentifier_.groupId_ == groupId; }))
+                    continue;
+
+                // the old end group has been sent up to the old end object (or completely)
+                std::optional<ObjectId> beginObjectId, endObjectId;
+                if (groupId == oldEnd->group_)
+                {
+                    if (oldEnd->object_ == SubscribeUpdateMessage::endOfGroup)
+                        continue;
+                    beginObjectId = oldEnd->object_;
+                }
+                if (groupId == start.group_ && (!beginObjectId || *beginObjectId < start.object_))
+                    beginObjectId = start.object_;
+                if (end.has_value() && groupId == end->group_ &&
+                    end->object_ != SubscribeUpdateMessage::endOfGroup)
+                    endObjectId = end->object_;
+                if (beginObjectId && endObjectId && !(*beginObjectId < *endObjectId))
+                    continue;
+
+                add_group_subscription(groupHandleIter->second, mustBeSent, deliveryTimeoutOpt,
+                                       beginObjectId, endObjectId);
+            }
+        }
+    }
+
+    // the runnable key picks up the new priority the next time the subscription is queued
+    if (subscribeUpdateMessage.subscriberPriority_ != subscriptionMessage_.subscriberPriority_)
+        connectionState.set_subscriber_priority(subscriptionMessage_.trackAlias_,
+                                                subscribeUpdateMessage.subscriberPriority_);
+
+    subscriptionMessage_.start_ = start;
+    subscriptionMessage_.end_ = end;
+    subscriptionMessage_.subscriberPriority_ = subscribeUpdateMessage.subscriberPriority_;
+}
+
+SubscriptionState::~SubscriptionState()
+{
+    waiter_->subscriptionState_ = nullptr;
+    if (tailObserver_)
+        tailObserver_->detach();
 }
 
 
 FulfillSomeReturn
-SubscriptionState::add_group_subscription(const GroupHandle& groupHandle,
+SubscriptionState::add_group_subscription(const std::shared_ptr<GroupHandle>& groupHandleSharedPtr,
                                           bool mustBeSent,
                                           std::optional<std::chrono::milliseconds> deliveryTimeout,
                                           std::optional<ObjectId> beginObjectId,
                                           std::optional<ObjectId> endObjectId)
 {
+    const GroupHandle& groupHandle = *groupHandleSharedPtr;
+
     if (beginObjectId == std::nullopt)
         beginObjectId = dataManager_->get_first_object(groupHandle.groupIdentifier_);
     if (beginObjectId == std::nullopt)
@@ -164,10 +634,26 @@ SubscriptionState::add_group_subscription(const GroupHandle& groupHandle,
     if (endObjectId == std::nullopt)
         return SubscriptionStateErr::ObjectDoesNotExist{};
 
-    minorSubscriptionStates_
-    .emplace_back(*this, ObjectIdentifier(groupHandle.groupIdentifier_, *beginObjectId),
-                  ObjectIdentifier(groupHandle.groupIdentifier_, *endObjectId),
-                  mustBeSent, deliveryTimeout);
+    // kept sorted so that fulfill_some sends the more important groups first:
+    // lower publisher priority first, then by group id in the subscriber's group order
+    bool descending = subscriptionMessage_.groupOrder_ == SubscribeMessage::groupOrderDescending;
+    auto insertIter = std::upper_bound(
+    minorSubscriptionStates_.begin(), minorSubscriptionStates_.end(), groupHandle,
+    [descending](const GroupHandle& groupHandle, const MinorSubscriptionState& minorSubscriptionState)
+    {
+        const GroupHandle& otherGroupHandle = *minorSubscriptionState.groupHandle_;
+        if (groupHandle.publisherPriority_ != otherGroupHandle.publisherPriority_)
+            return groupHandle.publisherPriority_ < otherGroupHandle.publisherPriority_;
+        GroupId groupId = groupHandle.groupIdentifier_.groupId_;
+        GroupId otherGroupId = otherGroupHandle.groupIdentifier_.groupId_;
+        return descending ? groupId > otherGroupId : groupId < otherGroupId;
+    });
+    std::size_t minorIdx = std::distance(minorSubscriptionStates_.begin(), insertIter);
+
+    minorSubscriptionStates_.emplace(insertIter, groupHandleSharedPtr, mustBeSent, deliveryTimeout);
+    minorWaitSlots_.insert(minorWaitSlots_.begin() + minorIdx, nullptr);
+    minorNextObjectIds_.insert(minorNextObjectIds_.begin() + minorIdx, *beginObjectId);
+    minorLastObjectIds_.insert(minorLastObjectIds_.begin() + minorIdx, *endObjectId);
 
     return false;
 }
@@ -176,11 +662,14 @@ SubscriptionState::add_group_subscription(const GroupHandle& groupHandle,
 SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connectionState,
                                      DataManager& dataManager,
                                      SubscriptionManager& subscriptionManager,
-                                     SubscribeMessage subscriptionMessage)
+                                     SubscribeMessage subscriptionMessage,
+                                     const std::shared_ptr<ReadyList>& readyList)
 : connectionStateWeakPtr_(std::move(connectionState)),
   dataManager_(std::addressof(dataManager)),
   subscriptionManager_(std::addressof(subscriptionManager)),
-  subscriptionMessage_(std::move(subscriptionMessage)), cleanup_(false)
+  subscriptionMessage_(std::move(subscriptionMessage)),
+  waiter_(std::make_shared<SubscriptionWaiter>(readyList, *this)), hasPendingUpdate_(false),
+  unsubscribed_(false), sendBlocked_(false), hasPendingTailEvents_(false), cleanup_(false), runnable_(false), connectionState_(nullptr)
 {
     auto filterType = subscriptionMessage_.filterType_;
     auto connectionStateSharedPtr = connectionStateWeakPtr_.lock();
@@ -190,6 +679,7 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
         subscriptionManager_->mark_subscription_cleanup(*this);
         return;
     }
+    connectionState_ = connectionStateSharedPtr.get();
 
     auto trackIdentifier =
     *connectionStateSharedPtr->alias_to_identifier(subscriptionMessage_.trackAlias_);
@@ -203,6 +693,7 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
     switch (filterType)
     {
         case SubscribeMessage::FilterType::LatestGroup:
+        case SubscribeMessage::FilterType::LatestObject:
         {
             std::optional<GroupId> currGroupOpt =
             connectionStateSharedPtr->get_current_group(subscriptionMessage_.trackAlias_);
@@ -216,54 +707,43 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
                 return;
             }
 
-            std::weak_ptr<GroupHandle> groupHandle =
-            dataManager_->get_group_handle(GroupIdentifier(trackIdentifier, *currGroupOpt));
+            GroupIdentifier currGroupIdentifier(trackIdentifier, *currGroupOpt);
+            std::optional<ObjectId> beginObjectOpt =
+            filterType == SubscribeMessage::FilterType::LatestGroup ?
+            dataManager_->get_first_object(currGroupIdentifier) :
+            dataManager_->get_latest_registered_object(currGroupIdentifier);
 
-            if (auto groupHandleSharedPtr = groupHandle.lock())
-                add_group_subscription(*groupHandleSharedPtr, true);
-            else
+            std::weak_ptr<TrackHandle> trackHandle =
+            dataManager_->get_track_handle(trackIdentifier);
+            auto trackHandleSharedPtr = trackHandle.lock();
+
+            if (!beginObjectOpt.has_value() || !trackHandleSharedPtr)
             {
                 subscriptionManager_->notify_subscription_error(*this);
                 return;
             }
 
-            break;
-        }
-        case SubscribeMessage::FilterType::LatestObject:
-        {
-            std::optional<GroupId> currGroupOpt =
-            connectionStateSharedPtr->get_current_group(subscriptionMessage_.trackAlias_);
+            std::shared_lock l(trackHandleSharedPtr->groupHandlesMtx_);
+            auto groupHandleIter = trackHandleSharedPtr->groupHandles_.find(*currGroupOpt);
 
-            if (!currGroupOpt.has_value())
-                currGroupOpt = dataManager_->get_first_group(trackIdentifier);
-
-            if (!currGroupOpt.has_value())
+            if (groupHandleIter == trackHandleSharedPtr->groupHandles_.end())
             {
                 subscriptionManager_->notify_subscription_error(*this);
                 return;
             }
 
-            std::weak_ptr<GroupHandle> groupHandle =
-            dataManager_->get_group_handle(GroupIdentifier(trackIdentifier, *currGroupOpt));
-
-            if (auto groupHandleSharedPtr = groupHandle.lock())
-            {
-                auto latestObjectOpt = dataManager_->get_latest_registered_object(
-                groupHandleSharedPtr->groupIdentifier_);
-                if (!latestObjectOpt.has_value())
-                {
-                    subscriptionManager_->notify_subscription_error(*this);
-                    return;
-                }
+            /*
+                the subscription goes on past the current group like an absolute start one: the
+                resolved start keeps apply_tail_events (and apply_update) off the earlier groups
+            */
+            subscriptionMessage_.start_ =
+            SubscribeMessage::GroupObjectPair{ *currGroupOpt, *beginObjectOpt };
+            follow_track(*trackHandleSharedPtr);
 
-                add_group_subscription(*groupHandleSharedPtr, true,
-                                       deliveryTimeoutOpt, latestObjectOpt);
-            }
-            else
-            {
-                subscriptionManager_->notify_subscription_error(*this);
-                return;
-            }
+            add_group_subscription(groupHandleIter->second, true, deliveryTimeoutOpt, beginObjectOpt);
+            ++groupHandleIter;
+            for (; groupHandleIter != trackHandleSharedPtr->groupHandles_.end(); ++groupHandleIter)
+                add_group_subscription(groupHandleIter->second, true, deliveryTimeoutOpt);
 
             break;
         }
@@ -284,11 +764,14 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
                     return;
                 }
 
-                add_group_subscription(*groupHandleIter->second, true, deliveryTimeoutOpt,
+                // groups and subgroups added from now on are handed over (see apply_tail_events)
+                follow_track(*trackHandleSharedPtr);
+
+                add_group_subscription(groupHandleIter->second, true, deliveryTimeoutOpt,
                                        subscriptionMessage_.start_->object_);
                 ++groupHandleIter;
                 for (; groupHandleIter != trackHandleSharedPtr->groupHandles_.end(); ++groupHandleIter)
-                    add_group_subscription(*groupHandleIter->second, true);
+                    add_group_subscription(groupHandleIter->second, true, deliveryTimeoutOpt);
             }
             else
             {
@@ -320,21 +803,21 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
 
                 if (beginGroupHandleIter->first == endGroupHandleIter->first)
                 {
-                    add_group_subscription(*beginGroupHandleIter->second, true, deliveryTimeoutOpt,
+                    add_group_subscription(beginGroupHandleIter->second, true, deliveryTimeoutOpt,
                                            subscriptionMessage_.start_->object_,
                                            subscriptionMessage_.end_->object_);
                     return;
                 }
                 else
                 {
-                    add_group_subscription(*beginGroupHandleIter->second, true, deliveryTimeoutOpt,
+                    add_group_subscription(beginGroupHandleIter->second, true, deliveryTimeoutOpt,
                                            subscriptionMessage_.start_->object_);
 
                     for (auto groupHandleIter = std::next(beginGroupHandleIter);
                          groupHandleIter != endGroupHandleIter; ++groupHandleIter)
-                        add_group_subscription(*groupHandleIter->second, true);
+                        add_group_subscription(groupHandleIter->second, true, deliveryTimeoutOpt);
 
-                    add_group_subscription(*endGroupHandleIter->second, true, std::nullopt,
+                    add_group_subscription(endGroupHandleIter->second, true, deliveryTimeoutOpt,
                                            subscriptionMessage_.end_->object_);
                 }
             }
@@ -353,9 +836,10 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
             if (auto trackHandleSharedPtr = trackHandle.lock())
             {
                 std::shared_lock l(trackHandleSharedPtr->groupHandlesMtx_);
+                follow_track(*trackHandleSharedPtr);
                 for (auto& groupHandleIter : trackHandleSharedPtr->groupHandles_)
                     // TODO: update it such that mustBeSent is true for base layers
-                    add_group_subscription(*groupHandleIter.second, false, deliveryTimeoutOpt,
+                    add_group_subscription(groupHandleIter.second, false, deliveryTimeoutOpt,
                                            dataManager_->get_latest_concrete_object(
                                            groupHandleIter.second->groupIdentifier_));
             }
@@ -374,76 +858,325 @@ SubscriptionState::SubscriptionState(std::weak_ptr<ConnectionState>&& connection
     }
 }
 
+ThreadLocalState::ThreadLocalState(SubscriptionManager& subscriptionManager, std::size_t threadIdx)
+: subscriptionManager_(subscriptionManager), threadIdx_(threadIdx),
+  readyList_(std::make_shared<ReadyList>()), runnableSeq_(0), numRunnable_(0), parked_(false)
+{
+}
+
+void ThreadLocalState::make_runnable(SubscriptionState& subscriptionState)
+{
+    if (subscriptionState.runnable_)
+        return;
+    subscriptionState.runnable_ = true;
+    push_runnable(std::addressof(subscriptionState));
+}
+
+void ThreadLocalState::push_runnable(SubscriptionState* subscriptionState)
+{
+    std::uint64_t key = subscriptionState->unsubscribed() ?
+                        0 :
+                        runnableSeq_++ + subscriptionState->subscriber_priority() * priorityAging;
+    runnable_.push_back({ key, subscriptionState });
+    std::push_heap(runnable_.begin(), runnable_.end());
+}
+
+void ThreadLocalState::add_subscription_state(SubscriptionState* subscriptionState)
+{
+    subscriptionState->index_ = subscriptionStates_.size();
+    subscriptionStates_.push_back(subscriptionState);
+}
+
+void ThreadLocalState::remove_subscription_state(SubscriptionState* subscriptionState)
+{
+    SubscriptionState* lastSubscriptionState = subscriptionStates_.back();
+    lastSubscriptionState->index_ = subscriptionState->index_;
+    subscriptionStates_[subscriptionState->index_] = lastSubscriptionState;
+    subscriptionStates_.pop_back();
+}
+
+bool ThreadLocalState::steal(std::vector<SubscriptionState*>& working)
+{
+    auto& threadLocalStates = subscriptionManager_.threadLocalStates_;
+    std::size_t numThreads = threadLocalStates.size();
+
+    for (std::size_t i = 1; i < numThreads; ++i)
+    {
+        ThreadLocalState& victim = *threadLocalStates[(threadIdx_ + i) % numThreads];
+
+        // a single runnable subscription is about to be run by its owner anyway
+        if (victim.numRunnable_.load(std::memory_order_relaxed) < 2)
+            continue;
+
+        std::scoped_lock l(mtx_, victim.mtx_);
+
+        std::size_t numStolen = victim.runnable_.size() / 2;
+        if (numStolen == 0)
+            continue;
+
+        for (std::size_t j = 0; j < numStolen; ++j)
+        {
+            SubscriptionState* subscriptionState = victim.runnable_.back().subscriptionState_;
+            victim.runnable_.pop_back();
+
+            // the subscription state is not relocated, it stays in the victim's pool
+            victim.remove_subscription_state(subscriptionState);
+            add_subscription_state(subscriptionState);
+            subscriptionState->rebind(readyList_);
+            working.push_back(subscriptionState);
+        }
+        victim.numRunnable_.store(victim.runnable_.size(), std::memory_order_relaxed);
+
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadLocalState::route_control_message(const std::weak_ptr<ConnectionState>& connectionStateWeakPtr,
+                                             SubscriptionQueueMessage& queueMessage)
+{
+    if (auto* connectionShutdown = std::get_if<ConnectionShutdown>(&queueMessage))
+    {
+        end_connection_subscriptions(connectionShutdown->connectionState_);
+        return;
+    }
+
+    // the connection is gone, so are its subscriptions
+    auto connectionStateSharedPtr = connectionStateWeakPtr.lock();
+    if (!connectionStateSharedPtr)
+        return;
+
+    auto* subscribeUpdateMessage = std::get_if<SubscribeUpdateMessage>(&queueMessage);
+    std::uint64_t subscribeId = subscribeUpdateMessage ?
+                                subscribeUpdateMessage->subscribeId_ :
+                                std::get<UnsubscribeMessage>(queueMessage).subscribeId_;
+
+    std::lock_guard l(subscriptionKeysMtx_);
+    auto iter = subscriptionsByKey_.find({ connectionStateSharedPtr.get(), subscribeId });
+    if (iter == subscriptionsByKey_.end())
+    {
+        // already fulfilled (or never created)
+        utils::LOG_EVENT(std::cout, "Control message for unknown subscription: ", subscribeId);
+        return;
+    }
+
+    if (subscribeUpdateMessage)
+        iter->second->post_update(std::move(*subscribeUpdateMessage));
+    else
+    {
+        // no pass of the subscription runs meanwhile (it might have been stolen by another thread)
+        // and none of it runs after, a SUBSCRIBE further down the queue can reuse the track alias
+        std::lock_guard fulfillLock(connectionStateSharedPtr->fulfillMtx_);
+        // the subscribe id can be used again right away
+        iter->second->post_unsubscribe(*connectionStateSharedPtr);
+        subscriptionsByKey_.erase(iter);
+    }
+}
+
+void ThreadLocalState::end_connection_subscriptions(const ConnectionState* connectionState)
+{
+    std::lock_guard l(subscriptionKeysMtx_);
+
+    // once per connection, the subscriptions of the other connections of the thread are skipped
+    for (auto iter = subscriptionsByKey_.begin(); iter != subscriptionsByKey_.end();)
+    {
+        if (iter->first.connectionState_ == connectionState)
+        {
+            iter->second->post_connection_shutdown();
+            iter = subscriptionsByKey_.erase(iter);
+        }
+        else
+            ++iter;
+    }
+}
+
+void ThreadLocalState::wake_thief()
+{
+    auto& threadLocalStates = subscriptionManager_.threadLocalStates_;
+    std::size_t numThreads = threadLocalStates.size();
+
+    for (std::size_t i = 1; i < numThreads; ++i)
+    {
+        ThreadLocalState& thief = *threadLocalStates[(threadIdx_ + i) % numThreads];
+        if (thief.parked_.load(std::memory_order_relaxed))
+        {
+            thief.readyList_->wake();
+            return;
+        }
+    }
+}
+
 void ThreadLocalState::operator()()
 {
+    std::vector<std::shared_ptr<SubscriptionWaiter>> readyWaiters;
+    std::vector<SubscriptionWaiter::HandedObject> handedObjects;
+    std::vector<SubscriptionState*> newSubscriptionStates;
+    std::vector<SubscriptionState*> working;
+    std::vector<SubscriptionState*> stillRunnable;
+    std::vector<SubscriptionState*> finished;
+
     while (true)
     {
+        // any wake up after this point makes park return right away, so no wake up is lost
+        std::uint32_t wakeupSeq = readyList_->wakeup_seq();
+
         // relaxed load and store works because there is no data dependencies
         // with cleanup_ used to denate that destructor of SubscriptionManager
         // is called, subscription threads should exit now
         if (subscriptionManager_.cleanup_.load(std::memory_order_relaxed)) [[unlikely]]
             break;
 
-        auto& subscriptionQueue_ = subscriptionManager_.subscriptionQueue_;
-
         // If we believe it there are pending subscriptions, dequeue them
         // Why are we doing size_approx? Because constructing weak_ptr is a rather expensive lock opertion
         // We want to do it only if we believe there are pending subscriptions
+        // constructed without holding mtx_, the constructor goes to the DataManager
         if (subscriptionQueue_.size_approx() != 0)
         {
-            std::tuple<std::weak_ptr<ConnectionState>, SubscribeMessage> subscriptionTuple;
+            std::tuple<std::weak_ptr<ConnectionState>, SubscriptionQueueMessage> subscriptionTuple;
             while (subscriptionQueue_.try_dequeue(subscriptionTuple))
             {
                 auto connectionStateWeakPtr = std::move(std::get<0>(subscriptionTuple));
-                auto subscriptionMessage = std::move(std::get<1>(subscriptionTuple));
-
-                subscriptionStates_.emplace_back(std::move(connectionStateWeakPtr),
-                                                 subscriptionManager_.dataManager_,
-                                                 subscriptionManager_,
-                                                 std::move(subscriptionMessage));
-                if (subscriptionStates_.back().cleanup_)
-                    subscriptionStates_.pop_back();
+                auto& queueMessage = std::get<1>(subscriptionTuple);
+                if (!std::holds_alternative<SubscribeMessage>(queueMessage))
+                {
+                    route_control_message(connectionStateWeakPtr, queueMessage);
+                    continue;
+                }
+                auto subscriptionMessage = std::move(std::get<SubscribeMessage>(queueMessage));
+
+                SubscriptionState* subscriptionState =
+                subscriptionStatePool_.create(std::move(connectionStateWeakPtr),
+                                              subscriptionManager_.dataManager_, subscriptionManager_,
+                                              std::move(subscriptionMessage), readyList_);
+                if (subscriptionState->cleanup_ ||
+                    !subscriptionManager_.register_subscription(*subscriptionState))
+                {
+                    SlabPool<SubscriptionState>::destroy(subscriptionState);
+                    continue;
+                }
+
+                newSubscriptionStates.push_back(subscriptionState);
+            }
+        }
+
+        // subscriptions whose awaited object has been published
+        readyList_->take(readyWaiters);
+
+        {
+            std::lock_guard l(mtx_);
+
+            for (auto subscriptionState : newSubscriptionStates)
+            {
+                add_subscription_state(subscriptionState);
+                make_runnable(*subscriptionState);
             }
+
+            for (auto& waiter : readyWaiters)
+            {
+                // before running it, an object published from now on queues it again
+                waiter->queued_.store(false, std::memory_order_release);
+                waiter->take_handed_objects(handedObjects);
+                if (waiter->subscriptionState_ != nullptr)
+                {
+                    waiter->subscriptionState_->accept_handed_objects(handedObjects);
+                    make_runnable(*waiter->subscriptionState_);
+                }
+                else
+                    // the subscription is gone, do not keep the buffers alive in its waiter
+                    handedObjects.clear();
+            }
+
+            // most important first
+            while (!runnable_.empty() && working.size() < schedulingBatchSize)
+            {
+                std::pop_heap(runnable_.begin(), runnable_.end());
+                working.push_back(runnable_.back().subscriptionState_);
+                runnable_.pop_back();
+            }
+            numRunnable_.store(runnable_.size(), std::memory_order_relaxed);
         }
+        readyWaiters.clear();
+        newSubscriptionStates.clear();
 
-        auto beginIter = subscriptionStates_.begin();
-        auto endIter = subscriptionStates_.end();
+        if (working.empty() && !steal(working))
+        {
+            parked_.store(true, std::memory_order_relaxed);
+            readyList_->park(wakeupSeq, subscriptionManager_.spinBeforePark_);
+            parked_.store(false, std::memory_order_relaxed);
+            continue;
+        }
 
-        for (auto traversalIter = beginIter; traversalIter != endIter; ++traversalIter)
+        // subscriptions in working are not reachable by thieves
+        for (auto subscriptionState : working)
         {
-            auto fulfillReturn = traversalIter->fulfill_some();
+            auto fulfillReturn = subscriptionState->fulfill_some();
 
             if (std::holds_alternative<bool>(fulfillReturn))
             // subscription is being fulfilled with no issues
             {
                 if (std::get<bool>(fulfillReturn) == false)
-                    // This unfortunately does not seem to be using move constructor though (according to perf report)
-                    // TODO: debug the issue
-                    *beginIter++ = std::move(*traversalIter);
+                {
+                    // held back by the send budget: parked till the connection drains
+                    if (!subscriptionState->send_blocked() && subscriptionState->has_runnable_minor())
+                        stillRunnable.push_back(subscriptionState);
+                    else
+                        // parked, its waiter is registered for every awaited object
+                        subscriptionState->runnable_ = false;
+                    continue;
+                }
             }
             else if (std::holds_alternative<SubscriptionStateErr::ConnectionExpired>(fulfillReturn))
             {
                 // Nothing to be done
             }
             else if (std::holds_alternative<SubscriptionStateErr::ObjectDoesNotExist>(fulfillReturn))
-                subscriptionManager_.notify_subscription_error(*traversalIter);
+                subscriptionManager_.notify_subscription_error(*subscriptionState);
             else
                 assert(false);
+
+            finished.push_back(subscriptionState);
         }
 
-        subscriptionStates_.erase(beginIter, endIter);
+        // no update can be routed to them anymore
+        for (auto subscriptionState : finished)
+            subscriptionManager_.unregister_subscription(*subscriptionState);
+
+        {
+            std::lock_guard l(mtx_);
+
+            for (auto subscriptionState : finished)
+            {
+                remove_subscription_state(subscriptionState);
+                // back to the pool it was created from (might be another thread's)
+                SlabPool<SubscriptionState>::destroy(subscriptionState);
+            }
+            for (auto subscriptionState : stillRunnable)
+                push_runnable(subscriptionState);
+            numRunnable_.store(runnable_.size(), std::memory_order_relaxed);
+        }
+
+        if (numRunnable_.load(std::memory_order_relaxed) > schedulingBatchSize)
+            wake_thief();
+        working.clear();
+        stillRunnable.clear();
+        finished.clear();
     }
 }
 
-SubscriptionManager::SubscriptionManager(DataManager& dataManager, std::size_t numThreads)
-: dataManager_(dataManager), cleanup_(false)
+SubscriptionManager::SubscriptionManager(DataManager& dataManager,
+                                         std::size_t numThreads,
+                                         std::chrono::microseconds spinBeforePark)
+: dataManager_(dataManager), cleanup_(false), spinBeforePark_(spinBeforePark)
 {
-    threadLocalStates_.reserve(numThreads);
+    numThreads = std::max<std::size_t>(numThreads, 1);
+
+    // every ThreadLocalState exists before any thread starts (threads steal from each other)
     for (std::size_t i = 0; i < numThreads; i++)
-    {
-        threadLocalStates_.emplace_back(*this);
-        threadPool_.emplace_back(threadLocalStates_.back());
-    }
+        threadLocalStates_.push_back(std::make_unique<ThreadLocalState>(*this, i));
+
+    for (auto& threadLocalState : threadLocalStates_)
+        threadPool_.emplace_back(std::ref(*threadLocalState));
 }
 
 SubscriptionManager::~SubscriptionManager()
@@ -452,13 +1185,100 @@ SubscriptionManager::~SubscriptionManager()
     // relaxed load and store works because there is no data dependencies with cleanup_
     // it is just a single flag to be set, this might change if we are doing more complex things before setting cleanup
     cleanup_.store(true, std::memory_order_relaxed);
+    for (auto& threadLocalState : threadLocalStates_)
+        threadLocalState->readyList_->wake();
+
+    threadPool_.clear();
+
+    // stolen subscription states live in other threads' pools, all of them go before any pool does
+    for (auto& threadLocalState : threadLocalStates_)
+    {
+        for (auto subscriptionState : threadLocalState->subscriptionStates_)
+            SlabPool<SubscriptionState>::destroy(subscriptionState);
+        threadLocalState->subscriptionStates_.clear();
+        threadLocalState->subscriptionsByKey_.clear();
+    }
+}
+
+ThreadLocalState& SubscriptionManager::connection_thread(const ConnectionState* connectionState)
+{
+    std::uint64_t connectionHash =
+    reinterpret_cast<std::uintptr_t>(connectionState) * 0x9E3779B97F4A7C15ULL;
+    connectionHash ^= connectionHash >> 32;
+
+    return *threadLocalStates_[connectionHash % threadLocalStates_.size()];
+}
+
+bool SubscriptionManager::register_subscription(SubscriptionState& subscriptionState)
+{
+    SubscriptionKey subscriptionKey = subscriptionState.key();
+    ThreadLocalState& threadLocalState = connection_thread(subscriptionKey.connectionState_);
+
+    std::lock_guard l(threadLocalState.subscriptionKeysMtx_);
+    bool inserted =
+    threadLocalState.subscriptionsByKey_.try_emplace(subscriptionKey, std::addressof(subscriptionState))
+    .second;
+    if (!inserted)
+        utils::LOG_EVENT(std::cout, "Duplicate subscribe id: ", subscriptionKey.subscribeId_);
+    return inserted;
+}
+
+void SubscriptionManager::unregister_subscription(SubscriptionState& subscriptionState)
+{
+    SubscriptionKey subscriptionKey = subscriptionState.key();
+    ThreadLocalState& threadLocalState = connection_thread(subscriptionKey.connectionState_);
+
+    std::lock_guard l(threadLocalState.subscriptionKeysMtx_);
+    auto iter = threadLocalState.subscriptionsByKey_.find(subscriptionKey);
+    // unsubscribed: the subscribe id might already belong to a new subscription
+    if (iter != threadLocalState.subscriptionsByKey_.end() &&
+        iter->second == std::addressof(subscriptionState))
+        threadLocalState.subscriptionsByKey_.erase(iter);
+}
+
+void SubscriptionManager::enqueue_subscription_message(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                                                       SubscriptionQueueMessage queueMessage)
+{
+    auto connectionStateSharedPtr = connectionStateWeakPtr.lock();
+    if (!connectionStateSharedPtr)
+        return;
+
+    // connection affinity: all subscriptions of a connection go to the same thread,
+    // which also knows where they are after being stolen
+    ThreadLocalState& threadLocalState = connection_thread(connectionStateSharedPtr.get());
+
+    threadLocalState.subscriptionQueue_.enqueue(
+    std::make_tuple(std::move(connectionStateWeakPtr), std::move(queueMessage)));
+    threadLocalState.readyList_->wake();
 }
 
 void SubscriptionManager::add_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
                                            SubscribeMessage subscribeMessage)
 {
-    subscriptionQueue_.enqueue(std::make_tuple(std::move(connectionStateWeakPtr),
-                                               std::move(subscribeMessage)));
+    enqueue_subscription_message(std::move(connectionStateWeakPtr), std::move(subscribeMessage));
+}
+
+void SubscriptionManager::update_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                                              SubscribeUpdateMessage subscribeUpdateMessage)
+{
+    enqueue_subscription_message(std::move(connectionStateWeakPtr), std::move(subscribeUpdateMessage));
+}
+
+void SubscriptionManager::remove_subscription(std::weak_ptr<ConnectionState> connectionStateWeakPtr,
+                                              UnsubscribeMessage unsubscribeMessage)
+{
+    enqueue_subscription_message(std::move(connectionStateWeakPtr), std::move(unsubscribeMessage));
+}
+
+void SubscriptionManager::remove_connection(std::weak_ptr<ConnectionState> connectionStateWeakPtr)
+{
+    auto connectionStateSharedPtr = connectionStateWeakPtr.lock();
+    if (!connectionStateSharedPtr)
+        return;
+
+    // behind the SUBSCRIBEs of the connection which are still queued
+    ConnectionShutdown connectionShutdown{ connectionStateSharedPtr.get() };
+    enqueue_subscription_message(std::move(connectionStateWeakPtr), connectionShutdown);
 }
 
 void SubscriptionManager::mark_subscription_cleanup(SubscriptionState& subscriptionState)
@@ -0,0 +1,275 @@
+#include <data_manager.hpp>
+#include <manifest.hpp>
+#include <object_cache.hpp>
+#include <segment_log.hpp>
+#include <storage_io.hpp>
+#include <unordered_map>
+#include <utilities.hpp>
+#include <vector>
+#include <write_behind.hpp>
+
+namespace rvn
+{
+WriteBehindPersister::WriteBehindPersister(ObjectCache& objectCache,
+                                           StorageIo& storageIo,
+                                           Manifest& manifest,
+                                           std::uint64_t maxPendingBytes)
+: objectCache_(objectCache), storageIo_(storageIo), manifest_(manifest),
+  maxPendingBytes_(maxPendingBytes),
+  persisterThread_([this](std::stop_token stopToken) { run(stopToken); })
+{
+}
+
+WriteBehindPersister::~WriteBehindPersister()
+{
+    // run drains the queue before returning
+    persisterThread_.request_stop();
+    persisterThread_.join();
+}
+
+void WriteBehindPersister::enqueue(Job job)
+{
+    std::uint64_t jobBytes = job.payload_.size();
+
+    std::unique_lock l(queueMtx_);
+
+    // backpressure, a single job larger than the budget is still let through on an empty queue
+    jobsPersistedCv_.wait(l,
+                          [this, jobBytes]()
+                          {
+                              return pendingBytes_ == 0 ||
+                                     pendingBytes_ + jobBytes <= maxPendingBytes_;
+                          });
+
+    jobs_.push_back(std::move(job));
+    ++pendingObjects_;
+    pendingBytes_ += jobBytes;
+    ++numEnqueued_;
+
+    l.unlock();
+    jobsAvailableCv_.notify_one();
+}
+
+void WriteBehindPersister::enqueue_batch(std::vector<Job> jobs)
+{
+    if (jobs.empty())
+        return;
+
+    std::uint64_t batchBytes = 0;
+    for (const auto& job : jobs)
+        batchBytes += job.payload_.size();
+
+    std::unique_lock l(queueMtx_);
+
+    // the whole batch is admitted at once, same rule as enqueue
+    jobsPersistedCv_.wait(l,
+                          [this, batchBytes]()
+                          {
+                              return pendingBytes_ == 0 ||
+                                     pendingBytes_ + batchBytes <= maxPendingBytes_;
+                          });
+
+    for (auto& job : jobs)
+        jobs_.push_back(std::move(job));
+    pendingObjects_ += jobs.size();
+    pendingBytes_ += batchBytes;
+    numEnqueued_ += jobs.size();
+
+    l.unlock();
+    jobsAvailableCv_.notify_one();
+}
+
+void WriteBehindPersister::flush()
+{
+    std::unique_lock l(queueMtx_);
+    std::uint64_t target = numEnqueued_;
+    jobsPersistedCv_.wait(l, [this, target]() { return numDone_ >= target && numRetryJobs_ == 0; });
+}
+
+void WriteBehindPersister::run(std::stop_token stopToken)
+{
+    std::chrono::milliseconds retryBackoff = minRetryBackoff;
+
+    while (true)
+    {
+        std::deque<Job> batch;
+        {
+            std::unique_lock l(queueMtx_);
+            jobsAvailableCv_.wait(l, stopToken, [this]() { return !jobs_.empty(); });
+
+            // stop has been requested and everything has been persisted (or given up)
+            if (jobs_.empty())
+                return;
+
+            batch.swap(jobs_);
+        }
+
+        std::uint64_t doneBytes = 0;
+        std::uint64_t numRetried = 0;
+        for (const auto& job : batch)
+        {
+            doneBytes += job.payload_.size();
+            numRetried += job.numAttempts_ != 0;
+        }
+
+        std::deque<Job> retryJobs;
+        persist_batch(batch, retryJobs);
+
+        std::uint64_t numDone = batch.size() - retryJobs.size();
+        for (const auto& job : retryJobs)
+            doneBytes -= job.payload_.size();
+
+        {
+            std::unique_lock l(queueMtx_);
+            // the retried jobs stay pending, ahead of the ones queued meanwhile
+            pendingObjects_ -= numDone;
+            pendingBytes_ -= doneBytes;
+            numDone_ += numDone;
+            numRetryJobs_ = numRetryJobs_ - numRetried + retryJobs.size();
+            jobs_.insert(jobs_.begin(), std::make_move_iterator(retryJobs.begin()),
+                         std::make_move_iterator(retryJobs.end()));
+        }
+        jobsPersistedCv_.notify_all();
+
+        if (retryJobs.empty())
+        {
+            retryBackoff = minRetryBackoff;
+            continue;
+        }
+
+        // bounded by maxPersistAttempts, also while stopping
+        std::this_thread::sleep_for(retryBackoff);
+        retryBackoff = std::min(retryBackoff * 2, maxRetryBackoff);
+    }
+}
+
+void WriteBehindPersister::persist_batch(std::deque<Job>& batch, std::deque<Job>& retryJobs)
+{
+    // subgroups (and groups, tracks) of the objects are on disk before the objects
+    manifest_.flush();
+
+    // group jobs by group, keeping the publishing order within a group
+    std::unordered_map<GroupHandle*, std::vector<Job*>> groupJobs;
+    std::vector<GroupHandle*> groupOrder;
+    for (auto& job : batch)
+    {
+        auto [iter, inserted] = groupJobs.try_emplace(job.groupHandle_.get());
+        if (inserted)
+            groupOrder.push_back(job.groupHandle_.get());
+        iter->second.push_back(&job);
+    }
+
+    // records of each group must stay alive till the batches are committed
+    std::vector<std::vector<SegmentLog::Record>> groupRecords(groupOrder.size());
+    std::vector<SegmentLog::PreparedBatch> preparedBatches;
+    std::vector<StorageWriteRequest> requests;
+    preparedBatches.reserve(groupOrder.size());
+    requests.reserve(groupOrder.size());
+
+    for (std::size_t i = 0; i < groupOrder.size(); ++i)
+    {
+        GroupHandle* groupHandle = groupOrder[i];
+        for (const Job* job : groupJobs[groupHandle])
+            groupRecords[i].push_back({ job->objectId_, job->payload_ });
+
+        preparedBatches.push_back(groupHandle->segmentLog_.prepare_batch(groupRecords[i]));
+        requests.push_back(groupHandle->segmentLog_.write_request(preparedBatches.back()));
+    }
+
+    // one submission for the writes of every group
+    // on failure only the requests with success_ set have been written completely
+    bool allWritten = storageIo_.write_batch(requests);
+    if (!allWritten)
+        utils::LOG_EVENT(std::cout, "Storage write batch failed");
+
+    // durable before the objects count as persisted, one sync per segment file written to
+    // (the prepared batches keep the files open)
+    std::vector<StorageSyncRequest> syncRequests;
+    std::vector<std::size_t> syncedGroups;
+    for (std::size_t i = 0; i < groupOrder.size(); ++i)
+        if (requests[i].success_)
+        {
+            syncRequests.push_back({ requests[i].fd_ });
+            syncedGroups.push_back(i);
+        }
+
+    auto syncBegin = Clock::now();
+    if (!syncRequests.empty() && !storageIo_.sync_batch(syncRequests))
+    {
+        utils::LOG_EVENT(std::cout, "Storage sync batch failed");
+        // written but maybe not durable, written again like a failed write
+        for (std::size_t k = 0; k < syncRequests.size(); ++k)
+            if (!syncRequests[k].success_)
+                requests[syncedGroups[k]].success_ = false;
+        allWritten = false;
+    }
+    lastSyncUs_.store(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - syncBegin)
+                      .count(),
+                      std::memory_order_relaxed);
+
+    for (std::size_t i = 0; i < groupOrder.size(); ++i)
+    {
+        GroupHandle* groupHandle = groupOrder[i];
+        const auto& jobs = groupJobs[groupHandle];
+
+        if (!allWritten && !requests[i].success_)
+        {
+            // this persister is the only one reserving space in the segment logs, the failed
+            // batch is the tail: the retry (or the next batch) is written in its place
+            groupHandle->segmentLog_.abort_batch(preparedBatches[i]);
+
+            utils::LOG_EVENT(std::cout, "Failed to persist ", jobs.size(),
+                             " objects of group: ", groupHandle->groupIdentifier_);
+            for (Job* job : jobs)
+            {
+                // the cache entry stays dirty, so the object is still served from memory meanwhile
+                if (++job->numAttempts_ < maxPersistAttempts)
+                {
+                    retriedObjects_.fetch_add(1, std::memory_order_relaxed);
+                    retryJobs.push_back(std::move(*job));
+                    continue;
+                }
+
+                // given up, the entry can be evicted (the object is lost then)
+                objectCache_.mark_clean({ groupHandle->cacheKey_, job->objectId_.get() });
+                failedObjects_.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        groupHandle->segmentLog_.commit_batch(preparedBatches[i]);
+        for (const Job* job : jobs)
+            objectCache_.mark_clean({ groupHandle->cacheKey_, job->objectId_.get() });
+
+        persistedObjects_.fetch_add(jobs.size(), std::memory_order_relaxed);
+    }
+
+    std::int64_t lagUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                         Clock::now() - batch.front().enqueueTimePoint_)
+                         .count();
+    lastLagUs_.store(lagUs, std::memory_order_relaxed);
+    if (lagUs > maxLagUs_.load(std::memory_order_relaxed))
+        maxLagUs_.store(lagUs, std::memory_order_relaxed);
+    numBatches_.fetch_add(1, std::memory_order_relaxed);
+}
+
+PersistenceStats WriteBehindPersister::get_stats()
+{
+    std::uint64_t pendingObjects, pendingBytes;
+    {
+        std::unique_lock l(queueMtx_);
+        pendingObjects = pendingObjects_;
+        pendingBytes = pendingBytes_;
+    }
+
+    return { pendingObjects,
+             pendingBytes,
+             persistedObjects_.load(std::memory_order_relaxed),
+             retriedObjects_.load(std::memory_order_relaxed),
+             failedObjects_.load(std::memory_order_relaxed),
+             numBatches_.load(std::memory_order_relaxed),
+             std::chrono::microseconds(lastLagUs_.load(std::memory_order_relaxed)),
+             std::chrono::microseconds(maxLagUs_.load(std::memory_order_relaxed)),
+             std::chrono::microseconds(lastSyncUs_.load(std::memory_order_relaxed)) };
+}
+} // namespace rvn
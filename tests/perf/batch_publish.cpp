@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    Bursty publisher: every frame tick a multi layer encoder emits objectsPerTick objects
+    compares one add_object per object against a single add_objects per tick
+*/
+
+using SteadyClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t numTicks = 20'000;
+constexpr std::uint64_t objectsPerTick = 4;
+constexpr std::uint64_t objectSize = 1200;
+
+struct PublishResult
+{
+    double objectsPerSecond;
+    double tickP50Us;
+    double tickP99Us;
+};
+
+template <typename PublishTickFn> PublishResult run_publish(PublishTickFn&& publish_tick)
+{
+    std::vector<std::string> tickObjects(objectsPerTick);
+    std::vector<double> latenciesUs;
+    latenciesUs.reserve(numTicks);
+
+    auto benchBegin = SteadyClock::now();
+    for (std::uint64_t tick = 0; tick < numTicks; ++tick)
+    {
+        for (auto& object : tickObjects)
+            object.assign(objectSize, 'a' + tick % 26);
+
+        auto begin = SteadyClock::now();
+        if (!publish_tick(tickObjects))
+        {
+            std::cerr << "publish failed in tick: " << tick << std::endl;
+            std::exit(1);
+        }
+        auto end = SteadyClock::now();
+        latenciesUs.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+    auto benchEnd = SteadyClock::now();
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    double totalSeconds = std::chrono::duration<double>(benchEnd - benchBegin).count();
+
+    return { numTicks * objectsPerTick / totalSeconds, latenciesUs[latenciesUs.size() / 2],
+             latenciesUs[latenciesUs.size() * 99 / 100] };
+}
+
+void print_result(const char* name, const PublishResult& result)
+{
+    std::cout << name << ": " << result.objectsPerSecond << " objects/sec, tick p50 "
+              << result.tickP50Us << "us, p99 " << result.tickP99Us << "us" << std::endl;
+}
+
+int main()
+{
+    PublishResult perObject, batched;
+    {
+        rvn::DataManager dataManager;
+        auto trackHandle = dataManager.add_track_identifier({ "perf" }, "per_object").lock();
+        auto groupHandle = trackHandle->add_group(rvn::GroupId(0), rvn::PublisherPriority(0), {}).lock();
+        auto subgroupHandle = groupHandle->add_open_ended_subgroup();
+
+        perObject = run_publish(
+        [&subgroupHandle](std::vector<std::string>& objects)
+        {
+            for (auto& object : objects)
+                if (!subgroupHandle.add_object(std::move(object)))
+                    return false;
+            return true;
+        });
+        dataManager.flush_storage();
+    }
+
+    {
+        rvn::DataManager dataManager;
+        auto trackHandle = dataManager.add_track_identifier({ "perf" }, "batched").lock();
+        auto groupHandle = trackHandle->add_group(rvn::GroupId(0), rvn::PublisherPriority(0), {}).lock();
+        auto subgroupHandle = groupHandle->add_open_ended_subgroup();
+
+        batched = run_publish([&subgroupHandle](std::vector<std::string>& objects)
+                              { return subgroupHandle.add_objects(objects); });
+        dataManager.flush_storage();
+    }
+
+    std::cout << "numTicks: " << numTicks << ", objectsPerTick: " << objectsPerTick
+              << ", objectSize: " << objectSize << std::endl;
+    print_result("add_object", perObject);
+    print_result("add_objects", batched);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <boost/program_options.hpp>
+/////////////////////////////////////////////////////////
+#include <deserializer.hpp>
+#include <serialization/chunk.hpp>
+#include <serialization/messages.hpp>
+#include <serialization/serialization_impl.hpp>
+#include <wrappers.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    Deserializer throughput of a data stream: a subgroup header followed by objects of objectSize
+    bytes, received as QUIC buffers of bufferSize bytes (roughly one per packet)
+
+    The buffers reference the serialized stream (as with ReceiveMode::ZERO_COPY), they are set up
+    before the clock starts, only appending them to the deserializer (and handing out the objects)
+    is timed, reported in GB/s of stream bytes
+*/
+
+using namespace rvn;
+using namespace rvn::serialization;
+namespace po = boost::program_options;
+
+using SteadyClock = std::chrono::steady_clock;
+
+struct ObjectCounter
+{
+    std::uint64_t* numObjects_;
+    std::uint64_t* numPayloadBytes_;
+
+    void operator()(const StreamHeaderSubgroupMessage&) const
+    {
+    }
+
+    void operator()(const StreamHeaderSubgroupObject& object) const
+    {
+        ++*numObjects_;
+        *numPayloadBytes_ += object.payload_.size();
+    }
+
+    void operator()(...) const
+    {
+        std::cout << "Unexpected Message\n";
+    }
+};
+
+std::vector<std::uint8_t> serialize_stream(std::uint64_t objectSize, std::uint64_t numObjects)
+{
+    std::vector<std::uint8_t> stream;
+    const auto append = [&stream](const ds::chunk& chunk)
+    { stream.insert(stream.end(), chunk.data(), chunk.data() + chunk.size()); };
+
+    ds::chunk headerChunk;
+    StreamHeaderSubgroupMessage header;
+    header.trackAlias_ = TrackAlias(0);
+    header.groupId_ = GroupId(0);
+    header.subgroupId_ = SubGroupId(0);
+    header.publisherPriority_ = PublisherPriority(0);
+    serialization::detail::serialize(headerChunk, header);
+    append(headerChunk);
+
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+    {
+        ds::chunk objectChunk;
+        StreamHeaderSubgroupObject object;
+        object.objectId_ = ObjectId(objectIdx);
+        object.payload_ = std::string(objectSize, 'a' + objectIdx % 26);
+        serialization::detail::serialize(objectChunk, object);
+        append(objectChunk);
+    }
+    return stream;
+}
+
+// GB/s
+double run(std::uint64_t objectSize, std::uint64_t bufferSize, std::uint64_t streamBytes)
+{
+    std::uint64_t numObjects = std::max<std::uint64_t>(streamBytes / objectSize, 1);
+    std::vector<std::uint8_t> stream = serialize_stream(objectSize, numObjects);
+
+    std::vector<UniqueQuicBuffer> quicBuffers;
+    quicBuffers.reserve(stream.size() / bufferSize + 1);
+    for (std::uint64_t offset = 0; offset < stream.size(); offset += bufferSize)
+    {
+        QUIC_BUFFER* descriptor = static_cast<QUIC_BUFFER*>(malloc(sizeof(QUIC_BUFFER)));
+        descriptor->Length = std::min(bufferSize, stream.size() - offset);
+        descriptor->Buffer = stream.data() + offset;
+        quicBuffers.emplace_back(descriptor, QUIC_BUFFERDeleter());
+    }
+
+    std::uint64_t numObjectsReceived = 0;
+    std::uint64_t numPayloadBytes = 0;
+    Deserializer deserializer(false, ObjectCounter{ &numObjectsReceived, &numPayloadBytes });
+
+    auto begin = SteadyClock::now();
+    for (auto& quicBuffer : quicBuffers)
+        deserializer.append_buffer(std::move(quicBuffer));
+    auto end = SteadyClock::now();
+
+    utils::ASSERT_LOG_THROW(numObjectsReceived == numObjects, "Objects missing", numObjectsReceived,
+                            "!=", numObjects);
+    utils::ASSERT_LOG_THROW(numPayloadBytes == numObjects * objectSize, "Payload bytes missing");
+
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    return stream.size() / seconds / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description poptions("Program Options");
+
+    // clang-format off
+    poptions.add_options()
+        ("help,h", "help")
+        ("buffer_size,b", po::value<std::uint64_t>()->default_value(1200), "QUIC buffer size in bytes")
+        ("stream_bytes,s", po::value<std::uint64_t>()->default_value(64 * 1024 * 1024), "Bytes deserialized per object size");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, poptions), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << poptions << std::endl;
+        exit(0);
+    }
+
+    std::uint64_t bufferSize = vm["buffer_size"].as<std::uint64_t>();
+    std::uint64_t streamBytes = vm["stream_bytes"].as<std::uint64_t>();
+
+    std::cout << "buffer size: " << bufferSize << ", stream bytes: " << streamBytes << std::endl;
+
+    // 1 KiB to 1 MiB objects
+    for (std::uint64_t objectSize = 1024; objectSize <= 1024 * 1024; objectSize *= 4)
+        std::cout << "object size: " << objectSize << " bytes, "
+                  << run(objectSize, bufferSize, streamBytes) << " GB/s" << std::endl;
+
+    return 0;
+}
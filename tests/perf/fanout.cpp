@@ -0,0 +1,143 @@
+///////////////////////////////////////////////////////////
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    Live edge fan out: numSubscribers subscribers follow one group, every published object
+    has to reach all of them, reports CPU time (of the publishing and reading thread)
+    per object per subscriber
+
+        lookup:  every subscriber resolves every object itself, get_object + next by ObjectIdentifier
+                 (track lookup, group lookup, cache lookup per subscriber)
+        fan out: subscribers wait on the group, the publisher hands the object buffer
+                 to all of them, subscribers only advance their cursor in the group and wait again
+*/
+
+constexpr std::uint64_t numObjects = 200;
+constexpr std::uint64_t objectSize = 1200;
+
+double thread_cpu_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+struct Subscriber : public rvn::ObjectWaiter
+{
+    rvn::ObjectId objectId_{ 0 };
+    rvn::ObjectBufferRef handedObject_;
+
+    void notify_object_ready(const rvn::GroupHandle&,
+                             rvn::ObjectId objectId,
+                             const rvn::ObjectBufferRef& objectBuffer) override
+    {
+        if (objectId == objectId_)
+            handedObject_ = objectBuffer;
+    }
+};
+
+// ns per object per subscriber
+double run_lookup(std::uint64_t numSubscribers)
+{
+    rvn::DataManager dataManager;
+    auto trackHandle = dataManager.add_track_identifier({ "perf" }, "lookup").lock();
+    auto groupHandle = trackHandle->add_group(rvn::GroupId(0), rvn::PublisherPriority(0), {}).lock();
+    auto subgroupHandle = groupHandle->add_subgroup(numObjects);
+
+    rvn::TrackIdentifier trackIdentifier({ "perf" }, "lookup");
+    std::vector<rvn::ObjectIdentifier> cursors(numSubscribers,
+                                               rvn::ObjectIdentifier(trackIdentifier, rvn::GroupId(0),
+                                                                     rvn::ObjectId(0)));
+
+    std::uint64_t checksum = 0;
+    double begin = thread_cpu_ns();
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+    {
+        subgroupHandle.add_object(std::string(objectSize, 'a' + objectIdx % 26));
+
+        for (auto& cursor : cursors)
+        {
+            auto objectOrStatus = dataManager.get_object(cursor);
+            checksum += objectOrStatus.index();
+            dataManager.next(cursor);
+        }
+    }
+    double end = thread_cpu_ns();
+
+    dataManager.flush_storage();
+    if (checksum != 0)
+        std::cerr << "lookup: not every object was ready" << std::endl;
+
+    return (end - begin) / (numObjects * numSubscribers);
+}
+
+// ns per object per subscriber
+double run_fanout(std::uint64_t numSubscribers)
+{
+    rvn::DataManager dataManager;
+    auto trackHandle = dataManager.add_track_identifier({ "perf" }, "fanout").lock();
+    auto groupHandle = trackHandle->add_group(rvn::GroupId(0), rvn::PublisherPriority(0), {}).lock();
+    auto subgroupHandle = groupHandle->add_subgroup(numObjects);
+
+    std::vector<std::shared_ptr<Subscriber>> subscribers;
+    for (std::uint64_t i = 0; i < numSubscribers; ++i)
+    {
+        subscribers.push_back(std::make_shared<Subscriber>());
+        dataManager.get_object(*groupHandle, rvn::ObjectId(0), subscribers.back());
+    }
+
+    std::uint64_t numMissed = 0;
+    double begin = thread_cpu_ns();
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+    {
+        subgroupHandle.add_object(std::string(objectSize, 'a' + objectIdx % 26));
+
+        for (auto& subscriber : subscribers)
+        {
+            if (!subscriber->handedObject_)
+            {
+                ++numMissed;
+                continue;
+            }
+            subscriber->handedObject_.reset();
+
+            auto nextObjectId = groupHandle->next_object_id(subscriber->objectId_);
+            if (!nextObjectId)
+                continue;
+            subscriber->objectId_ = *nextObjectId;
+            dataManager.get_object(*groupHandle, subscriber->objectId_, subscriber);
+        }
+    }
+    double end = thread_cpu_ns();
+
+    dataManager.flush_storage();
+    if (numMissed != 0)
+        std::cerr << "fan out: " << numMissed << " objects were not handed over" << std::endl;
+
+    return (end - begin) / (numObjects * numSubscribers);
+}
+
+int main()
+{
+    std::cout << "numObjects: " << numObjects << ", objectSize: " << objectSize << std::endl;
+
+    for (std::uint64_t numSubscribers : { 1, 10, 100, 1'000, 10'000 })
+    {
+        double lookupNs = run_lookup(numSubscribers);
+        double fanoutNs = run_fanout(numSubscribers);
+
+        std::cout << "subscribers: " << numSubscribers << ", lookup: " << lookupNs
+                  << " ns/object/subscriber, fan out: " << fanoutNs << " ns/object/subscriber"
+                  << std::endl;
+    }
+
+    return 0;
+}
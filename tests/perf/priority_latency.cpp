@@ -0,0 +1,207 @@
+/////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/program_options.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+#include "./object_generator_builder.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    Layered publisher over a bandwidth constrained link (--netem: netem on lo, needs sudo,
+    the link is not constrained without it)
+    group i is layer i with publisher priority i and 2^i times the base bit rate,
+    layer 0 is the base layer
+
+    Reports per layer object latency, with the priority scheduler the base layer
+    latency should stay flat as the link saturates while enhancement layers degrade
+*/
+
+using namespace rvn;
+namespace bip = boost::interprocess;
+namespace po = boost::program_options;
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex_;
+    bool serverSetup_;
+    bool clientDone_;
+};
+
+constexpr std::uint8_t numLayers = 4;
+
+int main(int argc, char* argv[])
+{
+    po::options_description poptions("Program Options");
+
+    // clang-format off
+    poptions.add_options()
+        ("help,h", "help")
+        ("objects,o", po::value<std::uint64_t>()->default_value(200), "Objects per layer")
+        ("sample_time,s", po::value<std::uint64_t>()->default_value(50), "Milliseconds between objects")
+        ("base_bit_rate,b", po::value<double>()->default_value(256), "Base layer bit rate in kbits per second")
+        ("link_bit_rate,l", po::value<double>()->default_value(2048), "Link bit rate in kbits per second")
+        ("delay_ms,d", po::value<double>()->default_value(20), "Network delay in milliseconds")
+        ("netem", "Constrain the link with netem on lo (needs sudo)");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, poptions), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << poptions << std::endl;
+        exit(0);
+    }
+
+    std::uint64_t numObjects = vm["objects"].as<std::uint64_t>();
+    auto msBetweenObjects = std::chrono::milliseconds(vm["sample_time"].as<std::uint64_t>());
+
+    std::string sharedMemoryName = "priority_latency_";
+    sharedMemoryName += std::to_string(getpid());
+
+    bip::shared_memory_object shmParent(bip::create_only, sharedMemoryName.c_str(), bip::read_write);
+    shmParent.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region regionParent(shmParent, bip::read_write);
+    InterprocessSynchronizationData* dataParent =
+    new (regionParent.get_address()) InterprocessSynchronizationData();
+
+    dataParent->serverSetup_ = false;
+    dataParent->clientDone_ = false;
+
+    if (fork())
+    {
+        // parent process, server
+        std::unique_ptr<MOQTServer> moqtServer = server_setup();
+        auto dm = moqtServer->dataManager_;
+
+        ObjectGeneratorFactory objectGeneratorFactory(*dm);
+        auto dataPublishers =
+        objectGeneratorFactory.create(ObjectGeneratorFactory::GroupGranularity, numLayers,
+                                      numObjects, msBetweenObjects,
+                                      vm["base_bit_rate"].as<double>() * 1000);
+
+        // groups are added by the publisher threads, the subscriber has to see all of them
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        {
+            std::unique_lock lock(dataParent->mutex_);
+            dataParent->serverSetup_ = true;
+        }
+
+        for (auto& dataPublisher : dataPublishers)
+            dataPublisher.join();
+
+        for (;;)
+        {
+            std::unique_lock lock(dataParent->mutex_);
+            if (dataParent->clientDone_)
+                break;
+        }
+
+        wait(NULL);
+        bip::shared_memory_object::remove(sharedMemoryName.c_str());
+        exit(0);
+    }
+    else
+    {
+        std::optional<NetemRAII> netemRAII;
+        if (vm.count("netem"))
+            netemRAII.emplace(0, vm["link_bit_rate"].as<double>(), vm["delay_ms"].as<double>(), 0);
+
+        bip::shared_memory_object shmChild(bip::open_only, sharedMemoryName.c_str(), bip::read_write);
+        bip::mapped_region regionChild(shmChild, bip::read_write);
+        InterprocessSynchronizationData* dataChild =
+        static_cast<InterprocessSynchronizationData*>(regionChild.get_address());
+
+        for (;;)
+        {
+            std::unique_lock lock(dataChild->mutex_);
+            if (dataChild->serverSetup_)
+                break;
+        }
+
+        std::unique_ptr<MOQTClient> moqtClient = client_setup();
+
+        SubscriptionBuilder subscriptionBuilder;
+        subscriptionBuilder.set_track_alias(TrackAlias(0));
+        subscriptionBuilder.set_track_namespace({ "namespace1", "namespace2", "namespace3" });
+        subscriptionBuilder.set_track_name("track");
+        subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteStart,
+                                           { GroupId(0), ObjectId(0) });
+        subscriptionBuilder.set_subscriber_priority(0);
+        subscriptionBuilder.set_group_order(0);
+
+        moqtClient->subscribe(subscriptionBuilder.build());
+
+        // latency in ms of every object, per layer
+        std::vector<std::vector<std::uint64_t>> latencies(numLayers);
+        std::uint64_t numReceived = 0;
+
+        // enhancement layer objects past their delivery timeout are dropped by the server,
+        // stop once nothing arrived for a while
+        constexpr auto idleTimeout = std::chrono::seconds(2);
+        auto lastReceived = std::chrono::steady_clock::now();
+
+        auto& receivedObjectsQueue = moqtClient->receivedObjects_;
+        while (numReceived < numLayers * numObjects)
+        {
+            MOQTClient::EnrichedObjectMessage enrichedObject;
+            if (!receivedObjectsQueue.try_dequeue(enrichedObject))
+            {
+                if (std::chrono::steady_clock::now() - lastReceived > idleTimeout)
+                    break;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            lastReceived = std::chrono::steady_clock::now();
+            ++numReceived;
+
+            // see ObjectGeneratorFactory::generate_object
+            std::uint64_t sentTimestamp, layerId;
+            std::memcpy(&sentTimestamp, enrichedObject.object_.payload_.data(), sizeof(sentTimestamp));
+            std::memcpy(&layerId, enrichedObject.object_.payload_.data() + sizeof(sentTimestamp),
+                        sizeof(layerId));
+
+            latencies[layerId].push_back(get_current_ms_timestamp() - sentTimestamp);
+        }
+
+        for (std::uint8_t layerId = 0; layerId < numLayers; ++layerId)
+        {
+            auto& layerLatencies = latencies[layerId];
+            std::cout << "layer " << int(layerId) << " (publisher priority " << int(layerId)
+                      << "): received " << layerLatencies.size() << "/" << numObjects;
+            if (!layerLatencies.empty())
+            {
+                std::sort(layerLatencies.begin(), layerLatencies.end());
+                std::cout << ", p50 " << layerLatencies[layerLatencies.size() / 2] << "ms, p99 "
+                          << layerLatencies[layerLatencies.size() * 99 / 100] << "ms";
+            }
+            std::cout << std::endl;
+        }
+
+        {
+            std::unique_lock lock(dataChild->mutex_);
+            dataChild->clientDone_ = true;
+        }
+        exit(0);
+    }
+}
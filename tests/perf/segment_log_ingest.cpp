@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <segment_log.hpp>
+#include <storage_io.hpp>
+#include <strong_types.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    Sustained ingest: store numObjects objects of objectSize bytes back to back
+    and compare the append-only segment log against the old file-per-object layout
+    (ofstream on <objectId>.temp followed by rename)
+*/
+
+using SteadyClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t numObjects = 50'000;
+constexpr std::uint64_t objectSize = 1024;
+
+struct IngestResult
+{
+    double objectsPerSecond;
+    double p50Us;
+    double p99Us;
+};
+
+template <typename StoreFn> IngestResult run_ingest(StoreFn&& store)
+{
+    std::string object(objectSize, 'x');
+    std::vector<double> latenciesUs;
+    latenciesUs.reserve(numObjects);
+
+    auto benchBegin = SteadyClock::now();
+    for (std::uint64_t objectId = 0; objectId < numObjects; ++objectId)
+    {
+        auto begin = SteadyClock::now();
+        if (!store(objectId, object))
+        {
+            std::cerr << "store failed for objectId: " << objectId << std::endl;
+            std::exit(1);
+        }
+        auto end = SteadyClock::now();
+        latenciesUs.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+    auto benchEnd = SteadyClock::now();
+
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    double totalSeconds = std::chrono::duration<double>(benchEnd - benchBegin).count();
+
+    return { numObjects / totalSeconds, latenciesUs[latenciesUs.size() / 2],
+             latenciesUs[latenciesUs.size() * 99 / 100] };
+}
+
+void print_result(const char* name, const IngestResult& result)
+{
+    std::cout << name << ": " << result.objectsPerSecond << " objects/sec, p50 "
+              << result.p50Us << "us, p99 " << result.p99Us << "us" << std::endl;
+}
+
+int main()
+{
+    std::filesystem::path benchDirectory =
+    std::filesystem::temp_directory_path() / "raven_segment_log_ingest";
+    std::filesystem::remove_all(benchDirectory);
+    std::filesystem::create_directories(benchDirectory / "file_per_object");
+
+    IngestResult filePerObject = run_ingest(
+    [&benchDirectory](std::uint64_t objectId, const std::string& object)
+    {
+        std::string pathString =
+        (benchDirectory / "file_per_object" / std::to_string(objectId)).string();
+        std::string tempFilePath = pathString + ".temp";
+
+        std::ofstream file(tempFilePath);
+        if (!file.is_open())
+            return false;
+        file << object;
+        file.close();
+
+        std::filesystem::rename(tempFilePath, pathString);
+        return true;
+    });
+
+    IngestResult segmentLog;
+    {
+        auto storageIo = rvn::make_storage_io(rvn::StorageBackendType::Posix);
+        rvn::SegmentFiles segmentFiles;
+        rvn::SegmentLog log((benchDirectory / "segment.log").string(), *storageIo, segmentFiles);
+        segmentLog = run_ingest([&log](std::uint64_t objectId, const std::string& object)
+                                { return log.append(rvn::ObjectId(objectId), object); });
+
+        // sanity check, cold read goes through the index
+        if (log.read(rvn::ObjectId(numObjects - 1)).value_or("").size() != objectSize)
+        {
+            std::cerr << "segment log read back failed" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "numObjects: " << numObjects << ", objectSize: " << objectSize << std::endl;
+    print_result("file per object", filePerObject);
+    print_result("segment log", segmentLog);
+
+    std::filesystem::remove_all(benchDirectory);
+    return 0;
+}
@@ -0,0 +1,240 @@
+/////////////////////////////////////////////////////////
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/program_options.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    Heap allocations of the send path: the client subscribes (absolute start) to one track
+    after the other, every track has numGroups groups (one data stream each) of numObjects objects
+
+    The server counts operator new calls while a track is sent and reports them per sent object
+    The first track warms up the connection (send / stream context pools, subscription state),
+    the following ones show the steady state
+    malloc is not counted (MsQuic's own allocations, serialized stream headers)
+*/
+
+static std::atomic<std::uint64_t> numAllocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    numAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+using namespace rvn;
+namespace bip = boost::interprocess;
+namespace po = boost::program_options;
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex_;
+    bool serverSetup_;
+    std::uint64_t numTracksReceived_;
+    std::uint64_t numTracksReported_;
+};
+
+struct BenchmarkConfig
+{
+    std::uint64_t numTracks_;
+    std::uint64_t numGroups_;
+    std::uint64_t numObjects_;
+    std::uint64_t objectSize_;
+};
+
+std::string track_name(std::uint64_t trackIdx)
+{
+    return "track-" + std::to_string(trackIdx);
+}
+
+void run_server(const BenchmarkConfig& config, InterprocessSynchronizationData* data)
+{
+    std::unique_ptr<MOQTServer> moqtServer = server_setup();
+    auto dm = moqtServer->dataManager_;
+
+    for (std::uint64_t trackIdx = 0; trackIdx < config.numTracks_; ++trackIdx)
+    {
+        auto trackHandle = dm->add_track_identifier({ "alloc" }, track_name(trackIdx));
+        for (std::uint64_t groupIdx = 0; groupIdx < config.numGroups_; ++groupIdx)
+        {
+            auto groupHandle =
+            trackHandle.lock()->add_group(GroupId(groupIdx), PublisherPriority(0), {});
+            auto subgroupHandle = groupHandle.lock()->add_subgroup(config.numObjects_);
+            for (std::uint64_t objectIdx = 0; objectIdx < config.numObjects_; ++objectIdx)
+                subgroupHandle.add_object(std::string(config.objectSize_, 'a' + objectIdx % 26));
+        }
+    }
+
+    std::uint64_t numObjectsPerTrack = config.numGroups_ * config.numObjects_;
+    std::uint64_t allocationsBefore;
+    {
+        std::unique_lock lock(data->mutex_);
+        allocationsBefore = numAllocations.load();
+        data->serverSetup_ = true;
+    }
+
+    for (std::uint64_t trackIdx = 0; trackIdx < config.numTracks_;)
+    {
+        {
+            std::unique_lock lock(data->mutex_);
+            if (data->numTracksReceived_ == trackIdx + 1)
+            {
+                std::uint64_t allocationsAfter = numAllocations.load();
+                std::uint64_t allocations = allocationsAfter - allocationsBefore;
+                std::cout << (trackIdx == 0 ? "warm up " : "track ") << trackIdx
+                          << ": allocations: " << allocations << ", per sent object: "
+                          << static_cast<double>(allocations) / numObjectsPerTrack << std::endl;
+
+                allocationsBefore = allocationsAfter;
+                data->numTracksReported_ = ++trackIdx;
+                continue;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void run_client(const BenchmarkConfig& config, InterprocessSynchronizationData* data)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock lock(data->mutex_);
+            if (data->serverSetup_)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::unique_ptr<MOQTClient> moqtClient = client_setup();
+    auto& receivedObjectsQueue = moqtClient->receivedObjects_;
+
+    for (std::uint64_t trackIdx = 0; trackIdx < config.numTracks_; ++trackIdx)
+    {
+        // the server reports the previous track before the next subscription comes in
+        for (;;)
+        {
+            {
+                std::unique_lock lock(data->mutex_);
+                if (data->numTracksReported_ == trackIdx)
+                    break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        SubscriptionBuilder subscriptionBuilder;
+        subscriptionBuilder.set_track_alias(TrackAlias(trackIdx));
+        subscriptionBuilder.set_track_namespace({ "alloc" });
+        subscriptionBuilder.set_track_name(track_name(trackIdx));
+        subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteRange,
+                                           { GroupId(0), ObjectId(0) },
+                                           { GroupId(config.numGroups_ - 1),
+                                             ObjectId(config.numObjects_ - 1) });
+        subscriptionBuilder.set_subscriber_priority(0);
+        subscriptionBuilder.set_group_order(0);
+
+        SubscribeMessage subscribeMessage = subscriptionBuilder.build();
+        subscribeMessage.subscribeId_ = trackIdx;
+        moqtClient->subscribe(std::move(subscribeMessage));
+
+        for (std::uint64_t i = 0; i < config.numGroups_ * config.numObjects_; ++i)
+            receivedObjectsQueue.wait_dequeue_ret();
+
+        std::unique_lock lock(data->mutex_);
+        data->numTracksReceived_ = trackIdx + 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description poptions("Program Options");
+
+    // clang-format off
+    poptions.add_options()
+        ("help,h", "help")
+        ("tracks,r", po::value<std::uint64_t>()->default_value(4), "Tracks, subscribed one after the other")
+        ("groups,g", po::value<std::uint64_t>()->default_value(16), "Groups (data streams) per track")
+        ("objects,o", po::value<std::uint64_t>()->default_value(1000), "Objects per group")
+        ("size,s", po::value<std::uint64_t>()->default_value(1200), "Object size in bytes");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, poptions), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << poptions << std::endl;
+        exit(0);
+    }
+
+    BenchmarkConfig config{ vm["tracks"].as<std::uint64_t>(), vm["groups"].as<std::uint64_t>(),
+                            vm["objects"].as<std::uint64_t>(), vm["size"].as<std::uint64_t>() };
+
+    std::string sharedMemoryName = "send_path_allocations_";
+    sharedMemoryName += std::to_string(getpid());
+
+    bip::shared_memory_object shm(bip::create_only, sharedMemoryName.c_str(), bip::read_write);
+    shm.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region region(shm, bip::read_write);
+    InterprocessSynchronizationData* data =
+    new (region.get_address()) InterprocessSynchronizationData();
+
+    data->serverSetup_ = false;
+    data->numTracksReceived_ = 0;
+    data->numTracksReported_ = 0;
+
+    std::cout << "tracks: " << config.numTracks_ << ", groups per track: " << config.numGroups_
+              << ", objects per group: " << config.numObjects_ << ", object size: " << config.objectSize_
+              << std::endl;
+
+    if (fork() == 0)
+    {
+        run_server(config, data);
+        exit(0);
+    }
+
+    if (fork() == 0)
+    {
+        run_client(config, data);
+        exit(0);
+    }
+
+    wait(NULL);
+    wait(NULL);
+    bip::shared_memory_object::remove(sharedMemoryName.c_str());
+
+    return 0;
+}
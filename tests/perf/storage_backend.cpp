@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <segment_log.hpp>
+#include <storage_io.hpp>
+#include <strong_types.hpp>
+///////////////////////////////////////////////////////////
+#include <fcntl.h>
+#include <unistd.h>
+///////////////////////////////////////////////////////////
+
+/*
+    Storage backend comparison (posix vs io_uring)
+
+    write: every round appends one batch of objectsPerBatch objects to each of numGroups
+           segment logs and submits all of them with a single StorageIo::write_batch
+           (what the write-behind persister does)
+    read:  random reads of single objects after dropping the files from the page cache
+
+    io_uring is only measured if Raven is built with RAVEN_WITH_IO_URING
+*/
+
+using SteadyClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t numGroups = 64;
+constexpr std::uint64_t objectsPerBatch = 8;
+constexpr std::uint64_t numRounds = 500;
+constexpr std::uint64_t objectSize = 4096;
+constexpr std::uint64_t numReads = 20'000;
+
+struct BackendResult
+{
+    double writeMiBPerSecond;
+    double writeP99Us;
+    double readP50Us;
+    double readP99Us;
+};
+
+double percentile(std::vector<double>& latenciesUs, std::uint64_t percent)
+{
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    return latenciesUs[latenciesUs.size() * percent / 100];
+}
+
+void drop_page_cache(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+}
+
+BackendResult run_backend(rvn::StorageIo& storageIo, const std::filesystem::path& directory)
+{
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    // one open file per group, the benchmark does not measure reopening
+    rvn::SegmentFiles segmentFiles(numGroups);
+    std::vector<std::unique_ptr<rvn::SegmentLog>> logs;
+    for (std::uint64_t groupId = 0; groupId < numGroups; ++groupId)
+        logs.push_back(std::make_unique<rvn::SegmentLog>(
+        (directory / (std::to_string(groupId) + ".log")).string(), storageIo, segmentFiles));
+
+    std::string object(objectSize, 'x');
+    std::vector<std::vector<rvn::SegmentLog::Record>> records(numGroups);
+    std::vector<rvn::SegmentLog::PreparedBatch> batches;
+    std::vector<rvn::StorageWriteRequest> requests;
+    std::vector<double> writeLatenciesUs;
+    writeLatenciesUs.reserve(numRounds);
+
+    auto benchBegin = SteadyClock::now();
+    for (std::uint64_t round = 0; round < numRounds; ++round)
+    {
+        auto begin = SteadyClock::now();
+
+        batches.clear();
+        requests.clear();
+        for (std::uint64_t groupId = 0; groupId < numGroups; ++groupId)
+        {
+            records[groupId].clear();
+            for (std::uint64_t i = 0; i < objectsPerBatch; ++i)
+                records[groupId].push_back({ rvn::ObjectId(round * objectsPerBatch + i), object });
+
+            batches.push_back(logs[groupId]->prepare_batch(records[groupId]));
+            requests.push_back(logs[groupId]->write_request(batches.back()));
+        }
+
+        if (!storageIo.write_batch(requests))
+        {
+            std::cerr << "write batch failed in round: " << round << std::endl;
+            std::exit(1);
+        }
+
+        for (std::uint64_t groupId = 0; groupId < numGroups; ++groupId)
+            logs[groupId]->commit_batch(batches[groupId]);
+
+        auto end = SteadyClock::now();
+        writeLatenciesUs.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+    auto benchEnd = SteadyClock::now();
+
+    double totalMiB = double(numRounds * numGroups * objectsPerBatch * objectSize) / (1 << 20);
+    double totalSeconds = std::chrono::duration<double>(benchEnd - benchBegin).count();
+
+    for (const auto& log : logs)
+        drop_page_cache(log->path());
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::uint64_t> groupDist(0, numGroups - 1);
+    std::uniform_int_distribution<std::uint64_t> objectDist(0, numRounds * objectsPerBatch - 1);
+
+    std::vector<double> readLatenciesUs;
+    readLatenciesUs.reserve(numReads);
+    for (std::uint64_t i = 0; i < numReads; ++i)
+    {
+        auto& log = logs[groupDist(rng)];
+        rvn::ObjectId objectId(objectDist(rng));
+
+        auto begin = SteadyClock::now();
+        auto payload = log->read(objectId);
+        auto end = SteadyClock::now();
+
+        if (!payload.has_value() || payload->size() != objectSize)
+        {
+            std::cerr << "read back failed for objectId: " << objectId << std::endl;
+            std::exit(1);
+        }
+        readLatenciesUs.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+    }
+
+    logs.clear();
+    std::filesystem::remove_all(directory);
+
+    return { totalMiB / totalSeconds, percentile(writeLatenciesUs, 99),
+             percentile(readLatenciesUs, 50), percentile(readLatenciesUs, 99) };
+}
+
+void print_result(const char* name, const BackendResult& result)
+{
+    std::cout << name << ": write " << result.writeMiBPerSecond << " MiB/sec, batch p99 "
+              << result.writeP99Us << "us | cold read p50 " << result.readP50Us
+              << "us, p99 " << result.readP99Us << "us" << std::endl;
+}
+
+int main()
+{
+    std::filesystem::path benchDirectory =
+    std::filesystem::temp_directory_path() / "raven_storage_backend";
+
+    std::cout << "numGroups: " << numGroups << ", objectsPerBatch: " << objectsPerBatch
+              << ", objectSize: " << objectSize << std::endl;
+
+    auto posixIo = rvn::make_storage_io(rvn::StorageBackendType::Posix);
+    print_result("posix", run_backend(*posixIo, benchDirectory));
+
+    auto ioUringIo = rvn::make_storage_io(rvn::StorageBackendType::IoUring);
+    if (ioUringIo->type() == rvn::StorageBackendType::IoUring)
+        print_result("io_uring", run_backend(*ioUringIo, benchDirectory));
+    else
+        std::cout << "io_uring: not available" << std::endl;
+
+    std::filesystem::remove_all(benchDirectory);
+    return 0;
+}
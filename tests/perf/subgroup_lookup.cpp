@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <set>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <subgroup_intervals.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    Subgroup lookups in a group with numSubgroups subgroups of one object each
+    (the object generator calls cap_and_next after every object)
+
+    Compares SubgroupIntervals against the previous std::set encoding
+    where get_subgroup_id is std::distance over the tree
+*/
+
+using SteadyClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t numSubgroups = 100'000;
+// the set based lookup is linear, only sample it
+constexpr std::uint64_t numSetLookups = 2'000;
+
+struct Comparator
+{
+    bool operator()(std::uint64_t l, std::uint64_t r) const
+    {
+        std::uint64_t lMasked = l & (~(1ULL << 63));
+        std::uint64_t rMasked = r & (~(1ULL << 63));
+
+        if (lMasked == rMasked)
+            return l > r;
+        else
+            return lMasked < rMasked;
+    }
+};
+
+template <typename F> double ns_per_op(std::uint64_t numOps, F&& f)
+{
+    auto begin = SteadyClock::now();
+    f();
+    auto end = SteadyClock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / numOps;
+}
+
+int main()
+{
+    std::set<std::uint64_t, Comparator> objectIdSet;
+    rvn::SubgroupIntervals intervals;
+
+    for (std::uint64_t i = 0; i < numSubgroups; ++i)
+    {
+        objectIdSet.insert(i);
+        objectIdSet.insert((i + 1) | (1ULL << 63));
+        intervals.append(i, i + 1);
+    }
+
+    std::mt19937_64 rng(42);
+    std::vector<std::uint64_t> lookups(numSubgroups);
+    for (auto& objectId : lookups)
+        objectId = rng() % numSubgroups;
+
+    std::uint64_t checksum = 0;
+
+    double setSubgroupNs = ns_per_op(numSetLookups,
+                                     [&]()
+                                     {
+                                         for (std::uint64_t i = 0; i < numSetLookups; ++i)
+                                         {
+                                             auto iter = objectIdSet.upper_bound(lookups[i]);
+                                             checksum +=
+                                             std::distance(objectIdSet.begin(), iter) / 2;
+                                         }
+                                     });
+
+    double flatSubgroupNs = ns_per_op(numSubgroups,
+                                      [&]()
+                                      {
+                                          for (auto objectId : lookups)
+                                              checksum -= intervals.subgroup_index(objectId);
+                                      });
+
+    // the first numSetLookups lookups were done by both, rest only by the flat array
+    for (std::uint64_t i = numSetLookups; i < numSubgroups; ++i)
+        checksum += lookups[i];
+
+    if (checksum != 0)
+    {
+        std::cerr << "subgroup ids do not match" << std::endl;
+        return 1;
+    }
+
+    double flatContainsNs = ns_per_op(numSubgroups,
+                                      [&]()
+                                      {
+                                          for (auto objectId : lookups)
+                                              checksum += intervals.contains(objectId);
+                                      });
+
+    double flatRangeNs =
+    ns_per_op(numSubgroups,
+              [&]()
+              {
+                  for (auto objectId : lookups)
+                      checksum += intervals.num_objects_in_range(objectId, numSubgroups);
+              });
+
+    std::cout << "numSubgroups: " << numSubgroups << " (checksum " << checksum << ")\n";
+    std::cout << "std::set get_subgroup_id: " << setSubgroupNs << " ns/op\n";
+    std::cout << "flat get_subgroup_id: " << flatSubgroupNs << " ns/op\n";
+    std::cout << "flat has_object_id: " << flatContainsNs << " ns/op\n";
+    std::cout << "flat num_objects_in_range: " << flatRangeNs << " ns/op" << std::endl;
+
+    return 0;
+}
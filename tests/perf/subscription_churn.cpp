@@ -0,0 +1,237 @@
+/////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/program_options.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    Subscribe / unsubscribe churn: the client subscribes numSubscriptions times
+    (absolute start over tracks which are far longer than a cycle), receives a few objects
+    and unsubscribes all of them, over and over again
+
+    The server reports its resident memory after every reportEvery cycles, with unsubscribed
+    subscriptions freed (and their streams aborted) it should stay flat
+*/
+
+using namespace rvn;
+namespace bip = boost::interprocess;
+namespace po = boost::program_options;
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex_;
+    bool serverSetup_;
+    std::uint64_t numCyclesDone_;
+    bool clientDone_;
+};
+
+struct BenchmarkConfig
+{
+    std::uint64_t numCycles_;
+    std::uint64_t numSubscriptions_;
+    std::uint64_t numTracks_;
+    std::uint64_t numObjects_;
+    std::uint64_t objectsPerCycle_;
+    std::uint64_t reportEvery_;
+};
+
+std::string track_name(std::uint64_t trackIdx)
+{
+    return "track-" + std::to_string(trackIdx);
+}
+
+std::uint64_t resident_kib()
+{
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t size, resident;
+    statm >> size >> resident;
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+void run_server(const BenchmarkConfig& config, InterprocessSynchronizationData* data)
+{
+    std::unique_ptr<MOQTServer> moqtServer = server_setup();
+    auto dm = moqtServer->dataManager_;
+
+    for (std::uint64_t trackIdx = 0; trackIdx < config.numTracks_; ++trackIdx)
+    {
+        auto trackHandle = dm->add_track_identifier({ "churn" }, track_name(trackIdx));
+        auto groupHandle = trackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(config.numObjects_);
+        for (std::uint64_t objectIdx = 0; objectIdx < config.numObjects_; ++objectIdx)
+            subgroupHandle.add_object(std::string(1200, 'a' + objectIdx % 26));
+    }
+
+    {
+        std::unique_lock lock(data->mutex_);
+        data->serverSetup_ = true;
+    }
+
+    std::uint64_t reportedCycles = 0;
+    for (;;)
+    {
+        std::uint64_t numCyclesDone;
+        bool clientDone;
+        {
+            std::unique_lock lock(data->mutex_);
+            numCyclesDone = data->numCyclesDone_;
+            clientDone = data->clientDone_;
+        }
+
+        if (numCyclesDone >= reportedCycles + config.reportEvery_ || (clientDone && numCyclesDone > reportedCycles))
+        {
+            // let the subscription threads get to the unsubscribes
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            reportedCycles = numCyclesDone;
+            std::cout << "cycles: " << reportedCycles << ", server resident memory: " << resident_kib()
+                      << " KiB" << std::endl;
+        }
+
+        if (clientDone)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void run_client(const BenchmarkConfig& config, InterprocessSynchronizationData* data)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock lock(data->mutex_);
+            if (data->serverSetup_)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::unique_ptr<MOQTClient> moqtClient = client_setup();
+    auto& receivedObjectsQueue = moqtClient->receivedObjects_;
+
+    for (std::uint64_t cycle = 0; cycle < config.numCycles_; ++cycle)
+    {
+        // subscribe ids are reused every cycle
+        for (std::uint64_t subscriptionIdx = 0; subscriptionIdx < config.numSubscriptions_; ++subscriptionIdx)
+        {
+            SubscriptionBuilder subscriptionBuilder;
+            subscriptionBuilder.set_track_alias(TrackAlias(subscriptionIdx));
+            subscriptionBuilder.set_track_namespace({ "churn" });
+            subscriptionBuilder.set_track_name(track_name(subscriptionIdx % config.numTracks_));
+            subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteStart,
+                                               { GroupId(0), ObjectId(0) });
+            subscriptionBuilder.set_subscriber_priority(0);
+            subscriptionBuilder.set_group_order(0);
+
+            SubscribeMessage subscribeMessage = subscriptionBuilder.build();
+            subscribeMessage.subscribeId_ = subscriptionIdx;
+            moqtClient->subscribe(std::move(subscribeMessage));
+        }
+
+        for (std::uint64_t i = 0; i < config.objectsPerCycle_; ++i)
+            receivedObjectsQueue.wait_dequeue_ret();
+
+        for (std::uint64_t subscriptionIdx = 0; subscriptionIdx < config.numSubscriptions_; ++subscriptionIdx)
+        {
+            UnsubscribeMessage unsubscribeMessage;
+            unsubscribeMessage.subscribeId_ = subscriptionIdx;
+            moqtClient->unsubscribe(std::move(unsubscribeMessage));
+        }
+
+        // objects which were in flight when the streams got aborted
+        MOQTClient::EnrichedObjectMessage enrichedObject;
+        while (receivedObjectsQueue.try_dequeue(enrichedObject))
+            ;
+
+        std::unique_lock lock(data->mutex_);
+        data->numCyclesDone_++;
+    }
+
+    std::unique_lock lock(data->mutex_);
+    data->clientDone_ = true;
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description poptions("Program Options");
+
+    // clang-format off
+    poptions.add_options()
+        ("help,h", "help")
+        ("cycles,c", po::value<std::uint64_t>()->default_value(500), "Subscribe / unsubscribe cycles")
+        ("subscriptions,s", po::value<std::uint64_t>()->default_value(64), "Subscriptions per cycle")
+        ("tracks,r", po::value<std::uint64_t>()->default_value(16), "Number of tracks")
+        ("objects,o", po::value<std::uint64_t>()->default_value(10000), "Objects per track")
+        ("objects_per_cycle,p", po::value<std::uint64_t>()->default_value(64), "Objects received before unsubscribing")
+        ("report_every,e", po::value<std::uint64_t>()->default_value(50), "Cycles between memory reports");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, poptions), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << poptions << std::endl;
+        exit(0);
+    }
+
+    BenchmarkConfig config{ vm["cycles"].as<std::uint64_t>(),
+                            vm["subscriptions"].as<std::uint64_t>(),
+                            vm["tracks"].as<std::uint64_t>(),
+                            vm["objects"].as<std::uint64_t>(),
+                            vm["objects_per_cycle"].as<std::uint64_t>(),
+                            vm["report_every"].as<std::uint64_t>() };
+
+    std::string sharedMemoryName = "subscription_churn_";
+    sharedMemoryName += std::to_string(getpid());
+
+    bip::shared_memory_object shm(bip::create_only, sharedMemoryName.c_str(), bip::read_write);
+    shm.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region region(shm, bip::read_write);
+    InterprocessSynchronizationData* data =
+    new (region.get_address()) InterprocessSynchronizationData();
+
+    data->serverSetup_ = false;
+    data->numCyclesDone_ = 0;
+    data->clientDone_ = false;
+
+    std::cout << "cycles: " << config.numCycles_ << ", subscriptions per cycle: " << config.numSubscriptions_
+              << ", tracks: " << config.numTracks_ << ", objects per track: " << config.numObjects_
+              << std::endl;
+
+    if (fork() == 0)
+    {
+        run_server(config, data);
+        exit(0);
+    }
+
+    if (fork() == 0)
+    {
+        run_client(config, data);
+        exit(0);
+    }
+
+    wait(NULL);
+    wait(NULL);
+    bip::shared_memory_object::remove(sharedMemoryName.c_str());
+
+    return 0;
+}
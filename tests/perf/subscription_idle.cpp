@@ -0,0 +1,53 @@
+///////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sys/resource.h>
+#include <thread>
+///////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+#include <subscription_manager.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    CPU burnt by idle subscription threads (no subscriptions, nothing published)
+    a busy polling thread shows up as ~1 core per thread,
+    parked threads should be close to 0
+*/
+
+constexpr std::size_t numThreads = 4;
+constexpr auto measureDuration = std::chrono::seconds(1);
+
+double process_cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// cores used by the subscription threads while idle
+double idle_cores(std::chrono::microseconds spinBeforePark)
+{
+    rvn::DataManager dataManager;
+    rvn::SubscriptionManager subscriptionManager(dataManager, numThreads, spinBeforePark);
+
+    // let the threads start up and settle
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    double cpuBegin = process_cpu_seconds();
+    std::this_thread::sleep_for(measureDuration);
+    double cpuEnd = process_cpu_seconds();
+
+    return (cpuEnd - cpuBegin) / std::chrono::duration<double>(measureDuration).count();
+}
+
+int main()
+{
+    std::cout << "numThreads: " << numThreads << std::endl;
+    std::cout << "park: " << idle_cores(std::chrono::microseconds(0)) << " cores" << std::endl;
+    std::cout << "spin 50us then park: " << idle_cores(std::chrono::microseconds(50))
+              << " cores" << std::endl;
+
+    return 0;
+}
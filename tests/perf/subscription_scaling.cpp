@@ -0,0 +1,232 @@
+/////////////////////////////////////////////////////////
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/program_options.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    Subscription thread scaling: the server publishes numTracks tracks upfront,
+    numClients client processes subscribe numSubscriptions times each (absolute range over a whole track)
+
+    Run for 1, 2, 4, ... max_threads subscription threads, reports the objects
+    delivered per second from the first subscribe till the last client received everything
+*/
+
+using namespace rvn;
+namespace bip = boost::interprocess;
+namespace po = boost::program_options;
+using SteadyClock = std::chrono::steady_clock;
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex_;
+    bool serverSetup_;
+    std::uint64_t numClientsDone_;
+    // steady clock is system wide, comparable across processes
+    std::int64_t firstSubscribeNs_;
+    std::int64_t lastReceiveNs_;
+};
+
+struct BenchmarkConfig
+{
+    std::uint64_t numClients_;
+    std::uint64_t numSubscriptions_;
+    std::uint64_t numTracks_;
+    std::uint64_t numObjects_;
+    std::uint64_t objectSize_;
+};
+
+std::string track_name(std::uint64_t trackIdx)
+{
+    return "track-" + std::to_string(trackIdx);
+}
+
+std::int64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(SteadyClock::now().time_since_epoch())
+    .count();
+}
+
+void run_server(const BenchmarkConfig& config, std::size_t numThreads, InterprocessSynchronizationData* data)
+{
+    std::unique_ptr<MOQTServer> moqtServer = server_setup({ nullptr, 0 }, numThreads);
+    auto dm = moqtServer->dataManager_;
+
+    for (std::uint64_t trackIdx = 0; trackIdx < config.numTracks_; ++trackIdx)
+    {
+        auto trackHandle = dm->add_track_identifier({ "scaling" }, track_name(trackIdx));
+        auto groupHandle = trackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(config.numObjects_);
+        for (std::uint64_t objectIdx = 0; objectIdx < config.numObjects_; ++objectIdx)
+            subgroupHandle.add_object(std::string(config.objectSize_, 'a' + objectIdx % 26));
+    }
+
+    {
+        std::unique_lock lock(data->mutex_);
+        data->serverSetup_ = true;
+    }
+
+    for (;;)
+    {
+        {
+            std::unique_lock lock(data->mutex_);
+            if (data->numClientsDone_ == config.numClients_)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+void run_client(const BenchmarkConfig& config, std::uint64_t clientIdx, InterprocessSynchronizationData* data)
+{
+    for (;;)
+    {
+        {
+            std::unique_lock lock(data->mutex_);
+            if (data->serverSetup_)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::unique_ptr<MOQTClient> moqtClient = client_setup();
+
+    std::int64_t subscribeNs = steady_now_ns();
+    for (std::uint64_t subscriptionIdx = 0; subscriptionIdx < config.numSubscriptions_; ++subscriptionIdx)
+    {
+        std::uint64_t trackIdx = (clientIdx * config.numSubscriptions_ + subscriptionIdx) % config.numTracks_;
+
+        SubscriptionBuilder subscriptionBuilder;
+        subscriptionBuilder.set_track_alias(TrackAlias(subscriptionIdx));
+        subscriptionBuilder.set_track_namespace({ "scaling" });
+        subscriptionBuilder.set_track_name(track_name(trackIdx));
+        subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteRange,
+                                           { GroupId(0), ObjectId(0) },
+                                           { GroupId(0), ObjectId(config.numObjects_ - 1) });
+        subscriptionBuilder.set_subscriber_priority(0);
+        subscriptionBuilder.set_group_order(0);
+
+        moqtClient->subscribe(subscriptionBuilder.build());
+    }
+
+    auto& receivedObjectsQueue = moqtClient->receivedObjects_;
+    for (std::uint64_t i = 0; i < config.numSubscriptions_ * config.numObjects_; ++i)
+        receivedObjectsQueue.wait_dequeue_ret();
+    std::int64_t receiveNs = steady_now_ns();
+
+    std::unique_lock lock(data->mutex_);
+    data->firstSubscribeNs_ = std::min(data->firstSubscribeNs_, subscribeNs);
+    data->lastReceiveNs_ = std::max(data->lastReceiveNs_, receiveNs);
+    data->numClientsDone_++;
+}
+
+// objects per second
+double run(const BenchmarkConfig& config, std::size_t numThreads)
+{
+    std::string sharedMemoryName = "subscription_scaling_";
+    sharedMemoryName += std::to_string(getpid()) + "_" + std::to_string(numThreads);
+
+    bip::shared_memory_object shm(bip::create_only, sharedMemoryName.c_str(), bip::read_write);
+    shm.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region region(shm, bip::read_write);
+    InterprocessSynchronizationData* data =
+    new (region.get_address()) InterprocessSynchronizationData();
+
+    data->serverSetup_ = false;
+    data->numClientsDone_ = 0;
+    data->firstSubscribeNs_ = std::numeric_limits<std::int64_t>::max();
+    data->lastReceiveNs_ = 0;
+
+    if (fork() == 0)
+    {
+        run_server(config, numThreads, data);
+        exit(0);
+    }
+
+    for (std::uint64_t clientIdx = 0; clientIdx < config.numClients_; ++clientIdx)
+    {
+        if (fork() == 0)
+        {
+            run_client(config, clientIdx, data);
+            exit(0);
+        }
+    }
+
+    // server and clients
+    for (std::uint64_t i = 0; i < config.numClients_ + 1; ++i)
+        wait(NULL);
+
+    double seconds = (data->lastReceiveNs_ - data->firstSubscribeNs_) / 1e9;
+    bip::shared_memory_object::remove(sharedMemoryName.c_str());
+
+    return config.numClients_ * config.numSubscriptions_ * config.numObjects_ / seconds;
+}
+
+int main(int argc, char* argv[])
+{
+    po::options_description poptions("Program Options");
+
+    // clang-format off
+    poptions.add_options()
+        ("help,h", "help")
+        ("max_threads,t", po::value<std::size_t>()->default_value(std::max(1u, std::thread::hardware_concurrency() / 2)), "Maximum number of subscription threads")
+        ("clients,c", po::value<std::uint64_t>()->default_value(16), "Number of client processes (connections)")
+        ("subscriptions,s", po::value<std::uint64_t>()->default_value(128), "Subscriptions per client")
+        ("tracks,r", po::value<std::uint64_t>()->default_value(64), "Number of tracks")
+        ("objects,o", po::value<std::uint64_t>()->default_value(100), "Objects per track")
+        ("object_size,z", po::value<std::uint64_t>()->default_value(1200), "Object size in bytes");
+    // clang-format on
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, poptions), vm);
+    po::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << poptions << std::endl;
+        exit(0);
+    }
+
+    BenchmarkConfig config{ vm["clients"].as<std::uint64_t>(), vm["subscriptions"].as<std::uint64_t>(),
+                            vm["tracks"].as<std::uint64_t>(), vm["objects"].as<std::uint64_t>(),
+                            vm["object_size"].as<std::uint64_t>() };
+    std::size_t maxThreads = vm["max_threads"].as<std::size_t>();
+
+    std::cout << "subscribers: " << config.numClients_ * config.numSubscriptions_
+              << " (clients: " << config.numClients_
+              << "), tracks: " << config.numTracks_ << ", objects: " << config.numObjects_
+              << ", objectSize: " << config.objectSize_ << std::endl;
+
+    double singleThreadRate = 0;
+    for (std::size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        double rate = run(config, numThreads);
+        if (numThreads == 1)
+            singleThreadRate = rate;
+
+        std::cout << "subscription threads: " << numThreads << ", " << rate
+                  << " objects/sec, speedup " << rate / singleThreadRate << std::endl;
+    }
+
+    return 0;
+}
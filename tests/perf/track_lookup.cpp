@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+///////////////////////////////////////////////////////////
+#include <boost/functional/hash.hpp>
+///////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+///////////////////////////////////////////////////////////
+
+/*
+    Cost of the track lookup done on the fulfill_some_minor path
+    (get_object + next for every object sent, per subscriber)
+
+        string keyed: hierarchy keyed by (namespace, name), hash_combine over
+                      all strings and a full string compare on every lookup (old TrackIdentifier)
+        interned:     hierarchy keyed by the integer track id, cached hash
+
+    Also reports get_object + next per object through the DataManager
+*/
+
+using SteadyClock = std::chrono::steady_clock;
+
+constexpr std::uint64_t numTracks = 1'000;
+constexpr std::uint64_t numLookups = 2'000'000;
+constexpr std::uint64_t numObjects = 1'000;
+
+struct StringKey
+{
+    std::vector<std::string> tnamespace_;
+    std::string tname_;
+
+    bool operator==(const StringKey&) const = default;
+};
+
+struct StringKeyHash
+{
+    std::uint64_t operator()(const StringKey& key) const
+    {
+        std::uint64_t hash = 0;
+        for (const auto& ns : key.tnamespace_)
+            boost::hash_combine(hash, ns);
+        boost::hash_combine(hash, key.tname_);
+        return hash;
+    }
+};
+
+std::vector<std::string> make_namespace(std::uint64_t trackIdx)
+{
+    return { "com.example.live", "broadcasts", "channel-" + std::to_string(trackIdx % 10) };
+}
+
+std::string make_trackname(std::uint64_t trackIdx)
+{
+    return "video-1080p-layer-" + std::to_string(trackIdx);
+}
+
+template <typename Fn> double ns_per_op(std::uint64_t numOps, Fn&& fn)
+{
+    auto begin = SteadyClock::now();
+    fn();
+    auto end = SteadyClock::now();
+    return std::chrono::duration<double, std::nano>(end - begin).count() / numOps;
+}
+
+int main()
+{
+    std::unordered_map<StringKey, std::uint64_t, StringKeyHash> stringKeyed;
+    std::vector<StringKey> stringKeys;
+    std::unordered_map<std::uint64_t, std::uint64_t> interned;
+    std::vector<rvn::TrackIdentifier> trackIdentifiers;
+
+    for (std::uint64_t trackIdx = 0; trackIdx < numTracks; ++trackIdx)
+    {
+        stringKeys.push_back({ make_namespace(trackIdx), make_trackname(trackIdx) });
+        stringKeyed.emplace(stringKeys.back(), trackIdx);
+
+        trackIdentifiers.emplace_back(make_namespace(trackIdx), make_trackname(trackIdx));
+        interned.emplace(trackIdentifiers.back().track_id(), trackIdx);
+    }
+
+    // lookups with keys which are copies (like the ObjectIdentifier of a subscription)
+    std::uint64_t checksum = 0;
+    double stringKeyedNs = ns_per_op(numLookups,
+                                     [&]()
+                                     {
+                                         for (std::uint64_t i = 0; i < numLookups; ++i)
+                                             checksum += stringKeyed.find(stringKeys[i % numTracks])->second;
+                                     });
+
+    double internedNs = ns_per_op(numLookups,
+                                  [&]()
+                                  {
+                                      for (std::uint64_t i = 0; i < numLookups; ++i)
+                                          checksum +=
+                                          interned.find(trackIdentifiers[i % numTracks].track_id())->second;
+                                  });
+
+    // the actual fulfill_some_minor data path
+    rvn::DataManager dataManager;
+    auto trackHandle =
+    dataManager.add_track_identifier(make_namespace(0), make_trackname(0)).lock();
+    auto groupHandle = trackHandle->add_group(rvn::GroupId(0), rvn::PublisherPriority(0), {}).lock();
+    auto subgroupHandle = groupHandle->add_subgroup(numObjects);
+    for (std::uint64_t objectId = 0; objectId < numObjects; ++objectId)
+        subgroupHandle.add_object(std::string(64, 'x'));
+
+    rvn::ObjectIdentifier objectIdentifier(trackIdentifiers[0], rvn::GroupId(0), rvn::ObjectId(0));
+    double getObjectNs = ns_per_op(numLookups,
+                                   [&]()
+                                   {
+                                       for (std::uint64_t i = 0; i < numLookups; ++i)
+                                       {
+                                           auto objectOrStatus = dataManager.get_object(objectIdentifier);
+                                           checksum += objectOrStatus.index();
+                                           if (!dataManager.next(objectIdentifier))
+                                               objectIdentifier.objectId_ = rvn::ObjectId(0);
+                                       }
+                                   });
+
+    std::cout << "numTracks: " << numTracks << ", numLookups: " << numLookups
+              << " (checksum " << checksum << ")" << std::endl;
+    std::cout << "string keyed lookup: " << stringKeyedNs << " ns" << std::endl;
+    std::cout << "interned lookup: " << internedNs << " ns" << std::endl;
+    std::cout << "get_object + next: " << getObjectNs << " ns" << std::endl;
+
+    return 0;
+}
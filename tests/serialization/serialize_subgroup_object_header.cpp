@@ -0,0 +1,154 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <publish_buffer.hpp>
+#include <data_manager.hpp>
+#include <serialization/chunk.hpp>
+#include <serialization/messages.hpp>
+#include <serialization/serialization.hpp>
+#include <serialization/serialization_impl.hpp>
+#include <utilities.hpp>
+
+/*
+    The zero copy publish path (PublishBuffer) writes the StreamHeaderSubgroupObject header in
+    place in front of the payload (serialize_subgroup_object_header), subscribers must get the
+    same bytes as from serialization::serialize(StreamHeaderSubgroupObject)
+
+    Object ids and payload lengths are taken around the var int size boundaries
+*/
+
+using namespace rvn;
+using namespace rvn::serialization;
+
+// 1 byte up to 63, 2 bytes up to 16383, 4 bytes up to 2^30 - 1, 8 bytes beyond
+const std::uint64_t varIntBoundaries[] = { 0,     1,     63,          64,        16383,
+                                           16384, 16385, (1ULL << 30) - 1, 1ULL << 30 };
+
+std::string make_payload(std::uint64_t length)
+{
+    std::string payload(length, '\0');
+    for (std::uint64_t i = 0; i < length; ++i)
+        payload[i] = char(i * 31 + 7);
+    return payload;
+}
+
+ds::chunk serialize_reference(std::uint64_t objectId, const std::string& payload)
+{
+    StreamHeaderSubgroupObject subgroupObject;
+    subgroupObject.objectId_ = objectId;
+    subgroupObject.payload_ = payload;
+
+    ds::chunk c;
+    serialize_into(c, subgroupObject);
+    return c;
+}
+
+void check_identical(const std::uint8_t* serialized,
+                     std::uint64_t serializedLength,
+                     const ds::chunk& expected,
+                     std::uint64_t objectId,
+                     std::uint64_t payloadLength)
+{
+    utils::ASSERT_LOG_THROW(serializedLength == expected.size(), "Size mismatch\n",
+                            "ObjectId: ", objectId, " PayloadLength: ", payloadLength, "\n",
+                            "Expected size: ", expected.size(), "\n",
+                            "Actual size: ", serializedLength, "\n");
+    for (std::uint64_t i = 0; i < serializedLength; i++)
+        utils::ASSERT_LOG_THROW(serialized[i] == expected.data()[i], "Mismatch at index: ", i, "\n",
+                                "ObjectId: ", objectId, " PayloadLength: ", payloadLength, "\n",
+                                "Expected: ", int(expected.data()[i]), "\n",
+                                "Actual: ", int(serialized[i]), "\n");
+}
+
+// header written into the headroom as DataManager::store_object(PublishBuffer) does
+void test_in_place_header()
+{
+    for (std::uint64_t payloadLength : { 0, 1, 63, 64, 16383, 16384 })
+    {
+        std::string payload = make_payload(payloadLength);
+        for (std::uint64_t objectId : varIntBoundaries)
+        {
+            PublishBuffer publishBuffer(payloadLength);
+            std::memcpy(publishBuffer.data(), payload.data(), payloadLength);
+
+            std::uint64_t headerLength =
+            serialize_subgroup_object_header(publishBuffer.data(), objectId, payloadLength);
+            utils::ASSERT_LOG_THROW(headerLength <= PublishBuffer::headroom,
+                                    "Header does not fit the headroom: ", headerLength);
+
+            check_identical(publishBuffer.data() - headerLength, headerLength + payloadLength,
+                            serialize_reference(objectId, payload), objectId, payloadLength);
+        }
+    }
+
+    // lengths only the header is written for (no payload of that size is allocated)
+    for (std::uint64_t payloadLength : varIntBoundaries)
+        for (std::uint64_t objectId : varIntBoundaries)
+        {
+            std::uint8_t header[PublishBuffer::headroom];
+            std::uint64_t headerLength =
+            serialize_subgroup_object_header(header + sizeof(header), objectId, payloadLength);
+
+            ds::chunk expected;
+            serialization::detail::serialize<ds::quic_var_int>(expected, objectId);
+            serialization::detail::serialize<ds::quic_var_int>(expected, payloadLength);
+            check_identical(header + sizeof(header) - headerLength, headerLength, expected,
+                            objectId, payloadLength);
+        }
+}
+
+// published through SubgroupHandle::add_object(PublishBuffer), read back from the cache
+void test_published()
+{
+    constexpr std::uint64_t numObjects = 65;
+    const std::uint64_t payloadLengths[] = { 63, 64, 16383, 16384 };
+
+    DataManager dataManager;
+    auto trackHandle = dataManager.add_track_identifier({ "publish_buffer" }, "track");
+    auto groupHandle = trackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {});
+    auto subgroupHandle = groupHandle.lock()->add_subgroup(numObjects);
+
+    for (std::uint64_t objectId = 0; objectId < numObjects; ++objectId)
+    {
+        std::string payload = make_payload(payloadLengths[objectId % 4]);
+        PublishBuffer publishBuffer(payload.size());
+        std::memcpy(publishBuffer.data(), payload.data(), payload.size());
+        subgroupHandle.add_object(std::move(publishBuffer));
+    }
+
+    TrackIdentifier trackIdentifier({ "publish_buffer" }, "track");
+    for (std::uint64_t objectId = 0; objectId < numObjects; ++objectId)
+    {
+        ObjectOrStatus objectOrStatus =
+        dataManager.get_object(ObjectIdentifier(trackIdentifier, GroupId(0), ObjectId(objectId)));
+        utils::ASSERT_LOG_THROW(std::holds_alternative<ObjectType>(objectOrStatus),
+                                "Object not published: ", objectId);
+
+        std::string payload = make_payload(payloadLengths[objectId % 4]);
+        const QUIC_BUFFER* quicBuffer =
+        std::get<0>(std::get<ObjectType>(objectOrStatus))->quic_buffer();
+        check_identical(quicBuffer->Buffer, quicBuffer->Length,
+                        serialize_reference(objectId, payload), objectId, payload.size());
+    }
+}
+
+void tests()
+{
+    try
+    {
+        test_in_place_header();
+        test_published();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "test failed\n";
+        std::cerr << e.what() << '\n';
+        std::exit(1);
+    }
+}
+
+int main()
+{
+    tests();
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "strong_types.hpp"
+#include "test_serialization_utils.hpp"
+#include "utilities.hpp"
+#include <cassert>
+#include <iostream>
+#include <serialization/chunk.hpp>
+#include <serialization/deserialization_impl.hpp>
+#include <serialization/messages.hpp>
+#include <serialization/serialization_impl.hpp>
+
+using namespace rvn;
+using namespace rvn::serialization;
+
+// deserializes back to msg unless another (equivalent) message is expected
+void test_serialize_subscribe_update(const SubscribeUpdateMessage& msg,
+                                     const std::string& expectedSerializationString,
+                                     const SubscribeUpdateMessage* expectedMsg = nullptr)
+{
+    ds::chunk c;
+    serialization::detail::serialize(c, msg);
+
+    auto expectedSerialization = binary_string_to_vector(expectedSerializationString);
+    utils::ASSERT_LOG_THROW(c.size() == expectedSerialization.size(), "Size mismatch\n",
+                            "Expected size: ", expectedSerialization.size(),
+                            "\n", "Actual size: ", c.size(), "\n");
+    for (std::size_t i = 0; i < c.size(); i++)
+        utils::ASSERT_LOG_THROW(c[i] == expectedSerialization[i], "Mismatch at index: ", i,
+                                "\n", "Expected: ", int(expectedSerialization[i]),
+                                "\n", "Actual: ", int(c[i]), "\n");
+
+    ds::ChunkSpan span(c);
+
+    ControlMessageHeader header;
+    serialization::detail::deserialize(header, span);
+
+    utils::ASSERT_LOG_THROW(header.messageType_ == MoQtMessageType::SUBSCRIBE_UPDATE,
+                            "Message type mismatch\n", "Expected: ",
+                            utils::to_underlying(MoQtMessageType::SUBSCRIBE_UPDATE), "\n",
+                            "Actual: ", utils::to_underlying(header.messageType_), "\n");
+
+    SubscribeUpdateMessage deserializedMsg;
+    serialization::detail::deserialize(deserializedMsg, span);
+
+    if (expectedMsg == nullptr)
+        expectedMsg = &msg;
+    utils::ASSERT_LOG_THROW(*expectedMsg == deserializedMsg, "Deserialization failed\n",
+                            "Expected: ", *expectedMsg, "\n", "Actual: ", deserializedMsg, "\n");
+}
+
+void test_closed_range()
+{
+    SubscribeUpdateMessage msg;
+    msg.subscribeId_ = 0x12;
+    msg.start_ = { GroupId(0x5678), ObjectId(0x1234) };
+    msg.end_ = SubscribeUpdateMessage::GroupObjectPair{ GroupId(0x5678), ObjectId(0x1234) };
+    msg.subscriberPriority_ = 0x40;
+
+    // clang-format off
+    /*   [ 00000010 ]      [ 00001111 ]    [ 00010010 ]     [ 10000000 00000000 01010110 01111000 ] [ 01010010 00110100 ]
+     * (msg_type: 0x02)    (len: 15)     (subscribeId_)             (start_.group_)                  (start_.object_)
+     *
+     * [ 10000000 00000000 01010110 01111001 ] [ 01010010 00110100 ]       [ 01000000 ]            [ 00000000 ]
+     *       (end_.group_ + 1: 0x5679)             (end_.object_)      (subscriberPriority_)    (parameters_.size)
+     */
+    std::string expectedSerializationString = "00000010 00001111 00010010 10000000 00000000 01010110 01111000 01010010 00110100 10000000 00000000 01010110 01111001 01010010 00110100 01000000 00000000";
+    // clang-format on
+
+    test_serialize_subscribe_update(msg, expectedSerializationString);
+}
+
+void test_open_ended()
+{
+    SubscribeUpdateMessage msg;
+    msg.subscribeId_ = 0x1;
+    msg.start_ = { GroupId(0x3), ObjectId(0x0) };
+    msg.subscriberPriority_ = 0x0;
+
+    // clang-format off
+    /*   [ 00000010 ]      [ 00000111 ]    [ 00000001 ]     [ 00000011 ]     [ 00000000 ]          [ 00000000 ]           [ 00000000 ]            [ 00000000 ]            [ 00000000 ]
+     * (msg_type: 0x02)    (len: 7)      (subscribeId_)  (start_.group_)  (start_.object_)  (EndGroup 0: open ended)     (EndObject)      (subscriberPriority_)    (parameters_.size)
+     */
+    std::string expectedSerializationString = "00000010 00000111 00000001 00000011 00000000 00000000 00000000 00000000 00000000";
+    // clang-format on
+
+    test_serialize_subscribe_update(msg, expectedSerializationString);
+}
+
+void test_whole_end_group()
+{
+    SubscribeUpdateMessage msg;
+    msg.subscribeId_ = 0x1;
+    msg.start_ = { GroupId(0x3), ObjectId(0x0) };
+    msg.end_ =
+    SubscribeUpdateMessage::GroupObjectPair{ GroupId(0x5), SubscribeUpdateMessage::endOfGroup };
+    msg.subscriberPriority_ = 0x0;
+
+    // clang-format off
+    /*   [ 00000010 ]      [ 00000111 ]    [ 00000001 ]     [ 00000011 ]     [ 00000000 ]            [ 00000110 ]                  [ 00000000 ]               [ 00000000 ]            [ 00000000 ]
+     * (msg_type: 0x02)    (len: 7)      (subscribeId_)  (start_.group_)  (start_.object_)  (end_.group_ + 1: 0x6)  (EndObject 0: whole end group)  (subscriberPriority_)    (parameters_.size)
+     */
+    std::string expectedSerializationString = "00000010 00000111 00000001 00000011 00000000 00000110 00000000 00000000 00000000";
+    // clang-format on
+
+    test_serialize_subscribe_update(msg, expectedSerializationString);
+}
+
+void test_empty_end_group()
+{
+    SubscribeUpdateMessage msg;
+    msg.subscribeId_ = 0x1;
+    msg.start_ = { GroupId(0x3), ObjectId(0x0) };
+    msg.end_ = SubscribeUpdateMessage::GroupObjectPair{ GroupId(0x5), ObjectId(0x0) };
+    msg.subscriberPriority_ = 0x0;
+
+    // nothing of group 5 is the whole of group 4
+    SubscribeUpdateMessage expectedMsg = msg;
+    expectedMsg.end_ =
+    SubscribeUpdateMessage::GroupObjectPair{ GroupId(0x4), SubscribeUpdateMessage::endOfGroup };
+
+    // clang-format off
+    /*   [ 00000010 ]      [ 00000111 ]    [ 00000001 ]     [ 00000011 ]     [ 00000000 ]         [ 00000101 ]                [ 00000000 ]               [ 00000000 ]            [ 00000000 ]
+     * (msg_type: 0x02)    (len: 7)      (subscribeId_)  (start_.group_)  (start_.object_)  (EndGroup: 0x4 + 1)  (EndObject 0: whole end group)  (subscriberPriority_)    (parameters_.size)
+     */
+    std::string expectedSerializationString = "00000010 00000111 00000001 00000011 00000000 00000101 00000000 00000000 00000000";
+    // clang-format on
+
+    test_serialize_subscribe_update(msg, expectedSerializationString, &expectedMsg);
+}
+
+void tests()
+{
+    try
+    {
+        test_closed_range();
+        test_open_ended();
+        test_whole_end_group();
+        test_empty_end_group();
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "test failed\n";
+        std::cerr << e.what() << '\n';
+    }
+}
+
+int main()
+{
+    tests();
+    return 0;
+}
@@ -31,16 +31,18 @@ struct InterprocessSynchronizationData
 
 namespace bip = boost::interprocess;
 
-// TODO: MsQuic issue for larget numObjects
 // https://github.com/microsoft/msquic/discussions/4813
-// We have solved the problem by making a copy of the buffer
-static constexpr std::uint64_t numObjects = 10'000;
+// Large transfers used to break when MsQuic's buffers were referenced after the receive callback returned
+// The transfer runs once per receive mode, ReceiveMode::ZERO_COPY keeps receives pending and
+// completes every buffer once it has been deserialized
+static constexpr std::uint64_t numObjects = 100'000;
 static constexpr std::uint8_t numGroups = 4;
 
-int main()
+// returns the exit status of the client
+int run_transfer(ReceiveMode receiveMode)
 {
     std::string sharedMemoryName = "chunk_transfer_test_";
-    sharedMemoryName += std::to_string(getpid());
+    sharedMemoryName += std::to_string(getpid()) + "_" + std::to_string(utils::to_underlying(receiveMode));
 
     bip::shared_memory_object shmParent(bip::create_only,
                                         sharedMemoryName.c_str(), bip::read_write);
@@ -95,8 +97,10 @@ int main()
         }
 
         std::cout << "Server done" << std::endl;
-        wait(NULL);
-        exit(0);
+        int status;
+        wait(&status);
+        bip::shared_memory_object::remove(sharedMemoryName.c_str());
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
     }
     else
     {
@@ -116,7 +120,7 @@ int main()
         }
 
 
-        std::unique_ptr<MOQTClient> moqtClient = client_setup();
+        std::unique_ptr<MOQTClient> moqtClient = client_setup({ nullptr, 0 }, receiveMode);
 
         SubscriptionBuilder subscriptionBuilder;
         subscriptionBuilder.set_track_alias(TrackAlias(0));
@@ -162,5 +166,18 @@ int main()
             dataChild->clientDone = true;
         }
         std::cout << "Client done" << std::endl;
+        exit(0);
+    }
+}
+
+int main()
+{
+    for (ReceiveMode receiveMode : { ReceiveMode::COPY, ReceiveMode::ZERO_COPY })
+    {
+        std::cout << "Receive mode: "
+                  << (receiveMode == ReceiveMode::COPY ? "COPY" : "ZERO_COPY") << std::endl;
+        if (run_transfer(receiveMode) != 0)
+            return 1;
     }
+    return 0;
 }
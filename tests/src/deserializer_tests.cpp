@@ -132,10 +132,140 @@ void test2()
     return;
 }
 
+// zero copy receive: the descriptors reference the data, deleting them completes the receive
+static std::uint64_t numBytesCompleted = 0;
+static void QUIC_API count_receive_complete(HQUIC, std::uint64_t bufferLength)
+{
+    numBytesCompleted += bufferLength;
+}
+
+void test3()
+{
+    std::vector<ds::chunk> chunks(1);
+
+    StreamHeaderSubgroupMessage streamHeaderSubgroupMessage;
+    streamHeaderSubgroupMessage.subgroupId_ = SubGroupId(0);
+    streamHeaderSubgroupMessage.groupId_ = GroupId(2);
+    streamHeaderSubgroupMessage.trackAlias_ = TrackAlias(3);
+    streamHeaderSubgroupMessage.publisherPriority_ = PublisherPriority(4);
+    serialization::detail::serialize(chunks[0], streamHeaderSubgroupMessage);
+
+    constexpr std::uint64_t NumObjects = 1000;
+    for (std::uint64_t i = 0; i < NumObjects; i++)
+    {
+        StreamHeaderSubgroupObject streamObjectMessage;
+        streamObjectMessage.objectId_ = ObjectId(i);
+        streamObjectMessage.payload_ = "Object Message: " + std::to_string(i);
+        serialization::detail::serialize(chunks.emplace_back(), streamObjectMessage);
+    }
+
+    // the bytes as received, stay where they are
+    std::vector<std::uint8_t> receivedBytes;
+    for (const auto& chunk : chunks)
+        receivedBytes.insert(receivedBytes.end(), chunk.data(), chunk.data() + chunk.size());
+
+    std::uint64_t numObjectsReceived = 0;
+    const auto visitor = overloads{ [](...) {},
+                                    [&](const StreamHeaderSubgroupObject& o)
+                                    {
+                                        utils::ASSERT_LOG_THROW(o.objectId_ == ObjectId(numObjectsReceived),
+                                                                "Unexpected object", o.objectId_);
+                                        ++numObjectsReceived;
+                                    } };
+
+    Deserializer deserializer(false, visitor);
+    for (std::uint64_t i = 0; i < receivedBytes.size();)
+    {
+        std::uint64_t length = std::min<std::uint64_t>((i % 7) + 1, receivedBytes.size() - i);
+
+        QUIC_BUFFER* descriptor = static_cast<QUIC_BUFFER*>(malloc(sizeof(QUIC_BUFFER)));
+        descriptor->Length = length;
+        descriptor->Buffer = receivedBytes.data() + i;
+        deserializer.append_buffer(
+        UniqueQuicBuffer(descriptor, QUIC_BUFFERDeleter(nullptr, count_receive_complete)));
+        i += length;
+
+        // only what has been deserialized is completed
+        utils::ASSERT_LOG_THROW(numBytesCompleted <= i, "Completed more than received",
+                                numBytesCompleted, ">", i);
+    }
+
+    utils::ASSERT_LOG_THROW(numObjectsReceived == NumObjects, "Objects missing", numObjectsReceived);
+    utils::ASSERT_LOG_THROW(numBytesCompleted == receivedBytes.size(), "Receive not completed",
+                            numBytesCompleted, "!=", receivedBytes.size());
+    std::cout << "Completed " << numBytesCompleted << " received bytes\n";
+}
+
+// zero copy receive of objects larger than MsQuic's default stream receive window (64 KiB):
+// the receive must not wait for a complete object to release the window
+void test4()
+{
+    constexpr std::uint64_t StreamRecvWindow = 64 * 1024;
+    constexpr std::uint64_t NumObjects = 4;
+    constexpr std::uint64_t ObjectSize = 4 * StreamRecvWindow;
+
+    std::vector<ds::chunk> chunks(1);
+
+    StreamHeaderSubgroupMessage streamHeaderSubgroupMessage;
+    streamHeaderSubgroupMessage.subgroupId_ = SubGroupId(0);
+    streamHeaderSubgroupMessage.groupId_ = GroupId(0);
+    streamHeaderSubgroupMessage.trackAlias_ = TrackAlias(0);
+    streamHeaderSubgroupMessage.publisherPriority_ = PublisherPriority(0);
+    serialization::detail::serialize(chunks[0], streamHeaderSubgroupMessage);
+
+    for (std::uint64_t i = 0; i < NumObjects; i++)
+    {
+        StreamHeaderSubgroupObject streamObjectMessage;
+        streamObjectMessage.objectId_ = ObjectId(i);
+        streamObjectMessage.payload_ = std::string(ObjectSize, 'a' + i);
+        serialization::detail::serialize(chunks.emplace_back(), streamObjectMessage);
+    }
+
+    std::vector<std::uint8_t> receivedBytes;
+    for (const auto& chunk : chunks)
+        receivedBytes.insert(receivedBytes.end(), chunk.data(), chunk.data() + chunk.size());
+
+    std::uint64_t numObjectsReceived = 0;
+    const auto visitor =
+    overloads{ [](...) {},
+               [&](const StreamHeaderSubgroupObject& o)
+               {
+                   utils::ASSERT_LOG_THROW(o.payload_ == std::string(ObjectSize, 'a' + numObjectsReceived),
+                                           "Payload mismatch", o.objectId_);
+                   ++numObjectsReceived;
+               } };
+
+    numBytesCompleted = 0;
+    Deserializer deserializer(false, visitor);
+    for (std::uint64_t i = 0; i < receivedBytes.size();)
+    {
+        // roughly a packet each
+        std::uint64_t length = std::min<std::uint64_t>(1200, receivedBytes.size() - i);
+
+        QUIC_BUFFER* descriptor = static_cast<QUIC_BUFFER*>(malloc(sizeof(QUIC_BUFFER)));
+        descriptor->Length = length;
+        descriptor->Buffer = receivedBytes.data() + i;
+        deserializer.append_buffer(
+        UniqueQuicBuffer(descriptor, QUIC_BUFFERDeleter(nullptr, count_receive_complete)));
+        i += length;
+
+        // MsQuic would not indicate more than the window
+        utils::ASSERT_LOG_THROW(i - numBytesCompleted < StreamRecvWindow,
+                                "Receive window exhausted", i - numBytesCompleted);
+    }
+
+    utils::ASSERT_LOG_THROW(numObjectsReceived == NumObjects, "Objects missing", numObjectsReceived);
+    utils::ASSERT_LOG_THROW(numBytesCompleted == receivedBytes.size(), "Receive not completed",
+                            numBytesCompleted, "!=", receivedBytes.size());
+    std::cout << "Completed " << numBytesCompleted << " received bytes of objects larger than the window\n";
+}
+
 
 int main()
 {
     test1();
     test2();
+    test3();
+    test4();
     return 0;
 }
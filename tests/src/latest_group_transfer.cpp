@@ -0,0 +1,175 @@
+/////////////////////////////////////////////////////////
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    A latest group subscription does not stop at the end of its group: the client subscribes
+    while the track has a single group, the server adds the next group only after the client
+    has received the first one, the objects of the new group have to arrive as well
+*/
+
+using namespace rvn;
+
+constexpr std::uint64_t numObjects = 4;
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex;
+    bool serverSetup;
+    bool firstGroupReceived;
+    bool clientDone;
+};
+
+namespace bip = boost::interprocess;
+
+std::string object_payload(std::uint64_t groupIdx, std::uint64_t objectIdx)
+{
+    return "group " + std::to_string(groupIdx) + " object " + std::to_string(objectIdx);
+}
+
+void add_group(const std::weak_ptr<TrackHandle>& trackHandle, std::uint64_t groupIdx)
+{
+    auto groupHandle =
+    trackHandle.lock()->add_group(GroupId(groupIdx), PublisherPriority(0), {});
+    auto subgroupHandle = groupHandle.lock()->add_subgroup(numObjects);
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+        subgroupHandle.add_object(object_payload(groupIdx, objectIdx));
+}
+
+void receive_group(MOQTClient& moqtClient, std::uint64_t groupIdx)
+{
+    auto dataStreamUserHandle = moqtClient.dataStreamUserHandles_.wait_dequeue_ret();
+    utils::ASSERT_LOG_THROW(dataStreamUserHandle.streamHeaderSubgroupMessage_->groupId_ ==
+                            GroupId(groupIdx),
+                            "Group mismatch", "Expected: ", groupIdx);
+
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+    {
+        auto streamHeaderSubgroupObject = dataStreamUserHandle.objectQueue_->wait_dequeue_ret();
+        utils::ASSERT_LOG_THROW(streamHeaderSubgroupObject.payload_ ==
+                                object_payload(groupIdx, objectIdx),
+                                "Payload mismatch", "Received: ", streamHeaderSubgroupObject.payload_,
+                                "Expected: ", object_payload(groupIdx, objectIdx));
+    }
+}
+
+int main()
+{
+    std::string sharedMemoryName = "latest_group_transfer_test_";
+    sharedMemoryName += std::to_string(getpid());
+
+    bip::shared_memory_object shmParent(bip::create_only,
+                                        sharedMemoryName.c_str(), bip::read_write);
+    shmParent.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region regionParent(shmParent, bip::read_write);
+    InterprocessSynchronizationData* dataParent =
+    new (regionParent.get_address()) InterprocessSynchronizationData();
+
+    dataParent->serverSetup = false;
+    dataParent->firstGroupReceived = false;
+    dataParent->clientDone = false;
+
+    if (fork())
+    {
+        // parent process, server
+        std::unique_ptr<MOQTServer> moqtServer = server_setup();
+
+        auto trackHandle = moqtServer->dataManager_->add_track_identifier({}, "track");
+        add_group(trackHandle, 0);
+
+        {
+            std::unique_lock lock(dataParent->mutex);
+            dataParent->serverSetup = true;
+        }
+
+        for (;;)
+        {
+            std::unique_lock lock(dataParent->mutex);
+            if (dataParent->firstGroupReceived)
+                break;
+        }
+
+        // the subscription is already running, the group reaches it through the track observer
+        add_group(trackHandle, 1);
+
+        for (;;)
+        {
+            std::unique_lock lock(dataParent->mutex);
+            if (dataParent->clientDone)
+                break;
+        }
+
+        std::cout << "Server done" << std::endl;
+
+        int status;
+        wait(&status);
+        bip::shared_memory_object::remove(sharedMemoryName.c_str());
+        exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    }
+    else
+    // child process
+    {
+        bip::shared_memory_object shmChild(bip::open_only, sharedMemoryName.c_str(),
+                                           bip::read_write);
+        bip::mapped_region regionChild(shmChild, bip::read_write);
+        InterprocessSynchronizationData* dataChild =
+        static_cast<InterprocessSynchronizationData*>(regionChild.get_address());
+
+        for (;;)
+        {
+            std::unique_lock lock(dataChild->mutex);
+            if (dataChild->serverSetup)
+                break;
+        }
+
+        std::unique_ptr<MOQTClient> moqtClient = client_setup();
+
+        SubscriptionBuilder subscriptionBuilder;
+        subscriptionBuilder.set_track_alias(TrackAlias(0));
+        subscriptionBuilder.set_track_namespace({});
+        subscriptionBuilder.set_track_name("track");
+        subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::latestGroup);
+        subscriptionBuilder.set_subscriber_priority(0);
+        subscriptionBuilder.set_group_order(0);
+
+        moqtClient->subscribe(subscriptionBuilder.build());
+
+        int exitCode = 0;
+        try
+        {
+            receive_group(*moqtClient, 0);
+            {
+                std::unique_lock lock(dataChild->mutex);
+                dataChild->firstGroupReceived = true;
+            }
+            receive_group(*moqtClient, 1);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            exitCode = 1;
+        }
+
+        {
+            std::unique_lock lock(dataChild->mutex);
+            dataChild->firstGroupReceived = true;
+            dataChild->clientDone = true;
+        }
+        std::cout << "Client done" << std::endl;
+        exit(exitCode);
+    }
+}
@@ -0,0 +1,240 @@
+/////////////////////////////////////////////////////////
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+#include <object_cache.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    ObjectCache: accounting of hits, misses and resident bytes, CLOCK eviction under the byte
+    budget, dirty entries pinned till they are marked clean, and DataManager::get_object
+    falling back to the segment log for objects which were evicted
+*/
+
+using namespace rvn;
+
+constexpr std::uint64_t objectSize = 1000;
+constexpr std::uint64_t entrySize = sizeof(ObjectBuffer) + objectSize;
+// the budget is split over 16 shards, 8 entries fit into each of them
+constexpr std::uint64_t budgetBytes = 16 * 8 * entrySize;
+
+ObjectBufferRef make_buffer(std::uint64_t length, char fill)
+{
+    std::uint8_t* allocation = static_cast<std::uint8_t*>(malloc(length));
+    utils::ASSERT_LOG_THROW(allocation != nullptr, "Allocation failed");
+    std::memset(allocation, fill, length);
+    return ObjectBufferRef(ObjectBuffer::create(allocation, allocation, length));
+}
+
+// hits, misses and resident bytes are exact, erase_group drops only its own group
+void test1()
+{
+    ObjectCache cache(budgetBytes);
+
+    for (std::uint64_t objectId = 0; objectId < 10; ++objectId)
+        cache.put({ 1, objectId }, make_buffer(objectSize, 'a'));
+    for (std::uint64_t objectId = 0; objectId < 4; ++objectId)
+        cache.put({ 2, objectId }, make_buffer(objectSize, 'b'));
+
+    ObjectCache::Stats stats = cache.get_stats();
+    utils::ASSERT_LOG_THROW(stats.residentBytes_ == 14 * entrySize, "Resident bytes mismatch",
+                            stats.residentBytes_);
+    utils::ASSERT_LOG_THROW(stats.budgetBytes_ == budgetBytes, "Budget mismatch",
+                            stats.budgetBytes_);
+
+    for (std::uint64_t objectId = 0; objectId < 10; ++objectId)
+    {
+        ObjectBufferRef buffer = cache.get({ 1, objectId });
+        utils::ASSERT_LOG_THROW(buffer && buffer->length() == objectSize &&
+                                buffer->quic_buffer()->Buffer[0] == 'a',
+                                "Cached object mismatch", objectId);
+    }
+    for (std::uint64_t objectId = 10; objectId < 15; ++objectId)
+        utils::ASSERT_LOG_THROW(!cache.get({ 1, objectId }), "Hit on an object never put",
+                                objectId);
+
+    stats = cache.get_stats();
+    utils::ASSERT_LOG_THROW(stats.hits_ == 10 && stats.misses_ == 5, "Hits / misses mismatch",
+                            stats.hits_, stats.misses_);
+    utils::ASSERT_LOG_THROW(stats.hit_rate() == 10.0 / 15, "Hit rate mismatch", stats.hit_rate());
+
+    // the cached buffer wins, nothing is charged twice
+    ObjectBufferRef cached = cache.get({ 1, 0 });
+    ObjectBufferRef returned = cache.put({ 1, 0 }, make_buffer(2 * objectSize, 'c'));
+    utils::ASSERT_LOG_THROW(returned.get() == cached.get(), "Cached buffer replaced");
+    utils::ASSERT_LOG_THROW(cache.get_stats().residentBytes_ == 14 * entrySize,
+                            "Object charged twice", cache.get_stats().residentBytes_);
+
+    cache.erase_group(1);
+    stats = cache.get_stats();
+    utils::ASSERT_LOG_THROW(stats.residentBytes_ == 4 * entrySize, "Group not erased",
+                            stats.residentBytes_);
+    utils::ASSERT_LOG_THROW(!cache.get({ 1, 3 }), "Erased object still cached");
+    utils::ASSERT_LOG_THROW(bool(cache.get({ 2, 3 })), "Object of another group erased");
+    utils::ASSERT_LOG_THROW(stats.evictions_ == 0, "Erasing counted as eviction");
+
+    // a buffer still referenced outside the cache outlives its entry
+    utils::ASSERT_LOG_THROW(cached->quic_buffer()->Buffer[0] == 'a', "Referenced buffer freed");
+}
+
+// clean entries are evicted to stay within the budget, hot entries get their second chance
+void test2()
+{
+    ObjectCache cache(budgetBytes);
+
+    constexpr std::uint64_t numHot = 4;
+    constexpr std::uint64_t numCold = 2000;
+    for (std::uint64_t objectId = 0; objectId < numHot; ++objectId)
+        cache.put({ 1, objectId }, make_buffer(objectSize, 'h'));
+
+    std::uint64_t hotMisses = 0;
+    for (std::uint64_t objectId = 0; objectId < numCold; ++objectId)
+    {
+        cache.put({ 2, objectId }, make_buffer(objectSize, 'c'));
+        utils::ASSERT_LOG_THROW(cache.get_stats().residentBytes_ <= budgetBytes,
+                                "Over the budget", cache.get_stats().residentBytes_);
+
+        // referenced after every insert, the clock hand passes over them
+        for (std::uint64_t hotObjectId = 0; hotObjectId < numHot; ++hotObjectId)
+            if (!cache.get({ 1, hotObjectId }))
+            {
+                ++hotMisses;
+                cache.put({ 1, hotObjectId }, make_buffer(objectSize, 'h'));
+            }
+    }
+
+    ObjectCache::Stats stats = cache.get_stats();
+    std::uint64_t numResident = stats.residentBytes_ / entrySize;
+    utils::ASSERT_LOG_THROW(stats.residentBytes_ % entrySize == 0 && numResident <= 16 * 8,
+                            "Resident bytes mismatch", stats.residentBytes_);
+    utils::ASSERT_LOG_THROW(stats.evictions_ == numHot + numCold + hotMisses - numResident,
+                            "Evictions do not add up", stats.evictions_, numResident, hotMisses);
+
+    // cold objects are only looked up once, hot ones all the time
+    utils::ASSERT_LOG_THROW(hotMisses * 100 < numHot * numCold, "Hot objects evicted",
+                            hotMisses);
+
+    std::uint64_t numColdResident = 0;
+    for (std::uint64_t objectId = 0; objectId < numCold; ++objectId)
+        numColdResident += bool(cache.get({ 2, objectId }));
+    utils::ASSERT_LOG_THROW(numColdResident < numResident, "Cold objects not evicted",
+                            numColdResident);
+}
+
+// dirty entries are never evicted, once marked clean they are
+void test3()
+{
+    ObjectCache cache(budgetBytes);
+
+    constexpr std::uint64_t numDirty = 300;
+    for (std::uint64_t objectId = 0; objectId < numDirty; ++objectId)
+        cache.put({ 1, objectId }, make_buffer(objectSize, 'd'), true);
+
+    // over the budget rather than dropping objects which are not persisted yet
+    ObjectCache::Stats stats = cache.get_stats();
+    utils::ASSERT_LOG_THROW(stats.evictions_ == 0 && stats.residentBytes_ == numDirty * entrySize,
+                            "Dirty entry evicted", stats.evictions_, stats.residentBytes_);
+
+    // half of them persisted
+    for (std::uint64_t objectId = 0; objectId < numDirty; objectId += 2)
+        cache.mark_clean({ 1, objectId });
+
+    constexpr std::uint64_t numClean = 1000;
+    for (std::uint64_t objectId = 0; objectId < numClean; ++objectId)
+        cache.put({ 2, objectId }, make_buffer(objectSize, 'c'));
+
+    for (std::uint64_t objectId = 1; objectId < numDirty; objectId += 2)
+        utils::ASSERT_LOG_THROW(bool(cache.get({ 1, objectId })), "Dirty entry evicted", objectId);
+
+    std::uint64_t numCleanedResident = 0;
+    for (std::uint64_t objectId = 0; objectId < numDirty; objectId += 2)
+        numCleanedResident += bool(cache.get({ 1, objectId }));
+    utils::ASSERT_LOG_THROW(numCleanedResident < numDirty / 2, "Cleaned entries not evicted",
+                            numCleanedResident);
+
+    // the dirty half alone is over the budget, nothing else fits
+    stats = cache.get_stats();
+    utils::ASSERT_LOG_THROW(stats.residentBytes_ <= (numDirty / 2) * entrySize + budgetBytes,
+                            "Clean entries kept over the budget", stats.residentBytes_);
+}
+
+// objects evicted from the cache are read back from the segment log
+void test4()
+{
+    constexpr std::uint64_t numObjects = 128;
+    constexpr std::uint64_t payloadSize = 2000;
+
+    DataManagerOptions options;
+    options.cacheBudgetBytes_ = 256 * 1024;
+    DataManager dataManager(options);
+
+    auto payload = [](std::uint64_t groupIdx, std::uint64_t objectIdx)
+    {
+        std::string payload = std::to_string(groupIdx) + "/" + std::to_string(objectIdx) + "/";
+        payload.resize(payloadSize, char('a' + objectIdx % 26));
+        return payload;
+    };
+
+    // every group is persisted (its entries marked clean) before the next one pushes it out
+    auto trackHandle = dataManager.add_track_identifier({ "object_cache" }, "track");
+    for (std::uint64_t groupIdx = 0; groupIdx < 4; ++groupIdx)
+    {
+        auto groupHandle =
+        trackHandle.lock()->add_group(GroupId(groupIdx), PublisherPriority(0), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(numObjects);
+        for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+            subgroupHandle.add_object(payload(groupIdx, objectIdx));
+        dataManager.flush_storage();
+    }
+
+    ObjectCache::Stats statsBefore = dataManager.get_cache_stats();
+    utils::ASSERT_LOG_THROW(statsBefore.evictions_ > 0, "Nothing evicted");
+    utils::ASSERT_LOG_THROW(statsBefore.residentBytes_ <= statsBefore.budgetBytes_,
+                            "Persisted objects kept over the budget", statsBefore.residentBytes_);
+
+    TrackIdentifier trackIdentifier({ "object_cache" }, "track");
+    std::uint64_t numLookups = 0;
+    for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+    {
+        ObjectIdentifier objectIdentifier(trackIdentifier, GroupId(0), ObjectId(objectIdx));
+        for (int lookup = 0; lookup < 2; ++lookup, ++numLookups)
+        {
+            ObjectOrStatus objectOrStatus = dataManager.get_object(objectIdentifier);
+            utils::ASSERT_LOG_THROW(std::holds_alternative<ObjectType>(objectOrStatus),
+                                    "Evicted object not read back", objectIdx);
+
+            std::string expected = payload(0, objectIdx);
+            const QUIC_BUFFER* quicBuffer =
+            std::get<0>(std::get<ObjectType>(objectOrStatus))->quic_buffer();
+            utils::ASSERT_LOG_THROW(quicBuffer->Length >= expected.size() &&
+                                    std::memcmp(quicBuffer->Buffer + quicBuffer->Length -
+                                                expected.size(),
+                                                expected.data(), expected.size()) == 0,
+                                    "Payload mismatch", objectIdx);
+        }
+    }
+
+    // the oldest group was pushed out: its first lookups miss, the object is cached again
+    // (referenced, so it is still there for the lookup right after)
+    ObjectCache::Stats statsAfter = dataManager.get_cache_stats();
+    std::uint64_t misses = statsAfter.misses_ - statsBefore.misses_;
+    std::uint64_t hits = statsAfter.hits_ - statsBefore.hits_;
+    utils::ASSERT_LOG_THROW(misses + hits == numLookups, "Lookups not counted", hits, misses);
+    utils::ASSERT_LOG_THROW(misses > 0 && misses <= numObjects && hits >= numObjects,
+                            "Unexpected hits / misses", hits, misses);
+    utils::ASSERT_LOG_THROW(statsAfter.residentBytes_ <= statsAfter.budgetBytes_,
+                            "Objects read back kept over the budget", statsAfter.residentBytes_);
+}
+
+int main()
+{
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
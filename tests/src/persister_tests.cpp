@@ -0,0 +1,316 @@
+/////////////////////////////////////////////////////////
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+#include <manifest.hpp>
+#include <object_cache.hpp>
+#include <segment_log.hpp>
+#include <storage_io.hpp>
+#include <utilities.hpp>
+#include <write_behind.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    WriteBehindPersister on a storage backend which fails or stalls on demand:
+    failed writes and syncs are retried till maxPersistAttempts and then given up,
+    publishers block once maxPendingBytes are pending, and the stats (persisted, retried,
+    failed, pending, lag, sync time) account for all of it
+
+    The jobs are written into the segment log of a group of a DataManager, the persister
+    under test has its own cache and storage backend
+*/
+
+using namespace rvn;
+
+// posix backend, writes and syncs can be made to fail, writes to stall
+class TestStorageIo : public StorageIo
+{
+    std::unique_ptr<StorageIo> storageIo_ = make_storage_io(StorageBackendType::Posix);
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool stalled_ = false;
+    std::uint64_t numWriteBatches_ = 0;
+
+public:
+    // the next failWrites_ write batches (syncs) fail
+    std::atomic<std::uint64_t> failWrites_{};
+    std::atomic<std::uint64_t> failSyncs_{};
+    std::chrono::milliseconds syncDelay_{};
+
+    StorageBackendType type() const noexcept override
+    {
+        return StorageBackendType::Posix;
+    }
+
+    bool write_batch(std::span<StorageWriteRequest> requests) override
+    {
+        {
+            std::unique_lock l(mtx_);
+            ++numWriteBatches_;
+            cv_.notify_all();
+            cv_.wait(l, [this]() { return !stalled_; });
+        }
+
+        if (failWrites_ > 0)
+        {
+            --failWrites_;
+            for (auto& request : requests)
+                request.success_ = false;
+            return false;
+        }
+        return storageIo_->write_batch(requests);
+    }
+
+    bool sync_batch(std::span<StorageSyncRequest> requests) override
+    {
+        std::this_thread::sleep_for(syncDelay_);
+        if (failSyncs_ > 0)
+        {
+            --failSyncs_;
+            for (auto& request : requests)
+                request.success_ = false;
+            return false;
+        }
+        return storageIo_->sync_batch(requests);
+    }
+
+    bool read(int fd, void* buffer, std::uint64_t length, std::uint64_t offset) override
+    {
+        return storageIo_->read(fd, buffer, length, offset);
+    }
+
+    void stall()
+    {
+        std::lock_guard l(mtx_);
+        stalled_ = true;
+    }
+
+    void resume()
+    {
+        std::lock_guard l(mtx_);
+        stalled_ = false;
+        cv_.notify_all();
+    }
+
+    // till the persister has entered numWriteBatches write batches
+    void wait_for_write_batches(std::uint64_t numWriteBatches)
+    {
+        std::unique_lock l(mtx_);
+        cv_.wait(l, [&]() { return numWriteBatches_ >= numWriteBatches; });
+    }
+};
+
+constexpr std::uint64_t objectSize = 1024;
+
+struct TestGroup
+{
+    DataManager dataManager_;
+    std::shared_ptr<GroupHandle> groupHandle_;
+
+    TestGroup()
+    {
+        auto trackHandle = dataManager_.add_track_identifier({ "persister" }, "track");
+        groupHandle_ = trackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {}).lock();
+    }
+
+    // cached dirty, as DataManager::publish_object does
+    WriteBehindPersister::Job make_job(ObjectCache& cache, std::uint64_t objectId)
+    {
+        std::uint8_t* allocation = static_cast<std::uint8_t*>(malloc(objectSize));
+        utils::ASSERT_LOG_THROW(allocation != nullptr, "Allocation failed");
+        std::memset(allocation, 'a' + objectId % 26, objectSize);
+        ObjectBufferRef objectBuffer(ObjectBuffer::create(allocation, allocation, objectSize));
+        cache.put({ groupHandle_->cache_key(), objectId }, objectBuffer, true);
+
+        std::string_view payload(reinterpret_cast<const char*>(allocation), objectSize);
+        return { groupHandle_, ObjectId(objectId), std::move(objectBuffer), payload, Clock::now() };
+    }
+
+    // objects in the segment file, read with a segment log of our own
+    std::uint64_t num_persisted_objects()
+    {
+        std::string path = std::string(DATA_DIRECTORY) + "persister/track/0.log";
+        auto storageIo = make_storage_io(StorageBackendType::Posix);
+        SegmentFiles segmentFiles;
+        SegmentLog segmentLog(path, *storageIo, segmentFiles);
+        segmentLog.recover();
+
+        std::uint64_t numObjects = 0;
+        for (; segmentLog.contains(ObjectId(numObjects)); ++numObjects)
+        {
+            std::optional<std::string> payload = segmentLog.read(ObjectId(numObjects));
+            utils::ASSERT_LOG_THROW(payload.has_value() &&
+                                    *payload == std::string(objectSize, 'a' + numObjects % 26),
+                                    "Persisted payload mismatch", numObjects);
+        }
+        return numObjects;
+    }
+
+    // a dirty entry survives any number of inserts, a clean one is evicted by them
+    bool is_dirty(ObjectCache& cache, std::uint64_t objectId)
+    {
+        for (std::uint64_t i = 0; i < 4096; ++i)
+        {
+            std::uint8_t* allocation = static_cast<std::uint8_t*>(malloc(objectSize));
+            utils::ASSERT_LOG_THROW(allocation != nullptr, "Allocation failed");
+            cache.put({ ~0ULL, i }, ObjectBufferRef(ObjectBuffer::create(allocation, allocation,
+                                                                         objectSize)));
+        }
+        return bool(cache.get({ groupHandle_->cache_key(), objectId }));
+    }
+};
+
+// failed writes and syncs are retried, the objects end up persisted once and in order
+void test1()
+{
+    TestGroup group;
+    ObjectCache cache(64 * objectSize);
+    Manifest manifest;
+    TestStorageIo storageIo;
+    storageIo.failWrites_ = 2;
+    storageIo.failSyncs_ = 1;
+
+    {
+        WriteBehindPersister persister(cache, storageIo, manifest);
+
+        std::vector<WriteBehindPersister::Job> jobs;
+        for (std::uint64_t objectId = 0; objectId < 8; ++objectId)
+            jobs.push_back(group.make_job(cache, objectId));
+        persister.enqueue_batch(std::move(jobs));
+        persister.flush();
+
+        PersistenceStats stats = persister.get_stats();
+        // every attempt which failed counts every object of it
+        utils::ASSERT_LOG_THROW(stats.persistedObjects_ == 8 && stats.retriedObjects_ == 3 * 8 &&
+                                stats.failedObjects_ == 0,
+                                "Retries not accounted", stats.persistedObjects_,
+                                stats.retriedObjects_, stats.failedObjects_);
+        utils::ASSERT_LOG_THROW(stats.pendingObjects_ == 0 && stats.pendingBytes_ == 0,
+                                "Objects still pending", stats.pendingObjects_,
+                                stats.pendingBytes_);
+        utils::ASSERT_LOG_THROW(stats.numBatches_ == 4, "Batches not counted", stats.numBatches_);
+
+        // retried with a backoff (10 + 20 + 40 ms), the lag covers it
+        utils::ASSERT_LOG_THROW(stats.maxLag_ >= std::chrono::milliseconds(70) &&
+                                stats.lastLag_ == stats.maxLag_,
+                                "Lag does not include the retries", stats.lastLag_.count(),
+                                stats.maxLag_.count());
+
+        utils::ASSERT_LOG_THROW(!group.is_dirty(cache, 0), "Persisted object still pinned");
+    }
+
+    // the failed attempts gave their space back, nothing was written twice
+    utils::ASSERT_LOG_THROW(group.num_persisted_objects() == 8, "Objects not persisted");
+}
+
+// after maxPersistAttempts the objects are given up and unpinned
+void test2()
+{
+    TestGroup group;
+    ObjectCache cache(64 * objectSize);
+    Manifest manifest;
+    TestStorageIo storageIo;
+    storageIo.failWrites_ = WriteBehindPersister::maxPersistAttempts;
+
+    // one batch, every attempt of it fails
+    WriteBehindPersister persister(cache, storageIo, manifest);
+    std::vector<WriteBehindPersister::Job> jobs;
+    for (std::uint64_t objectId = 0; objectId < 3; ++objectId)
+        jobs.push_back(group.make_job(cache, objectId));
+    persister.enqueue_batch(std::move(jobs));
+
+    persister.flush();
+    PersistenceStats stats = persister.get_stats();
+    utils::ASSERT_LOG_THROW(stats.persistedObjects_ == 0 && stats.failedObjects_ == 3 &&
+                            stats.retriedObjects_ ==
+                            3 * (WriteBehindPersister::maxPersistAttempts - 1),
+                            "Given up objects not accounted", stats.persistedObjects_,
+                            stats.retriedObjects_, stats.failedObjects_);
+    utils::ASSERT_LOG_THROW(stats.pendingObjects_ == 0 && stats.pendingBytes_ == 0,
+                            "Given up objects still pending", stats.pendingObjects_);
+    utils::ASSERT_LOG_THROW(!group.is_dirty(cache, 0), "Given up object still pinned");
+
+    // the storage works again, later objects are persisted as usual
+    persister.enqueue(group.make_job(cache, 0));
+    persister.flush();
+    utils::ASSERT_LOG_THROW(persister.get_stats().persistedObjects_ == 1, "Object not persisted");
+}
+
+// publishers block once maxPendingBytes are pending, the lag and sync time are reported
+void test3()
+{
+    TestGroup group;
+    ObjectCache cache(64 * objectSize);
+    Manifest manifest;
+    TestStorageIo storageIo;
+    storageIo.syncDelay_ = std::chrono::milliseconds(20);
+
+    constexpr std::uint64_t maxPendingObjects = 4;
+    WriteBehindPersister persister(cache, storageIo, manifest, maxPendingObjects * objectSize);
+
+    // the first job is taken by the persister, which stalls in the write, it stays pending
+    storageIo.stall();
+    persister.enqueue(group.make_job(cache, 0));
+    storageIo.wait_for_write_batches(1);
+
+    for (std::uint64_t objectId = 1; objectId < maxPendingObjects; ++objectId)
+        persister.enqueue(group.make_job(cache, objectId));
+
+    PersistenceStats stats = persister.get_stats();
+    utils::ASSERT_LOG_THROW(stats.pendingObjects_ == maxPendingObjects &&
+                            stats.pendingBytes_ == maxPendingObjects * objectSize,
+                            "Pending objects not accounted", stats.pendingObjects_,
+                            stats.pendingBytes_);
+
+    // the queue is full
+    std::atomic<bool> enqueued = false;
+    std::jthread publisher(
+    [&]()
+    {
+        persister.enqueue(group.make_job(cache, maxPendingObjects));
+        enqueued = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    utils::ASSERT_LOG_THROW(!enqueued, "Publisher not blocked on a full queue");
+    utils::ASSERT_LOG_THROW(persister.get_stats().pendingBytes_ <= maxPendingObjects * objectSize,
+                            "Over maxPendingBytes");
+
+    storageIo.resume();
+    publisher.join();
+    utils::ASSERT_LOG_THROW(enqueued, "Publisher not woken up");
+
+    persister.flush();
+    stats = persister.get_stats();
+    utils::ASSERT_LOG_THROW(stats.persistedObjects_ == maxPendingObjects + 1 &&
+                            stats.retriedObjects_ == 0,
+                            "Objects not persisted", stats.persistedObjects_);
+
+    // the first object waited for the stall, every batch includes its sync
+    utils::ASSERT_LOG_THROW(stats.maxLag_ >= std::chrono::milliseconds(100), "Stall not in the lag",
+                            stats.maxLag_.count());
+    utils::ASSERT_LOG_THROW(stats.lastSync_ >= std::chrono::milliseconds(20) &&
+                            stats.lastLag_ >= stats.lastSync_,
+                            "Sync not in the lag", stats.lastSync_.count(), stats.lastLag_.count());
+
+    utils::ASSERT_LOG_THROW(group.num_persisted_objects() == maxPendingObjects + 1,
+                            "Objects not persisted");
+}
+
+int main()
+{
+    test1();
+    test2();
+    test3();
+    return 0;
+}
@@ -0,0 +1,173 @@
+/////////////////////////////////////////////////////////
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+#include <segment_log.hpp>
+#include <storage_io.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    Segment files are opened lazily and only a bounded number of them is kept open (LRU),
+    a publisher which keeps adding groups must not run out of file descriptors
+*/
+
+using namespace rvn;
+
+std::string object_payload(std::uint64_t groupIdx, std::uint64_t objectIdx)
+{
+    return "group " + std::to_string(groupIdx) + " object " + std::to_string(objectIdx);
+}
+
+std::uint64_t num_open_fds()
+{
+    std::uint64_t numFds = 0;
+    for ([[maybe_unused]] const auto& entry : std::filesystem::directory_iterator("/proc/self/fd"))
+        ++numFds;
+    return numFds;
+}
+
+// SegmentLogs sharing a SegmentFiles: bounded open files, reopened on use, pinned while in use
+void test1()
+{
+    constexpr std::size_t maxOpenFiles = 4;
+    constexpr std::uint64_t numLogs = 32;
+
+    std::filesystem::path directory =
+    std::filesystem::temp_directory_path() / ("raven_segment_files_" + std::to_string(getpid()));
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+
+    auto storageIo = make_storage_io(StorageBackendType::Posix);
+    SegmentFiles segmentFiles(maxOpenFiles);
+    {
+        std::vector<std::unique_ptr<SegmentLog>> logs;
+        for (std::uint64_t logIdx = 0; logIdx < numLogs; ++logIdx)
+            logs.push_back(std::make_unique<SegmentLog>(
+            (directory / (std::to_string(logIdx) + ".log")).string(), *storageIo, segmentFiles));
+
+        // nothing is opened before it is used
+        utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() == 0, "Segment file opened eagerly");
+
+        for (std::uint64_t objectIdx = 0; objectIdx < 4; ++objectIdx)
+            for (std::uint64_t logIdx = 0; logIdx < numLogs; ++logIdx)
+            {
+                utils::ASSERT_LOG_THROW(logs[logIdx]->append(ObjectId(objectIdx),
+                                                             object_payload(logIdx, objectIdx)),
+                                        "Append failed", logIdx, objectIdx);
+                utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() <= maxOpenFiles,
+                                        "Too many open segment files",
+                                        segmentFiles.num_open_files());
+            }
+
+        // every file has been closed and reopened a few times by now
+        for (std::uint64_t logIdx = 0; logIdx < numLogs; ++logIdx)
+            for (std::uint64_t objectIdx = 0; objectIdx < 4; ++objectIdx)
+                utils::ASSERT_LOG_THROW(logs[logIdx]->read(ObjectId(objectIdx)) ==
+                                        object_payload(logIdx, objectIdx),
+                                        "Payload mismatch", logIdx, objectIdx);
+        utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() <= maxOpenFiles,
+                                "Too many open segment files", segmentFiles.num_open_files());
+
+        // batches in flight pin their files, the limit is exceeded only while they are
+        std::vector<std::string> payloads;
+        std::vector<std::vector<SegmentLog::Record>> records(maxOpenFiles + 2);
+        std::vector<SegmentLog::PreparedBatch> batches;
+        std::vector<StorageWriteRequest> requests;
+        for (std::uint64_t logIdx = 0; logIdx < records.size(); ++logIdx)
+            payloads.push_back(object_payload(logIdx, 4));
+        for (std::uint64_t logIdx = 0; logIdx < records.size(); ++logIdx)
+        {
+            records[logIdx].push_back({ ObjectId(4), payloads[logIdx] });
+            batches.push_back(logs[logIdx]->prepare_batch(records[logIdx]));
+            requests.push_back(logs[logIdx]->write_request(batches.back()));
+        }
+        utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() == records.size(),
+                                "Pinned segment file closed", segmentFiles.num_open_files());
+
+        utils::ASSERT_LOG_THROW(storageIo->write_batch(requests), "Write batch failed");
+        for (std::uint64_t logIdx = 0; logIdx < records.size(); ++logIdx)
+            logs[logIdx]->commit_batch(batches[logIdx]);
+        batches.clear();
+
+        utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() <= maxOpenFiles,
+                                "Segment files not closed after the batches",
+                                segmentFiles.num_open_files());
+        for (std::uint64_t logIdx = 0; logIdx < records.size(); ++logIdx)
+            utils::ASSERT_LOG_THROW(logs[logIdx]->read(ObjectId(4)) == object_payload(logIdx, 4),
+                                    "Payload mismatch", logIdx);
+    }
+
+    // a destroyed segment log closes its file
+    utils::ASSERT_LOG_THROW(segmentFiles.num_open_files() == 0, "Segment file left open");
+    std::filesystem::remove_all(directory);
+}
+
+// many more groups than open segment files through DataManager, cold reads reopen the files
+void test2()
+{
+    constexpr std::size_t maxOpenSegmentFiles = 8;
+    constexpr std::uint64_t numGroups = 256;
+    constexpr std::uint64_t numObjects = 4;
+
+    std::uint64_t numFdsBefore = num_open_fds();
+
+    DataManagerOptions options;
+    options.maxOpenSegmentFiles_ = maxOpenSegmentFiles;
+    // small enough that most objects have to be read back from their segment files
+    options.cacheBudgetBytes_ = 64 * 1024;
+    DataManager dataManager(options);
+
+    auto trackHandle = dataManager.add_track_identifier({ "segment_files" }, "track");
+    for (std::uint64_t groupIdx = 0; groupIdx < numGroups; ++groupIdx)
+    {
+        auto groupHandle =
+        trackHandle.lock()->add_group(GroupId(groupIdx), PublisherPriority(0), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(numObjects);
+        for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+            subgroupHandle.add_object(object_payload(groupIdx, objectIdx));
+    }
+    dataManager.flush_storage();
+
+    // storage I/O (a ring), the manifest and the persister take a few fds of their own
+    utils::ASSERT_LOG_THROW(num_open_fds() <= numFdsBefore + maxOpenSegmentFiles + 8,
+                            "Segment files kept open", num_open_fds(), numFdsBefore);
+
+    TrackIdentifier trackIdentifier({ "segment_files" }, "track");
+    for (std::uint64_t groupIdx = 0; groupIdx < numGroups; ++groupIdx)
+        for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+        {
+            ObjectOrStatus objectOrStatus = dataManager.get_object(
+            ObjectIdentifier(trackIdentifier, GroupId(groupIdx), ObjectId(objectIdx)));
+            utils::ASSERT_LOG_THROW(std::holds_alternative<ObjectType>(objectOrStatus),
+                                    "Object missing", groupIdx, objectIdx);
+
+            // the payload is the tail of the serialized object
+            ObjectBufferRef objectBuffer = std::get<0>(std::get<ObjectType>(objectOrStatus));
+            std::string payload = object_payload(groupIdx, objectIdx);
+            const QUIC_BUFFER* quicBuffer = objectBuffer->quic_buffer();
+            const std::uint8_t* payloadBegin =
+            quicBuffer->Buffer + quicBuffer->Length - payload.size();
+            utils::ASSERT_LOG_THROW(quicBuffer->Length >= payload.size() &&
+                                    std::memcmp(payloadBegin, payload.data(), payload.size()) == 0,
+                                    "Payload mismatch", groupIdx, objectIdx);
+        }
+
+    utils::ASSERT_LOG_THROW(dataManager.get_cache_stats().misses_ > 0,
+                            "No object was read back from its segment file");
+    utils::ASSERT_LOG_THROW(num_open_fds() <= numFdsBefore + maxOpenSegmentFiles + 8,
+                            "Segment files kept open after cold reads", num_open_fds(),
+                            numFdsBefore);
+}
+
+int main()
+{
+    test1();
+    test2();
+    return 0;
+}
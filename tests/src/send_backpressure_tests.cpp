@@ -0,0 +1,404 @@
+/////////////////////////////////////////////////////////
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <data_manager.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <subscription_manager.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    Parking and waking up of subscriptions on the send budget (SendBackpressurePolicy) of a
+    connection, no connection is started: the stream functions of the server's MsQuic table are
+    replaced, StreamSend only records the sends it is handed
+
+    The subscription sends through ConnectionState::send_object as usual (one object per pass),
+    the sends are completed through the server's data stream callback as MsQuic would
+    (QUIC_STREAM_EVENT_SEND_COMPLETE), a woken up subscription shows up on its ready list
+*/
+
+using namespace rvn;
+
+constexpr std::uint64_t numObjects = 32;
+// objects are a few bytes larger on the wire (objectId and length), the first one also
+// carries the stream header
+constexpr std::uint64_t payloadSize = 1000;
+
+// handed out by StreamOpen as the stream's handle
+struct TestStream
+{
+    QUIC_STREAM_CALLBACK_HANDLER handler_;
+    void* context_;
+    // (send context, bytes) handed to StreamSend and not completed yet, oldest first
+    std::deque<std::pair<void*, std::uint64_t>> sends_;
+    bool shutdown_ = false;
+
+    TestStream(QUIC_STREAM_CALLBACK_HANDLER handler, void* context)
+    : handler_(handler), context_(context)
+    {
+    }
+
+    StreamContext& stream_context()
+    {
+        return *static_cast<StreamContext*>(context_);
+    }
+
+    void deliver(QUIC_STREAM_EVENT& event)
+    {
+        handler_(reinterpret_cast<HQUIC>(this), context_, &event);
+    }
+
+    // completes the oldest send, returns its bytes
+    std::uint64_t send_complete(bool canceled = false)
+    {
+        auto [sendContext, numBytes] = sends_.front();
+        sends_.pop_front();
+
+        QUIC_STREAM_EVENT event{};
+        event.Type = QUIC_STREAM_EVENT_SEND_COMPLETE;
+        event.SEND_COMPLETE.Canceled = canceled;
+        event.SEND_COMPLETE.ClientContext = sendContext;
+        deliver(event);
+        return numBytes;
+    }
+
+    void ideal_send_buffer(std::uint64_t numBytes)
+    {
+        QUIC_STREAM_EVENT event{};
+        event.Type = QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE;
+        event.IDEAL_SEND_BUFFER_SIZE.ByteCount = numBytes;
+        deliver(event);
+    }
+};
+
+std::vector<std::unique_ptr<TestStream>> testStreams;
+// returned by StreamSend (without recording the send) unless it is a success
+QUIC_STATUS sendStatus = QUIC_STATUS_SUCCESS;
+std::uint64_t numSends = 0;
+
+QUIC_STATUS test_stream_open(HQUIC,
+                             QUIC_STREAM_OPEN_FLAGS,
+                             QUIC_STREAM_CALLBACK_HANDLER handler,
+                             void* context,
+                             HQUIC* stream)
+{
+    testStreams.push_back(std::make_unique<TestStream>(handler, context));
+    *stream = reinterpret_cast<HQUIC>(testStreams.back().get());
+    return QUIC_STATUS_SUCCESS;
+}
+
+QUIC_STATUS test_stream_start(HQUIC, QUIC_STREAM_START_FLAGS)
+{
+    return QUIC_STATUS_SUCCESS;
+}
+
+// the events of the shutdown are delivered by drain_streams
+QUIC_STATUS test_stream_shutdown(HQUIC stream, QUIC_STREAM_SHUTDOWN_FLAGS, QUIC_UINT62)
+{
+    reinterpret_cast<TestStream*>(stream)->shutdown_ = true;
+    return QUIC_STATUS_SUCCESS;
+}
+
+QUIC_STATUS test_stream_send(HQUIC stream,
+                             const QUIC_BUFFER* const buffers,
+                             std::uint32_t bufferCount,
+                             QUIC_SEND_FLAGS,
+                             void* sendContext)
+{
+    if (QUIC_FAILED(sendStatus))
+        return sendStatus;
+
+    std::uint64_t numBytes = 0;
+    for (std::uint32_t i = 0; i < bufferCount; ++i)
+        numBytes += buffers[i].Length;
+    reinterpret_cast<TestStream*>(stream)->sends_.emplace_back(sendContext, numBytes);
+    ++numSends;
+    return QUIC_STATUS_SUCCESS;
+}
+
+// stream priorities
+QUIC_STATUS test_set_param(HQUIC, std::uint32_t, std::uint32_t, const void*)
+{
+    return QUIC_STATUS_SUCCESS;
+}
+
+// as MsQuic once a stream has been shut down: its sends are cancelled, then it completes
+void drain_streams()
+{
+    for (auto& testStream : testStreams)
+    {
+        while (!testStream->sends_.empty())
+            testStream->send_complete(true);
+
+        utils::ASSERT_LOG_THROW(testStream->shutdown_, "Stream not shut down");
+        QUIC_STREAM_EVENT event{};
+        event.Type = QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE;
+        testStream->deliver(event);
+    }
+    testStreams.clear();
+}
+
+std::uint64_t num_in_flight_bytes()
+{
+    std::uint64_t numBytes = 0;
+    for (const auto& testStream : testStreams)
+        for (const auto& send : testStream->sends_)
+            numBytes += send.second;
+    return numBytes;
+}
+
+// an AbsoluteStart subscription of a track with numObjects objects published on one connection
+struct TestServer
+{
+    MOQTServer moqtServer_;
+    std::shared_ptr<ConnectionState> connectionState_;
+    std::shared_ptr<ReadyList> readyList_;
+    std::unique_ptr<SubscriptionState> subscriptionState_;
+
+    TestServer(const std::string& trackName, SendBackpressurePolicy sendBackpressurePolicy)
+    : moqtServer_(std::make_shared<DataManager>()), readyList_(std::make_shared<ReadyList>())
+    {
+        // every MsQuicOpen2 hands out a table of its own, only the streams of this server are faked
+        QUIC_API_TABLE* tbl = const_cast<QUIC_API_TABLE*>(moqtServer_.get_tbl());
+        tbl->StreamOpen = test_stream_open;
+        tbl->StreamStart = test_stream_start;
+        tbl->StreamShutdown = test_stream_shutdown;
+        tbl->StreamSend = test_stream_send;
+        tbl->SetParam = test_set_param;
+        moqtServer_.set_dataStreamCb(callbacks::server_data_stream_callback);
+        sendStatus = QUIC_STATUS_SUCCESS;
+
+        auto trackHandle =
+        moqtServer_.dataManager_->add_track_identifier({ "backpressure" }, trackName);
+        auto groupHandle = trackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(numObjects);
+        for (std::uint64_t objectIdx = 0; objectIdx < numObjects; ++objectIdx)
+            subgroupHandle.add_object(std::string(payloadSize, 'a' + objectIdx % 26));
+
+        connectionState_ =
+        std::make_shared<ConnectionState>(unique_connection(), moqtServer_,
+                                          SendFlushPolicy{ .objectsPerPass = 1 },
+                                          sendBackpressurePolicy);
+        connectionState_->add_track_alias(TrackIdentifier({ "backpressure" }, trackName),
+                                          TrackAlias(0));
+
+        SubscriptionBuilder subscriptionBuilder;
+        subscriptionBuilder.set_track_alias(TrackAlias(0));
+        subscriptionBuilder.set_track_namespace({ "backpressure" });
+        subscriptionBuilder.set_track_name(trackName);
+        subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteStart,
+                                           { GroupId(0), ObjectId(0) });
+        subscriptionBuilder.set_subscriber_priority(0);
+        subscriptionBuilder.set_group_order(0);
+        SubscribeMessage subscribeMessage = subscriptionBuilder.build();
+        subscribeMessage.subscribeId_ = 0;
+
+        subscriptionState_ = std::make_unique<SubscriptionState>(
+        std::weak_ptr<ConnectionState>(connectionState_), *moqtServer_.dataManager_,
+        *moqtServer_.subscriptionManager_, std::move(subscribeMessage), readyList_);
+    }
+
+    ~TestServer()
+    {
+        subscriptionState_.reset();
+        connectionState_.reset();
+        drain_streams();
+    }
+
+    TestStream& stream()
+    {
+        return *testStreams.front();
+    }
+
+    // one pass (one object), false if the subscription parked on the send budget
+    bool run()
+    {
+        std::uint64_t numSendsBefore = numSends;
+        FulfillSomeReturn fulfillReturn = subscriptionState_->fulfill_some();
+        utils::ASSERT_LOG_THROW(std::holds_alternative<bool>(fulfillReturn), "Subscription failed");
+        utils::ASSERT_LOG_THROW(connectionState_->inFlightBytes_.load() == num_in_flight_bytes(),
+                                "In flight bytes not accounted",
+                                connectionState_->inFlightBytes_.load(), num_in_flight_bytes());
+
+        if (subscriptionState_->send_blocked())
+        {
+            utils::ASSERT_LOG_THROW(numSends == numSendsBefore, "Sent while parked");
+            return false;
+        }
+        utils::ASSERT_LOG_THROW(numSends == numSendsBefore + 1, "Nothing sent");
+        return true;
+    }
+
+    // returns the number of objects sent before the subscription parked
+    std::uint64_t run_till_parked()
+    {
+        std::uint64_t numSent = 0;
+        while (run())
+            ++numSent;
+        return numSent;
+    }
+
+    // a waiter is queued once, the subscription thread lets it be queued again when it takes it,
+    // here the subscription gets a fresh one instead
+    bool woken_up()
+    {
+        std::vector<std::shared_ptr<SubscriptionWaiter>> ready;
+        readyList_->take(ready);
+        utils::ASSERT_LOG_THROW(ready.size() <= 1, "Waiter queued more than once");
+        if (ready.empty())
+            return false;
+
+        subscriptionState_->rebind(readyList_);
+        return true;
+    }
+};
+
+// connection limit: parks at connectionHighWater, woken up only once drained to connectionLowWater
+void test1()
+{
+    TestServer server("connection",
+                      { .connectionHighWater = 3 * payloadSize,
+                        .connectionLowWater = payloadSize + payloadSize / 2,
+                        .streamHighWater = 0 });
+    ConnectionState& connectionState = *server.connectionState_;
+
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 3, "Not parked at connectionHighWater");
+    utils::ASSERT_LOG_THROW(connectionState.sendBlocked_.load(), "Connection not blocked");
+    utils::ASSERT_LOG_THROW(connectionState.sendWaiters_.size() == 1, "Waiter not listed");
+
+    // listed once, however often the subscription runs into the limit
+    utils::ASSERT_LOG_THROW(!server.run(), "Sent over connectionHighWater");
+    utils::ASSERT_LOG_THROW(connectionState.sendWaiters_.size() == 1, "Waiter listed twice");
+
+    // below connectionHighWater but above connectionLowWater: still parked
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(!server.woken_up(), "Woken up above connectionLowWater");
+    utils::ASSERT_LOG_THROW(connectionState.sendBlocked_.load(),
+                            "Connection unblocked above connectionLowWater");
+
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up at connectionLowWater");
+    utils::ASSERT_LOG_THROW(!connectionState.sendBlocked_.load(), "Connection still blocked");
+    utils::ASSERT_LOG_THROW(connectionState.sendWaiters_.empty(), "Waiter still listed");
+
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 2, "Not parked at connectionHighWater");
+
+    // drained without anyone blocked: nothing to wake up
+    server.stream().send_complete();
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up at connectionLowWater");
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(!server.woken_up(), "Woken up twice");
+    utils::ASSERT_LOG_THROW(connectionState.inFlightBytes_.load() == 0,
+                            "Completed bytes in flight");
+}
+
+// stream limit: parks at max(streamHighWater, ideal send buffer), woken up as soon as it is below
+void test2()
+{
+    TestServer server("stream",
+                      { .connectionHighWater = 0,
+                        .connectionLowWater = 0,
+                        .streamHighWater = 2 * payloadSize });
+
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 2, "Not parked at streamHighWater");
+    StreamContext& streamContext = server.stream().stream_context();
+    utils::ASSERT_LOG_THROW(streamContext.sendBlocked_.load(), "Stream not blocked");
+    utils::ASSERT_LOG_THROW(!server.connectionState_->sendBlocked_.load(),
+                            "Connection blocked without a connection limit");
+
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up below streamHighWater");
+    utils::ASSERT_LOG_THROW(!streamContext.sendBlocked_.load(), "Stream still blocked");
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 1, "Not parked at streamHighWater");
+
+    // the path got faster while the stream was blocked: woken up without a completion
+    server.stream().ideal_send_buffer(8 * payloadSize);
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up by a larger ideal send buffer");
+
+    // a larger ideal send buffer raises the limit of the stream
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 6,
+                            "Not parked at the ideal send buffer size");
+
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up below the ideal send buffer size");
+}
+
+// the connection limit is checked before the stream limit, a waiter is woken up by either draining
+void test3()
+{
+    TestServer server("connection_and_stream",
+                      { .connectionHighWater = 3 * payloadSize,
+                        .connectionLowWater = payloadSize + payloadSize / 2,
+                        .streamHighWater = payloadSize });
+    ConnectionState& connectionState = *server.connectionState_;
+
+    // the first object is not held back by the stream (nothing sent on it yet)
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 1, "Not parked at streamHighWater");
+    server.stream().ideal_send_buffer(8 * payloadSize);
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up by a larger ideal send buffer");
+
+    utils::ASSERT_LOG_THROW(server.run_till_parked() == 2, "Not parked at connectionHighWater");
+    StreamContext& streamContext = server.stream().stream_context();
+    utils::ASSERT_LOG_THROW(connectionState.sendBlocked_.load(), "Connection not blocked");
+    utils::ASSERT_LOG_THROW(!streamContext.sendBlocked_.load(), "Stream blocked below its limit");
+
+    // over both limits now, held by the connection
+    server.stream().ideal_send_buffer(0);
+    utils::ASSERT_LOG_THROW(!server.run(), "Sent over connectionHighWater");
+    utils::ASSERT_LOG_THROW(!streamContext.sendBlocked_.load(),
+                            "Stream blocked behind the connection");
+
+    server.stream().send_complete();
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up at connectionLowWater");
+
+    // the stream still is over its limit, the subscription parks on it next
+    utils::ASSERT_LOG_THROW(!server.run(), "Sent over streamHighWater");
+    utils::ASSERT_LOG_THROW(streamContext.sendBlocked_.load(), "Stream not blocked");
+    utils::ASSERT_LOG_THROW(!connectionState.sendBlocked_.load(),
+                            "Connection blocked below connectionHighWater");
+
+    server.stream().send_complete();
+    utils::ASSERT_LOG_THROW(server.woken_up(), "Not woken up below streamHighWater");
+}
+
+// a send MsQuic did not take is not in flight (no SEND_COMPLETE is delivered for it)
+void test4()
+{
+    TestServer server("failed_send",
+                      { .connectionHighWater = 3 * payloadSize,
+                        .connectionLowWater = payloadSize,
+                        .streamHighWater = 0 });
+
+    utils::ASSERT_LOG_THROW(server.run(), "Nothing sent");
+    std::uint64_t inFlightBytes = server.connectionState_->inFlightBytes_.load();
+
+    sendStatus = QUIC_STATUS_ABORTED;
+    FulfillSomeReturn fulfillReturn = server.subscriptionState_->fulfill_some();
+    using ConnectionExpired = SubscriptionStateErr::ConnectionExpired;
+    utils::ASSERT_LOG_THROW(std::holds_alternative<ConnectionExpired>(fulfillReturn),
+                            "Failed send not reported");
+    utils::ASSERT_LOG_THROW(server.connectionState_->inFlightBytes_.load() == inFlightBytes &&
+                            server.stream().stream_context().inFlightBytes_.load() == inFlightBytes,
+                            "Failed send accounted",
+                            server.connectionState_->inFlightBytes_.load());
+}
+
+int main()
+{
+    test1();
+    test2();
+    test3();
+    test4();
+    return 0;
+}
@@ -0,0 +1,413 @@
+/////////////////////////////////////////////////////////
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+/////////////////////////////////////////////////////////
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+/////////////////////////////////////////////////////////
+#include <callbacks.hpp>
+#include <contexts.hpp>
+#include <moqt.hpp>
+#include <subscription_builder.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+#include "../test_utilities.hpp"
+/////////////////////////////////////////////////////////
+
+/*
+    SUBSCRIBE_UPDATE applied to running subscriptions
+
+    Every update also lowers the subscriber priority value, the server waits till the track's open
+    streams have been re-prioritized (the update has been applied by then) before it publishes
+    the next objects:
+        narrow: an absolute start subscription is cut down to a closed range,
+                nothing past the new end arrives (neither later objects nor later groups)
+        extend: an absolute range subscription is extended to a later end, then to the whole
+                end group (EndObject 0), later groups stay outside of it, then made open ended
+                (EndGroup 0), the groups added before and after the update arrive as well
+*/
+
+using namespace rvn;
+
+constexpr std::uint64_t numObjects = 8;
+
+constexpr TrackAlias narrowTrackAlias(0);
+constexpr TrackAlias extendTrackAlias(1);
+
+struct InterprocessSynchronizationData
+{
+    boost::interprocess::interprocess_mutex mutex;
+    bool serverSetup;
+    // client: update sent (odd), server: update applied and next objects published (even)
+    std::uint64_t step;
+    bool clientDone;
+};
+
+namespace bip = boost::interprocess;
+
+void set_step(InterprocessSynchronizationData* data, std::uint64_t step)
+{
+    std::unique_lock lock(data->mutex);
+    data->step = step;
+}
+
+void wait_step(InterprocessSynchronizationData* data, std::uint64_t step)
+{
+    for (;;)
+    {
+        std::unique_lock lock(data->mutex);
+        if (data->step >= step)
+            break;
+    }
+}
+
+std::string object_payload(const std::string& trackName, std::uint64_t groupIdx, std::uint64_t objectIdx)
+{
+    return trackName + " group " + std::to_string(groupIdx) + " object " + std::to_string(objectIdx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// server
+
+void publish(SubgroupHandle& subgroupHandle,
+             const std::string& trackName,
+             std::uint64_t groupIdx,
+             std::uint64_t beginObjectIdx,
+             std::uint64_t endObjectIdx)
+{
+    for (std::uint64_t objectIdx = beginObjectIdx; objectIdx < endObjectIdx; ++objectIdx)
+        subgroupHandle.add_object(object_payload(trackName, groupIdx, objectIdx));
+}
+
+SubgroupHandle add_group(const std::weak_ptr<TrackHandle>& trackHandle, std::uint64_t groupIdx)
+{
+    auto groupHandle =
+    trackHandle.lock()->add_group(GroupId(groupIdx), PublisherPriority(0), {});
+    return groupHandle.lock()->add_subgroup(numObjects);
+}
+
+// 0 if the group has no open stream
+std::uint16_t stream_priority(MOQTServer& moqtServer, TrackAlias trackAlias, GroupId groupId)
+{
+    std::shared_ptr<ConnectionState> connectionState;
+    {
+        std::shared_lock l(moqtServer.connectionStateMapMtx);
+        connectionState = moqtServer.connectionStateMap.begin()->second;
+    }
+
+    return connectionState->dataStreams.read(
+    [&](const DataStreams& dataStreams) -> std::uint16_t
+    {
+        const DataStreamState* dataStream =
+        dataStreams.find({ trackAlias.get(), groupId.get(), 0 });
+        if (dataStream == nullptr)
+            return 0;
+
+        std::uint16_t priority = 0;
+        std::uint32_t size = sizeof(priority);
+        moqtServer.get_tbl()->GetParam(dataStream->stream.get(), QUIC_PARAM_STREAM_PRIORITY,
+                                       &size, &priority);
+        return priority;
+    });
+}
+
+// waits till the stream of the group has been re-prioritized for subscriberPriority (or the client gave up)
+void wait_subscriber_priority(MOQTServer& moqtServer,
+                              InterprocessSynchronizationData* data,
+                              TrackAlias trackAlias,
+                              GroupId groupId,
+                              std::uint8_t subscriberPriority)
+{
+    // subscriber priority in the high byte, publisher priority (0) in the low one, lower is more important
+    std::uint16_t expectedPriority = ((0xFF - subscriberPriority) << 8) | 0xFF;
+    while (stream_priority(moqtServer, trackAlias, groupId) != expectedPriority)
+    {
+        {
+            std::unique_lock lock(data->mutex);
+            if (data->clientDone)
+                return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void run_server(InterprocessSynchronizationData* data)
+{
+    std::unique_ptr<MOQTServer> moqtServer = server_setup();
+
+    // narrow: groups 0, 1, 2 with the first half of their objects
+    auto narrowTrackHandle = moqtServer->dataManager_->add_track_identifier({}, "narrow");
+    std::vector<SubgroupHandle> narrowSubgroupHandles;
+    for (std::uint64_t groupIdx = 0; groupIdx < 3; ++groupIdx)
+    {
+        narrowSubgroupHandles.push_back(add_group(narrowTrackHandle, groupIdx));
+        publish(narrowSubgroupHandles.back(), "narrow", groupIdx, 0, numObjects / 2);
+    }
+
+    // extend: group 0 complete, objects 0 and 1 of group 1
+    auto extendTrackHandle = moqtServer->dataManager_->add_track_identifier({}, "extend");
+    SubgroupHandle extendGroup0 = add_group(extendTrackHandle, 0);
+    publish(extendGroup0, "extend", 0, 0, numObjects);
+    SubgroupHandle extendGroup1 = add_group(extendTrackHandle, 1);
+    publish(extendGroup1, "extend", 1, 0, 2);
+
+    {
+        std::unique_lock lock(data->mutex);
+        data->serverSetup = true;
+    }
+
+    // narrowed to [(0, 0), (1, 6))
+    wait_step(data, 1);
+    wait_subscriber_priority(*moqtServer, data, narrowTrackAlias, GroupId(1), 10);
+    for (std::uint64_t groupIdx = 0; groupIdx < 3; ++groupIdx)
+        publish(narrowSubgroupHandles[groupIdx], "narrow", groupIdx, numObjects / 2, numObjects);
+    SubgroupHandle narrowGroup3 = add_group(narrowTrackHandle, 3);
+    publish(narrowGroup3, "narrow", 3, 0, numObjects);
+    set_step(data, 2);
+
+    // extended from [(0, 0), (1, 4)) to [(0, 0), (1, 6)), object 5 is held back so the subscription stays alive
+    wait_step(data, 3);
+    wait_subscriber_priority(*moqtServer, data, extendTrackAlias, GroupId(1), 100);
+    publish(extendGroup1, "extend", 1, 2, 5);
+    set_step(data, 4);
+
+    // the whole of group 1, the last object is held back, group 2 is outside the range
+    wait_step(data, 5);
+    wait_subscriber_priority(*moqtServer, data, extendTrackAlias, GroupId(1), 50);
+    publish(extendGroup1, "extend", 1, 5, numObjects - 1);
+    SubgroupHandle extendGroup2 = add_group(extendTrackHandle, 2);
+    publish(extendGroup2, "extend", 2, 0, numObjects);
+    set_step(data, 6);
+
+    // open ended
+    wait_step(data, 7);
+    wait_subscriber_priority(*moqtServer, data, extendTrackAlias, GroupId(1), 10);
+    publish(extendGroup1, "extend", 1, numObjects - 1, numObjects);
+    SubgroupHandle extendGroup3 = add_group(extendTrackHandle, 3);
+    publish(extendGroup3, "extend", 3, 0, numObjects);
+    set_step(data, 8);
+
+    for (;;)
+    {
+        std::unique_lock lock(data->mutex);
+        if (data->clientDone)
+            break;
+    }
+
+    std::cout << "Server done" << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// client
+
+using DataStreamUserHandle = MOQTClient::DataStreamUserHandle;
+
+// data streams of numStreams groups by group id, they can arrive in any order
+std::map<std::uint64_t, DataStreamUserHandle> receive_streams(MOQTClient& moqtClient, std::uint64_t numStreams)
+{
+    std::map<std::uint64_t, DataStreamUserHandle> dataStreamUserHandles;
+    for (std::uint64_t i = 0; i < numStreams; ++i)
+    {
+        auto dataStreamUserHandle = moqtClient.dataStreamUserHandles_.wait_dequeue_ret();
+        dataStreamUserHandles.emplace(dataStreamUserHandle.streamHeaderSubgroupMessage_->groupId_.get(),
+                                      dataStreamUserHandle);
+    }
+    return dataStreamUserHandles;
+}
+
+void receive_objects(DataStreamUserHandle& dataStreamUserHandle,
+                     const std::string& trackName,
+                     std::uint64_t beginObjectIdx,
+                     std::uint64_t endObjectIdx)
+{
+    std::uint64_t groupIdx = dataStreamUserHandle.streamHeaderSubgroupMessage_->groupId_.get();
+    for (std::uint64_t objectIdx = beginObjectIdx; objectIdx < endObjectIdx; ++objectIdx)
+    {
+        auto streamHeaderSubgroupObject = dataStreamUserHandle.objectQueue_->wait_dequeue_ret();
+        utils::ASSERT_LOG_THROW(streamHeaderSubgroupObject.payload_ ==
+                                object_payload(trackName, groupIdx, objectIdx),
+                                "Payload mismatch", "Received: ", streamHeaderSubgroupObject.payload_,
+                                "Expected: ", object_payload(trackName, groupIdx, objectIdx));
+    }
+}
+
+SubscribeUpdateMessage
+update_message(std::uint64_t subscribeId,
+               std::optional<SubscribeUpdateMessage::GroupObjectPair> end,
+               std::uint8_t subscriberPriority)
+{
+    SubscribeUpdateMessage subscribeUpdateMessage;
+    subscribeUpdateMessage.subscribeId_ = subscribeId;
+    subscribeUpdateMessage.start_ = { GroupId(0), ObjectId(0) };
+    subscribeUpdateMessage.end_ = end;
+    subscribeUpdateMessage.subscriberPriority_ = subscriberPriority;
+    return subscribeUpdateMessage;
+}
+
+void test_narrow(MOQTClient& moqtClient, InterprocessSynchronizationData* data)
+{
+    SubscriptionBuilder subscriptionBuilder;
+    subscriptionBuilder.set_track_alias(narrowTrackAlias);
+    subscriptionBuilder.set_track_namespace({});
+    subscriptionBuilder.set_track_name("narrow");
+    subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteStart,
+                                       { GroupId(0), ObjectId(0) });
+    subscriptionBuilder.set_subscriber_priority(200);
+    subscriptionBuilder.set_group_order(0);
+
+    SubscribeMessage subscribeMessage = subscriptionBuilder.build();
+    subscribeMessage.subscribeId_ = 0;
+    moqtClient.subscribe(std::move(subscribeMessage));
+
+    auto dataStreamUserHandles = receive_streams(moqtClient, 3);
+    for (auto& [groupIdx, dataStreamUserHandle] : dataStreamUserHandles)
+        receive_objects(dataStreamUserHandle, "narrow", 0, numObjects / 2);
+
+    // the end object is not sent
+    moqtClient.subscribe_update(
+    update_message(0, SubscribeUpdateMessage::GroupObjectPair{ GroupId(1), ObjectId(6) }, 10));
+    set_step(data, 1);
+
+    receive_objects(dataStreamUserHandles.at(0), "narrow", numObjects / 2, numObjects);
+    receive_objects(dataStreamUserHandles.at(1), "narrow", numObjects / 2, 6);
+
+    // group 1 past the end, group 2 and the new group 3 are outside the range
+    wait_step(data, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    StreamHeaderSubgroupObject streamHeaderSubgroupObject;
+    for (auto& [groupIdx, dataStreamUserHandle] : dataStreamUserHandles)
+        utils::ASSERT_LOG_THROW(!dataStreamUserHandle.objectQueue_->try_dequeue(streamHeaderSubgroupObject),
+                                "Object outside the narrowed range", "Received: ",
+                                streamHeaderSubgroupObject.payload_);
+
+    DataStreamUserHandle dataStreamUserHandle;
+    utils::ASSERT_LOG_THROW(!moqtClient.dataStreamUserHandles_.try_dequeue(dataStreamUserHandle),
+                            "Stream outside the narrowed range");
+}
+
+void test_extend(MOQTClient& moqtClient, InterprocessSynchronizationData* data)
+{
+    SubscriptionBuilder subscriptionBuilder;
+    subscriptionBuilder.set_track_alias(extendTrackAlias);
+    subscriptionBuilder.set_track_namespace({});
+    subscriptionBuilder.set_track_name("extend");
+    subscriptionBuilder.set_data_range(SubscriptionBuilder::Filter::absoluteRange,
+                                       { GroupId(0), ObjectId(0) }, { GroupId(1), ObjectId(4) });
+    subscriptionBuilder.set_subscriber_priority(200);
+    subscriptionBuilder.set_group_order(0);
+
+    SubscribeMessage subscribeMessage = subscriptionBuilder.build();
+    subscribeMessage.subscribeId_ = 1;
+    moqtClient.subscribe(std::move(subscribeMessage));
+
+    auto dataStreamUserHandles = receive_streams(moqtClient, 2);
+    receive_objects(dataStreamUserHandles.at(0), "extend", 0, numObjects);
+    receive_objects(dataStreamUserHandles.at(1), "extend", 0, 2);
+
+    moqtClient.subscribe_update(
+    update_message(1, SubscribeUpdateMessage::GroupObjectPair{ GroupId(1), ObjectId(6) }, 100));
+    set_step(data, 3);
+    receive_objects(dataStreamUserHandles.at(1), "extend", 2, 5);
+
+    // EndObject 0 on the wire
+    wait_step(data, 4);
+    SubscribeUpdateMessage::GroupObjectPair wholeGroup1{ GroupId(1), SubscribeUpdateMessage::endOfGroup };
+    moqtClient.subscribe_update(update_message(1, wholeGroup1, 50));
+    set_step(data, 5);
+    receive_objects(dataStreamUserHandles.at(1), "extend", 5, numObjects - 1);
+
+    wait_step(data, 6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    DataStreamUserHandle dataStreamUserHandle;
+    utils::ASSERT_LOG_THROW(!moqtClient.dataStreamUserHandles_.try_dequeue(dataStreamUserHandle),
+                            "Group after the whole end group");
+
+    // EndGroup 0 on the wire
+    moqtClient.subscribe_update(update_message(1, std::nullopt, 10));
+    set_step(data, 7);
+    receive_objects(dataStreamUserHandles.at(1), "extend", numObjects - 1, numObjects);
+
+    // group 2 added before the update, group 3 after it
+    auto newDataStreamUserHandles = receive_streams(moqtClient, 2);
+    utils::ASSERT_LOG_THROW(newDataStreamUserHandles.contains(2), "Group 2 missing");
+    utils::ASSERT_LOG_THROW(newDataStreamUserHandles.contains(3), "Group 3 missing");
+    receive_objects(newDataStreamUserHandles.at(2), "extend", 0, numObjects);
+    receive_objects(newDataStreamUserHandles.at(3), "extend", 0, numObjects);
+}
+
+void run_client(InterprocessSynchronizationData* data)
+{
+    for (;;)
+    {
+        std::unique_lock lock(data->mutex);
+        if (data->serverSetup)
+            break;
+    }
+
+    std::unique_ptr<MOQTClient> moqtClient = client_setup();
+
+    int exitCode = 0;
+    try
+    {
+        test_narrow(*moqtClient, data);
+        test_extend(*moqtClient, data);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        exitCode = 1;
+    }
+
+    {
+        std::unique_lock lock(data->mutex);
+        data->step = 8;
+        data->clientDone = true;
+    }
+    std::cout << "Client done" << std::endl;
+    exit(exitCode);
+}
+
+int main()
+{
+    std::string sharedMemoryName = "subscribe_update_test_";
+    sharedMemoryName += std::to_string(getpid());
+
+    bip::shared_memory_object shmParent(bip::create_only,
+                                        sharedMemoryName.c_str(), bip::read_write);
+    shmParent.truncate(sizeof(InterprocessSynchronizationData));
+    bip::mapped_region regionParent(shmParent, bip::read_write);
+    InterprocessSynchronizationData* dataParent =
+    new (regionParent.get_address()) InterprocessSynchronizationData();
+
+    dataParent->serverSetup = false;
+    dataParent->step = 0;
+    dataParent->clientDone = false;
+
+    if (fork())
+    {
+        // parent process, server
+        run_server(dataParent);
+
+        int status;
+        wait(&status);
+        bip::shared_memory_object::remove(sharedMemoryName.c_str());
+        exit(WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+    }
+    else
+    // child process
+    {
+        bip::shared_memory_object shmChild(bip::open_only, sharedMemoryName.c_str(),
+                                           bip::read_write);
+        bip::mapped_region regionChild(shmChild, bip::read_write);
+        InterprocessSynchronizationData* dataChild =
+        static_cast<InterprocessSynchronizationData*>(regionChild.get_address());
+
+        run_client(dataChild);
+    }
+}
@@ -0,0 +1,289 @@
+/////////////////////////////////////////////////////////
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+/////////////////////////////////////////////////////////
+#include <data_manager.hpp>
+#include <segment_log.hpp>
+#include <utilities.hpp>
+/////////////////////////////////////////////////////////
+
+/*
+    Warm restart (DataManagerOptions::recoverFromStorage_): objects are published, the
+    DataManager is destroyed and a new one is constructed on the same DATA_DIRECTORY
+
+    The manifest replay has to bring back tracks, groups (publisher priority, delivery timeout)
+    and subgroup ranges, the segment log scan the objects, records failing the magic or the crc
+    and torn records at the tail are dropped, and every subgroup is capped at its first object
+    which was not recovered (the caps survive the next restart)
+*/
+
+using namespace rvn;
+
+const TrackIdentifier trackIdentifier({ "warm_restart" }, "track");
+
+std::string object_payload(std::uint64_t groupIdx, std::uint64_t objectIdx)
+{
+    // different lengths, a corrupted length field does not happen to line up
+    return "group " + std::to_string(groupIdx) + " object " + std::to_string(objectIdx) +
+           std::string(objectIdx * 7, 'x');
+}
+
+std::string segment_path(std::uint64_t groupIdx)
+{
+    return std::string(DATA_DIRECTORY) + "warm_restart/track/" + std::to_string(groupIdx) + ".log";
+}
+
+// file offsets of the records of a segment file, in file order
+std::vector<std::uint64_t> record_offsets(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t offset = 0;
+    while (offset + sizeof(SegmentLog::RecordHeader) <= contents.size())
+    {
+        SegmentLog::RecordHeader header;
+        std::memcpy(&header, contents.data() + offset, sizeof(header));
+        utils::ASSERT_LOG_THROW(header.is_valid() && header.objectId_ == offsets.size(),
+                                "Unexpected record in segment file", path, offset);
+        offsets.push_back(offset);
+        offset += sizeof(header) + header.payloadLength_;
+    }
+    return offsets;
+}
+
+void overwrite(const std::string& path, std::uint64_t offset, std::string_view bytes)
+{
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write(bytes.data(), bytes.size());
+}
+
+void check_object(DataManager& dataManager,
+                  std::uint64_t groupIdx,
+                  std::uint64_t objectIdx,
+                  std::optional<std::chrono::milliseconds> deliveryTimeout = {})
+{
+    ObjectOrStatus objectOrStatus = dataManager.get_object(
+    ObjectIdentifier(trackIdentifier, GroupId(groupIdx), ObjectId(objectIdx)));
+    utils::ASSERT_LOG_THROW(std::holds_alternative<ObjectType>(objectOrStatus),
+                            "Object not recovered", groupIdx, objectIdx);
+
+    // the payload is the tail of the serialized object
+    const auto& [objectBuffer, objectDeliveryTimeout] = std::get<ObjectType>(objectOrStatus);
+    std::string payload = object_payload(groupIdx, objectIdx);
+    const QUIC_BUFFER* quicBuffer = objectBuffer->quic_buffer();
+    utils::ASSERT_LOG_THROW(quicBuffer->Length >= payload.size() &&
+                            std::memcmp(quicBuffer->Buffer + quicBuffer->Length - payload.size(),
+                                        payload.data(), payload.size()) == 0,
+                            "Payload mismatch", groupIdx, objectIdx);
+    utils::ASSERT_LOG_THROW(objectDeliveryTimeout == deliveryTimeout,
+                            "Delivery timeout not recovered", groupIdx);
+}
+
+void check_missing(DataManager& dataManager, std::uint64_t groupIdx, std::uint64_t objectIdx)
+{
+    ObjectOrStatus objectOrStatus = dataManager.get_object(
+    ObjectIdentifier(trackIdentifier, GroupId(groupIdx), ObjectId(objectIdx)));
+    utils::ASSERT_LOG_THROW(std::holds_alternative<DoesNotExist>(objectOrStatus),
+                            "Object which was not recovered still registered", groupIdx, objectIdx);
+}
+
+DataManagerOptions recovery_options()
+{
+    DataManagerOptions options;
+    options.recoverFromStorage_ = true;
+    return options;
+}
+
+/*
+    group 0: subgroups [0, 4) and [4, 8), delivery timeout, intact
+    group 1: subgroup [0, 8), last record torn (file truncated in its payload)
+    group 2: subgroups [0, 4) and [4, 8), crc of object 5 broken
+    group 3: subgroup [0, 6), magic of object 2 zeroed (a hole)
+    group 4: open ended subgroup with 3 objects, never capped by its publisher
+*/
+void publish()
+{
+    DataManager dataManager;
+    utils::ASSERT_LOG_THROW(!dataManager.get_recovery_stats().has_value(),
+                            "Recovery stats without recovery");
+
+    auto trackHandle = dataManager.add_track_identifier({ "warm_restart" }, "track");
+
+    auto add_group = [&](std::uint64_t groupIdx, std::vector<std::uint64_t> subgroupSizes,
+                         std::optional<std::chrono::milliseconds> deliveryTimeout = {})
+    {
+        auto groupHandle = trackHandle.lock()->add_group(GroupId(groupIdx),
+                                                         PublisherPriority(groupIdx), deliveryTimeout);
+        std::uint64_t objectIdx = 0;
+        for (std::uint64_t subgroupSize : subgroupSizes)
+        {
+            auto subgroupHandle = groupHandle.lock()->add_subgroup(subgroupSize);
+            for (std::uint64_t i = 0; i < subgroupSize; ++i, ++objectIdx)
+                subgroupHandle.add_object(object_payload(groupIdx, objectIdx));
+        }
+    };
+
+    add_group(0, { 4, 4 }, std::chrono::milliseconds(1500));
+    add_group(1, { 8 });
+    add_group(2, { 4, 4 });
+    add_group(3, { 6 });
+
+    auto groupHandle = trackHandle.lock()->add_group(GroupId(4), PublisherPriority(4), {});
+    auto subgroupHandle = groupHandle.lock()->add_open_ended_subgroup();
+    for (std::uint64_t objectIdx = 0; objectIdx < 3; ++objectIdx)
+        subgroupHandle.add_object(object_payload(4, objectIdx));
+
+    // the destructor drains the persister as well, flushed to be sure the files are complete
+    dataManager.flush_storage();
+}
+
+void corrupt()
+{
+    // torn last record
+    std::uint64_t fileSize = std::filesystem::file_size(segment_path(1));
+    std::filesystem::resize_file(segment_path(1), fileSize - 3);
+
+    // objectId of object 5 changed, the crc no longer matches
+    std::vector<std::uint64_t> offsets = record_offsets(segment_path(2));
+    utils::ASSERT_LOG_THROW(offsets.size() == 8, "Objects of group 2 not persisted");
+    std::uint64_t objectIdOffset = offsetof(SegmentLog::RecordHeader, objectId_);
+    overwrite(segment_path(2), offsets[5] + objectIdOffset, std::string_view("\x05\x01", 2));
+
+    // zeros, as space reserved by a batch which was never written reads
+    offsets = record_offsets(segment_path(3));
+    utils::ASSERT_LOG_THROW(offsets.size() == 6, "Objects of group 3 not persisted");
+    overwrite(segment_path(3), offsets[2], std::string(4, '\0'));
+
+    // crash while the manifest was written: a torn record at its tail
+    std::ofstream manifest(std::string(DATA_DIRECTORY) + ".raven_manifest",
+                           std::ios::binary | std::ios::app);
+    manifest.write("\x03\x20\x00", 3);
+}
+
+void check_recovered(DataManager& dataManager)
+{
+    // hierarchy
+    utils::ASSERT_LOG_THROW(dataManager.get_first_group(trackIdentifier) == GroupId(0),
+                            "First group not recovered");
+    for (std::uint64_t groupIdx = 0; groupIdx < 5; ++groupIdx)
+    {
+        GroupIdentifier groupIdentifier(trackIdentifier, GroupId(groupIdx));
+        utils::ASSERT_LOG_THROW(dataManager.get_publisher_priority(groupIdentifier) ==
+                                PublisherPriority(groupIdx),
+                                "Publisher priority not recovered", groupIdx);
+        utils::ASSERT_LOG_THROW(dataManager.get_first_object(groupIdentifier) == ObjectId(0),
+                                "First object not recovered", groupIdx);
+    }
+
+    // subgroups end at their first object which was not recovered
+    std::uint64_t expectedEnds[] = { 8, 7, 5, 2, 3 };
+    for (std::uint64_t groupIdx = 0; groupIdx < 5; ++groupIdx)
+    {
+        GroupIdentifier groupIdentifier(trackIdentifier, GroupId(groupIdx));
+        // registered objects end (exclusive) at the end of the last subgroup
+        utils::ASSERT_LOG_THROW(dataManager.get_latest_registered_object(groupIdentifier) ==
+                                ObjectId(expectedEnds[groupIdx]),
+                                "Subgroup not capped at its first missing object", groupIdx);
+        utils::ASSERT_LOG_THROW(dataManager.get_latest_concrete_object(groupIdentifier) ==
+                                ObjectId(expectedEnds[groupIdx] - 1),
+                                "Recovered objects not ready", groupIdx);
+
+        for (std::uint64_t objectIdx = 0; objectIdx < expectedEnds[groupIdx]; ++objectIdx)
+            check_object(dataManager, groupIdx, objectIdx,
+                         groupIdx == 0 ? std::optional(std::chrono::milliseconds(1500)) :
+                                         std::nullopt);
+        check_missing(dataManager, groupIdx, expectedEnds[groupIdx]);
+    }
+
+    // subgroups after the first missing object are empty ([5, 8) of group 2 is gone entirely)
+    check_missing(dataManager, 2, 6);
+    check_missing(dataManager, 2, 7);
+    check_missing(dataManager, 3, 5);
+}
+
+void test1()
+{
+    publish();
+    corrupt();
+
+    {
+        DataManager dataManager(recovery_options());
+
+        // the hierarchy and the object index are rebuilt by the time the constructor returns
+        const auto& recoveryStats = dataManager.get_recovery_stats();
+        utils::ASSERT_LOG_THROW(recoveryStats.has_value(), "No recovery stats");
+        utils::ASSERT_LOG_THROW(recoveryStats->numTracks_ == 1 && recoveryStats->numGroups_ == 5,
+                                "Hierarchy not recovered", recoveryStats->numTracks_,
+                                recoveryStats->numGroups_);
+        utils::ASSERT_LOG_THROW(recoveryStats->numObjects_ == 8 + 7 + 5 + 2 + 3,
+                                "Objects not recovered", recoveryStats->numObjects_);
+        auto manifestReplayTime = recoveryStats->manifestReplayTime_;
+        auto indexRebuildTime = recoveryStats->indexRebuildTime_;
+        auto timeToServing = recoveryStats->timeToServing_;
+        utils::ASSERT_LOG_THROW(timeToServing >= manifestReplayTime &&
+                                timeToServing >= indexRebuildTime &&
+                                timeToServing <= manifestReplayTime + indexRebuildTime +
+                                                 std::chrono::microseconds(1),
+                                "Time to serving is not replay plus rebuild");
+
+        check_recovered(dataManager);
+
+        // publishing goes on after a restart, in a new group and a new track
+        auto trackHandle = dataManager.get_track_handle(trackIdentifier);
+        auto groupHandle = trackHandle.lock()->add_group(GroupId(5), PublisherPriority(5), {});
+        auto subgroupHandle = groupHandle.lock()->add_subgroup(2);
+        subgroupHandle.add_object(object_payload(5, 0));
+        subgroupHandle.add_object(object_payload(5, 1));
+
+        auto otherTrackHandle = dataManager.add_track_identifier({ "warm_restart" }, "other");
+        otherTrackHandle.lock()->add_group(GroupId(0), PublisherPriority(0), {});
+
+        dataManager.flush_storage();
+    }
+
+    // second restart: the caps were logged, nothing is capped any further
+    DataManager dataManager(recovery_options());
+    const auto& recoveryStats = dataManager.get_recovery_stats();
+    utils::ASSERT_LOG_THROW(recoveryStats->numTracks_ == 2 && recoveryStats->numGroups_ == 7,
+                            "Hierarchy not recovered after the second restart",
+                            recoveryStats->numTracks_, recoveryStats->numGroups_);
+    utils::ASSERT_LOG_THROW(recoveryStats->numObjects_ == 8 + 7 + 5 + 2 + 3 + 2,
+                            "Objects not recovered after the second restart",
+                            recoveryStats->numObjects_);
+
+    check_recovered(dataManager);
+    check_object(dataManager, 5, 0);
+    check_object(dataManager, 5, 1);
+
+    // the tracks kept distinct track keys, the group of the new track did not land in the old one
+    TrackIdentifier otherTrackIdentifier({ "warm_restart" }, "other");
+    utils::ASSERT_LOG_THROW(dataManager.get_first_group(otherTrackIdentifier) == GroupId(0),
+                            "Track added after the restart not recovered");
+}
+
+// without recoverFromStorage_ the data directory is wiped
+void test2()
+{
+    publish();
+
+    DataManager dataManager;
+    utils::ASSERT_LOG_THROW(!dataManager.get_first_group(trackIdentifier).has_value(),
+                            "Hierarchy recovered without recoverFromStorage_");
+    utils::ASSERT_LOG_THROW(!std::filesystem::exists(segment_path(0)),
+                            "Segment file kept without recoverFromStorage_");
+}
+
+int main()
+{
+    test1();
+    test2();
+    return 0;
+}
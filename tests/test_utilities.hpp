@@ -26,10 +26,13 @@ static const char* KeyFile = RAVEN_KEY_FILE_PATH;
 
 
 static inline std::unique_ptr<rvn::MOQTClient>
-client_setup(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> executionConfig = { nullptr, 0 })
+client_setup(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> executionConfig = { nullptr, 0 },
+             rvn::ReceiveMode receiveMode = rvn::ReceiveMode::COPY)
 {
     std::unique_ptr<rvn::MOQTClient> moqtClient =
     std::make_unique<rvn::MOQTClient>(executionConfig);
+    // before connecting, the mode of a stream must not change while it receives
+    moqtClient->set_receiveMode(receiveMode);
 
     QUIC_REGISTRATION_CONFIG RegConfig = { "test1", QUIC_EXECUTION_PROFILE_TYPE_REAL_TIME };
     moqtClient->set_regConfig(&RegConfig);
@@ -71,11 +74,12 @@ client_setup(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> executionConfig =
 
 
 static inline std::unique_ptr<rvn::MOQTServer>
-server_setup(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> executionConfig = { nullptr, 0 })
+server_setup(std::tuple<QUIC_EXECUTION_CONFIG*, std::uint64_t> executionConfig = { nullptr, 0 },
+             std::size_t numSubscriptionThreads = 1)
 {
     auto dm = std::make_shared<rvn::DataManager>();
     std::unique_ptr<rvn::MOQTServer> moqtServer =
-    std::make_unique<rvn::MOQTServer>(dm, executionConfig);
+    std::make_unique<rvn::MOQTServer>(dm, executionConfig, numSubscriptionThreads);
 
     QUIC_REGISTRATION_CONFIG RegConfig = { "test1", QUIC_EXECUTION_PROFILE_TYPE_REAL_TIME };
     moqtServer->set_regConfig(&RegConfig);